@@ -0,0 +1,97 @@
+#include "AckPolicy.h"
+
+AckPolicy::AckPolicy() :
+    mMode(ACK_PER_PACKET), mCount(1), mIntervalNs(0), mSeed(getpid() ^ time(NULL))
+{
+}
+
+bool AckPolicy::parse(const string& spec)
+{
+  if ("packet" == spec)
+  {
+    mMode = ACK_PER_PACKET;
+    return true;
+  }
+
+  size_t colon = spec.find(':');
+  if (string::npos == colon)
+  {
+    return false;
+  }
+
+  const string name = spec.substr(0, colon);
+  unsigned value;
+  char extra;
+  if (1 != sscanf(spec.c_str() + colon + 1, "%u%c", &value, &extra) || 0 == value)
+  {
+    return false;
+  }
+
+  if ("count" == name)
+  {
+    mMode = ACK_COUNT;
+    mCount = value;
+  }
+  else if ("time" == name || "jitter" == name)
+  {
+    mMode = ("time" == name)? ACK_INTERVAL : ACK_JITTER;
+    mIntervalNs = value * 1000000ULL;
+  }
+  else
+  {
+    return false;
+  }
+
+  return true;
+}
+
+string AckPolicy::toString() const
+{
+  std::stringstream stm;
+  switch (mMode)
+  {
+  case ACK_COUNT:
+    stm << "summary every " << mCount << " datagrams";
+    break;
+  case ACK_INTERVAL:
+    stm << "summary every " << mIntervalNs / 1000000 << " ms";
+    break;
+  case ACK_JITTER:
+    stm << "summary every " << mIntervalNs / 1000000 << " ms +-50%";
+    break;
+  default:
+    stm << "per packet";
+    break;
+  }
+  return stm.str();
+}
+
+bool AckPolicy::onDatagram(AckTimer& timer, uint64_t nowNs)
+{
+  if (0 == timer.pending++)
+  {
+    uint64_t delayNs = ACK_FLUSH_NS;
+    if (ACK_INTERVAL == mMode)
+    {
+      delayNs = mIntervalNs;
+    }
+    else if (ACK_JITTER == mMode)
+    {
+      delayNs = mIntervalNs / 2 + (uint64_t) ((double) rand_r(&mSeed) / RAND_MAX * mIntervalNs);
+    }
+    timer.dueNs = nowNs + delayNs;
+  }
+
+  return (ACK_COUNT == mMode && timer.pending >= mCount) || isDue(timer, nowNs);
+}
+
+bool AckPolicy::isDue(const AckTimer& timer, uint64_t nowNs) const
+{
+  return timer.pending && nowNs >= timer.dueNs;
+}
+
+void AckPolicy::onSent(AckTimer& timer) const
+{
+  timer.pending = 0;
+  timer.dueNs = 0;
+}
@@ -0,0 +1,73 @@
+#ifndef MCASTIT_ACKPOLICY_H_
+#define MCASTIT_ACKPOLICY_H_
+
+#include "Common.h"
+
+#define ACK_FLUSH_NS      (500000000ULL) // summary of a stream that stopped short of N datagrams
+#define ACK_CHECK_NS      (1000000ULL)   // how often listeners look at the summary timers
+
+/**
+ * Summary state of one acknowledged stream, see AckPolicy
+ */
+struct AckTimer
+{
+  uint64_t pending;   // datagrams since the last summary
+  uint64_t dueNs;     // realtime when the summary is due, 0 if nothing is pending
+
+  AckTimer(): pending(0), dueNs(0) {}
+};
+
+/**
+ * When listeners acknowledge sequenced datagrams
+ *
+ * Per packet, every datagram is echoed back in its own ACK. The other policies
+ * send one summary ACK per stream with its received & lost counts and highest
+ * sequence instead: every N datagrams, every T ms, or after T ms +-50% drawn at
+ * random for each summary so that receivers that joined together don't answer
+ * together
+ */
+class AckPolicy
+{
+public:
+  typedef enum _Mode
+  {
+    ACK_PER_PACKET=0,
+    ACK_COUNT,      // every N datagrams, pending ones are flushed after ACK_FLUSH_NS
+    ACK_INTERVAL,   // T ms after the first datagram not acknowledged yet
+    ACK_JITTER      // T ms +-50% after it
+  } Mode;
+
+  AckPolicy();
+
+  /**
+   * @param spec - "packet", "count:{n}", "time:{ms}" or "jitter:{ms}"
+   * @return false if spec is invalid, the policy is unchanged
+   */
+  bool parse(const string& spec);
+  string toString() const;
+  bool isPerPacket() const { return ACK_PER_PACKET == mMode; }
+
+  /**
+   * Count one datagram of a stream, arms its timer on the first one
+   * @return true if the summary is due
+   */
+  bool onDatagram(AckTimer& timer, uint64_t nowNs);
+
+  /**
+   * @return true if the timer of a stream with pending datagrams expired
+   */
+  bool isDue(const AckTimer& timer, uint64_t nowNs) const;
+
+  /**
+   * Summary sent, nothing is pending anymore
+   */
+  void onSent(AckTimer& timer) const;
+
+private:
+  Mode     mMode;
+  unsigned mCount;
+  uint64_t mIntervalNs;
+  unsigned mSeed;
+};
+
+#endif /* MCASTIT_ACKPOLICY_H_ */
@@ -1,5 +1,11 @@
 #include "Common.h"
 
+#include <dirent.h>
+#include <fstream>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
 #define DEFAULT_IP_ADDRESS  "0.0.0.0"
 #define DEFAULT_IFACE       "default"
 
@@ -14,8 +20,35 @@ static IfaceName2IpMap g_if6_name2ip_map;
 // Debug info
 static bool g_debugMode = false;
 
+// Cpu & scheduling of each thread role
+struct ThreadSettings
+{
+  vector<int> cpus;
+  int policy;
+  int priority;
+
+  ThreadSettings(): policy(SCHED_OTHER), priority(0) {}
+};
+static ThreadSettings g_threadSettings[Common::THREAD_ROLES];
+static const char* g_threadRoleNames[Common::THREAD_ROLES] = {"main", "rx", "tx"};
+
+// Cpus the process may run on, before any thread was pinned
+static pthread_once_t g_allowedCpusOnce = PTHREAD_ONCE_INIT;
+static cpu_set_t g_allowedCpus;
+
+// From linux/mempolicy.h
+#define NUMA_MPOL_PREFERRED   (1)
+#define NUMA_MPOL_MF_MOVE     (1 << 1)
+
 // Misc values
 static const string ACK_SIGNATURE = "-MCAST-ACK"; // append to make the ack message
+static const string NACK_SIGNATURE = "MCAST-NACK "; // prepend to make the nack message
+static const string ACK_SUMMARY_SIGNATURE = "MCAST-ACKSUM "; // prepend to make the summary ack message
+static const char FEC_SIGNATURE[] = "MCAST-FEC ";      // FEC_HEADER_LEN starts with it
+static const char* const SUBSCRIBE_SIGNATURES[] =       // by SubscribeType
+{
+  "MCAST-SUBSCRIBE ", "MCAST-UNSUBSCRIBE ", "MCAST-SUBSCRIBED "
+};
 
 /**
  * Init g_ifap
@@ -233,6 +266,280 @@ bool Common::decodeAckMessage(const string& message, string& resultMsg)
   return true;
 }
 
+bool Common::decodeAckSender(const string& decodedMsg, string& message, uint32_t& pid)
+{
+  size_t sep = decodedMsg.rfind(" - ");
+  unsigned long value;
+  char extra;
+  if (string::npos == sep || 1 != sscanf(decodedMsg.c_str() + sep + 3, "%lu%c", &value, &extra))
+  {
+    return false;
+  }
+
+  message = decodedMsg.substr(0, sep);
+  pid = value;
+  return true;
+}
+
+/**
+ * Right align value in width chars, space padded
+ */
+static void writeFixedDigits(char* buf, unsigned width, uint64_t value)
+{
+  char* digit = buf + width;
+  do
+  {
+    *--digit = '0' + value % 10;
+    value /= 10;
+  } while (value && digit > buf);
+
+  while (digit > buf)
+  {
+    *--digit = ' ';
+  }
+}
+
+/**
+ * Parse a space padded number, i is moved past it
+ * @return true if at least a digit was found
+ */
+static bool readDigits(const char* message, unsigned len, unsigned& i, uint64_t& value)
+{
+  while (i < len && ' ' == message[i])
+  {
+    ++i;
+  }
+
+  unsigned firstDigit = i;
+  value = 0;
+  while (i < len && message[i] >= '0' && message[i] <= '9')
+  {
+    value = value * 10 + (message[i] - '0');
+    ++i;
+  }
+
+  return i != firstDigit;
+}
+
+void Common::encodeMessageHeader(char* buf, uint32_t seq, uint64_t sendTimeNs)
+{
+  writeFixedDigits(buf, MCAST_SEQ_WIDTH, seq);
+  buf[MCAST_SEQ_WIDTH] = ' ';
+  writeFixedDigits(buf + MCAST_SEQ_WIDTH + 1, MCAST_TS_WIDTH, sendTimeNs);
+  buf[MCAST_HEADER_LEN - 1] = ' ';
+}
+
+bool Common::decodeMessageHeader(const char* message, unsigned len, uint32_t& seq,
+    uint64_t& sendTimeNs)
+{
+  unsigned i = 0;
+  uint64_t value;
+  if (!readDigits(message, len, i, value))
+  {
+    return false;
+  }
+  seq = value;
+  sendTimeNs = 0;
+
+  // optional timestamp
+  if (i + 1 < len && ' ' == message[i] && '<' != message[i + 1])
+  {
+    if (!readDigits(message, len, i, sendTimeNs))
+    {
+      return false;
+    }
+  }
+
+  // then " <"
+  return i + 1 < len && ' ' == message[i] && '<' == message[i + 1];
+}
+
+bool Common::encodeNackMessage(const string& group, const vector<SeqRange>& ranges,
+    string& resultMsg)
+{
+  std::stringstream stm;
+  stm << NACK_SIGNATURE << group << " ";
+  for (unsigned i = 0; i < ranges.size(); ++i)
+  {
+    stm << (i? "," : "") << ranges[i].first << "-" << ranges[i].last;
+  }
+
+  resultMsg = stm.str();
+  return ranges.size() > 0;
+}
+
+bool Common::decodeNackMessage(const string& message, string& group, vector<SeqRange>& ranges)
+{
+  ranges.clear();
+  if (0 != message.compare(0, NACK_SIGNATURE.size(), NACK_SIGNATURE))
+  {
+    return false;
+  }
+
+  std::stringstream stm(message.substr(NACK_SIGNATURE.size()));
+  string rangeList;
+  if (!(stm >> group >> rangeList))
+  {
+    return false;
+  }
+
+  std::stringstream rangeStm(rangeList);
+  string token;
+  while (std::getline(rangeStm, token, ','))
+  {
+    unsigned long first, last;
+    if (2 != sscanf(token.c_str(), "%lu-%lu", &first, &last) || last < first)
+    {
+      return false;
+    }
+    ranges.push_back(SeqRange(first, last));
+  }
+
+  return ranges.size() > 0;
+}
+
+bool Common::encodeAckSummary(const AckSummary& summary, string& resultMsg)
+{
+  std::stringstream stm;
+  stm << ACK_SUMMARY_SIGNATURE << summary.group << " " << summary.received << " "
+      << summary.lost << " " << summary.highest << " " << summary.echoNs << " " << summary.holdNs;
+  return encodeAckMessage(stm.str(), resultMsg);
+}
+
+bool Common::decodeAckSummary(const string& message, AckSummary& summary)
+{
+  if (0 != message.compare(0, ACK_SUMMARY_SIGNATURE.size(), ACK_SUMMARY_SIGNATURE))
+  {
+    return false;
+  }
+
+  std::stringstream stm(message.substr(ACK_SUMMARY_SIGNATURE.size()));
+  if (!(stm >> summary.group >> summary.received >> summary.lost >> summary.highest))
+  {
+    return false;
+  }
+
+  if (!(stm >> summary.echoNs >> summary.holdNs))
+  {
+    summary.echoNs = summary.holdNs = 0;
+  }
+  return true;
+}
+
+bool Common::encodeSubscribeMessage(SubscribeType type, const string& group, string& resultMsg)
+{
+  resultMsg = SUBSCRIBE_SIGNATURES[type] + group;
+  return !group.empty();
+}
+
+bool Common::decodeSubscribeMessage(const string& message, SubscribeType& type, string& group)
+{
+  for (int i = SUBSCRIBE; i <= SUBSCRIBED; ++i)
+  {
+    size_t signatureLen = strlen(SUBSCRIBE_SIGNATURES[i]);
+    if (0 == message.compare(0, signatureLen, SUBSCRIBE_SIGNATURES[i]))
+    {
+      std::stringstream stm(message.substr(signatureLen));
+      type = (SubscribeType) i;
+      if (!(stm >> group))
+      {
+        return false;
+      }
+      return true;
+    }
+  }
+  return false;
+}
+
+bool Common::parseDestination(const string& spec, int defaultPort, bool isIpV6,
+    struct sockaddr_storage& dest)
+{
+  string group = spec;
+  int port = defaultPort;
+
+  // a port follows the ipv4 group after ':', or the ipv6 group in brackets
+  size_t portPos = string::npos;
+  if (isIpV6 && 0 == spec.find('['))
+  {
+    size_t close = spec.find(']');
+    if (string::npos == close)
+    {
+      return false;
+    }
+    group = spec.substr(1, close - 1);
+    portPos = (close + 1 < spec.size() && ':' == spec[close + 1])? close + 2 : string::npos;
+  }
+  else if (!isIpV6 && string::npos != spec.find(':'))
+  {
+    group = spec.substr(0, spec.find(':'));
+    portPos = spec.find(':') + 1;
+  }
+
+  if (string::npos != portPos)
+  {
+    port = atoi(spec.c_str() + portPos);
+    if (0 >= port || 65535 < port)
+    {
+      return false;
+    }
+  }
+
+  memset(&dest, 0, sizeof(dest));
+  if (isIpV6)
+  {
+    struct sockaddr_in6* addr6 = (struct sockaddr_in6*) &dest;
+    addr6->sin6_family = AF_INET6;
+    addr6->sin6_port = htons(port);
+    return 1 == inet_pton(AF_INET6, group.c_str(), &addr6->sin6_addr);
+  }
+
+  struct sockaddr_in* addr = (struct sockaddr_in*) &dest;
+  addr->sin_family = AF_INET;
+  addr->sin_port = htons(port);
+  return 1 == inet_pton(AF_INET, group.c_str(), &addr->sin_addr);
+}
+
+void Common::encodeFecHeader(char* buf, const FecHeader& header)
+{
+  memcpy(buf, FEC_SIGNATURE, sizeof(FEC_SIGNATURE) - 1);
+  char* field = buf + sizeof(FEC_SIGNATURE) - 1;
+  writeFixedDigits(field, MCAST_SEQ_WIDTH, header.firstSeq);
+  field += MCAST_SEQ_WIDTH;
+  *field++ = ' ';
+
+  const unsigned counts[] = {header.nData, header.nParity, header.index};
+  for (unsigned i = 0; i < sizeof(counts) / sizeof(counts[0]); ++i)
+  {
+    writeFixedDigits(field, FEC_COUNT_WIDTH, counts[i]);
+    field += FEC_COUNT_WIDTH;
+    *field++ = ' ';
+  }
+}
+
+bool Common::decodeFecHeader(const char* message, unsigned len, FecHeader& header)
+{
+  if (len < FEC_HEADER_LEN || 0 != memcmp(message, FEC_SIGNATURE, sizeof(FEC_SIGNATURE) - 1))
+  {
+    return false;
+  }
+
+  unsigned i = sizeof(FEC_SIGNATURE) - 1;
+  uint64_t values[4];
+  for (unsigned v = 0; v < sizeof(values) / sizeof(values[0]); ++v)
+  {
+    if (!readDigits(message, FEC_HEADER_LEN, i, values[v]))
+    {
+      return false;
+    }
+  }
+
+  header.firstSeq = values[0];
+  header.nData = values[1];
+  header.nParity = values[2];
+  header.index = values[3];
+  return 0 < header.nData && header.index < header.nParity;
+}
+
 bool Common::unicastMessage(int sock, struct sockaddr_storage& target, const string& msg)
 {
   int sendBytes = -1;
@@ -300,3 +607,368 @@ const vector<string>& Common::getAllIfaceNames(bool useIpV6)
 
   return useIpV6? allIfacesV6 : allIfacesV4;
 }
+
+bool Common::parseCpuList(const string& cpuList, vector<int>& cpus)
+{
+  cpus.clear();
+  std::stringstream stm(cpuList);
+  string token;
+  while (std::getline(stm, token, ','))
+  {
+    int first = -1, last = -1;
+    char dash;
+    std::stringstream tokenStm(token);
+    if (!(tokenStm >> first) || first < 0)
+    {
+      return false;
+    }
+
+    last = first;
+    if (tokenStm >> dash && (dash != '-' || !(tokenStm >> last) || last < first))
+    {
+      return false;
+    }
+
+    for (int cpu = first; cpu <= last; ++cpu)
+    {
+      cpus.push_back(cpu);
+    }
+  }
+
+  return cpus.size() > 0;
+}
+
+int Common::pinThreadToCpu(int cpu)
+{
+  cpu_set_t cpuSet;
+  CPU_ZERO(&cpuSet);
+  CPU_SET(cpu, &cpuSet);
+  return pthread_setaffinity_np(pthread_self(), sizeof(cpuSet), &cpuSet);
+}
+
+void Common::setThreadCpus(ThreadRole role, const vector<int>& cpus)
+{
+  g_threadSettings[role].cpus = cpus;
+}
+
+void Common::setThreadScheduling(ThreadRole role, int policy, int priority)
+{
+  g_threadSettings[role].policy = policy;
+  g_threadSettings[role].priority = priority;
+}
+
+static void getAllowedCpus()
+{
+  if (0 != sched_getaffinity(0, sizeof(g_allowedCpus), &g_allowedCpus))
+  {
+    CPU_ZERO(&g_allowedCpus);
+  }
+}
+
+bool Common::applyThreadSettings(ThreadRole role, unsigned index, int numaNode)
+{
+  const ThreadSettings& settings = g_threadSettings[role];
+  bool retVal = true;
+
+  // the first call comes before any pinning, threads inherit the cpus of the thread spawning them
+  (void) pthread_once(&g_allowedCpusOnce, getAllowedCpus);
+
+  if (settings.cpus.size())
+  {
+    int cpu = settings.cpus[index % settings.cpus.size()];
+    int res = pinThreadToCpu(cpu);
+    if (0 != res)
+    {
+      LOG_ERROR("Cannot pin thread to cpu " << cpu << ": " << strerror(res));
+      retVal = false;
+    }
+
+    int cpuNode = getCpuNumaNode(cpu);
+    if (0 <= numaNode && 0 <= cpuNode && cpuNode != numaNode)
+    {
+      LOG_WARN(g_threadRoleNames[role] << " thread on cpu " << cpu << " of NUMA node " << cpuNode
+          << " works on data of node " << numaNode << ", remote memory accesses");
+    }
+  }
+  else if (0 <= numaNode)
+  {
+    int res = pinThreadToNumaNode(numaNode);
+    if (0 != res)
+    {
+      LOG_ERROR("Cannot pin thread to NUMA node " << numaNode << ": " << strerror(res));
+      retVal = false;
+    }
+  }
+  else if (CPU_COUNT(&g_allowedCpus))
+  {
+    // don't keep the cpu of the spawning thread, e.g. --cpu-main for the rx & tx threads
+    int res = pthread_setaffinity_np(pthread_self(), sizeof(g_allowedCpus), &g_allowedCpus);
+    if (0 != res)
+    {
+      LOG_ERROR("Cannot unpin thread: " << strerror(res));
+      retVal = false;
+    }
+  }
+
+  // nor its real time policy
+  int priority = (SCHED_OTHER == settings.policy)? 0 : settings.priority;
+  int policy;
+  struct sched_param current;
+  if (0 == pthread_getschedparam(pthread_self(), &policy, &current) &&
+      (policy != settings.policy || current.sched_priority != priority))
+  {
+    struct sched_param param;
+    memset(&param, 0, sizeof(param));
+    param.sched_priority = priority;
+    int res = pthread_setschedparam(pthread_self(), settings.policy, &param);
+    if (0 != res)
+    {
+      LOG_ERROR("Cannot set scheduling policy " << settings.policy << " priority "
+          << priority << ": " << strerror(res));
+      retVal = false;
+    }
+  }
+
+  return retVal;
+}
+
+/**
+ * Read the first integer of a sysfs file
+ * @return false if the file can't be read
+ */
+static bool readSysfsInt(const string& path, int& value)
+{
+  FILE* file = fopen(path.c_str(), "r");
+  if (!file)
+  {
+    return false;
+  }
+
+  bool retVal = (1 == fscanf(file, "%d", &value));
+  fclose(file);
+  return retVal;
+}
+
+int Common::getIfaceNumaNode(const string& ifaceName)
+{
+  // virtual devices have no device link, single node systems report -1
+  int node = -1;
+  if (ifaceName.empty() || !readSysfsInt("/sys/class/net/" + ifaceName + "/device/numa_node", node))
+  {
+    return -1;
+  }
+
+  return node;
+}
+
+unsigned Common::getIfaceMtu(const string& ifaceName)
+{
+  int mtu = 0;
+  if (ifaceName.empty() || !readSysfsInt("/sys/class/net/" + ifaceName + "/mtu", mtu) || 0 > mtu)
+  {
+    return 0;
+  }
+
+  return mtu;
+}
+
+int Common::getCpuNumaNode(int cpu)
+{
+  std::stringstream path;
+  path << "/sys/devices/system/cpu/cpu" << cpu;
+  DIR* dir = opendir(path.str().c_str());
+  if (!dir)
+  {
+    return -1;
+  }
+
+  // the cpu directory has a nodeN link to its node
+  int node = -1;
+  for (struct dirent* entry = readdir(dir); entry; entry = readdir(dir))
+  {
+    if (0 == strncmp(entry->d_name, "node", 4) && 1 == sscanf(entry->d_name + 4, "%d", &node))
+    {
+      break;
+    }
+  }
+
+  closedir(dir);
+  return node;
+}
+
+int Common::pinThreadToNumaNode(int node)
+{
+  std::stringstream path;
+  path << "/sys/devices/system/node/node" << node << "/cpulist";
+  std::ifstream file(path.str().c_str());
+  string cpuList;
+  vector<int> cpus;
+  if (!std::getline(file, cpuList) || !parseCpuList(cpuList, cpus))
+  {
+    return ENOENT;
+  }
+
+  cpu_set_t cpuSet;
+  CPU_ZERO(&cpuSet);
+  for (unsigned i = 0; i < cpus.size(); ++i)
+  {
+    CPU_SET(cpus[i], &cpuSet);
+  }
+  return pthread_setaffinity_np(pthread_self(), sizeof(cpuSet), &cpuSet);
+}
+
+bool Common::bindMemoryToNumaNode(void* addr, size_t len, int node)
+{
+  if (0 > node || node >= (int)(sizeof(unsigned long) * 8))
+  {
+    return false;
+  }
+
+  // raw syscall, no libnuma dependency
+  unsigned long nodeMask = 1UL << node;
+  if (0 != syscall(SYS_mbind, addr, len, NUMA_MPOL_PREFERRED, &nodeMask, sizeof(nodeMask) * 8,
+      NUMA_MPOL_MF_MOVE))
+  {
+    LOG_ERROR("mbind to NUMA node " << node << ": " << strerror(errno));
+    return false;
+  }
+
+  return true;
+}
+
+void* Common::createSharedMemory(const string& name, size_t len)
+{
+  int fd = shm_open(("/" + name).c_str(), O_CREAT | O_RDWR | O_TRUNC, 0644);
+  if (0 > fd)
+  {
+    LOG_ERROR("shm_open " << name << ": " << strerror(errno));
+    return NULL;
+  }
+
+  void* addr = MAP_FAILED;
+  if (0 == ftruncate(fd, len))
+  {
+    addr = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  }
+  close(fd);
+  if (MAP_FAILED == addr)
+  {
+    LOG_ERROR("Mapping shared memory " << name << ": " << strerror(errno));
+    return NULL;
+  }
+
+  // pages are touched now rather than on the first writes
+  memset(addr, 0, len);
+  return addr;
+}
+
+const void* Common::openSharedMemory(const string& name, size_t& len)
+{
+  int fd = shm_open(("/" + name).c_str(), O_RDONLY, 0);
+  if (0 > fd)
+  {
+    LOG_ERROR("shm_open " << name << ": " << strerror(errno));
+    return NULL;
+  }
+
+  struct stat st;
+  void* addr = MAP_FAILED;
+  if (0 == fstat(fd, &st) && 0 < st.st_size)
+  {
+    len = st.st_size;
+    addr = mmap(NULL, len, PROT_READ, MAP_SHARED, fd, 0);
+  }
+  close(fd);
+  if (MAP_FAILED == addr)
+  {
+    LOG_ERROR("Mapping shared memory " << name << ": " << strerror(errno));
+    return NULL;
+  }
+
+  return addr;
+}
+
+int Common::getThreadCpu(ThreadRole role, unsigned index)
+{
+  const vector<int>& cpus = g_threadSettings[role].cpus;
+  return cpus.size()? cpus[index % cpus.size()] : -1;
+}
+
+bool Common::parseSchedPolicy(const string& name, int& policy)
+{
+  if ("fifo" == name)
+  {
+    policy = SCHED_FIFO;
+  }
+  else if ("rr" == name)
+  {
+    policy = SCHED_RR;
+  }
+  else if ("other" == name)
+  {
+    policy = SCHED_OTHER;
+  }
+  else
+  {
+    return false;
+  }
+
+  return true;
+}
+
+string Common::threadSettingsToString()
+{
+  std::stringstream stm;
+  for (int role = 0; role < THREAD_ROLES; ++role)
+  {
+    const ThreadSettings& settings = g_threadSettings[role];
+    stm << (role? ", " : "") << g_threadRoleNames[role] << ": cpu ";
+    if (settings.cpus.empty())
+    {
+      stm << "any";
+    }
+    for (unsigned i = 0; i < settings.cpus.size(); ++i)
+    {
+      stm << (i? "," : "") << settings.cpus[i];
+    }
+
+    switch (settings.policy)
+    {
+    case SCHED_FIFO:
+      stm << " SCHED_FIFO/" << settings.priority;
+      break;
+    case SCHED_RR:
+      stm << " SCHED_RR/" << settings.priority;
+      break;
+    default:
+      stm << " SCHED_OTHER";
+      break;
+    }
+  }
+
+  return stm.str();
+}
+
+uint64_t Common::getMonotonicNs()
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t) now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+uint64_t Common::getRealtimeNs()
+{
+  struct timespec now;
+  clock_gettime(CLOCK_REALTIME, &now);
+  return (uint64_t) now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+void Common::sleepUntilNs(uint64_t monotonicNs)
+{
+  struct timespec deadline;
+  deadline.tv_sec = monotonicNs / 1000000000ULL;
+  deadline.tv_nsec = monotonicNs % 1000000000ULL;
+  while (EINTR == clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL))
+  {
+  }
+}
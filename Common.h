@@ -14,11 +14,16 @@
 #include <signal.h>
 #include <execinfo.h>
 #include <algorithm>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <stdint.h>
 
 #include <sys/select.h>
 #include <sys/ioctl.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
+#include <netinet/udp.h>
 #include <arpa/inet.h>
 #include <sys/errno.h>
 #include <sys/types.h>
@@ -37,6 +42,45 @@ using std::set;
 using std::map;
 
 #define MCAST_BUFF_LEN    (1024)  // message length
+#define MCAST_MAX_DGRAM_LEN (65507) // largest udp payload
+#define UDP_IPV4_OVERHEAD (20 + 8)  // IP & UDP headers in front of the payload
+#define UDP_IPV6_OVERHEAD (40 + 8)
+
+// Test message header "  seq  sendTimeNs ", fixed width so it can be patched in place
+#define MCAST_SEQ_WIDTH   (10)
+#define MCAST_TS_WIDTH    (20)
+#define MCAST_HEADER_LEN  (MCAST_SEQ_WIDTH + 1 + MCAST_TS_WIDTH + 1)
+
+// FEC parity datagram header "MCAST-FEC   firstSeq   k   m idx ", followed by the parity bytes
+#define FEC_COUNT_WIDTH   (3)
+#define FEC_HEADER_LEN    (10 + MCAST_SEQ_WIDTH + 1 + 3 * (FEC_COUNT_WIDTH + 1))
+
+// UDP segmentation offload, older libc headers may not have them
+#ifndef SOL_UDP
+#define SOL_UDP           (17)
+#endif
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT       (103)
+#endif
+#ifndef UDP_GRO
+#define UDP_GRO           (104)
+#endif
+#ifndef MSG_ZEROCOPY
+#define MSG_ZEROCOPY      (0x4000000)
+#endif
+#define UDP_MAX_SEGMENTS  (64)    // max datagrams the kernel segments from one send
+#define UDP_MAX_GSO_LEN   (65000) // max bytes of one segmented send
+
+// relay & gateway sockets, same for older libc headers
+#ifndef SO_RXQ_OVFL
+#define SO_RXQ_OVFL       (40)
+#endif
+#ifndef IP_MULTICAST_ALL
+#define IP_MULTICAST_ALL  (49)
+#endif
+#ifndef IPV6_MULTICAST_ALL
+#define IPV6_MULTICAST_ALL (29)
+#endif
 
 // print out error message to stderr
 #define LOG_ERROR(msg) \
@@ -45,6 +89,12 @@ using std::map;
         <<__func__ << ") [ERROR] " << msg << endl;\
     } while(0)
 
+#define LOG_WARN(msg) \
+    do {if (!Common::isDebugMode()) std::cerr << "[WARNING] " << msg << endl;\
+        else std::cerr << __FILE__ << ":" << __LINE__ << "-(" \
+        <<__func__ << ") [WARNING] " << msg << endl;\
+    } while(0)
+
 #define LOG_DEBUG(msg) \
     do {if (Common::isDebugMode()) std::cerr << __FILE__ << ":" \
         << __LINE__ << "-(" <<__func__ << ") [DEBUG] " << msg << endl;\
@@ -56,6 +106,46 @@ typedef set<string> McastAddressSet;
 /**
  * Struct that contains interface name and its associated socket
  */
+/**
+ * Inclusive range of sequence numbers
+ */
+struct SeqRange
+{
+  uint32_t first;
+  uint32_t last;
+
+  SeqRange(): first(0), last(0) {}
+  SeqRange(uint32_t f, uint32_t l): first(f), last(l) {}
+};
+
+/**
+ * Which parity datagram of which block of data datagrams
+ */
+struct FecHeader
+{
+  uint32_t firstSeq;  // sequence of the first data datagram of the block
+  unsigned nData;     // data datagrams in the block, fewer than the block size for the last one
+  unsigned nParity;   // parity datagrams per block
+  unsigned index;     // of this parity datagram, 0 to nParity - 1
+
+  FecHeader(): firstSeq(0), nData(0), nParity(0), index(0) {}
+};
+
+/**
+ * Receive state of one stream carried by a summary ACK
+ */
+struct AckSummary
+{
+  string   group;     // destination group of the stream
+  uint64_t received;  // distinct sequences so far
+  uint64_t lost;      // sequences still missing
+  uint32_t highest;
+  uint64_t echoNs;    // send time of the newest datagram, 0 if unknown
+  uint64_t holdNs;    // from its arrival to the summary, for the sender's RTT
+
+  AckSummary(): received(0), lost(0), highest(0), echoNs(0), holdNs(0) {}
+};
+
 struct IfaceData
 {
   int sockFd;
@@ -77,6 +167,17 @@ private:
 namespace Common
 {
 
+/**
+ * Threads that can be pinned & scheduled from the command line
+ */
+typedef enum _ThreadRole
+{
+  THREAD_MAIN=0,  // startup & waiting for the other threads
+  THREAD_RX,      // listener loop, server loop & ACK listener
+  THREAD_TX,      // send loop, one thread per interface with --tx-threads
+  THREAD_ROLES
+} ThreadRole;
+
 /**
  * Get ip addresses for ifaceName
  *
@@ -129,6 +230,84 @@ bool isDebugMode();
 bool encodeAckMessage(const string& message, string& resultMsg);
 bool decodeAckMessage(const string& message, string& resultMsg);
 
+/**
+ * Split a decoded ack in the acknowledged message & the pid of the listener that sent it
+ * @param decodedMsg  [IN]  see decodeAckMessage
+ * @return false if decodedMsg doesn't end with a pid
+ */
+bool decodeAckSender(const string& decodedMsg, string& message, uint32_t& pid);
+
+/**
+ * Encode/decode negative ack, "MCAST-NACK {group} {first}-{last},{first}-{last}..."
+ * @param group   - destination group of the missing datagrams
+ * @param ranges  - missing sequences
+ * @return true on success
+ */
+bool encodeNackMessage(const string& group, const vector<SeqRange>& ranges, string& resultMsg);
+bool decodeNackMessage(const string& message, string& group, vector<SeqRange>& ranges);
+
+/**
+ * Encode/decode summary ack, "MCAST-ACKSUM {group} {received} {lost} {highest} {echoNs} {holdNs}",
+ * it's sent as the message of an ack so it ends with the ack signature,
+ * summaries without the last two fields are accepted
+ * @param message - decode: message of a decoded ack, see decodeAckMessage
+ * @return true on success
+ */
+bool encodeAckSummary(const AckSummary& summary, string& resultMsg);
+bool decodeAckSummary(const string& message, AckSummary& summary);
+
+/**
+ * Gateway subscription messages, see encodeSubscribeMessage
+ */
+typedef enum _SubscribeType
+{
+  SUBSCRIBE=0,    // "MCAST-SUBSCRIBE {group}", sent by subscribers & repeated to stay subscribed
+  UNSUBSCRIBE,    // "MCAST-UNSUBSCRIBE {group}"
+  SUBSCRIBED      // "MCAST-SUBSCRIBED {group}", answer of the gateway
+} SubscribeType;
+
+/**
+ * Encode/decode a gateway subscription message
+ * @return true on success
+ */
+bool encodeSubscribeMessage(SubscribeType type, const string& group, string& resultMsg);
+bool decodeSubscribeMessage(const string& message, SubscribeType& type, string& group);
+
+/**
+ * Parse a destination "{group}", "{group}:{port}" or "[{ipv6 group}]:{port}"
+ * @param defaultPort - port of a destination without one
+ * @return false if spec is invalid
+ */
+bool parseDestination(const string& spec, int defaultPort, bool isIpV6, struct sockaddr_storage& dest);
+
+/**
+ * Write/read the FEC_HEADER_LEN bytes header of a parity datagram in place
+ * @param buf     - at least FEC_HEADER_LEN bytes
+ * @param len     - datagram length
+ * @return decode: false if message isn't a parity datagram
+ */
+void encodeFecHeader(char* buf, const FecHeader& header);
+bool decodeFecHeader(const char* message, unsigned len, FecHeader& header);
+
+/**
+ * Write the header of a test message "  seq  sendTimeNs " in place, without allocation
+ * @param buf         [OUT] at least MCAST_HEADER_LEN bytes
+ * @param seq         [IN]  sequence number
+ * @param sendTimeNs  [IN]  realtime send timestamp
+ */
+void encodeMessageHeader(char* buf, uint32_t seq, uint64_t sendTimeNs);
+
+/**
+ * Get sequence number & send time of a test message "  12  1760000000000000000 <Sender info: ...>"
+ * older "  12 <Sender info: ...>" messages are accepted without timestamp
+ * @param message     [IN]  message, doesn't have to be null terminated
+ * @param len         [IN]  message length
+ * @param seq         [OUT] sequence number
+ * @param sendTimeNs  [OUT] realtime send timestamp, 0 if message has none
+ * @return true if message has a sequence number
+ */
+bool decodeMessageHeader(const char* message, unsigned len, uint32_t& seq, uint64_t& sendTimeNs);
+
 /**
  * Send unicast message to target
  * @param sock
@@ -138,5 +317,112 @@ bool decodeAckMessage(const string& message, string& resultMsg);
  */
 bool unicastMessage(int sock, struct sockaddr_storage& target, const string& msg);
 
+/**
+ * Parse cpu list such as "0,2,4-7"
+ * @param cpuList  [IN]  comma separated cpu ids or ranges
+ * @param cpus     [OUT] cpu ids in the order they appear
+ * @return true on success
+ */
+bool parseCpuList(const string& cpuList, vector<int>& cpus);
+
+/**
+ * Pin calling thread to a single cpu
+ * @param cpu
+ * @return 0 on success, error number otherwise
+ */
+int pinThreadToCpu(int cpu);
+
+/**
+ * Cpus & scheduling for the threads of a role, applied by applyThreadSettings
+ * @param role
+ * @param cpus      - cpu of each thread of the role, reused from the start if shorter
+ * @param policy    - SCHED_FIFO, SCHED_RR or SCHED_OTHER
+ * @param priority  - real time priority, ignored for SCHED_OTHER
+ */
+void setThreadCpus(ThreadRole role, const vector<int>& cpus);
+void setThreadScheduling(ThreadRole role, int policy, int priority);
+
+/**
+ * Pin & schedule the calling thread as configured for its role, a role without
+ * cpu nor node runs on any allowed cpu & without real time policy, whatever
+ * the thread it was spawned from has
+ * @param role
+ * @param index     - index of the thread among the threads of its role
+ * @param numaNode  - node of the data the thread works on, -1 if unknown
+ *                    threads without cpu are pinned to the node's cpus,
+ *                    a cpu on another node is reported as a warning
+ * @return true on success or if nothing is configured
+ */
+bool applyThreadSettings(ThreadRole role, unsigned index = 0, int numaNode = -1);
+
+/**
+ * @return cpu configured for thread index of role, -1 if not pinned
+ */
+int getThreadCpu(ThreadRole role, unsigned index = 0);
+
+/**
+ * Parse scheduling policy name: fifo, rr or other
+ * @return true on success
+ */
+bool parseSchedPolicy(const string& name, int& policy);
+
+/**
+ * Describe cpus & scheduling of every role for the startup banner,
+ * e.g. "main: cpu any SCHED_OTHER, rx: cpu 3 SCHED_FIFO/50, tx: cpu 1,2 SCHED_OTHER"
+ */
+string threadSettingsToString();
+
+/**
+ * NUMA node a network interface is attached to
+ * @param ifaceName
+ * @return node from /sys/class/net/<iface>/device/numa_node, -1 if unknown or virtual
+ */
+int getIfaceNumaNode(const string& ifaceName);
+
+/**
+ * MTU of a network interface
+ * @param ifaceName
+ * @return bytes from /sys/class/net/<iface>/mtu, 0 if unknown
+ */
+unsigned getIfaceMtu(const string& ifaceName);
+
+/**
+ * @return NUMA node of cpu, -1 if unknown
+ */
+int getCpuNumaNode(int cpu);
+
+/**
+ * Pin the calling thread to all cpus of a NUMA node
+ * @return 0 on success, error number otherwise
+ */
+int pinThreadToNumaNode(int node);
+
+/**
+ * Prefer node for the pages of [addr, addr + len), addr has to be page aligned
+ * Pages already touched are moved when possible
+ * @return true on success
+ */
+bool bindMemoryToNumaNode(void* addr, size_t len, int node);
+
+/**
+ * Create or replace the POSIX shared memory /dev/shm/{name}, mapped for writing & zeroed
+ * @return mapping of len bytes, NULL on error
+ */
+void* createSharedMemory(const string& name, size_t len);
+
+/**
+ * Map an existing POSIX shared memory read only
+ * @param len - set to its size
+ * @return NULL on error
+ */
+const void* openSharedMemory(const string& name, size_t& len);
+
+/**
+ * Monotonic clock helpers in nanoseconds
+ */
+uint64_t getMonotonicNs();
+uint64_t getRealtimeNs();
+void sleepUntilNs(uint64_t monotonicNs);
+
 }
 #endif /*COMMON_H_*/
@@ -0,0 +1,336 @@
+#include "FecCodec.h"
+#include "GaloisField.h"
+
+/**
+ * Coefficient of data datagram col in parity datagram row
+ * XOR for a single parity datagram, Cauchy matrix 1 / (x_row + y_col) otherwise,
+ * with x_row = FEC_MAX_DATA + row and y_col = col so that no sum is 0.
+ * Every square sub matrix of a Cauchy matrix can be inverted
+ */
+static uint8_t parityCoef(unsigned nParity, unsigned row, unsigned col)
+{
+  if (1 == nParity)
+  {
+    return 1;
+  }
+  return GaloisField::inv((FEC_MAX_DATA + row) ^ col);
+}
+
+FecEncoder::FecEncoder() :
+    mBlockLen(0), mNParity(0), mSegLen(0)
+{
+}
+
+bool FecEncoder::init(unsigned blockLen, unsigned nParity, unsigned segLen, int numaNode)
+{
+  if (0 == blockLen || FEC_MAX_DATA < blockLen || 0 == nParity || FEC_MAX_PARITY < nParity)
+  {
+    LOG_ERROR("FEC blocks are 1 to " << FEC_MAX_DATA << " datagrams with 1 to "
+        << FEC_MAX_PARITY << " parity datagrams");
+    return false;
+  }
+
+  if (segLen + FEC_HEADER_LEN > MCAST_MAX_DGRAM_LEN)
+  {
+    LOG_ERROR("No room for the FEC header in datagrams of " << segLen << " bytes");
+    return false;
+  }
+
+  GaloisField::init();
+  if (!mParity.init(FEC_HEADER_LEN + segLen, nParity, numaNode))
+  {
+    return false;
+  }
+
+  mBlockLen = blockLen;
+  mNParity = nParity;
+  mSegLen = segLen;
+  mHeader = FecHeader();
+  mHeader.nParity = nParity;
+  return true;
+}
+
+bool FecEncoder::add(uint32_t seq, const char* data)
+{
+  unsigned idx = (seq - 1) % mBlockLen;
+  uint32_t firstSeq = seq - idx;
+
+  // parity of the previous block is kept until the first datagram of the next one
+  if (0 == mHeader.nData || firstSeq != mHeader.firstSeq)
+  {
+    for (unsigned row = 0; row < mNParity; ++row)
+    {
+      memset(mParity.getSlot(row) + FEC_HEADER_LEN, 0, mSegLen);
+    }
+    mHeader.firstSeq = firstSeq;
+  }
+
+  for (unsigned row = 0; row < mNParity; ++row)
+  {
+    GaloisField::mulAdd((uint8_t*) mParity.getSlot(row) + FEC_HEADER_LEN, (const uint8_t*) data,
+        parityCoef(mNParity, row, idx), mSegLen);
+  }
+  mHeader.nData = idx + 1;
+
+  return (mHeader.nData == mBlockLen) && flush();
+}
+
+bool FecEncoder::flush()
+{
+  if (0 == mHeader.nData)
+  {
+    return false;
+  }
+
+  for (unsigned row = 0; row < mNParity; ++row)
+  {
+    mHeader.index = row;
+    Common::encodeFecHeader(mParity.getSlot(row), mHeader);
+  }
+
+  mHeader.nData = 0;
+  return true;
+}
+
+const char* FecEncoder::getParity(unsigned idx, unsigned& len)
+{
+  len = FEC_HEADER_LEN + mSegLen;
+  return mParity.getSlot(idx);
+}
+
+FecDecoder::FecDecoder() :
+    mBlockLen(0), mNParity(0), mSegLen(0), mStartSeq(0),
+    mRecoveredCount(0), mUnrecoverable(0), mDecodeNs(0)
+{
+}
+
+bool FecDecoder::init(const FecHeader& header, unsigned segLen)
+{
+  unsigned blockLen = header.nData;
+  unsigned nParity = header.nParity;
+  if (0 == blockLen || FEC_MAX_DATA < blockLen || 0 == nParity || FEC_MAX_PARITY < nParity ||
+      0 == segLen)
+  {
+    return false;
+  }
+
+  GaloisField::init();
+  if (!mSlots.init(segLen, FEC_WINDOW_BLOCKS * (blockLen + nParity)))
+  {
+    return false;
+  }
+
+  mBlockLen = blockLen;
+  mNParity = nParity;
+  mSegLen = segLen;
+  mStartSeq = header.firstSeq + blockLen;
+
+  Block empty;
+  empty.firstSeq = 0;
+  empty.nData = blockLen;
+  empty.highest = 0;
+  empty.nDataRx = 0;
+  empty.nParityRx = 0;
+  empty.done = false;
+  empty.hasData.assign(blockLen, false);
+  empty.hasParity.assign(nParity, false);
+  mBlocks.assign(FEC_WINDOW_BLOCKS, empty);
+  mRecovered.reserve(nParity);
+  return true;
+}
+
+bool FecDecoder::accepts(const FecHeader& header, unsigned len) const
+{
+  return header.nData <= mBlockLen && header.nParity == mNParity && len == mSegLen;
+}
+
+FecDecoder::Block* FecDecoder::getBlock(uint32_t firstSeq)
+{
+  Block& block = mBlocks[((firstSeq - 1) / mBlockLen) % FEC_WINDOW_BLOCKS];
+  if (block.firstSeq == firstSeq)
+  {
+    return &block;
+  }
+
+  // slot taken by a newer block, this one is out of the window
+  if (0 != block.firstSeq && (int32_t)(firstSeq - block.firstSeq) < 0)
+  {
+    return NULL;
+  }
+
+  mUnrecoverable += countMissing(block);
+  block.firstSeq = firstSeq;
+  block.nData = mBlockLen;
+  block.highest = 0;
+  block.nDataRx = 0;
+  block.nParityRx = 0;
+  block.done = false;
+  std::fill(block.hasData.begin(), block.hasData.end(), false);
+  std::fill(block.hasParity.begin(), block.hasParity.end(), false);
+  return &block;
+}
+
+uint8_t* FecDecoder::getDataSlot(const Block& block, unsigned idx) const
+{
+  unsigned blockIdx = &block - &mBlocks[0];
+  return (uint8_t*) mSlots.getSlot(blockIdx * (mBlockLen + mNParity) + idx);
+}
+
+uint8_t* FecDecoder::getParitySlot(const Block& block, unsigned idx) const
+{
+  return getDataSlot(block, mBlockLen + idx);
+}
+
+unsigned FecDecoder::countMissing(const Block& block) const
+{
+  if (0 == block.firstSeq || block.done)
+  {
+    return 0;
+  }
+
+  // without parity the size of a last, shorter block isn't known
+  unsigned nData = block.nParityRx? block.nData : block.highest;
+  return (nData > block.nDataRx)? nData - block.nDataRx : 0;
+}
+
+uint64_t FecDecoder::getUnrecoverable() const
+{
+  uint64_t missing = mUnrecoverable;
+  for (unsigned i = 0; i < mBlocks.size(); ++i)
+  {
+    missing += countMissing(mBlocks[i]);
+  }
+  return missing;
+}
+
+unsigned FecDecoder::addData(uint32_t seq, const char* data, unsigned len)
+{
+  mRecovered.clear();
+  if (len != mSegLen || 0 == seq || (int32_t)(seq - mStartSeq) < 0)
+  {
+    return 0;
+  }
+
+  unsigned idx = (seq - 1) % mBlockLen;
+  Block* block = getBlock(seq - idx);
+  if (!block || block->done || idx >= block->nData || block->hasData[idx])
+  {
+    return 0;
+  }
+
+  memcpy(getDataSlot(*block, idx), data, len);
+  block->hasData[idx] = true;
+  ++block->nDataRx;
+  block->highest = std::max(block->highest, idx + 1);
+  return decode(*block);
+}
+
+unsigned FecDecoder::addParity(const FecHeader& header, const char* payload, unsigned len)
+{
+  mRecovered.clear();
+  if (len != mSegLen || header.nParity != mNParity || header.nData > mBlockLen ||
+      0 == header.firstSeq || 0 != (header.firstSeq - 1) % mBlockLen ||
+      (int32_t)(header.firstSeq - mStartSeq) < 0)
+  {
+    return 0;
+  }
+
+  Block* block = getBlock(header.firstSeq);
+  if (!block || block->done || block->hasParity[header.index])
+  {
+    return 0;
+  }
+
+  memcpy(getParitySlot(*block, header.index), payload, len);
+  block->hasParity[header.index] = true;
+  ++block->nParityRx;
+  block->nData = header.nData;
+  return decode(*block);
+}
+
+const char* FecDecoder::getRecovered(unsigned idx) const
+{
+  return (const char*) mRecovered[idx];
+}
+
+unsigned FecDecoder::decode(Block& block)
+{
+  if (block.nDataRx >= block.nData)
+  {
+    block.done = block.nParityRx || block.nDataRx == mBlockLen;
+    return 0;
+  }
+
+  unsigned nMissing = block.nData - block.nDataRx;
+  if (0 == block.nParityRx || nMissing > block.nParityRx)
+  {
+    return 0;
+  }
+
+  uint64_t startNs = Common::getMonotonicNs();
+  unsigned missing[FEC_MAX_PARITY], rows[FEC_MAX_PARITY];
+  for (unsigned i = 0, n = 0; i < block.nData && n < nMissing; ++i)
+  {
+    if (!block.hasData[i])
+    {
+      missing[n++] = i;
+    }
+  }
+  for (unsigned j = 0, n = 0; j < mNParity && n < nMissing; ++j)
+  {
+    if (block.hasParity[j])
+    {
+      rows[n++] = j;
+    }
+  }
+
+  // remove the received data from the parity, what's left only depends on the missing data
+  for (unsigned r = 0; r < nMissing; ++r)
+  {
+    uint8_t* syndrome = getParitySlot(block, rows[r]);
+    for (unsigned i = 0; i < block.nData; ++i)
+    {
+      if (block.hasData[i])
+      {
+        GaloisField::mulAdd(syndrome, getDataSlot(block, i), parityCoef(mNParity, rows[r], i), mSegLen);
+      }
+    }
+  }
+
+  // missing data = inverse of their coefficients in the parity rows x syndromes
+  uint8_t matrix[FEC_MAX_PARITY * FEC_MAX_PARITY];
+  for (unsigned r = 0; r < nMissing; ++r)
+  {
+    for (unsigned c = 0; c < nMissing; ++c)
+    {
+      matrix[r * nMissing + c] = parityCoef(mNParity, rows[r], missing[c]);
+    }
+  }
+
+  if (!GaloisField::invertMatrix(matrix, nMissing))
+  {
+    LOG_ERROR("FEC block " << block.firstSeq << " can't be decoded");
+    block.done = true;
+    mUnrecoverable += nMissing;
+    return 0;
+  }
+
+  for (unsigned c = 0; c < nMissing; ++c)
+  {
+    uint8_t* data = getDataSlot(block, missing[c]);
+    memset(data, 0, mSegLen);
+    for (unsigned r = 0; r < nMissing; ++r)
+    {
+      GaloisField::mulAdd(data, getParitySlot(block, rows[r]), matrix[c * nMissing + r], mSegLen);
+    }
+
+    block.hasData[missing[c]] = true;
+    mRecovered.push_back(data);
+  }
+
+  block.nDataRx += nMissing;
+  block.done = true;
+  mRecoveredCount += nMissing;
+  mDecodeNs += Common::getMonotonicNs() - startNs;
+  return nMissing;
+}
@@ -0,0 +1,161 @@
+#ifndef MCASTIT_FECCODEC_H_
+#define MCASTIT_FECCODEC_H_
+
+#include "Common.h"
+#include "PacketArena.h"
+
+#define FEC_MAX_DATA      (128)   // data datagrams per block
+#define FEC_MAX_PARITY    (16)    // parity datagrams per block
+#define FEC_WINDOW_BLOCKS (8)     // blocks a receiver can have open at once
+
+/**
+ * Forward error correction over blocks of consecutive sequences
+ *
+ * Block b holds the data datagrams with sequences b * blockLen + 1 to
+ * (b + 1) * blockLen. Each of its parity datagrams carries a GF(256) linear
+ * combination of the whole data datagrams, headers included, so a recovered
+ * datagram is the original one. With one parity datagram per block it's the
+ * XOR of the block, with more a systematic Reed-Solomon code built on a
+ * Cauchy matrix: any nParity losses of the block can be recovered
+ */
+class FecEncoder
+{
+public:
+  FecEncoder();
+
+  /**
+   * @param blockLen  - data datagrams per block, up to FEC_MAX_DATA
+   * @param nParity   - parity datagrams per block, up to FEC_MAX_PARITY
+   * @param segLen    - size of every data datagram
+   * @param numaNode  - node to place the parity buffers on, -1 for the default policy
+   * @return true on success
+   */
+  bool init(unsigned blockLen, unsigned nParity, unsigned segLen, int numaNode = -1);
+
+  /**
+   * Add one data datagram to the parity of its block
+   * @param seq   - sequences have to be added in order
+   * @param data  - segLen bytes
+   * @return true if seq completed its block, the parity is ready to send
+   */
+  bool add(uint32_t seq, const char* data);
+
+  /**
+   * Close the block being filled, e.g. when done sending
+   * @return true if it has data, the parity is ready to send
+   */
+  bool flush();
+
+  /**
+   * Parity datagram idx of the last completed block, valid until the next add
+   * @param len - [OUT] datagram size
+   */
+  const char* getParity(unsigned idx, unsigned& len);
+
+  unsigned getParityCount() const { return mNParity; }
+  const char* getCodeName() const { return (1 == mNParity)? "xor" : "reed-solomon"; }
+
+private:
+  PacketArena mParity;    // one slot per parity datagram, header then segLen parity bytes
+  unsigned    mBlockLen, mNParity, mSegLen;
+  FecHeader   mHeader;    // block being filled, nData datagrams added so far
+};
+
+/**
+ * Receiver side of FecEncoder for one stream
+ *
+ * Keeps a copy of the data datagrams of the last FEC_WINDOW_BLOCKS blocks
+ * with their parity and rebuilds the missing data datagrams of a block as
+ * soon as it has as many datagrams, data or parity, as data datagrams
+ */
+class FecDecoder
+{
+public:
+  FecDecoder();
+
+  /**
+   * Set up from the first parity datagram of a stream, its data datagrams
+   * went by without being kept so decoding starts with the next block
+   * @param header  - block size & parity count, only the last block can be shorter
+   * @param segLen  - size of every data datagram
+   * @return true on success
+   */
+  bool init(const FecHeader& header, unsigned segLen);
+
+  /**
+   * @param len - parity bytes after the header
+   * @return true if the parity datagram fits the parameters of init,
+   *         false if the sender changed them
+   */
+  bool accepts(const FecHeader& header, unsigned len) const;
+
+  /**
+   * Keep a copy of data datagram seq, may recover the rest of its block
+   * @return datagrams recovered, see getRecovered
+   */
+  unsigned addData(uint32_t seq, const char* data, unsigned len);
+
+  /**
+   * Keep a parity datagram, may recover missing data datagrams of its block
+   * @param payload - parity bytes after the header
+   * @return datagrams recovered, see getRecovered
+   */
+  unsigned addParity(const FecHeader& header, const char* payload, unsigned len);
+
+  /**
+   * Datagram recovered by the last add, valid until the next one, segLen bytes
+   */
+  const char* getRecovered(unsigned idx) const;
+  unsigned getSegLen() const { return mSegLen; }
+
+  uint64_t getRecoveredCount() const { return mRecoveredCount; }
+  uint64_t getDecodeNs() const { return mDecodeNs; }
+
+  /**
+   * @return data datagrams of the retired blocks that could not be rebuilt,
+   *         plus the ones still missing from the open blocks
+   */
+  uint64_t getUnrecoverable() const;
+
+private:
+  struct Block
+  {
+    uint32_t firstSeq;   // 0 if the slot isn't used
+    unsigned nData;      // block size, blockLen until a parity datagram tells otherwise
+    unsigned highest;    // highest data index seen + 1
+    unsigned nDataRx, nParityRx;
+    bool     done;       // nothing more to recover
+    vector<bool> hasData, hasParity;
+  };
+
+  /**
+   * Slot of the block starting at firstSeq, retiring the older block it replaces
+   * @return NULL if a newer block already took the slot
+   */
+  Block* getBlock(uint32_t firstSeq);
+  uint8_t* getDataSlot(const Block& block, unsigned idx) const;
+  uint8_t* getParitySlot(const Block& block, unsigned idx) const;
+
+  /**
+   * Missing data datagrams of a block once it can't receive more
+   */
+  unsigned countMissing(const Block& block) const;
+
+  /**
+   * Rebuild the missing data datagrams of block if enough datagrams arrived
+   */
+  unsigned decode(Block& block);
+
+private:
+  PacketArena mSlots;     // (blockLen + nParity) slots per block of the window
+  unsigned    mBlockLen, mNParity, mSegLen;
+  uint32_t    mStartSeq;  // first data datagram kept
+  vector<Block> mBlocks;  // by block number % FEC_WINDOW_BLOCKS
+  vector<uint8_t*> mRecovered;
+
+  uint64_t mRecoveredCount;
+  uint64_t mUnrecoverable;  // retired blocks only
+  uint64_t mDecodeNs;
+};
+
+#endif /* MCASTIT_FECCODEC_H_ */
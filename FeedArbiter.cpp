@@ -0,0 +1,113 @@
+#include "FeedArbiter.h"
+
+#define ARB_WINDOW_MASK   (ARB_WINDOW_LEN - 1)
+
+// state of a window slot
+enum
+{
+  ARB_EMPTY=0,        // not used yet
+  ARB_MISSING,        // jumped over, no copy yet
+  ARB_ONE_SIDE,       // delivered, waiting for the other copy
+  ARB_BOTH_SIDES
+};
+
+FeedArbiter::FeedArbiter() :
+    mWindow(ARB_WINDOW_LEN), mHighest(0), mHasSeq(false), mDelivered(0), mDuplicates(0),
+    mRepeats(0), mTooOld(0), mGaps(0)
+{
+  memset(&mWindow[0], 0, ARB_WINDOW_LEN * sizeof(ArbSlot));
+  memset(mWins, 0, sizeof(mWins));
+  memset(mOnlyOn, 0, sizeof(mOnlyOn));
+}
+
+void FeedArbiter::evict(const ArbSlot& slot)
+{
+  if (ARB_MISSING == slot.state)
+  {
+    ++mGaps;
+  }
+  else if (ARB_ONE_SIDE == slot.state)
+  {
+    ++mOnlyOn[slot.side];
+  }
+}
+
+FeedArbiter::ArbResult FeedArbiter::arbitrate(unsigned side, uint32_t seq, uint64_t arrivalNs)
+{
+  // signed distance so that wrap around of the sequence still moves forward
+  int32_t ahead = mHasSeq? (int32_t) (seq - mHighest) : 1;
+  if (0 < ahead)
+  {
+    // sequences jumped over wait in the window for a late copy from either side
+    uint32_t from = mHasSeq? mHighest + 1 : seq;
+    if (ARB_WINDOW_LEN < (uint32_t) ahead)
+    {
+      for (unsigned i = 0; i < ARB_WINDOW_LEN; ++i)
+      {
+        evict(mWindow[i]);
+        mWindow[i].state = ARB_EMPTY;
+      }
+      mGaps += ahead - ARB_WINDOW_LEN;
+      from = seq - ARB_WINDOW_LEN + 1;
+    }
+
+    for (uint32_t s = from; s != seq; ++s)
+    {
+      ArbSlot& slot = mWindow[s & ARB_WINDOW_MASK];
+      evict(slot);
+      slot.seq = s;
+      slot.state = ARB_MISSING;
+    }
+    evict(mWindow[seq & ARB_WINDOW_MASK]);
+    mHighest = seq;
+    mHasSeq = true;
+  }
+  else if (ARB_WINDOW_LEN <= (uint32_t) -ahead)
+  {
+    ++mTooOld;
+    return ARB_TOO_OLD;
+  }
+
+  ArbSlot& slot = mWindow[seq & ARB_WINDOW_MASK];
+  if (0 < ahead || slot.seq != seq || ARB_ONE_SIDE > slot.state)
+  {
+    slot.firstNs = arrivalNs;
+    slot.seq = seq;
+    slot.state = ARB_ONE_SIDE;
+    slot.side = side;
+    ++mDelivered;
+    ++mWins[side];
+    return ARB_DELIVER;
+  }
+
+  if (ARB_ONE_SIDE == slot.state && side != slot.side)
+  {
+    slot.state = ARB_BOTH_SIDES;
+    if (slot.firstNs <= arrivalNs)
+    {
+      mLead[slot.side].add(arrivalNs - slot.firstNs);
+    }
+    ++mDuplicates;
+    return ARB_DUPLICATE;
+  }
+
+  ++mRepeats;
+  return ARB_REPEAT;
+}
+
+void FeedArbiter::getPending(unsigned& gaps, unsigned* onlyOn) const
+{
+  gaps = 0;
+  memset(onlyOn, 0, ARB_SIDES * sizeof(*onlyOn));
+  for (unsigned i = 0; i < ARB_WINDOW_LEN; ++i)
+  {
+    if (ARB_MISSING == mWindow[i].state)
+    {
+      ++gaps;
+    }
+    else if (ARB_ONE_SIDE == mWindow[i].state)
+    {
+      ++onlyOn[mWindow[i].side];
+    }
+  }
+}
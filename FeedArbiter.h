@@ -0,0 +1,95 @@
+#ifndef MCASTIT_FEEDARBITER_H_
+#define MCASTIT_FEEDARBITER_H_
+
+#include "Common.h"
+#include "Histogram.h"
+
+#define ARB_WINDOW_LEN    (8192)  // sequences matched behind the highest one, power of 2
+#define ARB_SIDES         (2)     // A & B
+
+/**
+ * One sequence of the window, 4 per cache line
+ */
+struct ArbSlot
+{
+  uint64_t firstNs;   // arrival of the delivered copy
+  uint32_t seq;
+  uint16_t state;     // ARB_EMPTY, ARB_MISSING, ARB_ONE_SIDE or ARB_BOTH_SIDES
+  uint16_t side;      // side of the delivered copy
+};
+
+/**
+ * A/B arbitration of one sequenced feed received twice, on two interfaces
+ *
+ * The first copy of each sequence is delivered & the other one dropped, the
+ * window remembers the last ARB_WINDOW_LEN sequences in a flat array indexed by
+ * sequence, so each datagram costs one slot access & the slots between the
+ * previous highest sequence and a new one. A sequence that leaves the window
+ * without any copy is a gap neither side filled. Not thread safe, it belongs
+ * to the receiving thread
+ */
+class FeedArbiter
+{
+public:
+  typedef enum _ArbResult
+  {
+    ARB_DELIVER=0,  // first copy of the sequence
+    ARB_DUPLICATE,  // the other side delivered it already
+    ARB_REPEAT,     // second copy from the same side
+    ARB_TOO_OLD     // behind the window, can't tell first copy from duplicate
+  } ArbResult;
+
+  FeedArbiter();
+
+  /**
+   * @param side      - 0 for A, 1 for B
+   * @param arrivalNs - receive time of the datagram
+   * @return whether to deliver the datagram
+   */
+  ArbResult arbitrate(unsigned side, uint32_t seq, uint64_t arrivalNs);
+
+  uint64_t getDelivered() const           { return mDelivered; }
+  uint64_t getWins(unsigned side) const   { return mWins[side]; }
+  uint64_t getDuplicates() const          { return mDuplicates; }
+  uint64_t getRepeats() const             { return mRepeats; }
+  uint64_t getTooOld() const              { return mTooOld; }
+
+  /**
+   * @return sequences that left the window with a copy from side only
+   */
+  uint64_t getOnlyOn(unsigned side) const { return mOnlyOn[side]; }
+
+  /**
+   * @return sequences that left the window without any copy
+   */
+  uint64_t getGaps() const                { return mGaps; }
+
+  /**
+   * Sequences still in the window without any copy & with one copy only, scans the window
+   * @param onlyOn  - ARB_SIDES counts, by side of the copy
+   */
+  void getPending(unsigned& gaps, unsigned* onlyOn) const;
+
+  /**
+   * @return how long side won by when the other side delivered the sequence too
+   */
+  const Histogram& getLead(unsigned side) const { return mLead[side]; }
+
+private:
+  /**
+   * Account for a sequence leaving the window
+   */
+  void evict(const ArbSlot& slot);
+
+private:
+  vector<ArbSlot> mWindow;   // ARB_WINDOW_LEN, seq % ARB_WINDOW_LEN
+  uint32_t mHighest;
+  bool     mHasSeq;
+
+  uint64_t mDelivered, mDuplicates, mRepeats, mTooOld, mGaps;
+  uint64_t mWins[ARB_SIDES];
+  uint64_t mOnlyOn[ARB_SIDES];
+  Histogram mLead[ARB_SIDES];
+};
+
+#endif /* MCASTIT_FEEDARBITER_H_ */
@@ -0,0 +1,291 @@
+#include "GaloisField.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define GF_HAVE_X86
+#endif
+
+static uint8_t g_exp[512];          // doubled so that log a + log b needs no modulo
+static uint8_t g_log[256];
+static uint8_t g_mulLow[256][16];   // coef * low nibble
+static uint8_t g_mulHigh[256][16];  // coef * (high nibble << 4)
+static bool    g_isInit = false;
+
+typedef void (*MulAddFunc)(uint8_t* dst, const uint8_t* src, uint8_t coef, unsigned len);
+typedef void (*XorFunc)(uint8_t* dst, const uint8_t* src, unsigned len);
+
+static GaloisField::Kernel g_kernel = GaloisField::GF_KERNEL_SCALAR;
+static MulAddFunc g_mulAdd = NULL;
+static XorFunc    g_xor = NULL;
+
+// Scalar kernels ---------------------------------------------------------
+static void mulAddScalar(uint8_t* dst, const uint8_t* src, uint8_t coef, unsigned len)
+{
+  const uint8_t* low = g_mulLow[coef];
+  const uint8_t* high = g_mulHigh[coef];
+  for (unsigned i = 0; i < len; ++i)
+  {
+    dst[i] ^= low[src[i] & 0x0f] ^ high[src[i] >> 4];
+  }
+}
+
+static void xorScalar(uint8_t* dst, const uint8_t* src, unsigned len)
+{
+  unsigned i = 0;
+  for (; i + sizeof(uint64_t) <= len; i += sizeof(uint64_t))
+  {
+    uint64_t d, s;
+    memcpy(&d, dst + i, sizeof(d));
+    memcpy(&s, src + i, sizeof(s));
+    d ^= s;
+    memcpy(dst + i, &d, sizeof(d));
+  }
+
+  for (; i < len; ++i)
+  {
+    dst[i] ^= src[i];
+  }
+}
+
+// x86 kernels, built for their own target & only called if the cpu has it ----
+#ifdef GF_HAVE_X86
+__attribute__((target("sse2")))
+static void xorSse2(uint8_t* dst, const uint8_t* src, unsigned len)
+{
+  unsigned i = 0;
+  for (; i + 16 <= len; i += 16)
+  {
+    __m128i d = _mm_loadu_si128((const __m128i*)(dst + i));
+    __m128i s = _mm_loadu_si128((const __m128i*)(src + i));
+    _mm_storeu_si128((__m128i*)(dst + i), _mm_xor_si128(d, s));
+  }
+  xorScalar(dst + i, src + i, len - i);
+}
+
+__attribute__((target("ssse3")))
+static void mulAddSsse3(uint8_t* dst, const uint8_t* src, uint8_t coef, unsigned len)
+{
+  const __m128i low = _mm_loadu_si128((const __m128i*) g_mulLow[coef]);
+  const __m128i high = _mm_loadu_si128((const __m128i*) g_mulHigh[coef]);
+  const __m128i mask = _mm_set1_epi8(0x0f);
+
+  unsigned i = 0;
+  for (; i + 16 <= len; i += 16)
+  {
+    __m128i s = _mm_loadu_si128((const __m128i*)(src + i));
+    __m128i product = _mm_xor_si128(
+        _mm_shuffle_epi8(low, _mm_and_si128(s, mask)),
+        _mm_shuffle_epi8(high, _mm_and_si128(_mm_srli_epi64(s, 4), mask)));
+    __m128i d = _mm_loadu_si128((const __m128i*)(dst + i));
+    _mm_storeu_si128((__m128i*)(dst + i), _mm_xor_si128(d, product));
+  }
+  mulAddScalar(dst + i, src + i, coef, len - i);
+}
+
+__attribute__((target("avx2")))
+static void xorAvx2(uint8_t* dst, const uint8_t* src, unsigned len)
+{
+  unsigned i = 0;
+  for (; i + 32 <= len; i += 32)
+  {
+    __m256i d = _mm256_loadu_si256((const __m256i*)(dst + i));
+    __m256i s = _mm256_loadu_si256((const __m256i*)(src + i));
+    _mm256_storeu_si256((__m256i*)(dst + i), _mm256_xor_si256(d, s));
+  }
+  xorScalar(dst + i, src + i, len - i);
+}
+
+__attribute__((target("avx2")))
+static void mulAddAvx2(uint8_t* dst, const uint8_t* src, uint8_t coef, unsigned len)
+{
+  // same 16 byte table in both lanes, vpshufb looks up within each lane
+  const __m256i low = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*) g_mulLow[coef]));
+  const __m256i high = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*) g_mulHigh[coef]));
+  const __m256i mask = _mm256_set1_epi8(0x0f);
+
+  unsigned i = 0;
+  for (; i + 32 <= len; i += 32)
+  {
+    __m256i s = _mm256_loadu_si256((const __m256i*)(src + i));
+    __m256i product = _mm256_xor_si256(
+        _mm256_shuffle_epi8(low, _mm256_and_si256(s, mask)),
+        _mm256_shuffle_epi8(high, _mm256_and_si256(_mm256_srli_epi64(s, 4), mask)));
+    __m256i d = _mm256_loadu_si256((const __m256i*)(dst + i));
+    _mm256_storeu_si256((__m256i*)(dst + i), _mm256_xor_si256(d, product));
+  }
+  mulAddScalar(dst + i, src + i, coef, len - i);
+}
+#endif /* GF_HAVE_X86 */
+// -------------------------------------------------------------------------
+
+void GaloisField::init()
+{
+  if (g_isInit)
+  {
+    return;
+  }
+
+  unsigned x = 1;
+  for (unsigned i = 0; i < 255; ++i)
+  {
+    g_exp[i] = g_exp[i + 255] = x;
+    g_log[x] = i;
+    x <<= 1;
+    if (x & 0x100)
+    {
+      x ^= GF_POLYNOMIAL;
+    }
+  }
+  g_exp[510] = g_exp[511] = g_exp[0];
+
+  for (unsigned coef = 0; coef < 256; ++coef)
+  {
+    for (unsigned nibble = 0; nibble < 16; ++nibble)
+    {
+      g_mulLow[coef][nibble] = mul(coef, nibble);
+      g_mulHigh[coef][nibble] = mul(coef, nibble << 4);
+    }
+  }
+
+  g_isInit = true;
+  if (!setKernel(GF_KERNEL_AVX2) && !setKernel(GF_KERNEL_SSSE3))
+  {
+    (void) setKernel(GF_KERNEL_SCALAR);
+  }
+  LOG_DEBUG("GF(256) kernel " << getKernelName(g_kernel));
+}
+
+bool GaloisField::setKernel(Kernel kernel)
+{
+#ifdef GF_HAVE_X86
+  __builtin_cpu_init();
+  if (GF_KERNEL_AVX2 == kernel && __builtin_cpu_supports("avx2"))
+  {
+    g_mulAdd = mulAddAvx2;
+    g_xor = xorAvx2;
+    g_kernel = kernel;
+    return true;
+  }
+
+  if (GF_KERNEL_SSSE3 == kernel && __builtin_cpu_supports("ssse3") && __builtin_cpu_supports("sse2"))
+  {
+    g_mulAdd = mulAddSsse3;
+    g_xor = xorSse2;
+    g_kernel = kernel;
+    return true;
+  }
+#endif
+
+  if (GF_KERNEL_SCALAR == kernel)
+  {
+    g_mulAdd = mulAddScalar;
+    g_xor = xorScalar;
+    g_kernel = kernel;
+    return true;
+  }
+
+  return false;
+}
+
+GaloisField::Kernel GaloisField::getKernel()
+{
+  return g_kernel;
+}
+
+const char* GaloisField::getKernelName(Kernel kernel)
+{
+  switch (kernel)
+  {
+  case GF_KERNEL_SCALAR:  return "scalar";
+  case GF_KERNEL_SSSE3:   return "ssse3";
+  case GF_KERNEL_AVX2:    return "avx2";
+  default:                return "unknown";
+  }
+}
+
+uint8_t GaloisField::mul(uint8_t a, uint8_t b)
+{
+  if (0 == a || 0 == b)
+  {
+    return 0;
+  }
+  return g_exp[g_log[a] + g_log[b]];
+}
+
+uint8_t GaloisField::inv(uint8_t a)
+{
+  return g_exp[255 - g_log[a]];
+}
+
+void GaloisField::mulAdd(uint8_t* dst, const uint8_t* src, uint8_t coef, unsigned len)
+{
+  if (0 == coef)
+  {
+    return;
+  }
+
+  if (1 == coef)
+  {
+    g_xor(dst, src, len);
+  }
+  else
+  {
+    g_mulAdd(dst, src, coef, len);
+  }
+}
+
+bool GaloisField::invertMatrix(uint8_t* matrix, unsigned n)
+{
+  // identity next to the matrix, both reduced with the same row operations
+  vector<uint8_t> inverse(n * n, 0);
+  for (unsigned i = 0; i < n; ++i)
+  {
+    inverse[i * n + i] = 1;
+  }
+
+  for (unsigned col = 0; col < n; ++col)
+  {
+    unsigned pivot = col;
+    while (pivot < n && 0 == matrix[pivot * n + col])
+    {
+      ++pivot;
+    }
+    if (pivot == n)
+    {
+      return false;
+    }
+
+    if (pivot != col)
+    {
+      std::swap_ranges(matrix + pivot * n, matrix + pivot * n + n, matrix + col * n);
+      std::swap_ranges(inverse.begin() + pivot * n, inverse.begin() + pivot * n + n,
+          inverse.begin() + col * n);
+    }
+
+    // scale the pivot row to 1, then clear the column in every other row
+    uint8_t scale = inv(matrix[col * n + col]);
+    for (unsigned j = 0; j < n; ++j)
+    {
+      matrix[col * n + j] = mul(matrix[col * n + j], scale);
+      inverse[col * n + j] = mul(inverse[col * n + j], scale);
+    }
+
+    for (unsigned row = 0; row < n; ++row)
+    {
+      uint8_t factor = matrix[row * n + col];
+      if (row == col || 0 == factor)
+      {
+        continue;
+      }
+
+      for (unsigned j = 0; j < n; ++j)
+      {
+        matrix[row * n + j] ^= mul(factor, matrix[col * n + j]);
+        inverse[row * n + j] ^= mul(factor, inverse[col * n + j]);
+      }
+    }
+  }
+
+  memcpy(matrix, &inverse[0], n * n);
+  return true;
+}
@@ -0,0 +1,62 @@
+#ifndef MCASTIT_GALOISFIELD_H_
+#define MCASTIT_GALOISFIELD_H_
+
+#include "Common.h"
+
+#define GF_POLYNOMIAL     (0x11d) // x^8 + x^4 + x^3 + x^2 + 1, generator 2
+
+/**
+ * Arithmetic in GF(2^8) for the FEC codes
+ *
+ * Addition is XOR, multiplication goes through log/exp tables for single
+ * bytes and through split nibble tables for buffers, so that SSSE3/AVX2
+ * pshufb can multiply 16/32 bytes at a time. The fastest kernel the cpu
+ * supports is picked at init
+ */
+namespace GaloisField
+{
+
+typedef enum _Kernel
+{
+  GF_KERNEL_SCALAR=0,
+  GF_KERNEL_SSSE3,    // pshufb multiply, SSE2 XOR
+  GF_KERNEL_AVX2,
+  GF_KERNELS
+} Kernel;
+
+/**
+ * Build the tables & select the best kernel, safe to call several times
+ * from the same thread, has to be called before any other function
+ */
+void init();
+
+/**
+ * Force a kernel, e.g. to compare them
+ * @return false if the cpu doesn't support it
+ */
+bool setKernel(Kernel kernel);
+Kernel getKernel();
+const char* getKernelName(Kernel kernel);
+
+uint8_t mul(uint8_t a, uint8_t b);
+
+/**
+ * @param a - nonzero
+ */
+uint8_t inv(uint8_t a);
+
+/**
+ * dst[i] ^= coef * src[i] for len bytes, plain XOR if coef is 1
+ */
+void mulAdd(uint8_t* dst, const uint8_t* src, uint8_t coef, unsigned len);
+
+/**
+ * Invert a n x n matrix in place with Gauss-Jordan elimination
+ * @param matrix  - row major
+ * @return false if matrix is singular
+ */
+bool invertMatrix(uint8_t* matrix, unsigned n);
+
+} /* namespace GaloisField */
+
+#endif /* MCASTIT_GALOISFIELD_H_ */
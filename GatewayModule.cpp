@@ -0,0 +1,858 @@
+#include "GatewayModule.h"
+
+#define GW_CONTROL_LEN    (CMSG_SPACE(sizeof(struct in6_pktinfo)) + \
+                           CMSG_SPACE(sizeof(struct timespec)) + CMSG_SPACE(sizeof(uint32_t)))
+#define GW_EXPIRY_CHECK_NS (1000000000ULL)
+#define GW_PRINT_MAX      (20)          // subscribers printed one by one in the statistics
+
+/**
+ * @return true if a & b have the same family, address & port
+ */
+static bool isSameAddress(const struct sockaddr_storage& a, const struct sockaddr_storage& b)
+{
+  if (a.ss_family != b.ss_family)
+  {
+    return false;
+  }
+
+  if (AF_INET6 == a.ss_family)
+  {
+    const struct sockaddr_in6* a6 = (const struct sockaddr_in6*) &a;
+    const struct sockaddr_in6* b6 = (const struct sockaddr_in6*) &b;
+    return a6->sin6_port == b6->sin6_port &&
+        0 == memcmp(&a6->sin6_addr, &b6->sin6_addr, sizeof(a6->sin6_addr));
+  }
+
+  const struct sockaddr_in* a4 = (const struct sockaddr_in*) &a;
+  const struct sockaddr_in* b4 = (const struct sockaddr_in*) &b;
+  return a4->sin_port == b4->sin_port && a4->sin_addr.s_addr == b4->sin_addr.s_addr;
+}
+
+GatewayModule::GatewayModule(const vector<IfaceData>& ifaces, const vector<string>& mcastAddresses,
+    int mcastPort, int nLoopbackIfaces, bool useIpV6) :
+    McastModuleInterface(ifaces, mcastAddresses, mcastPort, useIpV6),
+    mLoopbackCount(nLoopbackIfaces), mRecvBufferSize(0), mCtrlSock(-1), mMcastOutSock(-1),
+    mNextFlush(0), mNumEnded(0), mHasUnsubscribed(false), mNextSeq(1), mReceived(0), mBytes(0),
+    mBatches(0), mTruncated(0), mUnsubscribed(0), mKernelDrops(0), mControlOther(0), mStartNs(0)
+{
+}
+
+GatewayModule::~GatewayModule()
+{
+  for (unsigned i = 0; i < mSubscribers.size(); ++i)
+  {
+    if (0 <= mSubscribers[i]->sockFd)
+    {
+      ::close(mSubscribers[i]->sockFd);
+    }
+    delete mSubscribers[i];
+  }
+
+  for (unsigned i = 0; i < mInbound.size(); ++i)
+  {
+    if (0 <= mInbound[i].sockFd)
+    {
+      ::close(mInbound[i].sockFd);
+    }
+  }
+
+  if (0 <= mCtrlSock)
+  {
+    ::close(mCtrlSock);
+  }
+  if (0 <= mMcastOutSock)
+  {
+    ::close(mMcastOutSock);
+  }
+}
+
+void GatewayModule::setRecvBufferSize(int size)
+{
+  mRecvBufferSize = size;
+}
+
+bool GatewayModule::addInbound(const string& spec)
+{
+  size_t equal = spec.find('=');
+  GwInbound inbound;
+  inbound.port = atoi(spec.c_str());
+  if (string::npos == equal || 0 >= inbound.port || 65535 < inbound.port ||
+      !Common::parseDestination(spec.substr(equal + 1), mMcastPort, isIpV6(), inbound.dest))
+  {
+    return false;
+  }
+
+  std::stringstream name;
+  name << ":" << inbound.port << " -> " << spec.substr(equal + 1);
+  inbound.name = name.str();
+  mInbound.push_back(inbound);
+  return true;
+}
+
+bool GatewayModule::setupSocket(int fd, int rcvBufSize) const
+{
+  int flags = fcntl(fd, F_GETFL, 0);
+  if (0 > flags || 0 > fcntl(fd, F_SETFL, flags | O_NONBLOCK))
+  {
+    LOG_ERROR("Cannot make socket " << fd << " non blocking: " << strerror(errno));
+    return false;
+  }
+
+  if (0 < rcvBufSize && 0 > setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvBufSize, sizeof(rcvBufSize)))
+  {
+    LOG_ERROR("sockopt BuffSz: " << strerror(errno));
+  }
+  return true;
+}
+
+/**
+ * Bind fd to port on all addresses
+ * @return false on error
+ */
+static bool bindAnyAddress(int fd, int port, bool isIpV6)
+{
+  struct sockaddr_storage anyAddr;
+  memset(&anyAddr, 0, sizeof(anyAddr));
+  socklen_t addrLen;
+  if (isIpV6)
+  {
+    struct sockaddr_in6* addr6 = (struct sockaddr_in6*) &anyAddr;
+    addr6->sin6_family = AF_INET6;
+    addr6->sin6_port = htons(port);
+    addrLen = sizeof(*addr6);
+  }
+  else
+  {
+    struct sockaddr_in* addr = (struct sockaddr_in*) &anyAddr;
+    addr->sin_family = AF_INET;
+    addr->sin_addr.s_addr = htonl(INADDR_ANY);
+    addr->sin_port = htons(port);
+    addrLen = sizeof(*addr);
+  }
+
+  if (0 > ::bind(fd, (struct sockaddr*) &anyAddr, addrLen))
+  {
+    LOG_ERROR("bind port " << port << ": " << strerror(errno));
+    return false;
+  }
+  return true;
+}
+
+bool GatewayModule::init()
+{
+  int rcvBufSize = (0 < mRecvBufferSize)? mRecvBufferSize : GW_RCVBUF;
+
+  /*
+   * Groups of the first interface, with their destination & receive time
+   */
+  const IfaceData& iface = mIfaces[0];
+  int fd = iface.sockFd;
+  int res = isIpV6()? joinMcastIfaceV6(fd, iface.ifaceName.c_str()) :
+      joinMcastIface(fd, iface.ifaceName.c_str());
+  if (0 != res)
+  {
+    LOG_ERROR("Joining groups on " << iface);
+    return false;
+  }
+
+  // only the groups joined by this socket, not the inbound ones looped back
+  int opt = 0;
+  res = isIpV6()? setsockopt(fd, IPPROTO_IPV6, IPV6_MULTICAST_ALL, &opt, sizeof(opt)) :
+      setsockopt(fd, IPPROTO_IP, IP_MULTICAST_ALL, &opt, sizeof(opt));
+  if (0 > res)
+  {
+    LOG_ERROR("sockopt MULTICAST_ALL: " << strerror(errno));
+  }
+
+  opt = 1;
+  res = isIpV6()? setsockopt(fd, IPPROTO_IPV6, IPV6_RECVPKTINFO, &opt, sizeof(opt)) :
+      setsockopt(fd, IPPROTO_IP, IP_PKTINFO, &opt, sizeof(opt));
+  if (0 > res)
+  {
+    LOG_ERROR("sockopt PKTINFO: " << strerror(errno));
+    return false;
+  }
+
+  if (0 > setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPNS, &opt, sizeof(opt)))
+  {
+    LOG_ERROR("sockopt SO_TIMESTAMPNS: " << strerror(errno) << ", no gateway latency");
+  }
+  if (0 > setsockopt(fd, SOL_SOCKET, SO_RXQ_OVFL, &opt, sizeof(opt)))
+  {
+    LOG_ERROR("sockopt SO_RXQ_OVFL: " << strerror(errno) << ", no kernel drop count");
+  }
+
+  if (!setupSocket(fd, rcvBufSize))
+  {
+    return false;
+  }
+  cout << "Groups on " << iface << " [OK]" << endl;
+
+  /*
+   * Subscriptions on the ACK port, each subscriber then gets its own socket on it
+   */
+  if (-1 == (mCtrlSock = Common::createSocket(isIpV6())) || -1 == Common::setReuseSocket(mCtrlSock) ||
+      !bindAnyAddress(mCtrlSock, mAckPort, isIpV6()) || !setupSocket(mCtrlSock, 0))
+  {
+    LOG_ERROR("Cannot open subscription port " << mAckPort);
+    return false;
+  }
+  cout << "Subscriptions on port " << mAckPort << " [OK]" << endl;
+
+  /*
+   * Inbound unicast ports, multicast on the first interface
+   */
+  if (!mInbound.empty())
+  {
+    bool isLoopBack = 0 != mLoopbackCount;
+    if (-1 == (mMcastOutSock = Common::createSocket(isIpV6())))
+    {
+      LOG_ERROR("Cannot create socket: " << strerror(errno));
+      return false;
+    }
+
+    bool setMcastOk = isIpV6()?
+        associateMcastV6WithIfaceName(mMcastOutSock, iface.ifaceName.c_str(), isLoopBack) :
+        associateMcastWithIfaceName(mMcastOutSock, iface.ifaceName.c_str(), isLoopBack);
+    if (!setMcastOk)
+    {
+      LOG_ERROR("Setting mcast for " << iface);
+      return false;
+    }
+
+    if (!mInBuf.init(GW_SLOT_LEN, GW_BATCH_LEN, Common::getIfaceNumaNode(iface.ifaceName)))
+    {
+      return false;
+    }
+  }
+
+  for (unsigned i = 0; i < mInbound.size(); ++i)
+  {
+    GwInbound& inbound = mInbound[i];
+    if (-1 == (inbound.sockFd = Common::createSocket(isIpV6())) ||
+        !bindAnyAddress(inbound.sockFd, inbound.port, isIpV6()) || !setupSocket(inbound.sockFd, rcvBufSize))
+    {
+      LOG_ERROR("Cannot open inbound port " << inbound.port);
+      return false;
+    }
+    cout << "Inbound " << inbound.name << " [OK]" << endl;
+  }
+
+  /*
+   * Group datagrams are received in the ring & sent to the subscribers from it
+   */
+  int numaNode = Common::getIfaceNumaNode(iface.ifaceName);
+  if (!Common::applyThreadSettings(Common::THREAD_RX, 0, numaNode))
+  {
+    LOG_ERROR("Running gateway with default cpu & scheduling");
+  }
+
+  if (!mRing.init(GW_SLOT_LEN, GW_RING_LEN, numaNode))
+  {
+    return false;
+  }
+  mSlots.resize(GW_RING_LEN);
+  mRxControl.resize(GW_BATCH_LEN * GW_CONTROL_LEN);
+  mMsgs.resize(GW_BATCH_LEN);
+  mIovs.resize(GW_BATCH_LEN);
+  cout << "Gateway ring " << mRing.toString() << endl;
+
+  return true;
+}
+
+bool GatewayModule::run()
+{
+  if (!init())
+  {
+    return false;
+  }
+  cout << "==============================================================" << endl;
+
+  mStartNs = Common::getMonotonicNs();
+  uint64_t lastExpiryNs = mStartNs;
+  int groupSock = mIfaces[0].sockFd;
+  while (!mIsStopped)
+  {
+    mPollFds.clear();
+    mPollSubscribers.clear();
+    struct pollfd pfd;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    pfd.fd = groupSock;
+    mPollFds.push_back(pfd);
+    pfd.fd = mCtrlSock;
+    mPollFds.push_back(pfd);
+    for (unsigned i = 0; i < mInbound.size(); ++i)
+    {
+      pfd.fd = mInbound[i].sockFd;
+      mPollFds.push_back(pfd);
+    }
+    unsigned nFixed = mPollFds.size();
+
+    // renewals of a subscriber come to its own socket, a full one waits until it can send
+    bool hasBacklog = false;
+    for (unsigned i = 0; i < mSubscribers.size(); ++i)
+    {
+      GwSubscriber& subscriber = *mSubscribers[i];
+      if (0 > subscriber.sockFd)
+      {
+        continue;
+      }
+
+      pfd.fd = subscriber.sockFd;
+      pfd.events = subscriber.isBlocked? (POLLIN | POLLOUT) : POLLIN;
+      mPollFds.push_back(pfd);
+      mPollSubscribers.push_back(&subscriber);
+      hasBacklog = hasBacklog || (subscriber.count && !subscriber.isBlocked);
+    }
+
+    int numReady = ::poll(&mPollFds[0], mPollFds.size(), hasBacklog? 0 : 1000);
+    if (0 > numReady && EINTR != errno)
+    {
+      LOG_ERROR("poll: " << strerror(errno));
+    }
+
+    if (0 < numReady)
+    {
+      // errors are seen by the next receive or send
+      const short readable = POLLIN | POLLERR | POLLHUP;
+      if (mPollFds[0].revents & readable)
+      {
+        receiveGroups();
+      }
+      if (mPollFds[1].revents & readable)
+      {
+        receiveControl(mCtrlSock);
+      }
+      for (unsigned i = 0; i < mInbound.size(); ++i)
+      {
+        if (mPollFds[2 + i].revents & readable)
+        {
+          forwardInbound(mInbound[i]);
+        }
+      }
+
+      // a subscriber unsubscribed meanwhile stays allocated until reapSubscribers()
+      for (unsigned i = 0; i < mPollSubscribers.size(); ++i)
+      {
+        GwSubscriber& subscriber = *mPollSubscribers[i];
+        short revents = mPollFds[nFixed + i].revents;
+        if (0 > subscriber.sockFd || subscriber.sockFd != mPollFds[nFixed + i].fd)
+        {
+          continue;
+        }
+        if (revents & (POLLOUT | POLLERR))
+        {
+          subscriber.isBlocked = false;
+        }
+        if (revents & readable)
+        {
+          receiveControl(subscriber.sockFd);
+        }
+      }
+    }
+
+    // one batch per subscriber & round, starting with a different one each round
+    unsigned nSubscribers = mSubscribers.size();
+    for (unsigned i = 0; i < nSubscribers; ++i)
+    {
+      GwSubscriber& subscriber = *mSubscribers[(mNextFlush + i) % nSubscribers];
+      if (0 <= subscriber.sockFd && subscriber.count && !subscriber.isBlocked)
+      {
+        flushSubscriber(subscriber);
+      }
+    }
+    ++mNextFlush;
+
+    uint64_t nowNs = Common::getMonotonicNs();
+    if (nowNs - lastExpiryNs >= GW_EXPIRY_CHECK_NS)
+    {
+      lastExpiryNs = nowNs;
+      for (unsigned i = 0; i < mSubscribers.size(); ++i)
+      {
+        if (0 <= mSubscribers[i]->sockFd && nowNs - mSubscribers[i]->lastSeenNs > GW_SUBSCRIBER_TTL_NS)
+        {
+          unsubscribe(*mSubscribers[i], "expired");
+        }
+      }
+    }
+
+    if (mHasUnsubscribed)
+    {
+      reapSubscribers();
+    }
+  }
+
+  return true;
+}
+
+void GatewayModule::receiveGroups()
+{
+  for (unsigned i = 0; i < GW_BATCH_LEN; ++i)
+  {
+    mIovs[i].iov_base = mRing.getSlot((mNextSeq + i) % GW_RING_LEN);
+    mIovs[i].iov_len = GW_SLOT_LEN;
+    struct msghdr& msg = mMsgs[i].msg_hdr;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &mIovs[i];
+    msg.msg_iovlen = 1;
+    msg.msg_control = &mRxControl[i * GW_CONTROL_LEN];
+    msg.msg_controllen = GW_CONTROL_LEN;
+  }
+
+  int fd = mIfaces[0].sockFd;
+  int numMsgs = recvmmsg(fd, &mMsgs[0], GW_BATCH_LEN, MSG_DONTWAIT, NULL);
+  if (0 >= numMsgs)
+  {
+    if (0 > numMsgs && EAGAIN != errno && EWOULDBLOCK != errno && EINTR != errno)
+    {
+      LOG_ERROR("recvmmsg " << fd << ": " << strerror(errno));
+    }
+    return;
+  }
+  ++mBatches;
+
+  for (int i = 0; i < numMsgs; ++i)
+  {
+    struct msghdr& msg = mMsgs[i].msg_hdr;
+    uint64_t seq = mNextSeq++;
+    GwSlot& slot = mSlots[seq % GW_RING_LEN];
+    slot.seq = seq;
+    slot.len = mMsgs[i].msg_len;
+    slot.kernelNs = 0;
+    memset(&slot.group, 0, sizeof(slot.group));
+    for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg))
+    {
+      if (SOL_SOCKET == cmsg->cmsg_level && SCM_TIMESTAMPNS == cmsg->cmsg_type)
+      {
+        struct timespec ts;
+        memcpy(&ts, CMSG_DATA(cmsg), sizeof(ts));
+        slot.kernelNs = ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+      }
+      else if (SOL_SOCKET == cmsg->cmsg_level && SO_RXQ_OVFL == cmsg->cmsg_type)
+      {
+        memcpy(&mKernelDrops, CMSG_DATA(cmsg), sizeof(mKernelDrops));
+      }
+      else if (IPPROTO_IP == cmsg->cmsg_level && IP_PKTINFO == cmsg->cmsg_type)
+      {
+        struct in_pktinfo pktInfo;
+        memcpy(&pktInfo, CMSG_DATA(cmsg), sizeof(pktInfo));
+        memcpy(&slot.group, &pktInfo.ipi_addr, sizeof(pktInfo.ipi_addr));
+      }
+      else if (IPPROTO_IPV6 == cmsg->cmsg_level && IPV6_PKTINFO == cmsg->cmsg_type)
+      {
+        struct in6_pktinfo pktInfo;
+        memcpy(&pktInfo, CMSG_DATA(cmsg), sizeof(pktInfo));
+        slot.group = pktInfo.ipi6_addr;
+      }
+    }
+
+    ++mReceived;
+    mBytes += slot.len;
+    if (msg.msg_flags & MSG_TRUNC)
+    {
+      ++mTruncated;
+      continue;
+    }
+
+    // only the position is queued, the datagram stays in the ring
+    bool hasSubscriber = false;
+    for (unsigned s = 0; s < mSubscribers.size(); ++s)
+    {
+      GwSubscriber& subscriber = *mSubscribers[s];
+      if (0 > subscriber.sockFd || 0 != memcmp(&subscriber.groupAddr, &slot.group, sizeof(slot.group)))
+      {
+        continue;
+      }
+
+      hasSubscriber = true;
+      if (GW_QUEUE_LEN == subscriber.count)
+      {
+        ++subscriber.queueDrops;
+        continue;
+      }
+      subscriber.queue[(subscriber.head + subscriber.count++) % GW_QUEUE_LEN] = seq;
+      subscriber.maxQueued = std::max(subscriber.maxQueued, subscriber.count);
+    }
+
+    if (!hasSubscriber)
+    {
+      ++mUnsubscribed;
+    }
+  }
+}
+
+void GatewayModule::receiveControl(int fd)
+{
+  char buf[MCAST_BUFF_LEN];
+  for (unsigned n = 0; n < GW_BATCH_LEN; ++n)
+  {
+    struct sockaddr_storage source;
+    memset(&source, 0, sizeof(source));
+    socklen_t sourceLen = sizeof(source);
+    int len = recvfrom(fd, buf, sizeof(buf) - 1, MSG_DONTWAIT, (struct sockaddr*) &source, &sourceLen);
+    if (0 > len)
+    {
+      // the subscriber of a connected socket is gone, also seen by its next send
+      if (ECONNREFUSED == errno)
+      {
+        continue;
+      }
+      if (EAGAIN != errno && EWOULDBLOCK != errno && EINTR != errno)
+      {
+        LOG_ERROR("recvfrom " << fd << ": " << strerror(errno));
+      }
+      return;
+    }
+    buf[len] = '\0';
+
+    Common::SubscribeType type;
+    string group;
+    if (!Common::decodeSubscribeMessage(buf, type, group) || Common::SUBSCRIBED == type)
+    {
+      ++mControlOther;
+      continue;
+    }
+
+    if (Common::SUBSCRIBE == type)
+    {
+      subscribe(source, group, Common::getMonotonicNs());
+      continue;
+    }
+
+    // the socket of the subscriber may be the one being read
+    bool isClosed = false;
+    for (unsigned i = 0; i < mSubscribers.size(); ++i)
+    {
+      GwSubscriber& subscriber = *mSubscribers[i];
+      if (0 <= subscriber.sockFd && group == subscriber.group &&
+          isSameAddress(subscriber.address, source))
+      {
+        isClosed = isClosed || fd == subscriber.sockFd;
+        unsubscribe(subscriber, "unsubscribed");
+      }
+    }
+
+    if (isClosed)
+    {
+      return;
+    }
+  }
+}
+
+void GatewayModule::subscribe(const struct sockaddr_storage& source, const string& group,
+    uint64_t nowNs)
+{
+  char sourceIp[INET6_ADDRSTRLEN];
+  int sourcePort;
+  if (AF_INET6 == source.ss_family)
+  {
+    const struct sockaddr_in6* addr6 = (const struct sockaddr_in6*) &source;
+    inet_ntop(AF_INET6, &addr6->sin6_addr, sourceIp, sizeof(sourceIp));
+    sourcePort = ntohs(addr6->sin6_port);
+  }
+  else
+  {
+    const struct sockaddr_in* addr = (const struct sockaddr_in*) &source;
+    inet_ntop(AF_INET, &addr->sin_addr, sourceIp, sizeof(sourceIp));
+    sourcePort = ntohs(addr->sin_port);
+  }
+
+  std::stringstream name;
+  name << sourceIp << ":" << sourcePort << " " << group;
+  if (mMcastAddresses.end() == std::find(mMcastAddresses.begin(), mMcastAddresses.end(), group))
+  {
+    LOG_WARN("Subscription " << name.str() << " to a group that isn't served");
+    return;
+  }
+
+  GwSubscriber* subscriber = NULL;
+  for (unsigned i = 0; i < mSubscribers.size() && !subscriber; ++i)
+  {
+    if (group == mSubscribers[i]->group && isSameAddress(mSubscribers[i]->address, source))
+    {
+      subscriber = mSubscribers[i];
+    }
+  }
+
+  // the subscriptions come from anyone, each one costs a socket & a queue
+  if (!subscriber && GW_MAX_SUBSCRIBERS <= mSubscribers.size())
+  {
+    LOG_WARN("Subscription " << name.str() << " refused, " << GW_MAX_SUBSCRIBERS << " subscribers");
+    return;
+  }
+
+  if (!subscriber)
+  {
+    subscriber = new GwSubscriber();
+    subscriber->address = source;
+    subscriber->name = name.str();
+    subscriber->group = group;
+    memset(&subscriber->groupAddr, 0, sizeof(subscriber->groupAddr));
+    inet_pton(isIpV6()? AF_INET6 : AF_INET, group.c_str(), &subscriber->groupAddr);
+    subscriber->queue.resize(GW_QUEUE_LEN);
+    mSubscribers.push_back(subscriber);
+  }
+
+  // from the subscription port so that connected clients accept the datagrams
+  if (0 > subscriber->sockFd)
+  {
+    int fd = Common::createSocket(isIpV6());
+    socklen_t addrLen = isIpV6()? sizeof(struct sockaddr_in6) : sizeof(struct sockaddr_in);
+    int sndBufSize = GW_SNDBUF;
+    if (-1 == fd || -1 == Common::setReuseSocket(fd) || !bindAnyAddress(fd, mAckPort, isIpV6()) ||
+        0 > connect(fd, (const struct sockaddr*) &source, addrLen) || !setupSocket(fd, 0) ||
+        0 > setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &sndBufSize, sizeof(sndBufSize)))
+    {
+      LOG_ERROR("Cannot open socket to subscriber " << subscriber->name << ": " << strerror(errno));
+      if (-1 != fd)
+      {
+        ::close(fd);
+      }
+      return;
+    }
+
+    subscriber->sockFd = fd;
+    subscriber->head = subscriber->count = 0;
+    subscriber->isBlocked = false;
+    subscriber->refused = 0;
+    subscriber->endReason.clear();
+    cout << "Subscribed " << subscriber->name << endl;
+  }
+  subscriber->lastSeenNs = nowNs;
+
+  string reply;
+  struct sockaddr_storage target = source;
+  if (Common::encodeSubscribeMessage(Common::SUBSCRIBED, group, reply))
+  {
+    (void) Common::unicastMessage(subscriber->sockFd, target, reply);
+  }
+}
+
+void GatewayModule::unsubscribe(GwSubscriber& subscriber, const string& reason)
+{
+  ::close(subscriber.sockFd);
+  subscriber.sockFd = -1;
+  subscriber.count = 0;
+  subscriber.endReason = reason;
+  mHasUnsubscribed = true;
+  cout << "Unsubscribed " << subscriber.name << " (" << reason << ")" << endl;
+}
+
+void GatewayModule::reapSubscribers()
+{
+  unsigned nKept = 0;
+  for (unsigned i = 0; i < mSubscribers.size(); ++i)
+  {
+    GwSubscriber* subscriber = mSubscribers[i];
+    if (0 <= subscriber->sockFd)
+    {
+      mSubscribers[nKept++] = subscriber;
+      continue;
+    }
+
+    mEnded.sent += subscriber->sent;
+    mEnded.bytes += subscriber->bytes;
+    mEnded.queueDrops += subscriber->queueDrops;
+    mEnded.overruns += subscriber->overruns;
+    mEnded.blocked += subscriber->blocked;
+    mEnded.errors += subscriber->errors;
+    mEnded.maxQueued = std::max(mEnded.maxQueued, subscriber->maxQueued);
+    ++mNumEnded;
+    delete subscriber;
+  }
+  mSubscribers.resize(nKept);
+  mHasUnsubscribed = false;
+}
+
+void GatewayModule::flushSubscriber(GwSubscriber& subscriber)
+{
+  // queue offset of each message of the batch, positions whose slot was reused are skipped
+  unsigned offsets[GW_BATCH_LEN];
+  uint64_t kernelNs[GW_BATCH_LEN];
+  unsigned nMsgs = 0;
+  unsigned nTaken = 0;
+  while (nMsgs < GW_BATCH_LEN && nTaken < subscriber.count)
+  {
+    uint64_t seq = subscriber.queue[(subscriber.head + nTaken) % GW_QUEUE_LEN];
+    const GwSlot& slot = mSlots[seq % GW_RING_LEN];
+    if (slot.seq != seq)
+    {
+      ++subscriber.overruns;
+      ++nTaken;
+      continue;
+    }
+
+    mIovs[nMsgs].iov_base = mRing.getSlot(seq % GW_RING_LEN);
+    mIovs[nMsgs].iov_len = slot.len;
+    struct msghdr& msg = mMsgs[nMsgs].msg_hdr;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &mIovs[nMsgs];
+    msg.msg_iovlen = 1;
+    offsets[nMsgs] = nTaken;
+    kernelNs[nMsgs] = slot.kernelNs;
+    ++nMsgs;
+    ++nTaken;
+  }
+
+  unsigned nConsumed = nTaken;
+  int sent = nMsgs? sendmmsg(subscriber.sockFd, &mMsgs[0], nMsgs, MSG_DONTWAIT) : 0;
+  if (0 > sent)
+  {
+    // a full socket keeps its queue, a refused datagram is dropped
+    if (EAGAIN == errno || EWOULDBLOCK == errno || ENOBUFS == errno)
+    {
+      ++subscriber.blocked;
+      subscriber.isBlocked = true;
+      nConsumed = offsets[0];
+    }
+    else
+    {
+      ++subscriber.errors;
+      subscriber.refused = (ECONNREFUSED == errno)? subscriber.refused + 1 : 0;
+      nConsumed = offsets[0] + 1;
+    }
+    sent = 0;
+  }
+  else if ((unsigned) sent < nMsgs)
+  {
+    nConsumed = offsets[sent];
+  }
+
+  if (sent)
+  {
+    uint64_t nowNs = Common::getRealtimeNs();
+    for (int i = 0; i < sent; ++i)
+    {
+      subscriber.bytes += mMsgs[i].msg_len;
+      if (0 < kernelNs[i] && kernelNs[i] <= nowNs)
+      {
+        subscriber.latency.add(nowNs - kernelNs[i]);
+      }
+    }
+    subscriber.sent += sent;
+    subscriber.refused = 0;
+  }
+
+  subscriber.head = (subscriber.head + nConsumed) % GW_QUEUE_LEN;
+  subscriber.count -= nConsumed;
+  if (GW_MAX_REFUSED <= subscriber.refused)
+  {
+    unsubscribe(subscriber, "unreachable");
+  }
+}
+
+void GatewayModule::forwardInbound(GwInbound& inbound)
+{
+  for (unsigned i = 0; i < GW_BATCH_LEN; ++i)
+  {
+    mIovs[i].iov_base = mInBuf.getSlot(i);
+    mIovs[i].iov_len = GW_SLOT_LEN;
+    struct msghdr& msg = mMsgs[i].msg_hdr;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &mIovs[i];
+    msg.msg_iovlen = 1;
+  }
+
+  int numMsgs = recvmmsg(inbound.sockFd, &mMsgs[0], GW_BATCH_LEN, MSG_DONTWAIT, NULL);
+  if (0 >= numMsgs)
+  {
+    if (0 > numMsgs && EAGAIN != errno && EWOULDBLOCK != errno && EINTR != errno)
+    {
+      LOG_ERROR("recvmmsg " << inbound.sockFd << ": " << strerror(errno));
+    }
+    return;
+  }
+  inbound.received += numMsgs;
+
+  // the same descriptors send the batch to the group
+  socklen_t destLen = isIpV6()? sizeof(struct sockaddr_in6) : sizeof(struct sockaddr_in);
+  for (int i = 0; i < numMsgs; ++i)
+  {
+    mIovs[i].iov_len = mMsgs[i].msg_len;
+    mMsgs[i].msg_hdr.msg_name = &inbound.dest;
+    mMsgs[i].msg_hdr.msg_namelen = destLen;
+  }
+
+  int nSent = 0;
+  while (nSent < numMsgs)
+  {
+    int sent = sendmmsg(mMcastOutSock, &mMsgs[nSent], numMsgs - nSent, 0);
+    if (0 > sent)
+    {
+      if (EINTR != errno)
+      {
+        ++inbound.errors;
+        ++nSent;
+      }
+      continue;
+    }
+
+    for (int i = nSent; i < nSent + sent; ++i)
+    {
+      inbound.bytes += mMsgs[i].msg_len;
+    }
+    inbound.sent += sent;
+    nSent += sent;
+  }
+}
+
+void GatewayModule::printStats() const
+{
+  if (0 == mStartNs)
+  {
+    return;
+  }
+
+  double elapsed = (Common::getMonotonicNs() - mStartNs) / 1e9;
+  unsigned nActive = 0;
+  for (unsigned i = 0; i < mSubscribers.size(); ++i)
+  {
+    nActive += (0 <= mSubscribers[i]->sockFd)? 1 : 0;
+  }
+
+  cout << "==============================================================" << endl;
+  printf("[GW] %-30s received: %llu bytes: %llu batches: %llu (%.1f per batch) kernel drops: %u "
+      "truncated: %llu no subscriber: %llu (%.1f pps)\n", mIfaces[0].toString().c_str(),
+      (unsigned long long) mReceived, (unsigned long long) mBytes, (unsigned long long) mBatches,
+      mBatches? (double) mReceived / mBatches : 0, mKernelDrops, (unsigned long long) mTruncated,
+      (unsigned long long) mUnsubscribed, elapsed > 0? mReceived / elapsed : 0);
+  printf("[GW] %-30s active: %u total: %u other messages: %llu\n", "subscribers", nActive,
+      (unsigned) mSubscribers.size() + mNumEnded, (unsigned long long) mControlOther);
+
+  for (unsigned i = 0; i < mSubscribers.size() && i < GW_PRINT_MAX; ++i)
+  {
+    const GwSubscriber& subscriber = *mSubscribers[i];
+    printf("[GW] %-30s sent: %llu bytes: %llu queue drops: %llu overruns: %llu blocked: %llu "
+        "errors: %llu max queued: %u%s%s\n", subscriber.name.c_str(),
+        (unsigned long long) subscriber.sent, (unsigned long long) subscriber.bytes,
+        (unsigned long long) subscriber.queueDrops, (unsigned long long) subscriber.overruns,
+        (unsigned long long) subscriber.blocked, (unsigned long long) subscriber.errors,
+        subscriber.maxQueued, subscriber.endReason.empty()? "" : " ",
+        subscriber.endReason.c_str());
+    printf("[GW] %-30s latency: %s\n", "", subscriber.latency.toString(1000, "us").c_str());
+  }
+  if (mSubscribers.size() > GW_PRINT_MAX)
+  {
+    printf("[GW] ... %u more subscribers\n", (unsigned) (mSubscribers.size() - GW_PRINT_MAX));
+  }
+  if (mNumEnded)
+  {
+    char ended[32];
+    snprintf(ended, sizeof(ended), "%u ended", mNumEnded);
+    printf("[GW] %-30s sent: %llu bytes: %llu queue drops: %llu overruns: %llu blocked: %llu "
+        "errors: %llu max queued: %u\n", ended, (unsigned long long) mEnded.sent,
+        (unsigned long long) mEnded.bytes, (unsigned long long) mEnded.queueDrops,
+        (unsigned long long) mEnded.overruns, (unsigned long long) mEnded.blocked,
+        (unsigned long long) mEnded.errors, mEnded.maxQueued);
+  }
+
+  for (unsigned i = 0; i < mInbound.size(); ++i)
+  {
+    const GwInbound& inbound = mInbound[i];
+    printf("[GW] inbound %-22s received: %llu sent: %llu bytes: %llu errors: %llu\n",
+        inbound.name.c_str(), (unsigned long long) inbound.received,
+        (unsigned long long) inbound.sent, (unsigned long long) inbound.bytes,
+        (unsigned long long) inbound.errors);
+  }
+}
@@ -0,0 +1,193 @@
+#ifndef MCASTIT_GATEWAYMODULE_H_
+#define MCASTIT_GATEWAYMODULE_H_
+
+#include "McastModuleInterface.h"
+#include "Histogram.h"
+#include "PacketArena.h"
+
+#include <poll.h>
+
+#define GW_RING_LEN       (4096)        // datagrams kept for the subscribers, oldest reused first
+#define GW_SLOT_LEN       (9216)        // largest datagram forwarded, jumbo frame payload
+#define GW_BATCH_LEN      (64)          // datagrams per recvmmsg & sendmmsg
+#define GW_QUEUE_LEN      (1024)        // datagrams waiting per subscriber
+#define GW_SNDBUF         (1024 * 1024) // per subscriber socket
+#define GW_RCVBUF         (1024 * 1024) // group & inbound sockets without --rcvbuf
+#define GW_SUBSCRIBER_TTL_NS (30000000000ULL) // dropped if its subscription isn't repeated
+#define GW_MAX_REFUSED    (3)           // port unreachable in a row before a subscriber is dropped
+#define GW_MAX_SUBSCRIBERS (512)        // subscriptions served at once, more are refused
+
+/**
+ * Datagram of a group in the gateway ring
+ */
+struct GwSlot
+{
+  uint64_t        seq;       // ring position it was received at, tells if the slot was reused
+  unsigned        len;
+  uint64_t        kernelNs;  // realtime receive timestamp, 0 if unknown
+  struct in6_addr group;     // ipv4 group in the first 4 bytes
+
+  GwSlot(): seq(0), len(0), kernelNs(0) {}
+};
+
+/**
+ * Unicast receiver of one group
+ *
+ * Each subscriber has its own socket connected to it and its own queue of ring
+ * positions, so a subscriber whose socket is full only delays itself
+ */
+struct GwSubscriber
+{
+  struct sockaddr_storage address;
+  string          name;      // "ip:port group"
+  string          group;
+  struct in6_addr groupAddr;
+  int             sockFd;    // from the subscription port, -1 once unsubscribed
+  string          endReason; // why it was unsubscribed
+
+  vector<uint64_t> queue;    // ring positions waiting to be sent, GW_QUEUE_LEN
+  unsigned        head, count;
+  bool            isBlocked; // waiting for its socket to be writable
+
+  uint64_t        lastSeenNs; // monotonic time of the last subscription
+  uint64_t        sent, bytes;
+  uint64_t        queueDrops; // queue full
+  uint64_t        overruns;  // ring slot reused before it was sent
+  uint64_t        blocked;   // sends that found the socket full
+  uint64_t        errors;
+  unsigned        refused;   // port unreachable in a row
+  unsigned        maxQueued;
+  Histogram       latency;   // group receive to unicast send
+
+  GwSubscriber(): sockFd(-1), head(0), count(0), isBlocked(false), lastSeenNs(0), sent(0),
+      bytes(0), queueDrops(0), overruns(0), blocked(0), errors(0), refused(0), maxQueued(0) {}
+};
+
+/**
+ * Unicast port whose datagrams are sent to a group
+ */
+struct GwInbound
+{
+  int       port;
+  int       sockFd;
+  string    name;            // ":port -> group:port"
+  struct sockaddr_storage dest;
+  uint64_t  received, sent, bytes, errors;
+
+  GwInbound(): port(0), sockFd(-1), received(0), sent(0), bytes(0), errors(0) {}
+};
+
+/**
+ * Gateway between multicast & unicast
+ *
+ * The groups received on the first interface are sent by unicast to every
+ * subscriber of the group. Subscribers register by sending
+ * "MCAST-SUBSCRIBE {group}" to the ACK port and repeating it within
+ * GW_SUBSCRIBER_TTL_NS, they are answered "MCAST-SUBSCRIBED {group}" & get the
+ * datagrams from that port. Datagrams received on the inbound unicast ports are
+ * multicast to their group on the first interface. Receives & sends are batched
+ */
+class GatewayModule: public McastModuleInterface
+{
+public:
+  /**
+   * @param ifaces    - interface of the groups, the first one is used
+   * @param nLoopbackIfaces - loop back the inbound streams if != 0
+   */
+  GatewayModule(const vector<IfaceData>& ifaces, const vector<string>& mcastAddresses,
+      int mcastPort, int nLoopbackIfaces, bool useIpV6);
+  virtual ~GatewayModule();
+  bool run();
+  void printStats() const;
+
+  /**
+   * Multicast the datagrams received on a unicast port
+   * @param spec - "{port}={group}" or "{port}={group}:{group port}"
+   * @return false if spec is invalid
+   */
+  bool addInbound(const string& spec);
+
+  /**
+   * @param size - group & inbound sockets receive buffer size, 0 for GW_RCVBUF
+   */
+  void setRecvBufferSize(int size);
+
+private:
+  /**
+   * Sockets & buffers
+   * @return true on success
+   */
+  bool init();
+
+  /**
+   * Receive a batch of group datagrams in the ring & queue them for their subscribers
+   */
+  void receiveGroups();
+
+  /**
+   * Read subscriptions & unsubscriptions waiting on fd
+   */
+  void receiveControl(int fd);
+
+  /**
+   * Add or renew the subscription of source to group
+   */
+  void subscribe(const struct sockaddr_storage& source, const string& group, uint64_t nowNs);
+
+  /**
+   * Close the socket of a subscriber, it is freed by reapSubscribers()
+   */
+  void unsubscribe(GwSubscriber& subscriber, const string& reason);
+
+  /**
+   * Add the counters of the unsubscribed subscribers to mEnded & free them
+   */
+  void reapSubscribers();
+
+  /**
+   * Send one batch of the queue of a subscriber
+   */
+  void flushSubscriber(GwSubscriber& subscriber);
+
+  /**
+   * Receive a batch on an inbound port & multicast it
+   */
+  void forwardInbound(GwInbound& inbound);
+
+  /**
+   * Prepare fd for the data path: non blocking, receive buffer
+   * @return false on error
+   */
+  bool setupSocket(int fd, int rcvBufSize) const;
+
+private:
+  int  mLoopbackCount;
+  int  mRecvBufferSize;
+  int  mCtrlSock;                       // subscriptions, on the ACK port
+  int  mMcastOutSock;                   // inbound streams to their groups
+  vector<GwInbound>      mInbound;
+  vector<GwSubscriber*>  mSubscribers;  // GW_MAX_SUBSCRIBERS at most, searched linearly
+  unsigned               mNextFlush;    // round robin start
+  GwSubscriber           mEnded;        // counters of the reaped subscribers
+  unsigned               mNumEnded;
+  bool                   mHasUnsubscribed; // mSubscribers has some to reap
+  vector<struct pollfd>  mPollFds;      // rebuilt each round, the subscribers last
+  vector<GwSubscriber*>  mPollSubscribers; // of the last mPollFds entries
+
+  PacketArena            mRing;         // GW_RING_LEN group datagrams
+  vector<GwSlot>         mSlots;
+  uint64_t               mNextSeq;      // ring position of the next datagram
+  PacketArena            mInBuf;        // one batch of an inbound port
+  vector<char>           mRxControl;
+  vector<struct mmsghdr> mMsgs;         // batch descriptors, rebuilt for each call
+  vector<struct iovec>   mIovs;
+
+  uint64_t mReceived, mBytes, mBatches;
+  uint64_t mTruncated;                  // longer than GW_SLOT_LEN, dropped
+  uint64_t mUnsubscribed;               // datagrams of a group without subscriber
+  uint32_t mKernelDrops;                // group socket overflows, SO_RXQ_OVFL
+  uint64_t mControlOther;               // other messages on the ACK port, e.g. ACKs of subscribers
+  uint64_t mStartNs;
+};
+
+#endif /* MCASTIT_GATEWAYMODULE_H_ */
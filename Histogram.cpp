@@ -0,0 +1,83 @@
+#include "Histogram.h"
+
+Histogram::Histogram()
+{
+  clear();
+}
+
+void Histogram::clear()
+{
+  memset(mBuckets, 0, sizeof(mBuckets));
+  mCount = 0;
+  mMin = ~0ULL;
+  mMax = 0;
+  mSum = 0;
+}
+
+unsigned Histogram::bucketOf(uint64_t value)
+{
+  if (value < HIST_SUB_BUCKETS)
+  {
+    return value;
+  }
+
+  // power of two then linear position inside it
+  unsigned msb = 63 - __builtin_clzll(value);
+  unsigned shift = msb - HIST_SUB_BITS;
+  return (shift + 1) * HIST_SUB_BUCKETS + ((value >> shift) & (HIST_SUB_BUCKETS - 1));
+}
+
+uint64_t Histogram::bucketUpperBound(unsigned bucket)
+{
+  if (bucket < HIST_SUB_BUCKETS)
+  {
+    return bucket;
+  }
+
+  unsigned shift = bucket / HIST_SUB_BUCKETS - 1;
+  uint64_t lower = (uint64_t)(HIST_SUB_BUCKETS + bucket % HIST_SUB_BUCKETS) << shift;
+  return lower + ((1ULL << shift) - 1);
+}
+
+void Histogram::add(uint64_t value)
+{
+  ++mBuckets[bucketOf(value)];
+  ++mCount;
+  mSum += value;
+  mMin = std::min(mMin, value);
+  mMax = std::max(mMax, value);
+}
+
+uint64_t Histogram::getPercentile(double percent) const
+{
+  if (!mCount)
+  {
+    return 0;
+  }
+
+  uint64_t rank = (uint64_t)(percent / 100.0 * mCount + 0.5);
+  rank = std::max(rank, (uint64_t) 1);
+
+  uint64_t seen = 0;
+  for (unsigned i = 0; i < HIST_BUCKETS; ++i)
+  {
+    seen += mBuckets[i];
+    if (seen >= rank)
+    {
+      return std::min(bucketUpperBound(i), mMax);
+    }
+  }
+
+  return mMax;
+}
+
+string Histogram::toString(double scale, const char* unit) const
+{
+  char line[256];
+  snprintf(line, sizeof(line),
+      "samples: %llu min: %.2f avg: %.2f p50: %.2f p99: %.2f p99.9: %.2f max: %.2f (%s)",
+      (unsigned long long) mCount, getMin() / scale, getMean() / scale,
+      getPercentile(50) / scale, getPercentile(99) / scale, getPercentile(99.9) / scale,
+      getMax() / scale, unit);
+  return line;
+}
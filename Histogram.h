@@ -0,0 +1,49 @@
+#ifndef MCASTIT_HISTOGRAM_H_
+#define MCASTIT_HISTOGRAM_H_
+
+#include "Common.h"
+
+#define HIST_SUB_BITS     (4)                    // 16 linear buckets per power of two
+#define HIST_SUB_BUCKETS  (1 << HIST_SUB_BITS)
+#define HIST_BUCKETS      ((64 - HIST_SUB_BITS + 1) * HIST_SUB_BUCKETS)
+
+/**
+ * Fixed size log-linear histogram of unsigned values, e.g. nanoseconds
+ * Values are exact up to 2*HIST_SUB_BUCKETS, then within 1/HIST_SUB_BUCKETS
+ */
+class Histogram
+{
+public:
+  Histogram();
+
+  void add(uint64_t value);
+  void clear();
+
+  uint64_t getCount() const { return mCount; }
+  uint64_t getMin() const   { return mCount? mMin : 0; }
+  uint64_t getMax() const   { return mMax; }
+  double   getMean() const  { return mCount? mSum / mCount : 0; }
+
+  /**
+   * @param percent - 0 to 100
+   * @return upper bound of the bucket holding the percentile
+   */
+  uint64_t getPercentile(double percent) const;
+
+  /**
+   * Print "samples: n min: x avg: x p50: x p99: x p99.9: x max: x" with values divided by scale
+   * @param unit  - name of the unit after scaling, e.g. "us"
+   */
+  string toString(double scale, const char* unit) const;
+
+private:
+  static unsigned bucketOf(uint64_t value);
+  static uint64_t bucketUpperBound(unsigned bucket);
+
+private:
+  uint64_t mBuckets[HIST_BUCKETS];
+  uint64_t mCount, mMin, mMax;
+  double   mSum;
+};
+
+#endif /* MCASTIT_HISTOGRAM_H_ */
@@ -1,9 +1,18 @@
 #include "McastModuleInterface.h"
+#include <sys/eventfd.h>
+#include <poll.h>
 
 McastModuleInterface::McastModuleInterface(const vector<IfaceData>& ifaces,
     const vector<string>& mcastAddresses, int mcastPort, bool useIpV6) :
-    mIfaces(ifaces), mMcastAddresses(mcastAddresses), mMcastPort(mcastPort), mIsIpV6(useIpV6)
+    mIfaces(ifaces), mMcastAddresses(mcastAddresses), mMcastPort(mcastPort), mIsStopped(false),
+    mIsIpV6(useIpV6), mHasRunThread(false)
 {
+  mStopFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (-1 == mStopFd)
+  {
+    LOG_ERROR("eventfd: " << strerror(errno) << ", stop() waits for the loop timeouts");
+  }
+
   string ipVer = (useIpV6)? "IPV6" : "IPV4";
 
   // Print out all mcast addresses
@@ -26,11 +35,98 @@ McastModuleInterface::McastModuleInterface(const vector<IfaceData>& ifaces,
   mAckPort = mMcastPort + 1;
 }
 
+McastModuleInterface::~McastModuleInterface()
+{
+  // the thread runs a derived class that is gone by now, it has to be joined by poll()
+  if (mHasRunThread)
+  {
+    LOG_ERROR("Module destroyed while running");
+  }
+
+  if (-1 != mStopFd)
+  {
+    close(mStopFd);
+  }
+}
+
 bool McastModuleInterface::isIpV6() const
 {
   return mIsIpV6;
 }
 
+bool McastModuleInterface::start()
+{
+  if (0 != pthread_create(&mRunThread, NULL, &McastModuleInterface::runThreadHelper, this))
+  {
+    LOG_ERROR("Cannot spawn module thread");
+    return false;
+  }
+
+  mHasRunThread = true;
+  return true;
+}
+
+bool McastModuleInterface::poll(int timeoutMs)
+{
+  if (!mHasRunThread)
+  {
+    return false;
+  }
+
+  struct timespec deadline;
+  clock_gettime(CLOCK_REALTIME, &deadline);
+  uint64_t deadlineNs = deadline.tv_nsec + (uint64_t) std::max(timeoutMs, 0) * 1000000ULL;
+  deadline.tv_sec += deadlineNs / 1000000000ULL;
+  deadline.tv_nsec = deadlineNs % 1000000000ULL;
+  if (0 != pthread_timedjoin_np(mRunThread, NULL, &deadline))
+  {
+    return true;
+  }
+
+  mHasRunThread = false;
+  return false;
+}
+
+void McastModuleInterface::stop()
+{
+  mIsStopped = true;
+  __sync_synchronize();
+
+  // the counter is never read back so the fd stays readable, write is async signal safe
+  uint64_t one = 1;
+  ssize_t len = (-1 != mStopFd)? write(mStopFd, &one, sizeof(one)) : 0;
+  (void) len;
+}
+
+bool McastModuleInterface::isStopped() const
+{
+  return mIsStopped;
+}
+
+int McastModuleInterface::getStopFd() const
+{
+  return mStopFd;
+}
+
+bool McastModuleInterface::sleepUnlessStopped(uint64_t timeoutNs)
+{
+  struct pollfd pfd;
+  pfd.fd = mStopFd;
+  pfd.events = POLLIN;
+  pfd.revents = 0;
+  struct timespec timeout;
+  timeout.tv_sec = timeoutNs / 1000000000ULL;
+  timeout.tv_nsec = timeoutNs % 1000000000ULL;
+  (void) ppoll(&pfd, 1, &timeout, NULL);
+  return !mIsStopped;
+}
+
+void* McastModuleInterface::runThreadHelper(void* context)
+{
+  McastModuleInterface* module = (McastModuleInterface*) context;
+  return module->run()? NULL : context;
+}
+
 bool McastModuleInterface::associateMcastWithIfaceName(int fd,
     const char* ifaceName, bool isLoopBack)
 {
@@ -11,14 +11,39 @@ class McastModuleInterface
 public:
   McastModuleInterface(const vector<IfaceData>& ifaces, const vector<string>& mcastAddresses,
                        int mcastPort, bool useIpV6 = false);
-  virtual ~McastModuleInterface() {}
+  virtual ~McastModuleInterface();
 
   /**
    * Main runner function, should not be inside a loop
+   * Returns when the module is done or after stop()
    * @return true if run successfully
    */
   virtual bool run() = 0;
 
+  /**
+   * Get ready for poll(), by default run() is started on a thread of its own
+   * @return false on error
+   */
+  virtual bool start();
+
+  /**
+   * Do the module's work for up to timeoutMs, by default wait for the thread of start()
+   * @return false once the module is done, stopped or failed
+   */
+  virtual bool poll(int timeoutMs);
+
+  /**
+   * Ask run() & poll() to return, safe from signal handlers & other threads,
+   * wakes up the loops waiting on getStopFd() at once
+   */
+  void stop();
+  bool isStopped() const;
+
+  /**
+   * Print out statistics gathered so far, called before module is destroyed
+   */
+  virtual void printStats() const {}
+
   bool isIpV6() const;
 
 protected:
@@ -44,12 +69,31 @@ protected:
   int joinMcastIface(int sock, const char* ifaceName = "");
   int joinMcastIfaceV6(int sock, const char* ifaceName = "");
 
+  /**
+   * @return eventfd that stays readable once stop() was called, for select & poll loops
+   */
+  int getStopFd() const;
+
+  /**
+   * Sleep for timeoutNs unless stop() is called meanwhile
+   * @return false if stopped
+   */
+  bool sleepUnlessStopped(uint64_t timeoutNs);
+
 protected:
   vector<IfaceData>   mIfaces; // all interfaces to be listened/sent to
   vector<string>      mMcastAddresses;
   int                 mMcastPort, mAckPort;
 
+  volatile bool       mIsStopped;
+
+private:
+  static void* runThreadHelper(void* context);
+
 private:
   bool mIsIpV6;
+  int mStopFd;
+  pthread_t mRunThread;  // of the default start()
+  bool mHasRunThread;
 };
 #endif /* MCAST_TOOL_MCASTMODULEINTERFACE_H_ */
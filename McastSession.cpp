@@ -0,0 +1,233 @@
+#include "McastSession.h"
+
+#define SESSION_JOIN_MS   (100)   // wait for a module thread by this much at a time
+
+McastSession::McastSession(bool useIpV6) :
+    mIsIpV6(useIpV6), mModule(NULL), mIsStarted(false), mIsStopped(false)
+{
+}
+
+McastSession::~McastSession()
+{
+  if (mModule)
+  {
+    // a module running on its own thread must be done before it is deleted
+    mModule->stop();
+    while (mIsStarted && mModule->poll(SESSION_JOIN_MS))
+    {
+    }
+    delete mModule;
+    mModule = NULL;
+  }
+
+  set<int> uniqueFdSet;
+  for (unsigned i = 0; i < mIfaces.size(); ++i)
+  {
+    if (-1 != mIfaces[i].sockFd)
+    {
+      uniqueFdSet.insert(mIfaces[i].sockFd);
+    }
+  }
+
+  for (set<int>::const_iterator setIt = uniqueFdSet.begin();
+            setIt != uniqueFdSet.end(); ++setIt)
+  {
+    if (-1 == close(*setIt))
+    {
+      LOG_ERROR("Close socket " << *setIt << ": " << strerror(errno));
+    }
+  }
+}
+
+bool McastSession::addIface(const string& name)
+{
+  vector<string> ifaceAddresses;
+  if (0 != Common::getIfaceIPFromIfaceName(name, ifaceAddresses, mIsIpV6))
+  {
+    LOG_ERROR("Can't find interface IP address for " << name);
+    return false;
+  }
+
+  mIfaces.push_back(IfaceData(name, ifaceAddresses));
+  return true;
+}
+
+bool McastSession::addAllIfaces()
+{
+  vector<string> ifaceNames = Common::getAllIfaceNames(mIsIpV6);
+  ifaceNames.erase(std::remove(ifaceNames.begin(), ifaceNames.end(), "lo"), ifaceNames.end());
+  for (unsigned i = 0; i < ifaceNames.size(); ++i)
+  {
+    if (!addIface(ifaceNames[i]))
+    {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+bool McastSession::openSockets(bool isShared)
+{
+  if (mModule)
+  {
+    LOG_ERROR("Session has a module already");
+    return false;
+  }
+
+  if (mIfaces.empty())
+  {
+    mIfaces.push_back(IfaceData("", vector<string>()));
+  }
+
+  int fd = -1;
+  for (unsigned i = 0; i < mIfaces.size(); ++i)
+  {
+    if (!isShared || i == 0)
+    {
+      fd = Common::createSocket(mIsIpV6);
+    }
+
+    if (-1 == fd)
+    {
+      LOG_ERROR("Can't create socket for " << mIfaces[i].ifaceName << " :" << strerror(errno));
+      return false;
+    }
+    mIfaces[i].sockFd = fd;
+  }
+
+  return true;
+}
+
+ReceiverModule* McastSession::createListener(const vector<string>& groups, int port)
+{
+  // one socket gets the groups of all interfaces
+  if (!openSockets(true))
+  {
+    return NULL;
+  }
+
+  ReceiverModule* receiver = new ReceiverModule(mIfaces, groups, port, mIsIpV6);
+  mModule = receiver;
+  return receiver;
+}
+
+SenderModule* McastSession::createSender(const vector<string>& groups, int port,
+    int nLoopbackIfaces, float interval)
+{
+  if (!openSockets(false))
+  {
+    return NULL;
+  }
+
+  SenderModule* sender = new SenderModule(mIfaces, groups, port, nLoopbackIfaces, mIsIpV6,
+      interval);
+  mModule = sender;
+  return sender;
+}
+
+ServerModule* McastSession::createServer(const vector<string>& groups, int port,
+    int nLoopbackIfaces, float interval)
+{
+  if (!openSockets(false))
+  {
+    return NULL;
+  }
+
+  ServerModule* server = new ServerModule(mIfaces, groups, port, nLoopbackIfaces, mIsIpV6,
+      interval);
+  mModule = server;
+  return server;
+}
+
+RelayModule* McastSession::createRelay(const vector<string>& groups, int port, int nLoopbackIfaces)
+{
+  if (!openSockets(false))
+  {
+    return NULL;
+  }
+
+  RelayModule* relay = new RelayModule(mIfaces, groups, port, nLoopbackIfaces, mIsIpV6);
+  mModule = relay;
+  return relay;
+}
+
+GatewayModule* McastSession::createGateway(const vector<string>& groups, int port,
+    int nLoopbackIfaces)
+{
+  if (!openSockets(false))
+  {
+    return NULL;
+  }
+
+  GatewayModule* gateway = new GatewayModule(mIfaces, groups, port, nLoopbackIfaces, mIsIpV6);
+  mModule = gateway;
+  return gateway;
+}
+
+StreamModule* McastSession::createStreams(const vector<StreamProfile>& profiles,
+    int nLoopbackIfaces)
+{
+  if (!openSockets(false))
+  {
+    return NULL;
+  }
+
+  StreamModule* streams = new StreamModule(mIfaces, profiles, nLoopbackIfaces, mIsIpV6);
+  mModule = streams;
+  return streams;
+}
+
+bool McastSession::start()
+{
+  if (!mModule || mIsStarted)
+  {
+    LOG_ERROR("Session has no module to start or is started already");
+    return false;
+  }
+
+  // stopped before the module was there
+  if (mIsStopped)
+  {
+    mModule->stop();
+  }
+  mIsStarted = mModule->start();
+  return mIsStarted;
+}
+
+bool McastSession::poll(int timeoutMs)
+{
+  return mIsStarted && mModule->poll(timeoutMs);
+}
+
+bool McastSession::run()
+{
+  if (!mModule || mIsStarted)
+  {
+    LOG_ERROR("Session has no module to run or is started already");
+    return false;
+  }
+
+  if (mIsStopped)
+  {
+    mModule->stop();
+  }
+  return mModule->run();
+}
+
+void McastSession::stop()
+{
+  mIsStopped = true;
+  if (mModule)
+  {
+    mModule->stop();
+  }
+}
+
+void McastSession::printStats() const
+{
+  if (mModule)
+  {
+    mModule->printStats();
+  }
+}
@@ -0,0 +1,110 @@
+#ifndef MCASTIT_MCASTSESSION_H_
+#define MCASTIT_MCASTSESSION_H_
+
+#include "SenderModule.h"
+#include "ReceiverModule.h"
+#include "ServerModule.h"
+#include "StreamModule.h"
+#include "RelayModule.h"
+#include "GatewayModule.h"
+
+/**
+ * Entry point of libmcastit: the interfaces, their sockets & one module
+ *
+ * Interfaces are added first, then one module is created on them and configured
+ * with its own setters. The application calls start() then poll() from its own
+ * loop, or run() until the module is done; stop() ends both from anywhere:
+ *
+ *   McastSession session;
+ *   session.addIface("eth0");
+ *   ReceiverModule* listener = session.createListener(groups, 12321);
+ *   listener->setQuiet();
+ *   listener->setPacketHandler(&handler);
+ *   if (session.start())
+ *   {
+ *     while (session.poll(100)) {}
+ *   }
+ *
+ * A listener receives on the thread calling poll(), its PacketHandler runs there
+ * too. The other modules run on a thread of their own & poll() waits for it
+ */
+class McastSession
+{
+public:
+  McastSession(bool useIpV6 = false);
+
+  /**
+   * Stop & delete the module, close the sockets
+   */
+  ~McastSession();
+
+  /**
+   * Use interface name, in order
+   * @return false if it has no address of the session family
+   */
+  bool addIface(const string& name);
+
+  /**
+   * Use all interfaces with an address of the session family, except localhost
+   * @return false on error
+   */
+  bool addAllIfaces();
+
+  /**
+   * Create the module of the session on the interfaces added so far, the kernel
+   * picks the interface if none was added. Only one module per session
+   * @return module, owned by the session, NULL on error
+   */
+  ReceiverModule* createListener(const vector<string>& groups, int port);
+  SenderModule* createSender(const vector<string>& groups, int port, int nLoopbackIfaces = -1,
+      float interval = -1);
+  ServerModule* createServer(const vector<string>& groups, int port, int nLoopbackIfaces,
+      float interval);
+  RelayModule* createRelay(const vector<string>& groups, int port, int nLoopbackIfaces = -1);
+  GatewayModule* createGateway(const vector<string>& groups, int port, int nLoopbackIfaces = -1);
+  StreamModule* createStreams(const vector<StreamProfile>& profiles, int nLoopbackIfaces = -1);
+
+  /**
+   * Get ready for poll()
+   * @return false on error or without module
+   */
+  bool start();
+
+  /**
+   * Receive for up to timeoutMs, or wait as long for a module running on its thread
+   * @return false once the module is done or stopped
+   */
+  bool poll(int timeoutMs);
+
+  /**
+   * Run the module on the calling thread until it is done or stopped
+   * @return false on error
+   */
+  bool run();
+
+  /**
+   * Make run() & poll() return, safe from signal handlers & other threads
+   */
+  void stop();
+
+  void printStats() const;
+  McastModuleInterface* getModule() const { return mModule; }
+  const vector<IfaceData>& getIfaces() const { return mIfaces; }
+
+private:
+  /**
+   * Sockets of the interfaces, the default interface if none was added
+   * @param isShared - one socket for all interfaces
+   * @return false on error or if there is a module already
+   */
+  bool openSockets(bool isShared);
+
+private:
+  bool mIsIpV6;
+  vector<IfaceData> mIfaces;
+  McastModuleInterface* mModule;
+  bool mIsStarted;
+  volatile bool mIsStopped;
+};
+
+#endif /* MCASTIT_MCASTSESSION_H_ */
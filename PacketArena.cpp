@@ -0,0 +1,112 @@
+#include "PacketArena.h"
+
+#include <sys/mman.h>
+
+PacketArena::PacketArena() :
+    mMapping(NULL), mMapLen(0), mRegion(NULL), mSlotLen(0), mSlotCount(0), mBacking(ARENA_NONE)
+{
+}
+
+PacketArena::~PacketArena()
+{
+  release();
+}
+
+void PacketArena::release()
+{
+  if (mMapping)
+  {
+    munmap(mMapping, mMapLen);
+  }
+
+  mMapping = NULL;
+  mMapLen = 0;
+  mRegion = NULL;
+  mSlotLen = 0;
+  mSlotCount = 0;
+  mBacking = ARENA_NONE;
+}
+
+bool PacketArena::init(unsigned slotLen, unsigned nSlots, int numaNode)
+{
+  release();
+
+  unsigned alignedSlotLen = (std::max(slotLen, 1u) + ARENA_SLOT_ALIGN - 1) / ARENA_SLOT_ALIGN
+      * ARENA_SLOT_ALIGN;
+  size_t len = (size_t) alignedSlotLen * std::max(nSlots, 1u);
+  size_t hugeLen = (len + ARENA_HUGE_PAGE_LEN - 1) / ARENA_HUGE_PAGE_LEN * ARENA_HUGE_PAGE_LEN;
+  void* mapping = MAP_FAILED;
+
+  // reserved hugepages, only worth it when most of the last huge page is used
+  if (len >= ARENA_HUGE_PAGE_LEN / 2)
+  {
+    mapping = mmap(NULL, hugeLen, PROT_READ|PROT_WRITE,
+        MAP_PRIVATE|MAP_ANONYMOUS|MAP_HUGETLB, -1, 0);
+    if (MAP_FAILED != mapping)
+    {
+      mMapLen = hugeLen;
+      mRegion = (char*) mapping;
+      mBacking = ARENA_HUGETLB;
+    }
+    else
+    {
+      LOG_DEBUG("MAP_HUGETLB: " << strerror(errno));
+    }
+  }
+
+  if (MAP_FAILED == mapping && len >= ARENA_HUGE_PAGE_LEN)
+  {
+    // transparent hugepages need a huge page aligned range, map one more to align it
+    mMapLen = hugeLen + ARENA_HUGE_PAGE_LEN;
+    mapping = mmap(NULL, mMapLen, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+    if (MAP_FAILED != mapping)
+    {
+      uintptr_t mask = ARENA_HUGE_PAGE_LEN - 1;
+      mRegion = (char*)(((uintptr_t) mapping + mask) & ~mask);
+      mBacking = (0 == madvise(mRegion, hugeLen, MADV_HUGEPAGE))? ARENA_THP : ARENA_PAGES;
+    }
+  }
+  else if (MAP_FAILED == mapping)
+  {
+    mMapLen = (len + ARENA_PAGE_LEN - 1) / ARENA_PAGE_LEN * ARENA_PAGE_LEN;
+    mapping = mmap(NULL, mMapLen, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+    mRegion = (char*) mapping;
+    mBacking = ARENA_PAGES;
+  }
+
+  if (MAP_FAILED == mapping)
+  {
+    LOG_ERROR("Cannot allocate " << len << " bytes of packet buffers: " << strerror(errno));
+    mMapLen = 0;
+    mRegion = NULL;
+    mBacking = ARENA_NONE;
+    return false;
+  }
+
+  mMapping = (char*) mapping;
+  mSlotLen = alignedSlotLen;
+  mSlotCount = std::max(nSlots, 1u);
+
+  // placed before the first touch, then faulted in now rather than on the data path,
+  // a byte per page is enough, mmap already returns them zeroed
+  if (0 <= numaNode)
+  {
+    (void) Common::bindMemoryToNumaNode(mRegion, len, numaNode);
+  }
+  size_t pageLen = (ARENA_HUGETLB == mBacking)? ARENA_HUGE_PAGE_LEN : ARENA_PAGE_LEN;
+  for (size_t offset = 0; offset < len; offset += pageLen)
+  {
+    mRegion[offset] = 0;
+  }
+
+  return true;
+}
+
+string PacketArena::toString() const
+{
+  static const char* backingNames[] = {"none", "pages", "thp", "hugetlb"};
+
+  std::stringstream stm;
+  stm << mSlotCount << " x " << mSlotLen << " bytes (" << backingNames[mBacking] << ")";
+  return stm.str();
+}
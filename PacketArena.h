@@ -0,0 +1,70 @@
+#ifndef MCASTIT_PACKETARENA_H_
+#define MCASTIT_PACKETARENA_H_
+
+#include "Common.h"
+
+#define ARENA_SLOT_ALIGN      (64)                // cache line
+#define ARENA_PAGE_LEN        (4096)
+#define ARENA_HUGE_PAGE_LEN   (2 * 1024 * 1024)
+
+/**
+ * One contiguous region of packet buffers carved into fixed size slots
+ *
+ * The region is backed by hugetlb pages when the system has some reserved,
+ * by transparent hugepages when it's large enough, by normal pages otherwise.
+ * It is allocated & faulted in once at init so the data path never allocates
+ */
+class PacketArena
+{
+public:
+  typedef enum _Backing
+  {
+    ARENA_NONE=0,
+    ARENA_PAGES,
+    ARENA_THP,      // madvise(MADV_HUGEPAGE), the kernel may still use normal pages
+    ARENA_HUGETLB
+  } Backing;
+
+  PacketArena();
+  ~PacketArena();
+
+  /**
+   * Allocate the region, releasing any previous one
+   * @param slotLen   - bytes per slot, rounded up to ARENA_SLOT_ALIGN
+   * @param nSlots
+   * @param numaNode  - node to place the region on, -1 for the default policy
+   * @return true on success
+   */
+  bool init(unsigned slotLen, unsigned nSlots, int numaNode = -1);
+
+  /**
+   * Unmap the region
+   */
+  void release();
+
+  char* getSlot(unsigned idx) const   { return mRegion + (size_t) idx * mSlotLen; }
+  unsigned getSlotIdx(const char* slot) const { return (slot - mRegion) / mSlotLen; }
+  unsigned getSlotLen() const         { return mSlotLen; }
+  unsigned getSlotCount() const       { return mSlotCount; }
+  Backing getBacking() const          { return mBacking; }
+
+  /**
+   * @return e.g. "32 x 65536 bytes (hugetlb)"
+   */
+  string toString() const;
+
+private:
+  // not copyable, owns the mapping
+  PacketArena(const PacketArena&);
+  PacketArena& operator=(const PacketArena&);
+
+private:
+  char*    mMapping;    // what was mapped, mRegion is aligned inside it
+  size_t   mMapLen;
+  char*    mRegion;
+  unsigned mSlotLen;
+  unsigned mSlotCount;
+  Backing  mBacking;
+};
+
+#endif /* MCASTIT_PACKETARENA_H_ */
@@ -0,0 +1,87 @@
+#ifndef MCASTIT_PROBES_H_
+#define MCASTIT_PROBES_H_
+
+#include <stdint.h>
+
+/*
+ * USDT static tracepoints of provider "mcastit", for bpftrace, perf & systemtap:
+ *
+ *   rx_packet    (fd, ifindex, len, kernelNs, appNs)          one receive, maybe coalesced
+ *   rx_decoded   (fd, ifindex, seq, len, sendNs, kernelNs)    one datagram split & decoded, seq 0 if none
+ *   ack_sent     (fd, ifindex, seq, len)                      listener, ifindex of the acked datagram,
+ *                                                              0 for a summary of which seq is the highest
+ *   ack_received (fd, ifindex, seq, len, rttNs)               sender, rttNs 0 if not measured
+ *   tx_sent      (fd, ifindex, seq, len, nDatagrams)          one send call done, seq of its first datagram
+ *   tx_slip      (fd, ifindex, seq, lateNs)                   pacing round started behind its deadline
+ *
+ * Times are CLOCK_REALTIME ns, 0 if unknown; all arguments are 64 bit. A probe is
+ * a single nop in the code plus an ELF note describing where its arguments are,
+ * the same format as <sys/sdt.h> without depending on it, so nothing is called
+ * while no tracer is attached. The arguments are still computed, keep them to
+ * values at hand. Build with -DMCASTIT_NO_PROBES for toolchains without ELF notes
+ *
+ *   bpftrace -e 'usdt:./mcastit:mcastit:rx_packet { @[arg1] = count(); }'
+ *   bpftrace -p $(pidof mcastit) scripts/mcastit-latency.bt
+ */
+
+#if defined(MCASTIT_NO_PROBES) || !defined(__GNUC__) || !defined(__ELF__)
+
+#define MCASTIT_PROBE4(name, a1, a2, a3, a4)
+#define MCASTIT_PROBE5(name, a1, a2, a3, a4, a5)
+#define MCASTIT_PROBE6(name, a1, a2, a3, a4, a5, a6)
+
+#else
+
+#if defined(__LP64__)
+#define MCASTIT_PROBE_ADDR ".8byte"
+#else
+#define MCASTIT_PROBE_ADDR ".4byte"
+#endif
+
+// nop at the probe site, then its note: site, base for prelinked binaries, no semaphore,
+// provider, name & argument locations as size@operand
+#define MCASTIT_PROBE_ASM(name, args)                                             \
+    "990: nop\n"                                                                  \
+    ".pushsection .note.stapsdt,\"?\",\"note\"\n"                                 \
+    ".balign 4\n"                                                                 \
+    ".4byte 992f-991f, 994f-993f, 3\n"                                            \
+    "991: .asciz \"stapsdt\"\n"                                                   \
+    "992: .balign 4\n"                                                            \
+    "993: " MCASTIT_PROBE_ADDR " 990b\n"                                          \
+    MCASTIT_PROBE_ADDR " _.stapsdt.base\n"                                        \
+    MCASTIT_PROBE_ADDR " 0\n"                                                     \
+    ".asciz \"mcastit\"\n"                                                        \
+    ".asciz \"" #name "\"\n"                                                      \
+    ".asciz \"" args "\"\n"                                                       \
+    "994: .balign 4\n"                                                            \
+    ".popsection\n"                                                               \
+    ".ifndef _.stapsdt.base\n"                                                    \
+    ".pushsection .stapsdt.base,\"aG\",\"progbits\",.stapsdt.base,comdat\n"       \
+    ".weak _.stapsdt.base\n"                                                      \
+    ".hidden _.stapsdt.base\n"                                                    \
+    "_.stapsdt.base: .space 1\n"                                                  \
+    ".size _.stapsdt.base, 1\n"                                                   \
+    ".popsection\n"                                                               \
+    ".endif\n"
+
+// register, memory or constant, wherever the compiler has the value
+#define MCASTIT_PROBE_ARG(a) "nor" ((uint64_t) (a))
+
+#define MCASTIT_PROBE4(name, a1, a2, a3, a4)                                      \
+    __asm__ __volatile__ (MCASTIT_PROBE_ASM(name, "8@%0 8@%1 8@%2 8@%3")          \
+        :: MCASTIT_PROBE_ARG(a1), MCASTIT_PROBE_ARG(a2), MCASTIT_PROBE_ARG(a3),  \
+        MCASTIT_PROBE_ARG(a4))
+
+#define MCASTIT_PROBE5(name, a1, a2, a3, a4, a5)                                  \
+    __asm__ __volatile__ (MCASTIT_PROBE_ASM(name, "8@%0 8@%1 8@%2 8@%3 8@%4")     \
+        :: MCASTIT_PROBE_ARG(a1), MCASTIT_PROBE_ARG(a2), MCASTIT_PROBE_ARG(a3),  \
+        MCASTIT_PROBE_ARG(a4), MCASTIT_PROBE_ARG(a5))
+
+#define MCASTIT_PROBE6(name, a1, a2, a3, a4, a5, a6)                              \
+    __asm__ __volatile__ (MCASTIT_PROBE_ASM(name, "8@%0 8@%1 8@%2 8@%3 8@%4 8@%5") \
+        :: MCASTIT_PROBE_ARG(a1), MCASTIT_PROBE_ARG(a2), MCASTIT_PROBE_ARG(a3),  \
+        MCASTIT_PROBE_ARG(a4), MCASTIT_PROBE_ARG(a5), MCASTIT_PROBE_ARG(a6))
+
+#endif
+
+#endif /* MCASTIT_PROBES_H_ */
@@ -1,24 +1,331 @@
 #include "ReceiverModule.h"
+#include "GaloisField.h"
+#include "Probes.h"
+
+#define RX_BUFF_LEN       (65536)       // largest datagram, coalesced or not
+#define GRO_MIN_RCVBUF    (1024 * 1024) // room for a few coalesced datagrams
+#define RX_BATCH_LEN      (32)          // messages per recvmmsg when busy polling
+#define RX_CONTROL_LEN    (CMSG_SPACE(sizeof(int)) + CMSG_SPACE(sizeof(struct in6_pktinfo)) + \
+                           CMSG_SPACE(sizeof(struct timespec)))
+
+#define NACK_RETRY_NS     (20000000ULL) // NACK again if the range is still missing after this
+#define NACK_CHECK_NS     (1000000ULL)  // how often pending NACKs are looked at
+#define NACK_MAX_TRIES    (5)
+#define NACK_MAX_RANGES   (32)          // per NACK message
+#define NACK_MAX_PENDING  (1024)        // missing ranges per stream
+#define RX_SUBSCRIBE_NS   (5000000000ULL) // gateway subscriptions are repeated this often
+#define RX_POLL_MS        (100)         // run() checks for stop() & the statistics page this often
+#define RX_MAX_IFINDEX    (65536)       // datagrams of larger interface indexes count on their socket's
+
+#ifndef SO_BUSY_POLL
+#define SO_BUSY_POLL        (46)
+#endif
+#ifndef SO_PREFER_BUSY_POLL
+#define SO_PREFER_BUSY_POLL (69)
+#endif
 
 ReceiverModule::ReceiverModule(const vector<IfaceData>& ifaces,
     const vector<string>& mcastAddresses, int mcastPort, bool useIpV6) :
     McastModuleInterface(ifaces, mcastAddresses, mcastPort, useIpV6)
 {
   mUnicastSenderSock = -1;
+  mIsQuiet = false;
+  mUseGro = false;
+  mRecvBufferSize = 0;
+  mBusyPollUs = 0;
+  mUseNack = false;
+  mNackSock = -1;
+  mLossPercent = 0;
+  mLossSeed = getpid();
+  mInjectedLoss = 0;
+  mNacksSent = 0;
+  mLastNackCheckNs = 0;
+  memset(&mGatewayAddr, 0, sizeof(mGatewayAddr));
+  mLastSubscribeNs = 0;
+  mUseArbitration = false;
+  mShmSlots = SHM_RING_SLOTS;
+  mShmPublished = 0;
+  mPacketHandler = NULL;
+  mMaxSockD = -1;
+  memset(mArbIfindex, 0, sizeof(mArbIfindex));
+  mFecNs = 0;
+  mAcksSent = 0;
+  mLastAckCheckNs = 0;
+}
+
+void ReceiverModule::setQuiet(bool enable)
+{
+  mIsQuiet = enable;
+}
+
+void ReceiverModule::setGro(bool enable)
+{
+  mUseGro = enable;
+}
+
+void ReceiverModule::setRecvBufferSize(int size)
+{
+  mRecvBufferSize = size;
+}
+
+void ReceiverModule::setBusyPoll(int usec)
+{
+  mBusyPollUs = usec;
+}
+
+void ReceiverModule::setNack(bool enable)
+{
+  mUseNack = enable;
+}
+
+void ReceiverModule::setLoss(float percent)
+{
+  mLossPercent = percent;
+}
+
+void ReceiverModule::setAckPolicy(const AckPolicy& policy)
+{
+  mAckPolicy = policy;
+}
+
+bool ReceiverModule::setSubscribe(const string& gateway)
+{
+  memset(&mGatewayAddr, 0, sizeof(mGatewayAddr));
+  if (isIpV6())
+  {
+    struct sockaddr_in6 addr6;
+    memset(&addr6, 0, sizeof(addr6));
+    if (1 != inet_pton(AF_INET6, gateway.c_str(), &addr6.sin6_addr))
+    {
+      return false;
+    }
+    addr6.sin6_family = AF_INET6;
+    addr6.sin6_port = htons(mAckPort);
+    memcpy(&mGatewayAddr, &addr6, sizeof(addr6));
+  }
+  else
+  {
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    if (1 != inet_pton(AF_INET, gateway.c_str(), &addr.sin_addr))
+    {
+      return false;
+    }
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(mAckPort);
+    memcpy(&mGatewayAddr, &addr, sizeof(addr));
+  }
+
+  mGateway = gateway;
+  return true;
+}
+
+void ReceiverModule::setArbitrate(bool enable)
+{
+  mUseArbitration = enable;
+}
+
+void ReceiverModule::setPacketHandler(PacketHandler* handler)
+{
+  mPacketHandler = handler;
+}
+
+void ReceiverModule::setShmRing(const string& name, unsigned nSlots)
+{
+  mShmName = name;
+  mShmSlots = nSlots;
+}
+
+void ReceiverModule::setStatsPage(const string& name)
+{
+  mStatsName = name;
+}
+
+/**
+ * Bind fd to an ephemeral port on all addresses
+ * @return false on error
+ */
+static bool bindEphemeral(int fd, bool isIpV6)
+{
+  struct sockaddr_storage anyAddr;
+  memset(&anyAddr, 0, sizeof(anyAddr));
+  anyAddr.ss_family = isIpV6? AF_INET6 : AF_INET;
+  socklen_t addrLen = isIpV6? sizeof(struct sockaddr_in6) : sizeof(struct sockaddr_in);
+  return 0 <= ::bind(fd, (struct sockaddr*) &anyAddr, addrLen);
+}
+
+bool ReceiverModule::openNackSocket()
+{
+  if (-1 == (mNackSock = Common::createSocket(isIpV6())))
+  {
+    LOG_ERROR("Cannot create nack socket");
+    return false;
+  }
+
+  if (!bindEphemeral(mNackSock, isIpV6()))
+  {
+    LOG_ERROR("Cannot bind nack socket " << strerror(errno));
+    return false;
+  }
+
+  return setupRxSocket(mNackSock);
+}
+
+bool ReceiverModule::openSubscribeSockets()
+{
+  for (unsigned i = 0; i < mMcastAddresses.size(); ++i)
+  {
+    struct in6_addr group;
+    memset(&group, 0, sizeof(group));
+    inet_pton(isIpV6()? AF_INET6 : AF_INET, mMcastAddresses[i].c_str(), &group);
+    mSubscribeGroups.push_back(group);
+
+    int fd = Common::createSocket(isIpV6());
+    if (-1 == fd)
+    {
+      LOG_ERROR("Cannot create subscription socket");
+      return false;
+    }
+    mSubscribeSocks.push_back(fd);
+
+    if (!bindEphemeral(fd, isIpV6()))
+    {
+      LOG_ERROR("Cannot bind subscription socket " << strerror(errno));
+      return false;
+    }
+    if (!setupRxSocket(fd))
+    {
+      return false;
+    }
+  }
+
+  sendSubscriptions(Common::SUBSCRIBE);
+  mLastSubscribeNs = Common::getMonotonicNs();
+  return true;
+}
+
+void ReceiverModule::sendSubscriptions(Common::SubscribeType type)
+{
+  for (unsigned i = 0; i < mSubscribeSocks.size(); ++i)
+  {
+    string subscribeMsg;
+    if (!Common::encodeSubscribeMessage(type, mMcastAddresses[i], subscribeMsg) ||
+        !Common::unicastMessage(mSubscribeSocks[i], mGatewayAddr, subscribeMsg))
+    {
+      LOG_ERROR("Sending subscription of " << mMcastAddresses[i] << " to the gateway");
+    }
+  }
+}
+
+void ReceiverModule::checkSubscriptions(uint64_t nowNs)
+{
+  if (!mSubscribeSocks.empty() && nowNs - mLastSubscribeNs >= RX_SUBSCRIBE_NS)
+  {
+    mLastSubscribeNs = nowNs;
+    sendSubscriptions(Common::SUBSCRIBE);
+  }
+}
+
+bool ReceiverModule::setupRxSocket(int fd)
+{
+  // destination group of each datagram
+  int opt = 1;
+  int res;
+  if (isIpV6())
+  {
+    res = setsockopt(fd, IPPROTO_IPV6, IPV6_RECVPKTINFO, &opt, sizeof(opt));
+  }
+  else
+  {
+    res = setsockopt(fd, IPPROTO_IP, IP_PKTINFO, &opt, sizeof(opt));
+  }
+
+  if (0 > res)
+  {
+    LOG_ERROR("sockopt PKTINFO: " << strerror(errno));
+    return false;
+  }
+
+  // kernel receive time, to tell wakeup latency from network latency
+  if (0 > setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPNS, &opt, sizeof(opt)))
+  {
+    LOG_ERROR("sockopt SO_TIMESTAMPNS: " << strerror(errno));
+  }
+
+  if (mUseGro && 0 > setsockopt(fd, SOL_UDP, UDP_GRO, &opt, sizeof(opt)))
+  {
+    LOG_ERROR("sockopt UDP_GRO: " << strerror(errno) << ", receiving without it");
+  }
+
+  // joinMcastIface leaves a receive buffer that only fits a few datagrams
+  int buffSz = mRecvBufferSize;
+  if (mUseGro && buffSz < GRO_MIN_RCVBUF)
+  {
+    buffSz = GRO_MIN_RCVBUF;
+  }
+
+  if (0 < buffSz && 0 > setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &buffSz, sizeof(buffSz)))
+  {
+    LOG_ERROR("sockopt BuffSz: " << strerror(errno));
+    return false;
+  }
+
+  return true;
 }
 
 ReceiverModule::~ReceiverModule()
 {
   ::close(mUnicastSenderSock);
+  if (0 <= mNackSock)
+  {
+    ::close(mNackSock);
+  }
+
+  // the gateway stops sending right away instead of when the subscriptions expire
+  sendSubscriptions(Common::UNSUBSCRIBE);
+  for (unsigned i = 0; i < mSubscribeSocks.size(); ++i)
+  {
+    ::close(mSubscribeSocks[i]);
+  }
+
+  for (map<RxStreamKey, RxStream>::iterator it = mStreams.begin(); it != mStreams.end(); ++it)
+  {
+    delete it->second.fec;
+  }
 }
 
 bool ReceiverModule::run()
+{
+  if (!start())
+  {
+    return false;
+  }
+
+  while (poll(RX_POLL_MS))
+  {
+  }
+
+  // final counters for the monitors
+  if (mStatsPage.isOpen())
+  {
+    updateStatsPage();
+  }
+  return true;
+}
+
+bool ReceiverModule::start()
 {
   int maxSockD = -1;
 
   cout << "Listening ..."<< endl;
   for (unsigned i = 0; i < mIfaces.size(); ++i)
   {
+    // subscribed groups come from the gateway, joining them too would receive them twice
+    if (AF_UNSPEC != mGatewayAddr.ss_family)
+    {
+      break;
+    }
+
     int fd = mIfaces[i].sockFd;
     int setOk;
 
@@ -31,6 +338,11 @@ bool ReceiverModule::run()
       setOk = joinMcastIface(fd, mIfaces[i].ifaceName.c_str());
     }
 
+    if (0 == setOk && !setupRxSocket(fd))
+    {
+      setOk = -1;
+    }
+
     if (setOk != 0)
     {
       LOG_ERROR("Error " << setOk << " setting mcast for " << mIfaces[i]);
@@ -82,112 +394,1159 @@ bool ReceiverModule::run()
     LOG_ERROR("Cannot bind ack source port " << strerror(errno));
     return false;
   }
-  cout << "==============================================================" << endl;
 
-  /**
-   * Setup fdset
-   */
-  struct timeval timeout;
-  fd_set rfds;
-  char buffer[MCAST_BUFF_LEN];
-  while (1)
+  // unicast retransmissions come back to the socket the NACKs are sent from,
+  // on its own port so that they can't be taken by a sender bound to the mcast port
+  if (mUseNack)
   {
-    FD_ZERO(&rfds);
-    for (unsigned i = 0; i < mIfaces.size(); ++i)
+    if (!openNackSocket())
     {
-      FD_SET(mIfaces[i].sockFd, &rfds);
+      return false;
     }
+    maxSockD = std::max(maxSockD, mNackSock);
+  }
 
-    timeout.tv_sec = 1;
-    timeout.tv_usec = 1;
-    int numReady = select(maxSockD + 1, &rfds, NULL, NULL, &timeout);
-    if (numReady <= 0)
+  if (AF_UNSPEC != mGatewayAddr.ss_family)
+  {
+    if (!openSubscribeSockets())
     {
-      continue;
+      return false;
     }
-
-    // for each found sock fd that detected from select()
-    for (int i = 0; i < numReady; ++i)
+    for (unsigned i = 0; i < mSubscribeSocks.size(); ++i)
     {
-      // Retrieve the fd that has data
-      int fd = -1;
-      std::string recvIface = "default";
-      for (unsigned ii = 0; ii < mIfaces.size(); ++ii)
-      {
-        fd = mIfaces[ii].sockFd;
-        if (FD_ISSET(fd, &rfds))
-        {
-          FD_CLR(fd, &rfds);
-          recvIface = mIfaces[ii].ifaceName;
-          break;
-        }
-      }
+      maxSockD = std::max(maxSockD, mSubscribeSocks[i]);
+    }
+    cout << "Subscribed " << mSubscribeSocks.size() << " groups to gateway "
+        << mGateway << endl;
+  }
 
-      // get sender data
-      struct sockaddr_storage sender;
-      socklen_t sendsize = sizeof(sender);
-      bzero(&sender, sizeof(sender));
+  // the receiving interface of each datagram tells its side
+  if (mUseArbitration)
+  {
+    if (2 > mIfaces.size())
+    {
+      LOG_ERROR("A/B arbitration needs two interfaces");
+      return false;
+    }
 
-      memset(buffer, 0, sizeof(buffer));
-      int recvLen = recvfrom(fd, buffer, sizeof(buffer), 0, (struct sockaddr*) &sender, &sendsize);
-      if (0 > recvLen)
-      {
-        LOG_ERROR("recvfrom " << fd << ": " << strerror(errno));
-        continue;
-      }
+    for (unsigned side = 0; side < ARB_SIDES; ++side)
+    {
+      mArbIfindex[side] = if_nametoindex(mIfaces[side].ifaceName.c_str());
+    }
 
-      // get the sender info
-      char senderIp[INET6_ADDRSTRLEN];
-      if (sender.ss_family == AF_INET)
-      {
-        struct sockaddr_in *sender_addr = (struct sockaddr_in*) &sender;
-        inet_ntop(sender.ss_family, &sender_addr->sin_addr, senderIp, sizeof(senderIp));
-      }
-      else if (sender.ss_family == AF_INET6)
-      {
-        struct sockaddr_in6 *sender_addr = (struct sockaddr_in6*) &sender;
-        inet_ntop(sender.ss_family, &sender_addr->sin6_addr, senderIp, sizeof(senderIp));
-      }
+    mArbiters.resize(mMcastAddresses.size());
+    for (unsigned i = 0; i < mMcastAddresses.size(); ++i)
+    {
+      struct in6_addr group;
+      memset(&group, 0, sizeof(group));
+      inet_pton(isIpV6()? AF_INET6 : AF_INET, mMcastAddresses[i].c_str(), &group);
+      mArbGroups.push_back(group);
+    }
+    cout << "A/B arbitration A: " << mIfaces[0] << " B: " << mIfaces[1] << endl;
+  }
 
-      // print result message
-      string decodedMsg;
-      if (Common::decodeAckMessage(buffer, decodedMsg))
-      {
-        if (isIpV6())
-        {
-          printf("[ACK] %-40s (%s)\n", senderIp, decodedMsg.c_str());
-        }
-        else
-        {
-          printf("[ACK] %-15s (%s)\n", senderIp, decodedMsg.c_str());
-        }
-      }
-      else
-      {
-        if (isIpV6())
-        {
-          printf("%-40s -> %-15s - %s\n", senderIp, recvIface.c_str(), decodedMsg.c_str());
-        }
-        else
-        {
-          printf("%-15s -> %-15s - %s\n", senderIp, recvIface.c_str(), decodedMsg.c_str());
-        }
-      }
+  // receive buffers are allocated after this, so they are first touched on the interfaces' node
+  int numaNode = getNumaNode();
+  if (!Common::applyThreadSettings(Common::THREAD_RX, 0, numaNode))
+  {
+    LOG_ERROR("Listening with default cpu & scheduling");
+  }
 
+  // one slot per message of a batch
+  if (!mRxBuf.init(RX_BUFF_LEN, (0 < mBusyPollUs)? RX_BATCH_LEN : 1, numaNode))
+  {
+    return false;
+  }
+  cout << "Receive buffers " << mRxBuf.toString() << endl;
 
-      // Build response message
-      string responseMsg;
-      Common::encodeAckMessage(buffer, responseMsg);
-      if (!Common::unicastMessage(mUnicastSenderSock, sender, responseMsg))
-      {
-        LOG_ERROR("sending ack message to " << senderIp);
-      }
+  // created by this thread too, for the same reason
+  if (!mShmName.empty())
+  {
+    if (!mShmRing.create(mShmName, mShmSlots))
+    {
+      return false;
+    }
+    cout << "Shared memory ring " << mShmRing.toString() << endl;
+  }
 
-      // rm fd so that it's not processed again
-      FD_CLR(fd, &rfds);
-      break;
+  if (!mStatsName.empty())
+  {
+    if (!mStatsPage.create(mStatsName, STATS_ROLE_LISTENER))
+    {
+      return false;
     }
+    cout << "Statistics page " << mStatsPage.toString() << endl;
+  }
+  cout << "==============================================================" << endl;
+
+  mIfaceStats.resize(mIfaces.size());
+  mMaxSockD = std::max(maxSockD, getStopFd());
+  setupIfaceIndexes();
+  setupPollFds();
+  if (0 < mBusyPollUs)
+  {
+    setupBusyPoll();
+  }
+  else
+  {
+    mRxControl.resize(RX_CONTROL_LEN);
   }
 
   return true;
 }
+
+bool ReceiverModule::poll(int timeoutMs)
+{
+  if (mIsStopped)
+  {
+    return false;
+  }
+
+  if (0 < mBusyPollUs)
+  {
+    pollBusy(timeoutMs);
+  }
+  else
+  {
+    pollSelect(timeoutMs);
+  }
+
+  if (mStatsPage.isOpen() && mStatsPage.isUpdateDue(Common::getMonotonicNs()))
+  {
+    updateStatsPage();
+  }
+  return !mIsStopped;
+}
+
+void ReceiverModule::updateStatsPage()
+{
+  mStatsPage.beginUpdate();
+  unsigned nIfaces = std::min((unsigned) mIfaceStats.size(), (unsigned) STATS_MAX_IFACES);
+  for (unsigned i = 0; i < nIfaces; ++i)
+  {
+    StatsIface& iface = mStatsPage.getIface(i);
+    memset(&iface, 0, sizeof(iface));
+    strncpy(iface.name, mIfaces[i].getReadableName().c_str(), sizeof(iface.name) - 1);
+    iface.packets = mIfaceStats[i].packets;
+    iface.bytes = mIfaceStats[i].bytes;
+    iface.coalesced = mIfaceStats[i].coalesced;
+  }
+
+  unsigned nStreams = 0;
+  for (map<RxStreamKey, RxStream>::const_iterator it = mStreams.begin();
+      it != mStreams.end() && nStreams < STATS_MAX_STREAMS; ++it, ++nStreams)
+  {
+    const RxStream& stream = it->second;
+    StatsStream& entry = mStatsPage.getStream(nStreams);
+    memset(&entry, 0, sizeof(entry));
+    strncpy(entry.name, stream.name.c_str(), sizeof(entry.name) - 1);
+    entry.received = stream.seq.getReceived();
+    entry.lost = stream.seq.getLost();
+    entry.duplicates = stream.seq.getDuplicates();
+    entry.reordered = stream.seq.getReordered();
+    entry.bytes = stream.bytes;
+    entry.jitterNs = stream.jitter16Ns / 16;
+    entry.maxGapNs = stream.maxGapNs;
+    entry.highest = stream.seq.getHighest();
+  }
+
+  mStatsPage.endUpdate(nIfaces, nStreams, mStreams.size() - nStreams);
+}
+
+int ReceiverModule::getNumaNode() const
+{
+  int node = -1;
+  for (unsigned i = 0; i < mIfaces.size(); ++i)
+  {
+    int ifaceNode = Common::getIfaceNumaNode(mIfaces[i].ifaceName);
+    if (0 > ifaceNode)
+    {
+      continue;
+    }
+
+    if (0 <= node && node != ifaceNode)
+    {
+      LOG_WARN("Interfaces on NUMA nodes " << node << " and " << ifaceNode
+          << ", listener memory is remote for some of them");
+      return -1;
+    }
+    node = ifaceNode;
+  }
+
+  return node;
+}
+
+void ReceiverModule::pollSelect(int timeoutMs)
+{
+  /**
+   * Setup fdset
+   */
+  struct timeval timeout;
+  fd_set rfds;
+  FD_ZERO(&rfds);
+  for (unsigned p = 0; p < mPollFds.size(); ++p)
+  {
+    FD_SET(mPollFds[p], &rfds);
+  }
+  if (-1 != getStopFd())
+  {
+    FD_SET(getStopFd(), &rfds);
+  }
+
+  // wake up often enough to retry NACKs & send summary ACKs on time
+  bool hasTimers = mUseNack || !mAckPolicy.isPerPacket();
+  uint64_t timeoutUs = std::max(timeoutMs, 0) * 1000ULL;
+  timeoutUs = hasTimers? std::min(timeoutUs, (uint64_t) NACK_CHECK_NS / 1000) : timeoutUs;
+  timeout.tv_sec = timeoutUs / 1000000;
+  timeout.tv_usec = timeoutUs % 1000000;
+  int numReady = select(mMaxSockD + 1, &rfds, NULL, NULL, &timeout);
+  if (mUseNack)
+  {
+    checkNacks(Common::getRealtimeNs());
+  }
+  if (!mAckPolicy.isPerPacket())
+  {
+    checkAcks(Common::getRealtimeNs());
+  }
+  checkSubscriptions(Common::getMonotonicNs());
+
+  if (numReady <= 0)
+  {
+    return;
+  }
+
+  // for each found sock fd that detected from select()
+  for (unsigned p = 0; p < mPollFds.size(); ++p)
+  {
+    if (FD_ISSET(mPollFds[p], &rfds))
+    {
+      receiveFrom(mPollFds[p], mPollIfaces[p], mPollGroups[p]);
+    }
+  }
+}
+
+void ReceiverModule::setupIfaceIndexes()
+{
+  // the first interface of a name wins, unnamed ones have no index
+  for (unsigned i = 0; i < mIfaces.size(); ++i)
+  {
+    unsigned ifindex = mIfaces[i].ifaceName.empty()? 0 :
+        if_nametoindex(mIfaces[i].ifaceName.c_str());
+    if (0 == ifindex || RX_MAX_IFINDEX <= ifindex)
+    {
+      continue;
+    }
+
+    if (mIfaceByIndex.size() <= ifindex)
+    {
+      mIfaceByIndex.resize(ifindex + 1, -1);
+    }
+    if (-1 == mIfaceByIndex[ifindex])
+    {
+      mIfaceByIndex[ifindex] = i;
+    }
+  }
+}
+
+unsigned ReceiverModule::getIfaceIdx(int ifindex, unsigned sockIfaceIdx) const
+{
+  return (0 < ifindex && (unsigned) ifindex < mIfaceByIndex.size() &&
+      -1 != mIfaceByIndex[ifindex])? mIfaceByIndex[ifindex] : sockIfaceIdx;
+}
+
+void ReceiverModule::setupPollFds()
+{
+  // interfaces may share the same socket, wait on each socket once
+  for (unsigned i = 0; i <= mIfaces.size() + mSubscribeSocks.size(); ++i)
+  {
+    // the datagrams of the NACK socket & subscribed groups go to the first interface
+    // unless they come in through one of the others
+    bool isNackSock = (i == mIfaces.size());
+    bool isSubscribeSock = (i > mIfaces.size());
+    if (isNackSock && !mUseNack)
+    {
+      continue;
+    }
+
+    unsigned subscribeIdx = i - mIfaces.size() - 1;
+    int fd = isSubscribeSock? mSubscribeSocks[subscribeIdx] :
+        isNackSock? mNackSock : mIfaces[i].sockFd;
+    if (mPollFds.end() != std::find(mPollFds.begin(), mPollFds.end(), fd))
+    {
+      continue;
+    }
+    mPollFds.push_back(fd);
+    mPollIfaces.push_back((isNackSock || isSubscribeSock)? 0 : i);
+    mPollGroups.push_back(isSubscribeSock? &mSubscribeGroups[subscribeIdx] : NULL);
+  }
+}
+
+void ReceiverModule::setupBusyPoll()
+{
+  for (unsigned p = 0; p < mPollFds.size(); ++p)
+  {
+    int fd = mPollFds[p];
+    int flags = fcntl(fd, F_GETFL, 0);
+    if (0 > flags || 0 > fcntl(fd, F_SETFL, flags | O_NONBLOCK))
+    {
+      LOG_ERROR("Cannot make socket " << fd << " non blocking: " << strerror(errno));
+    }
+
+    // both need CAP_NET_ADMIN to go above net.core.busy_poll, spinning works without them
+    int opt = mBusyPollUs;
+    if (0 > setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &opt, sizeof(opt)))
+    {
+      LOG_ERROR("sockopt SO_BUSY_POLL: " << strerror(errno));
+    }
+
+    opt = 1;
+    if (0 > setsockopt(fd, SOL_SOCKET, SO_PREFER_BUSY_POLL, &opt, sizeof(opt)))
+    {
+      LOG_ERROR("sockopt SO_PREFER_BUSY_POLL: " << strerror(errno));
+    }
+  }
+
+  // control buffer & sender address per batch slot, data goes to the arena slots
+  mRxControl.resize(RX_BATCH_LEN * RX_CONTROL_LEN);
+  mRxSenders.resize(RX_BATCH_LEN);
+  mRxIovs.resize(RX_BATCH_LEN);
+  mRxMsgs.resize(RX_BATCH_LEN);
+  for (unsigned i = 0; i < RX_BATCH_LEN; ++i)
+  {
+    mRxIovs[i].iov_base = mRxBuf.getSlot(i);
+    mRxIovs[i].iov_len = RX_BUFF_LEN;
+  }
+}
+
+void ReceiverModule::pollBusy(int timeoutMs)
+{
+  vector<struct mmsghdr>& msgs = mRxMsgs;
+
+  // spin until something is received or for timeoutMs
+  uint64_t endNs = Common::getMonotonicNs() + std::max(timeoutMs, 0) * 1000000ULL;
+  bool hasReceived = false;
+  while (!hasReceived && !mIsStopped)
+  {
+    if (mUseNack)
+    {
+      checkNacks(Common::getRealtimeNs());
+    }
+    if (!mAckPolicy.isPerPacket())
+    {
+      checkAcks(Common::getRealtimeNs());
+    }
+    checkSubscriptions(Common::getMonotonicNs());
+
+    for (unsigned p = 0; p < mPollFds.size(); ++p)
+    {
+      // lengths are updated by each call
+      for (unsigned i = 0; i < RX_BATCH_LEN; ++i)
+      {
+        struct msghdr& msg = msgs[i].msg_hdr;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_name = &mRxSenders[i];
+        msg.msg_namelen = sizeof(mRxSenders[i]);
+        msg.msg_iov = &mRxIovs[i];
+        msg.msg_iovlen = 1;
+        msg.msg_control = &mRxControl[i * RX_CONTROL_LEN];
+        msg.msg_controllen = RX_CONTROL_LEN;
+      }
+
+      unsigned ifaceIdx = mPollIfaces[p];
+      int numMsgs = recvmmsg(mPollFds[p], &msgs[0], RX_BATCH_LEN, MSG_DONTWAIT, NULL);
+      if (0 >= numMsgs)
+      {
+        if (0 > numMsgs && EAGAIN != errno && EWOULDBLOCK != errno && EINTR != errno)
+        {
+          LOG_ERROR("recvmmsg " << mPollFds[p] << ": " << strerror(errno));
+        }
+        continue;
+      }
+
+      hasReceived = true;
+      uint64_t appTimeNs = Common::getRealtimeNs();
+      for (int i = 0; i < numMsgs; ++i)
+      {
+        handleMessage(mPollFds[p], ifaceIdx, msgs[i].msg_hdr, msgs[i].msg_len, appTimeNs,
+            mPollGroups[p]);
+      }
+    }
+
+    if (Common::getMonotonicNs() >= endNs)
+    {
+      break;
+    }
+  }
+}
+
+void ReceiverModule::receiveFrom(int fd, unsigned ifaceIdx, const struct in6_addr* subscribedGroup)
+{
+  // get sender data
+  struct sockaddr_storage sender;
+  bzero(&sender, sizeof(sender));
+
+  struct iovec iov;
+  iov.iov_base = mRxBuf.getSlot(0);
+  iov.iov_len = RX_BUFF_LEN;
+
+  struct msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_name = &sender;
+  msg.msg_namelen = sizeof(sender);
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = &mRxControl[0];
+  msg.msg_controllen = mRxControl.size();
+
+  int recvLen = recvmsg(fd, &msg, 0);
+  if (0 > recvLen)
+  {
+    LOG_ERROR("recvfrom " << fd << ": " << strerror(errno));
+    return;
+  }
+
+  handleMessage(fd, ifaceIdx, msg, recvLen, Common::getRealtimeNs(), subscribedGroup);
+}
+
+void ReceiverModule::handleMessage(int fd, unsigned ifaceIdx, struct msghdr& msg, unsigned len,
+    uint64_t appTimeNs, const struct in6_addr* subscribedGroup)
+{
+  // destination group, interface, gso size & kernel timestamp from control messages
+  RxMeta meta;
+  memset(&meta, 0, sizeof(meta));
+  meta.fd = fd;
+  int gsoSize = 0;
+  for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg))
+  {
+    if (SOL_UDP == cmsg->cmsg_level && UDP_GRO == cmsg->cmsg_type)
+    {
+      memcpy(&gsoSize, CMSG_DATA(cmsg), sizeof(gsoSize));
+    }
+    else if (SOL_SOCKET == cmsg->cmsg_level && SCM_TIMESTAMPNS == cmsg->cmsg_type)
+    {
+      struct timespec ts;
+      memcpy(&ts, CMSG_DATA(cmsg), sizeof(ts));
+      meta.kernelNs = ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+    }
+    else if (IPPROTO_IP == cmsg->cmsg_level && IP_PKTINFO == cmsg->cmsg_type)
+    {
+      struct in_pktinfo pktInfo;
+      memcpy(&pktInfo, CMSG_DATA(cmsg), sizeof(pktInfo));
+      memcpy(&meta.group, &pktInfo.ipi_addr, sizeof(pktInfo.ipi_addr));
+      meta.ifindex = pktInfo.ipi_ifindex;
+    }
+    else if (IPPROTO_IPV6 == cmsg->cmsg_level && IPV6_PKTINFO == cmsg->cmsg_type)
+    {
+      struct in6_pktinfo pktInfo;
+      memcpy(&pktInfo, CMSG_DATA(cmsg), sizeof(pktInfo));
+      meta.group = pktInfo.ipi6_addr;
+      meta.ifindex = pktInfo.ipi6_ifindex;
+    }
+  }
+  MCASTIT_PROBE5(rx_packet, fd, meta.ifindex, len, meta.kernelNs, appTimeNs);
+
+  // one socket may receive for all interfaces, the kernel tells which one it was
+  ifaceIdx = getIfaceIdx(meta.ifindex, ifaceIdx);
+
+  // unicast by the gateway, to the socket of its group
+  if (subscribedGroup)
+  {
+    meta.group = *subscribedGroup;
+  }
+
+  if (0 < meta.kernelNs && meta.kernelNs <= appTimeNs)
+  {
+    mKernelLatency.add(appTimeNs - meta.kernelNs);
+  }
+
+  // a coalesced datagram is split back in datagrams of gso size, the last one may be shorter
+  unsigned segSize = (0 < gsoSize && (unsigned) gsoSize < len)? gsoSize : len;
+  if (segSize < len)
+  {
+    ++mIfaceStats[ifaceIdx].coalesced;
+  }
+
+  // interfaces share one socket, the side of an A/B pair comes from the receiving interface
+  meta.arbSide = -1;
+  if (mUseArbitration && !subscribedGroup)
+  {
+    meta.arbSide = (meta.ifindex == mArbIfindex[0])? 0 : (meta.ifindex == mArbIfindex[1])? 1 : -1;
+  }
+
+  const char* data = (const char*) msg.msg_iov[0].iov_base;
+  struct sockaddr_storage& sender = *(struct sockaddr_storage*) msg.msg_name;
+  for (unsigned offset = 0; offset < len; offset += segSize)
+  {
+    processDatagram(ifaceIdx, data + offset, std::min(segSize, len - offset), sender, meta,
+        appTimeNs);
+  }
+}
+
+void ReceiverModule::processDatagram(unsigned ifaceIdx, const char* data, unsigned len,
+    struct sockaddr_storage& sender, const RxMeta& meta, uint64_t appTimeNs)
+{
+  const struct in6_addr& group = meta.group;
+  RxIfaceStats& ifaceStats = mIfaceStats[ifaceIdx];
+  ++ifaceStats.packets;
+  ifaceStats.bytes += len;
+
+  // get the sender info
+  char senderIp[INET6_ADDRSTRLEN];
+  if (sender.ss_family == AF_INET)
+  {
+    struct sockaddr_in *sender_addr = (struct sockaddr_in*) &sender;
+    inet_ntop(sender.ss_family, &sender_addr->sin_addr, senderIp, sizeof(senderIp));
+  }
+  else if (sender.ss_family == AF_INET6)
+  {
+    struct sockaddr_in6 *sender_addr = (struct sockaddr_in6*) &sender;
+    inet_ntop(sender.ss_family, &sender_addr->sin6_addr, senderIp, sizeof(senderIp));
+  }
+
+  // message may not be null terminated when sent with fixed size
+  const string message(data, strnlen(data, len));
+
+  // print result message
+  string decodedMsg;
+  if (Common::decodeAckMessage(message, decodedMsg))
+  {
+    if (!mIsQuiet)
+    {
+      if (isIpV6())
+      {
+        printf("[ACK] %-40s (%s)\n", senderIp, decodedMsg.c_str());
+      }
+      else
+      {
+        printf("[ACK] %-15s (%s)\n", senderIp, decodedMsg.c_str());
+      }
+    }
+
+    // don't ack an ack
+    return;
+  }
+
+  // answers of the gateway to the subscriptions
+  Common::SubscribeType subscribeType;
+  string subscribedGroup;
+  if (Common::decodeSubscribeMessage(message, subscribeType, subscribedGroup))
+  {
+    if (!mIsQuiet)
+    {
+      printf("[GW] %-15s (%s)\n", senderIp, message.c_str());
+    }
+    return;
+  }
+
+  // induced loss of data datagrams, as if the network dropped them
+  if (0 < mLossPercent && rand_r(&mLossSeed) < mLossPercent / 100.0 * RAND_MAX)
+  {
+    ++mInjectedLoss;
+    return;
+  }
+
+  RxStreamKey key;
+  memset(&key, 0, sizeof(key));
+  memcpy(&key.source, &sender, sizeof(sender));
+  key.group = group;
+
+  // parity of a block of the stream, never acked, both sides of an A/B pair feed one stream
+  FecHeader fecHeader;
+  if (Common::decodeFecHeader(data, len, fecHeader))
+  {
+    if (0 <= meta.arbSide && findArbiter(group))
+    {
+      memset(&key.source, 0, sizeof(key.source));
+    }
+    handleParity(key, fecHeader, data + FEC_HEADER_LEN, len - FEC_HEADER_LEN, appTimeNs);
+    return;
+  }
+
+  // sequenced test message, one stream per sender & group
+  bool isSummarized = false;
+  uint32_t seq = 0;
+  uint64_t sendTimeNs = 0;
+  bool isSequenced = Common::decodeMessageHeader(data, len, seq, sendTimeNs);
+  MCASTIT_PROBE6(rx_decoded, meta.fd, meta.ifindex, isSequenced? seq : 0, len,
+      isSequenced? sendTimeNs : 0, meta.kernelNs);
+  if (isSequenced)
+  {
+    // the copy from the other side of an A/B pair is dropped, both sides make one stream
+    FeedArbiter* arbiter = (0 <= meta.arbSide)? findArbiter(group) : NULL;
+    if (arbiter)
+    {
+      uint64_t arrivalNs = meta.kernelNs? meta.kernelNs : appTimeNs;
+      if (FeedArbiter::ARB_DELIVER != arbiter->arbitrate(meta.arbSide, seq, arrivalNs))
+      {
+        return;
+      }
+      memset(&key.source, 0, sizeof(key.source));
+    }
+
+    // unicast retransmissions belong to the stream that asked for them
+    bool isMcast = isIpV6()? IN6_IS_ADDR_MULTICAST(&group) :
+        IN_MULTICAST(ntohl(*(const uint32_t*) &group));
+    RxStream* repairStream = (mUseNack && !isMcast)? findRepairStream(sender, seq) : NULL;
+    RxStream& stream = repairStream? *repairStream : mStreams[key];
+    if (!repairStream)
+    {
+      // an A/B pair has a sender per side, answer the one that delivered last
+      memcpy(&stream.source, &sender, sizeof(sender));
+    }
+    if (stream.name.empty())
+    {
+      char groupIp[INET6_ADDRSTRLEN];
+      inet_ntop(isIpV6()? AF_INET6 : AF_INET, &group, groupIp, sizeof(groupIp));
+      stream.group = groupIp;
+      stream.name = string(arbiter? "A/B" : senderIp) + " -> " + groupIp;
+    }
+
+    trackDatagram(stream, sender, seq, len, appTimeNs);
+    if (!repairStream)
+    {
+      trackTiming(stream, seq, sendTimeNs, meta.kernelNs? meta.kernelNs : appTimeNs);
+    }
+    if (seq == stream.seq.getHighest())
+    {
+      stream.echoSendNs = sendTimeNs;
+      stream.echoRxNs = appTimeNs;
+    }
+    if (stream.fec)
+    {
+      uint64_t startNs = Common::getMonotonicNs();
+      unsigned nRecovered = stream.fec->addData(seq, data, len);
+      mFecNs += Common::getMonotonicNs() - startNs;
+      trackRecovered(stream, sender, nRecovered, appTimeNs);
+    }
+
+    // one way latency, only meaningful when sender & listener clocks are synchronized
+    if (0 < sendTimeNs && sendTimeNs <= appTimeNs)
+    {
+      mSendLatency.add(appTimeNs - sendTimeNs);
+    }
+
+    // acknowledged by the stream summary, messages without sequence always have their own ACK
+    if (!mAckPolicy.isPerPacket())
+    {
+      isSummarized = true;
+      if (mAckPolicy.onDatagram(stream.ack, appTimeNs))
+      {
+        sendAckSummary(stream, sender);
+      }
+    }
+  }
+
+  // local consumers get every delivered datagram, the dropped copies of A/B pairs excluded
+  if (mShmRing.isOpen())
+  {
+    publishShm(data, len, sender, meta, isSequenced? seq : 0);
+  }
+  if (mPacketHandler)
+  {
+    RxPacket packet = {data, len, &sender, &meta, ifaceIdx, isSequenced? seq : 0, sendTimeNs,
+        appTimeNs};
+    mPacketHandler->onPacket(packet);
+  }
+
+  if (!mIsQuiet)
+  {
+    const string& recvIface = mIfaces[ifaceIdx].ifaceName;
+    if (isIpV6())
+    {
+      printf("%-40s -> %-15s - %s\n", senderIp, recvIface.c_str(), decodedMsg.c_str());
+    }
+    else
+    {
+      printf("%-15s -> %-15s - %s\n", senderIp, recvIface.c_str(), decodedMsg.c_str());
+    }
+  }
+
+  if (isSummarized)
+  {
+    return;
+  }
+
+  // Build response message
+  string responseMsg;
+  Common::encodeAckMessage(message, responseMsg);
+  if (!Common::unicastMessage(mUnicastSenderSock, sender, responseMsg))
+  {
+    LOG_ERROR("sending ack message to " << senderIp);
+    return;
+  }
+  MCASTIT_PROBE4(ack_sent, mUnicastSenderSock, meta.ifindex, isSequenced? seq : 0,
+      responseMsg.size());
+  ++mAcksSent;
+}
+
+void ReceiverModule::trackDatagram(RxStream& stream, const struct sockaddr_storage& sender,
+    uint32_t seq, unsigned len, uint64_t nowNs)
+{
+  stream.bytes += len;
+
+  uint32_t prevHighest = stream.seq.getHighest();
+  SequenceTracker::SeqResult result = stream.seq.track(seq);
+  if (SequenceTracker::SEQ_DUPLICATE != result && SequenceTracker::SEQ_TOO_OLD != result)
+  {
+    stream.uniqueBytes += len;
+    stream.firstNs = stream.firstNs? stream.firstNs : nowNs;
+    stream.lastNs = nowNs;
+  }
+
+  if (mUseNack)
+  {
+    updateNacks(stream, result, seq, prevHighest, nowNs);
+    if (SequenceTracker::SEQ_GAP == result)
+    {
+      sendNacks(stream, sender, nowNs);
+    }
+  }
+}
+
+void ReceiverModule::publishShm(const char* data, unsigned len,
+    const struct sockaddr_storage& sender, const RxMeta& meta, uint32_t msgSeq)
+{
+  ShmSlotHeader slot;
+  memset(&slot, 0, sizeof(slot));
+  slot.kernelNs = meta.kernelNs;
+  slot.len = len;
+  slot.msgSeq = msgSeq;
+  slot.ifindex = meta.ifindex;
+  slot.family = sender.ss_family;
+  if (AF_INET6 == sender.ss_family)
+  {
+    const struct sockaddr_in6* addr6 = (const struct sockaddr_in6*) &sender;
+    memcpy(slot.source, &addr6->sin6_addr, sizeof(addr6->sin6_addr));
+    slot.sourcePort = ntohs(addr6->sin6_port);
+  }
+  else
+  {
+    const struct sockaddr_in* addr = (const struct sockaddr_in*) &sender;
+    memcpy(slot.source, &addr->sin_addr, sizeof(addr->sin_addr));
+    slot.sourcePort = ntohs(addr->sin_port);
+  }
+  memcpy(slot.group, &meta.group, sizeof(slot.group));
+
+  mShmRing.publish(slot, data, len);
+  ++mShmPublished;
+}
+
+FeedArbiter* ReceiverModule::findArbiter(const struct in6_addr& group)
+{
+  for (unsigned i = 0; i < mArbGroups.size(); ++i)
+  {
+    if (0 == memcmp(&mArbGroups[i], &group, sizeof(group)))
+    {
+      return &mArbiters[i];
+    }
+  }
+  return NULL;
+}
+
+void ReceiverModule::trackTiming(RxStream& stream, uint32_t seq, uint64_t sendTimeNs,
+    uint64_t arrivalNs)
+{
+  // coalesced datagrams share one receive time, a late repair could go back in time
+  if (arrivalNs < stream.lastArrivalNs)
+  {
+    return;
+  }
+
+  if (stream.lastArrivalNs)
+  {
+    uint64_t gapNs = arrivalNs - stream.lastArrivalNs;
+    stream.interArrival.add(gapNs);
+    if (gapNs > stream.maxGapNs)
+    {
+      stream.maxGapNs = gapNs;
+      stream.maxGapSeq = seq;
+    }
+  }
+  stream.lastArrivalNs = arrivalNs;
+
+  // RFC 3550 A.8: J += (|D| - J) / 16, the clock offset of the sender cancels out in D
+  if (0 == sendTimeNs)
+  {
+    return;
+  }
+
+  int64_t transitNs = (int64_t) (arrivalNs - sendTimeNs);
+  if (stream.lastTransitNs)
+  {
+    int64_t deltaNs = transitNs - stream.lastTransitNs;
+    uint64_t absDeltaNs = (0 > deltaNs)? -deltaNs : deltaNs;
+    stream.jitter16Ns += absDeltaNs - ((stream.jitter16Ns + 8) >> 4);
+    stream.maxJitterNs = std::max(stream.maxJitterNs, stream.jitter16Ns >> 4);
+  }
+  stream.lastTransitNs = transitNs;
+}
+
+void ReceiverModule::handleParity(const RxStreamKey& key, const FecHeader& header,
+    const char* payload, unsigned len, uint64_t nowNs)
+{
+  map<RxStreamKey, RxStream>::iterator it = mStreams.find(key);
+  if (mStreams.end() == it)
+  {
+    // can't be told from a sender restart before the stream's first data datagram
+    return;
+  }
+
+  RxStream& stream = it->second;
+  if (!stream.fec || !stream.fec->accepts(header, len))
+  {
+    delete stream.fec;
+    stream.fec = new FecDecoder();
+    if (!stream.fec->init(header, len))
+    {
+      LOG_ERROR("Bad FEC parameters from " << stream.name);
+      delete stream.fec;
+      stream.fec = NULL;
+      return;
+    }
+    LOG_DEBUG("FEC " << header.nData << "+" << header.nParity << " for " << stream.name);
+  }
+
+  uint64_t startNs = Common::getMonotonicNs();
+  unsigned nRecovered = stream.fec->addParity(header, payload, len);
+  mFecNs += Common::getMonotonicNs() - startNs;
+  trackRecovered(stream, stream.source, nRecovered, nowNs);
+}
+
+void ReceiverModule::trackRecovered(RxStream& stream, const struct sockaddr_storage& sender,
+    unsigned nRecovered, uint64_t nowNs)
+{
+  for (unsigned i = 0; i < nRecovered; ++i)
+  {
+    uint32_t seq;
+    uint64_t sendTimeNs;
+    const char* data = stream.fec->getRecovered(i);
+    if (Common::decodeMessageHeader(data, stream.fec->getSegLen(), seq, sendTimeNs))
+    {
+      trackDatagram(stream, sender, seq, stream.fec->getSegLen(), nowNs);
+    }
+  }
+}
+
+RxStream* ReceiverModule::findRepairStream(const struct sockaddr_storage& sender, uint32_t seq)
+{
+  RxStream* senderStream = NULL;
+  for (map<RxStreamKey, RxStream>::iterator it = mStreams.begin(); it != mStreams.end(); ++it)
+  {
+    if (0 != memcmp(&it->second.source, &sender, sizeof(sender)))
+    {
+      continue;
+    }
+
+    senderStream = senderStream? senderStream : &it->second;
+    const vector<NackRange>& nacks = it->second.nacks;
+    for (unsigned i = 0; i < nacks.size(); ++i)
+    {
+      if ((int32_t)(seq - nacks[i].range.first) >= 0 && (int32_t)(nacks[i].range.last - seq) >= 0)
+      {
+        return &it->second;
+      }
+    }
+  }
+
+  // late repair of a datagram that arrived or was rebuilt meanwhile, a duplicate
+  return senderStream;
+}
+
+void ReceiverModule::updateNacks(RxStream& stream, SequenceTracker::SeqResult result,
+    uint32_t seq, uint32_t prevHighest, uint64_t nowNs)
+{
+  vector<NackRange>& nacks = stream.nacks;
+  if (SequenceTracker::SEQ_GAP == result)
+  {
+    // only the sequences still inside the tracker window can be told apart when they come
+    uint32_t first = prevHighest + 1;
+    if (seq - first >= SEQ_WINDOW_LEN)
+    {
+      stream.unrecovered += seq - first - (SEQ_WINDOW_LEN - 1);
+      first = seq - (SEQ_WINDOW_LEN - 1);
+    }
+
+    if (nacks.size() >= NACK_MAX_PENDING)
+    {
+      const SeqRange& oldest = nacks.front().range;
+      stream.unrecovered += oldest.last - oldest.first + 1;
+      nacks.erase(nacks.begin());
+    }
+
+    NackRange nack;
+    nack.range = SeqRange(first, seq - 1);
+    nack.detectNs = nowNs;
+    nack.lastNackNs = 0;
+    nack.nNacks = 0;
+    nacks.push_back(nack);
+    return;
+  }
+
+  if (SequenceTracker::SEQ_FILL != result)
+  {
+    return;
+  }
+
+  // take seq out of the range waiting for it
+  for (unsigned i = 0; i < nacks.size(); ++i)
+  {
+    SeqRange& range = nacks[i].range;
+    if ((int32_t)(seq - range.first) < 0 || (int32_t)(range.last - seq) < 0)
+    {
+      continue;
+    }
+
+    ++stream.recovered;
+    mRecoveryLatency.add(nowNs - nacks[i].detectNs);
+    if (range.first == range.last)
+    {
+      nacks.erase(nacks.begin() + i);
+    }
+    else if (seq == range.first)
+    {
+      ++range.first;
+    }
+    else if (seq == range.last)
+    {
+      --range.last;
+    }
+    else
+    {
+      NackRange upper = nacks[i];
+      upper.range.first = seq + 1;
+      range.last = seq - 1;
+      nacks.push_back(upper);
+    }
+    return;
+  }
+}
+
+void ReceiverModule::sendNacks(RxStream& stream, const struct sockaddr_storage& source,
+    uint64_t nowNs)
+{
+  vector<SeqRange> due;
+  vector<NackRange>& nacks = stream.nacks;
+  for (unsigned i = 0; i < nacks.size(); )
+  {
+    NackRange& nack = nacks[i];
+
+    // behind the tracker window a retransmission couldn't be told from a duplicate
+    bool tooOld = (int32_t)(stream.seq.getHighest() - nack.range.first) >= SEQ_WINDOW_LEN;
+    if (tooOld || (nack.nNacks >= NACK_MAX_TRIES && nowNs - nack.lastNackNs >= NACK_RETRY_NS))
+    {
+      stream.unrecovered += nack.range.last - nack.range.first + 1;
+      nacks.erase(nacks.begin() + i);
+      continue;
+    }
+
+    if (due.size() < NACK_MAX_RANGES && nack.nNacks < NACK_MAX_TRIES &&
+        (0 == nack.lastNackNs || nowNs - nack.lastNackNs >= NACK_RETRY_NS))
+    {
+      due.push_back(nack.range);
+      nack.lastNackNs = nowNs;
+      ++nack.nNacks;
+    }
+    ++i;
+  }
+
+  string nackMsg;
+  if (!Common::encodeNackMessage(stream.group, due, nackMsg))
+  {
+    return;
+  }
+
+  struct sockaddr_storage target;
+  memcpy(&target, &source, sizeof(target));
+  if (!Common::unicastMessage(mNackSock, target, nackMsg))
+  {
+    LOG_ERROR("sending nack message for " << stream.name);
+    return;
+  }
+  ++mNacksSent;
+}
+
+void ReceiverModule::checkNacks(uint64_t nowNs)
+{
+  if (nowNs - mLastNackCheckNs < NACK_CHECK_NS)
+  {
+    return;
+  }
+  mLastNackCheckNs = nowNs;
+
+  for (map<RxStreamKey, RxStream>::iterator it = mStreams.begin(); it != mStreams.end(); ++it)
+  {
+    if (it->second.nacks.size())
+    {
+      sendNacks(it->second, it->second.source, nowNs);
+    }
+  }
+}
+
+void ReceiverModule::sendAckSummary(RxStream& stream, const struct sockaddr_storage& source)
+{
+  mAckPolicy.onSent(stream.ack);
+
+  AckSummary summary;
+  summary.group = stream.group;
+  summary.received = stream.seq.getReceived();
+  summary.lost = stream.seq.getLost();
+  summary.highest = stream.seq.getHighest();
+  summary.echoNs = stream.echoSendNs;
+  summary.holdNs = stream.echoSendNs? Common::getRealtimeNs() - stream.echoRxNs : 0;
+
+  string ackMsg;
+  Common::encodeAckSummary(summary, ackMsg);
+  struct sockaddr_storage target;
+  memcpy(&target, &source, sizeof(target));
+  if (!Common::unicastMessage(mUnicastSenderSock, target, ackMsg))
+  {
+    LOG_ERROR("sending summary ack for " << stream.name);
+    return;
+  }
+  MCASTIT_PROBE4(ack_sent, mUnicastSenderSock, 0, summary.highest, ackMsg.size());
+  ++mAcksSent;
+}
+
+void ReceiverModule::checkAcks(uint64_t nowNs)
+{
+  if (nowNs - mLastAckCheckNs < ACK_CHECK_NS)
+  {
+    return;
+  }
+  mLastAckCheckNs = nowNs;
+
+  for (map<RxStreamKey, RxStream>::iterator it = mStreams.begin(); it != mStreams.end(); ++it)
+  {
+    if (mAckPolicy.isDue(it->second.ack, nowNs))
+    {
+      sendAckSummary(it->second, it->second.source);
+    }
+  }
+}
+
+void ReceiverModule::printStats() const
+{
+  if (mIfaceStats.empty())
+  {
+    return;
+  }
+
+  cout << "==============================================================" << endl;
+  for (unsigned i = 0; i < mIfaces.size(); ++i)
+  {
+    const RxIfaceStats& stats = mIfaceStats[i];
+    printf("[RX] %-30s packets: %llu bytes: %llu coalesced receives: %llu\n",
+        mIfaces[i].getReadableName().c_str(), (unsigned long long) stats.packets,
+        (unsigned long long) stats.bytes, (unsigned long long) stats.coalesced);
+  }
+
+  uint64_t fecRecovered = 0, fecDecodeNs = 0;
+  for (map<RxStreamKey, RxStream>::const_iterator it = mStreams.begin(); it != mStreams.end(); ++it)
+  {
+    const RxStream& stream = it->second;
+    const SequenceTracker& seq = stream.seq;
+    printf("[RX] %-40s received: %llu lost: %llu duplicates: %llu reordered: %llu highest: %u\n",
+        stream.name.c_str(), (unsigned long long) seq.getReceived(),
+        (unsigned long long) seq.getLost(), (unsigned long long) seq.getDuplicates(),
+        (unsigned long long) seq.getReordered(), seq.getHighest());
+
+    if (stream.lastTransitNs)
+    {
+      printf("[RX] %-40s jitter: %.2f us max jitter: %.2f us max gap: %.2f us before seq %u\n", "",
+          (stream.jitter16Ns >> 4) / 1e3, stream.maxJitterNs / 1e3, stream.maxGapNs / 1e3,
+          stream.maxGapSeq);
+    }
+    if (stream.interArrival.getCount())
+    {
+      printf("[RX] %-40s inter-arrival: %s\n", "", stream.interArrival.toString(1000, "us").c_str());
+    }
+
+    if (mUseNack)
+    {
+      double elapsed = (stream.lastNs - stream.firstNs) / 1e9;
+      printf("[RX] %-40s recovered: %llu unrecovered: %llu pending: %u goodput: %.3f Mbit/s\n", "",
+          (unsigned long long) stream.recovered, (unsigned long long) stream.unrecovered,
+          (unsigned) stream.nacks.size(), (elapsed > 0)? stream.uniqueBytes * 8 / elapsed / 1e6 : 0);
+    }
+
+    if (stream.fec)
+    {
+      printf("[RX] %-40s fec recovered: %llu unrecoverable: %llu\n", "",
+          (unsigned long long) stream.fec->getRecoveredCount(),
+          (unsigned long long) stream.fec->getUnrecoverable());
+      fecRecovered += stream.fec->getRecoveredCount();
+      fecDecodeNs += stream.fec->getDecodeNs();
+    }
+  }
+
+  // decoding alone, then with the copies of every protected datagram
+  if (fecRecovered)
+  {
+    printf("[RX] fec cost (%s): decode: %.2f us/recovered, buffering & decode: %.2f us/recovered\n",
+        GaloisField::getKernelName(GaloisField::getKernel()), fecDecodeNs / 1e3 / fecRecovered,
+        mFecNs / 1e3 / fecRecovered);
+  }
+
+  for (unsigned i = 0; i < mArbiters.size(); ++i)
+  {
+    const FeedArbiter& arbiter = mArbiters[i];
+    if (!arbiter.getDelivered())
+    {
+      continue;
+    }
+
+    const string name = "A/B " + mMcastAddresses[i];
+    printf("[RX] %-40s delivered: %llu won by A: %llu won by B: %llu duplicates dropped: %llu "
+        "repeats: %llu too old: %llu\n", name.c_str(), (unsigned long long) arbiter.getDelivered(),
+        (unsigned long long) arbiter.getWins(0), (unsigned long long) arbiter.getWins(1),
+        (unsigned long long) arbiter.getDuplicates(), (unsigned long long) arbiter.getRepeats(),
+        (unsigned long long) arbiter.getTooOld());
+    // the window may still get the missing copies
+    unsigned pendingGaps, pendingOnlyOn[ARB_SIDES];
+    arbiter.getPending(pendingGaps, pendingOnlyOn);
+    printf("[RX] %-40s only on A: %llu (+%u in window) only on B: %llu (+%u in window) "
+        "gaps neither side filled: %llu (+%u in window)\n", "",
+        (unsigned long long) arbiter.getOnlyOn(0), pendingOnlyOn[0],
+        (unsigned long long) arbiter.getOnlyOn(1), pendingOnlyOn[1],
+        (unsigned long long) arbiter.getGaps(), pendingGaps);
+    for (unsigned side = 0; side < ARB_SIDES; ++side)
+    {
+      if (arbiter.getLead(side).getCount())
+      {
+        printf("[RX] %-40s %c %s lead: %s\n", "", "AB"[side], mIfaces[side].ifaceName.c_str(),
+            arbiter.getLead(side).toString(1000, "us").c_str());
+      }
+    }
+  }
+
+  if (mShmRing.isOpen())
+  {
+    printf("[RX] shared memory ring %s: published: %llu\n", mShmRing.toString().c_str(),
+        (unsigned long long) mShmPublished);
+  }
+
+  printf("[RX] acks sent: %llu (%s)\n", (unsigned long long) mAcksSent,
+      mAckPolicy.toString().c_str());
+  if (mInjectedLoss)
+  {
+    printf("[RX] induced loss: %llu datagrams dropped\n", (unsigned long long) mInjectedLoss);
+  }
+  if (mUseNack)
+  {
+    printf("[RX] nacks sent: %llu\n", (unsigned long long) mNacksSent);
+    if (mRecoveryLatency.getCount())
+    {
+      printf("[RX] recovery latency: %s\n", mRecoveryLatency.toString(1000, "us").c_str());
+    }
+  }
+
+  const char* mode = (0 < mBusyPollUs)? "busy poll" : "select";
+  if (mKernelLatency.getCount())
+  {
+    printf("[RX] kernel -> app latency, %s: %s\n", mode, mKernelLatency.toString(1000, "us").c_str());
+  }
+  if (mSendLatency.getCount())
+  {
+    printf("[RX] sender -> app latency, %s: %s\n", mode, mSendLatency.toString(1000, "us").c_str());
+  }
+}
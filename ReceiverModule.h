@@ -2,6 +2,132 @@
 #define MCAST_TOOL_MCASTRECEIVERMODULE_H_
 
 #include "McastModuleInterface.h"
+#include "SequenceTracker.h"
+#include "Histogram.h"
+#include "PacketArena.h"
+#include "FecCodec.h"
+#include "AckPolicy.h"
+#include "FeedArbiter.h"
+#include "ShmRing.h"
+#include "StatsPage.h"
+
+/**
+ * Receive counters of one interface
+ */
+struct RxIfaceStats
+{
+  uint64_t packets;     // original datagrams, coalesced ones are counted one by one
+  uint64_t bytes;
+  uint64_t coalesced;   // receives that carried more than one datagram
+
+  RxIfaceStats(): packets(0), bytes(0), coalesced(0) {}
+};
+
+/**
+ * Where & when a datagram was received, from the control messages of its receive
+ */
+struct RxMeta
+{
+  struct in6_addr group;     // destination, ipv4 group in the first 4 bytes
+  uint64_t        kernelNs;  // kernel receive time, 0 if unknown
+  int             fd;        // socket it was received on
+  int             ifindex;   // receiving interface, 0 if unknown
+  int             arbSide;   // side of an A/B pair, -1 if not arbitrated
+};
+
+/**
+ * One datagram handed to a PacketHandler, without copy: the pointers are into the
+ * receive buffers and only valid during the call
+ */
+struct RxPacket
+{
+  const char*                    data;
+  unsigned                       len;
+  const struct sockaddr_storage* source;
+  const RxMeta*                  meta;
+  unsigned                       ifaceIdx;   // in the interfaces of the module
+  uint32_t                       seq;        // sequence of the test message header, 0 if none
+  uint64_t                       sendTimeNs; // sender timestamp of the header, 0 if none
+  uint64_t                       appTimeNs;  // realtime when the receive call returned
+};
+
+/**
+ * Consumer of the datagrams of a listener, called on the receiving thread
+ */
+class PacketHandler
+{
+public:
+  virtual ~PacketHandler() {}
+
+  /**
+   * Every delivered datagram, after loss injection & A/B arbitration, ACKs &
+   * gateway answers excluded. Should return quickly, the next datagrams wait for it
+   */
+  virtual void onPacket(const RxPacket& packet) = 0;
+};
+
+/**
+ * Sender and destination group of a received stream
+ */
+struct RxStreamKey
+{
+  struct sockaddr_storage source;
+  struct in6_addr         group; // ipv4 group in the first 4 bytes
+
+  bool operator<(const RxStreamKey& other) const
+  {
+    return memcmp(this, &other, sizeof(*this)) < 0;
+  }
+};
+
+/**
+ * Missing sequences of a stream waiting for retransmission
+ */
+struct NackRange
+{
+  SeqRange range;
+  uint64_t detectNs;    // realtime when the gap was seen
+  uint64_t lastNackNs;  // realtime of the last NACK, 0 if not sent yet
+  unsigned nNacks;
+};
+
+/**
+ * One sequenced stream as seen by this listener
+ */
+struct RxStream
+{
+  string          name;  // "source -> group"
+  string          group;
+  struct sockaddr_storage source;    // sender of the last multicast datagram, gets NACKs & ACKs
+  uint64_t        bytes;
+  uint64_t        uniqueBytes;       // first copy of each datagram only
+  uint64_t        firstNs, lastNs;   // realtime of the first & last new datagram
+  SequenceTracker seq;
+
+  vector<NackRange> nacks;
+  uint64_t        recovered;         // gaps filled after a NACK
+  uint64_t        unrecovered;       // given up after NACK_MAX_TRIES or out of window
+
+  FecDecoder*     fec;               // NULL until a parity datagram is received, owned by the module
+  AckTimer        ack;               // datagrams not covered by a summary ACK yet
+  uint64_t        echoSendNs, echoRxNs; // send & arrival time of the highest sequence, for summaries
+
+  // arrival timing of the multicast datagrams, kernel receive time when known
+  int64_t         lastTransitNs;     // arrival - send time of the previous datagram
+  uint64_t        lastArrivalNs;     // 0 before the first datagram
+  uint64_t        jitter16Ns;        // RFC 3550 interarrival jitter, scaled by 16
+  uint64_t        maxJitterNs;
+  uint64_t        maxGapNs;          // longest time without datagram
+  uint32_t        maxGapSeq;         // sequence that ended it
+  Histogram       interArrival;
+
+  RxStream(): bytes(0), uniqueBytes(0), firstNs(0), lastNs(0), recovered(0), unrecovered(0),
+      fec(NULL), echoSendNs(0), echoRxNs(0), lastTransitNs(0), lastArrivalNs(0), jitter16Ns(0),
+      maxJitterNs(0), maxGapNs(0), maxGapSeq(0)
+  {
+    memset(&source, 0, sizeof(source));
+  }
+};
 
 /**
  * Listener for multicast messages
@@ -13,9 +139,327 @@ public:
        const vector<string>& mcastAddresses, int mcastPort, bool useIpV6);
    virtual ~ReceiverModule();
    bool run();
+   void printStats() const;
+
+   /**
+    * Join the groups & open the sockets, the datagrams are received by poll()
+    * on the calling thread
+    * @return false on error
+    */
+   bool start();
+
+   /**
+    * Receive & process what arrives within timeoutMs, send the NACKs & ACKs that are due
+    * @return false after stop()
+    */
+   bool poll(int timeoutMs);
+
+   /**
+    * Don't print a line per received message, only the statistics
+    * @param enable
+    */
+   void setQuiet(bool enable = true);
+
+   /**
+    * Let the kernel coalesce datagrams of the same flow with UDP_GRO,
+    * they are split again by their gso size before being processed
+    * @param enable
+    */
+   void setGro(bool enable = true);
+
+   /**
+    * Socket receive buffer size
+    * @param size - bytes, 0 to keep the default
+    */
+   void setRecvBufferSize(int size);
+
+   /**
+    * Spin on non-blocking recvmmsg instead of sleeping in select,
+    * with SO_BUSY_POLL so the kernel polls the device queue too
+    * @param usec - SO_BUSY_POLL budget, 0 to use select
+    */
+   void setBusyPoll(int usec);
+
+   /**
+    * Ask the sender for missing sequences with unicast NACKs like ACKs,
+    * from a socket that also receives the retransmissions unicast by the sender
+    * @param enable
+    */
+   void setNack(bool enable = true);
+
+   /**
+    * Drop this share of received data datagrams before processing them, to test recovery
+    * @param percent - 0 to 100
+    */
+   void setLoss(float percent);
+
+   /**
+    * When sequenced datagrams are acknowledged, one ACK per datagram by default
+    * @param policy
+    */
+   void setAckPolicy(const AckPolicy& policy);
+
+   /**
+    * Get the groups by unicast from a gateway instead of joining them,
+    * one socket per group subscribes on the gateway ACK port & receives the group
+    * @param gateway - ip of the gateway
+    * @return false if gateway isn't a valid address
+    */
+   bool setSubscribe(const string& gateway);
+
+   /**
+    * A/B arbitration: the first two interfaces carry the same sequenced groups,
+    * the first copy of each sequence is processed & the other one dropped
+    * @param enable
+    */
+   void setArbitrate(bool enable = true);
+
+   /**
+    * Hand every delivered datagram to handler, without copy
+    * @param handler - not owned, NULL to stop
+    */
+   void setPacketHandler(PacketHandler* handler);
+
+   /**
+    * Publish every processed datagram & its metadata in a shared memory ring
+    * for local readers, see ShmRing.h for the layout
+    * @param name   - /dev/shm/{name}, replaced if it exists
+    * @param nSlots - power of 2
+    */
+   void setShmRing(const string& name, unsigned nSlots);
+
+   /**
+    * Keep the interface & stream counters in a shared memory page for monitors,
+    * updated every STATS_UPDATE_NS from the receiving loop, see StatsPage.h
+    * @param name - /dev/shm/{name}, replaced if it exists
+    */
+   void setStatsPage(const string& name);
+
+private:
+   /**
+    * Socket on an ephemeral port to send NACKs & receive unicast retransmissions
+    * @return true on success
+    */
+   bool openNackSocket();
+
+   /**
+    * One socket on an ephemeral port per group, subscribed to the gateway
+    * @return true on success
+    */
+   bool openSubscribeSockets();
+
+   /**
+    * Send a subscription message for every group to the gateway
+    */
+   void sendSubscriptions(Common::SubscribeType type);
+
+   /**
+    * Renew the subscriptions every RX_SUBSCRIBE_NS
+    */
+   void checkSubscriptions(uint64_t nowNs);
+
+   /**
+    * Enable control messages and offloads on the joined sockets
+    * @return true on success
+    */
+   bool setupRxSocket(int fd);
+
+   /**
+    * @return NUMA node shared by all interfaces, -1 if unknown or if they are on different nodes
+    */
+   int getNumaNode() const;
+
+   /**
+    * Wait for messages with select, once
+    */
+   void pollSelect(int timeoutMs);
+
+   /**
+    * Map the kernel index of each named interface to its position in mIfaces
+    */
+   void setupIfaceIndexes();
+
+   /**
+    * @return position in mIfaces of the interface with index ifindex,
+    *         sockIfaceIdx if it isn't one of them
+    */
+   unsigned getIfaceIdx(int ifindex, unsigned sockIfaceIdx) const;
+
+   /**
+    * List every socket to wait on once, with the interface & group it receives for
+    */
+   void setupPollFds();
+
+   /**
+    * Make the listener sockets non blocking & busy polled, set up the batch buffers
+    */
+   void setupBusyPoll();
+
+   /**
+    * Spin on every listener socket with recvmmsg until a batch is received or for timeoutMs
+    */
+   void pollBusy(int timeoutMs);
+
+   /**
+    * Read one (possibly coalesced) datagram from fd, counted on its receiving interface,
+    * else on ifaceIdx
+    */
+   void receiveFrom(int fd, unsigned ifaceIdx, const struct in6_addr* subscribedGroup = NULL);
+
+   /**
+    * Handle one received message: control messages, latency & split in datagrams
+    * @param fd         - socket it was received on
+    * @param msg        - filled by recvmsg or recvmmsg
+    * @param len        - bytes received
+    * @param appTimeNs  - realtime when the receive call returned
+    * @param subscribedGroup - group of a gateway subscription socket, NULL to use the destination
+    */
+   void handleMessage(int fd, unsigned ifaceIdx, struct msghdr& msg, unsigned len,
+       uint64_t appTimeNs, const struct in6_addr* subscribedGroup = NULL);
+
+   /**
+    * Handle one original datagram: statistics, print out & ack
+    */
+   void processDatagram(unsigned ifaceIdx, const char* data, unsigned len,
+       struct sockaddr_storage& sender, const RxMeta& meta, uint64_t appTimeNs);
+
+   /**
+    * @return arbiter of a group, NULL if the group isn't arbitrated
+    */
+   FeedArbiter* findArbiter(const struct in6_addr& group);
+
+   /**
+    * Append one datagram to the shared memory ring
+    * @param msgSeq - sequence of the test message header, 0 if none
+    */
+   void publishShm(const char* data, unsigned len, const struct sockaddr_storage& sender,
+       const RxMeta& meta, uint32_t msgSeq);
+
+   /**
+    * Copy the interface & stream counters to the statistics page
+    */
+   void updateStatsPage();
+
+   /**
+    * Account for one new or repeated sequence of stream, NACKs included
+    */
+   void trackDatagram(RxStream& stream, const struct sockaddr_storage& sender, uint32_t seq,
+       unsigned len, uint64_t nowNs);
+
+   /**
+    * Jitter, inter-arrival & gap of a stream, constant time per datagram
+    * @param sendTimeNs - sender timestamp, 0 if the datagram has none
+    * @param arrivalNs  - kernel receive time, else when the receive call returned
+    */
+   void trackTiming(RxStream& stream, uint32_t seq, uint64_t sendTimeNs, uint64_t arrivalNs);
+
+   /**
+    * Keep a parity datagram for its stream, creating the decoder on the first one
+    * @param payload - parity bytes after the header
+    */
+   void handleParity(const RxStreamKey& key, const FecHeader& header, const char* payload,
+       unsigned len, uint64_t nowNs);
+
+   /**
+    * Track the datagrams the stream decoder just recovered
+    */
+   void trackRecovered(RxStream& stream, const struct sockaddr_storage& sender, unsigned nRecovered,
+       uint64_t nowNs);
+
+   /**
+    * Stream of a unicast retransmission, the one from sender waiting for seq,
+    * else the first one from sender
+    * @return NULL if none
+    */
+   RxStream* findRepairStream(const struct sockaddr_storage& sender, uint32_t seq);
+
+   /**
+    * Account for the missing or recovered sequences of a stream after track()
+    * @param prevHighest - highest sequence before seq was tracked
+    */
+   void updateNacks(RxStream& stream, SequenceTracker::SeqResult result, uint32_t seq,
+       uint32_t prevHighest, uint64_t nowNs);
+
+   /**
+    * Send the NACKs that are due for one stream, give up on the ranges tried too often
+    */
+   void sendNacks(RxStream& stream, const struct sockaddr_storage& source, uint64_t nowNs);
+
+   /**
+    * Retry the NACKs of all streams, at most once per NACK_CHECK_NS
+    */
+   void checkNacks(uint64_t nowNs);
+
+   /**
+    * Send the summary ACK of one stream to its sender
+    */
+   void sendAckSummary(RxStream& stream, const struct sockaddr_storage& source);
+
+   /**
+    * Send the summary ACKs whose timer expired, at most once per ACK_CHECK_NS
+    */
+   void checkAcks(uint64_t nowNs);
 
 private:
    int mUnicastSenderSock;
+   bool mIsQuiet;
+   bool mUseGro;
+   int mRecvBufferSize;
+   int mBusyPollUs;
+   PacketArena mRxBuf;       // one slot per message of a receive batch
+   vector<char> mRxControl;
+   int mMaxSockD;
+
+   // listened sockets, each once, & the batch of busy polling
+   vector<int> mPollFds;
+   vector<unsigned> mPollIfaces;               // interface of the datagrams without a known ifindex
+   vector<const struct in6_addr*> mPollGroups; // subscribed group of the socket, else NULL
+   vector<struct sockaddr_storage> mRxSenders;
+   vector<struct iovec> mRxIovs;
+   vector<struct mmsghdr> mRxMsgs;
+
+   PacketHandler* mPacketHandler;
+
+   bool mUseNack;
+   int mNackSock;
+   float mLossPercent;
+   unsigned mLossSeed;
+   uint64_t mInjectedLoss;
+   uint64_t mNacksSent;
+   uint64_t mLastNackCheckNs;
+   Histogram mRecoveryLatency; // gap detection to retransmission received
+
+   string mGateway;
+   struct sockaddr_storage mGatewayAddr; // family is 0 without gateway
+   vector<int> mSubscribeSocks;         // same order as mMcastAddresses
+   vector<struct in6_addr> mSubscribeGroups;
+   uint64_t mLastSubscribeNs;
+
+   bool mUseArbitration;
+   int mArbIfindex[ARB_SIDES];         // interface index of A & B
+   vector<struct in6_addr> mArbGroups; // same order as mMcastAddresses
+   vector<FeedArbiter> mArbiters;
+
+   string mShmName;
+   unsigned mShmSlots;
+   ShmRing mShmRing;
+   uint64_t mShmPublished;
+
+   string mStatsName;
+   StatsPage mStatsPage;
+
+   uint64_t mFecNs;          // buffering & decoding of FEC protected streams
+
+   AckPolicy mAckPolicy;
+   uint64_t mAcksSent;       // per packet & summary ones
+   uint64_t mLastAckCheckNs;
+
+   Histogram mSendLatency;   // sender timestamp to application
+   Histogram mKernelLatency; // kernel receive timestamp to application
+
+   vector<RxIfaceStats> mIfaceStats; // same order as mIfaces
+   vector<int> mIfaceByIndex;        // position in mIfaces by kernel ifindex, -1 if not listened on
+   map<RxStreamKey, RxStream> mStreams;
 };
 
 #endif /* MCAST_TOOL_MCASTRECEIVERMODULE_H_ */
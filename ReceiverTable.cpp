@@ -0,0 +1,110 @@
+#include "ReceiverTable.h"
+
+ReceiverKey::ReceiverKey(const struct sockaddr_storage& source, uint32_t pid, const string& group)
+{
+  memset(this, 0, sizeof(*this));
+  family = source.ss_family;
+  this->pid = pid;
+  if (AF_INET6 == family)
+  {
+    const struct sockaddr_in6* addr6 = (const struct sockaddr_in6*) &source;
+    address = addr6->sin6_addr;
+    port = ntohs(addr6->sin6_port);
+  }
+  else
+  {
+    const struct sockaddr_in* addr = (const struct sockaddr_in*) &source;
+    memcpy(&address, &addr->sin_addr, sizeof(addr->sin_addr));
+    port = ntohs(addr->sin_port);
+  }
+
+  if (!group.empty() && 1 != inet_pton(family, group.c_str(), &this->group))
+  {
+    memset(&this->group, 0, sizeof(this->group));
+  }
+}
+
+string ReceiverKey::toString() const
+{
+  char addressIp[INET6_ADDRSTRLEN], groupIp[INET6_ADDRSTRLEN];
+  inet_ntop(family, &address, addressIp, sizeof(addressIp));
+
+  std::stringstream stm;
+  stm << addressIp << ":" << port << " pid " << pid;
+  struct in6_addr none;
+  memset(&none, 0, sizeof(none));
+  if (0 != memcmp(&group, &none, sizeof(none)))
+  {
+    inet_ntop(family, &group, groupIp, sizeof(groupIp));
+    stm << " " << groupIp;
+  }
+  return stm.str();
+}
+
+ReceiverTable::ReceiverTable()
+{
+  Slot empty;
+  empty.hash = 0;
+  empty.idx = 0;
+  mSlots.assign(RXTABLE_MIN_SLOTS, empty);
+}
+
+uint32_t ReceiverTable::hashOf(const ReceiverKey& key)
+{
+  // FNV-1a over the whole key, it has no padding
+  const uint8_t* bytes = (const uint8_t*) &key;
+  uint32_t hash = 2166136261U;
+  for (unsigned i = 0; i < sizeof(key); ++i)
+  {
+    hash = (hash ^ bytes[i]) * 16777619U;
+  }
+  return hash;
+}
+
+ReceiverEntry& ReceiverTable::get(const ReceiverKey& key)
+{
+  uint32_t hash = hashOf(key);
+  unsigned mask = mSlots.size() - 1;
+  unsigned i = hash & mask;
+  for (; 0 != mSlots[i].idx; i = (i + 1) & mask)
+  {
+    if (hash == mSlots[i].hash && key == mEntries[mSlots[i].idx - 1].key)
+    {
+      return mEntries[mSlots[i].idx - 1];
+    }
+  }
+
+  // new listener, taking the free slot that ended the probe unless the slots have to grow first
+  mEntries.push_back(ReceiverEntry());
+  mEntries.back().key = key;
+  if (mEntries.size() > mSlots.size() * RXTABLE_MAX_LOAD)
+  {
+    grow();
+    return mEntries.back();
+  }
+
+  mSlots[i].hash = hash;
+  mSlots[i].idx = mEntries.size();
+  return mEntries.back();
+}
+
+void ReceiverTable::grow()
+{
+  Slot empty;
+  empty.hash = 0;
+  empty.idx = 0;
+  mSlots.assign(mSlots.size() * 2, empty);
+
+  unsigned mask = mSlots.size() - 1;
+  for (unsigned e = 0; e < mEntries.size(); ++e)
+  {
+    uint32_t hash = hashOf(mEntries[e].key);
+    unsigned i = hash & mask;
+    while (0 != mSlots[i].idx)
+    {
+      i = (i + 1) & mask;
+    }
+    mSlots[i].hash = hash;
+    mSlots[i].idx = e + 1;
+  }
+}
@@ -0,0 +1,93 @@
+#ifndef MCASTIT_RECEIVERTABLE_H_
+#define MCASTIT_RECEIVERTABLE_H_
+
+#include "Common.h"
+#include "Histogram.h"
+
+#define RXTABLE_MIN_SLOTS (64)    // power of two
+#define RXTABLE_MAX_LOAD  (0.75)  // slots are doubled above this
+
+/**
+ * Listener as seen by a sender: where its ACKs come from & which process sent them,
+ * plus the group for summary ACKs, which are per stream
+ */
+struct ReceiverKey
+{
+  struct in6_addr address;  // ipv4 address in the first 4 bytes
+  struct in6_addr group;    // all zero for per packet ACKs
+  uint16_t        family;
+  uint16_t        port;     // host order
+  uint32_t        pid;
+
+  ReceiverKey() { memset(this, 0, sizeof(*this)); }
+  ReceiverKey(const struct sockaddr_storage& source, uint32_t pid, const string& group);
+
+  bool operator==(const ReceiverKey& other) const
+  {
+    return 0 == memcmp(this, &other, sizeof(*this));
+  }
+
+  /**
+   * @return "address:port pid group"
+   */
+  string toString() const;
+};
+
+/**
+ * What a sender knows about one listener
+ */
+struct ReceiverEntry
+{
+  ReceiverKey key;
+  uint64_t    acks;         // ACK messages
+  uint64_t    acked;        // datagrams acknowledged
+  uint64_t    lost;         // reported by summaries, below the highest sequence acked for per packet ACKs
+  uint32_t    highest;
+  uint64_t    firstSeenNs, lastSeenNs;  // monotonic
+  Histogram   rtt;          // send time to ACK, minus the time summaries were held
+
+  ReceiverEntry(): acks(0), acked(0), lost(0), highest(0), firstSeenNs(0), lastSeenNs(0) {}
+};
+
+/**
+ * Open addressing hash table of the listeners that ACK a sender
+ *
+ * Entries are stored densely in arrival order, the slot array only holds the hash
+ * and index of an entry and is probed linearly, so that a lookup touches a couple
+ * of 8 byte slots and the entry. Slots are doubled before they are 3/4 full,
+ * entries are never removed
+ */
+class ReceiverTable
+{
+public:
+  ReceiverTable();
+
+  /**
+   * @return entry of key, added with zero counters if it's new
+   */
+  ReceiverEntry& get(const ReceiverKey& key);
+
+  unsigned size() const { return mEntries.size(); }
+  unsigned getSlotCount() const { return mSlots.size(); }
+  const ReceiverEntry& operator[](unsigned idx) const { return mEntries[idx]; }
+
+private:
+  struct Slot
+  {
+    uint32_t hash;
+    uint32_t idx;   // entry index + 1, 0 if the slot is free
+  };
+
+  static uint32_t hashOf(const ReceiverKey& key);
+
+  /**
+   * Double the slots & place every entry again
+   */
+  void grow();
+
+private:
+  vector<Slot>          mSlots;
+  vector<ReceiverEntry> mEntries;
+};
+
+#endif /* MCASTIT_RECEIVERTABLE_H_ */
@@ -0,0 +1,399 @@
+#include "RelayModule.h"
+
+#define RELAY_BUFF_LEN    (65536)       // largest datagram
+#define RELAY_CONTROL_LEN (CMSG_SPACE(sizeof(struct in6_pktinfo)) + \
+                           CMSG_SPACE(sizeof(struct timespec)) + CMSG_SPACE(sizeof(uint32_t)))
+#define RELAY_STOP_CHECK_MS (1000)      // a blocked receive returns this often to check for stop()
+
+RelayModule::RelayModule(const vector<IfaceData>& ifaces, const vector<string>& mcastAddresses,
+    int mcastPort, int nLoopbackIfaces, bool useIpV6) :
+    McastModuleInterface(ifaces, mcastAddresses, mcastPort, useIpV6),
+    mLoopbackCount(nLoopbackIfaces), mRecvBufferSize(0), mReceived(0), mBytes(0), mBatches(0),
+    mUnrouted(0), mKernelDrops(0), mStartNs(0)
+{
+}
+
+RelayModule::~RelayModule()
+{
+}
+
+void RelayModule::setRecvBufferSize(int size)
+{
+  mRecvBufferSize = size;
+}
+
+bool RelayModule::addMapping(const string& spec)
+{
+  size_t equal = spec.find('=');
+  if (string::npos == equal)
+  {
+    return false;
+  }
+
+  const string group = spec.substr(0, equal);
+  const string dest = spec.substr(equal + 1);
+  struct in6_addr addr;
+  struct sockaddr_storage destAddr;
+  if (1 != inet_pton(isIpV6()? AF_INET6 : AF_INET, group.c_str(), &addr) ||
+      !Common::parseDestination(dest, mMcastPort, isIpV6(), destAddr))
+  {
+    return false;
+  }
+
+  if (mMcastAddresses.end() == std::find(mMcastAddresses.begin(), mMcastAddresses.end(), group))
+  {
+    mMcastAddresses.push_back(group);
+  }
+  mMappings[group] = dest;
+  return true;
+}
+
+bool RelayModule::init()
+{
+  if (mIfaces.size() < 2)
+  {
+    LOG_ERROR("Relay needs an ingress interface followed by at least one egress interface");
+    return false;
+  }
+
+  /*
+   * Ingress: the groups of the first interface only, with their destination & receive time
+   */
+  const IfaceData& ingress = mIfaces[0];
+  int fd = ingress.sockFd;
+  int res = isIpV6()? joinMcastIfaceV6(fd, ingress.ifaceName.c_str()) :
+      joinMcastIface(fd, ingress.ifaceName.c_str());
+  if (0 != res)
+  {
+    LOG_ERROR("Joining groups on " << ingress);
+    return false;
+  }
+
+  // only the groups joined by this socket, not the ones relayed back on the same host
+  int opt = 0;
+  res = isIpV6()? setsockopt(fd, IPPROTO_IPV6, IPV6_MULTICAST_ALL, &opt, sizeof(opt)) :
+      setsockopt(fd, IPPROTO_IP, IP_MULTICAST_ALL, &opt, sizeof(opt));
+  if (0 > res)
+  {
+    LOG_ERROR("sockopt MULTICAST_ALL: " << strerror(errno) << ", other groups of the host may be relayed");
+  }
+
+  opt = 1;
+  res = isIpV6()? setsockopt(fd, IPPROTO_IPV6, IPV6_RECVPKTINFO, &opt, sizeof(opt)) :
+      setsockopt(fd, IPPROTO_IP, IP_PKTINFO, &opt, sizeof(opt));
+  if (0 > res)
+  {
+    LOG_ERROR("sockopt PKTINFO: " << strerror(errno));
+    return false;
+  }
+
+  if (0 > setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPNS, &opt, sizeof(opt)))
+  {
+    LOG_ERROR("sockopt SO_TIMESTAMPNS: " << strerror(errno) << ", no forwarding latency");
+  }
+
+  if (0 > setsockopt(fd, SOL_SOCKET, SO_RXQ_OVFL, &opt, sizeof(opt)))
+  {
+    LOG_ERROR("sockopt SO_RXQ_OVFL: " << strerror(errno) << ", no kernel drop count");
+  }
+
+  struct timeval timeout;
+  timeout.tv_sec = RELAY_STOP_CHECK_MS / 1000;
+  timeout.tv_usec = (RELAY_STOP_CHECK_MS % 1000) * 1000;
+  if (0 > setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)))
+  {
+    LOG_ERROR("sockopt SO_RCVTIMEO: " << strerror(errno));
+  }
+
+  // joinMcastIface leaves a receive buffer that only fits a few datagrams
+  int buffSz = (0 < mRecvBufferSize)? mRecvBufferSize : RELAY_RCVBUF;
+  if (0 > setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &buffSz, sizeof(buffSz)))
+  {
+    LOG_ERROR("sockopt BuffSz: " << strerror(errno));
+  }
+  cout << "Ingress " << ingress << " [OK]" << endl;
+
+  /*
+   * Egress: multicast out of each of the other interfaces
+   */
+  for (unsigned i = 1; i < mIfaces.size(); ++i)
+  {
+    bool isLoopBack = mLoopbackCount < 0 || (int) i - 1 < mLoopbackCount;
+    bool setMcastOk = isIpV6()?
+        associateMcastV6WithIfaceName(mIfaces[i].sockFd, mIfaces[i].ifaceName.c_str(), isLoopBack) :
+        associateMcastWithIfaceName(mIfaces[i].sockFd, mIfaces[i].ifaceName.c_str(), isLoopBack);
+    if (!setMcastOk)
+    {
+      LOG_ERROR("Setting mcast for " << mIfaces[i]);
+      return false;
+    }
+
+    RelayEgress egress;
+    egress.ifaceIdx = i;
+    egress.label = mIfaces[i].toString();
+    mEgress.push_back(egress);
+    cout << "Egress " << mIfaces[i] << " [OK]" << endl;
+  }
+
+  /*
+   * One route per group, refusing the ones that would come back to the ingress
+   */
+  for (unsigned i = 0; i < mMcastAddresses.size(); ++i)
+  {
+    RelayRoute route;
+    route.group = mMcastAddresses[i];
+    memset(&route.groupAddr, 0, sizeof(route.groupAddr));
+    inet_pton(isIpV6()? AF_INET6 : AF_INET, route.group.c_str(), &route.groupAddr);
+
+    map<string, string>::const_iterator mapping = mMappings.find(route.group);
+    const string dest = (mMappings.end() != mapping)? mapping->second : route.group;
+    if (!Common::parseDestination(dest, mMcastPort, isIpV6(), route.dest))
+    {
+      LOG_ERROR("Invalid destination " << dest << " for " << route.group);
+      return false;
+    }
+
+    const struct sockaddr_in* dest4 = (const struct sockaddr_in*) &route.dest;
+    const struct sockaddr_in6* dest6 = (const struct sockaddr_in6*) &route.dest;
+    const void* destAddr = isIpV6()? (const void*) &dest6->sin6_addr : (const void*) &dest4->sin_addr;
+    int destPort = ntohs(isIpV6()? dest6->sin6_port : dest4->sin_port);
+    bool isSameGroup = 0 == memcmp(destAddr, &route.groupAddr, isIpV6()? 16 : 4);
+
+    char destIp[INET6_ADDRSTRLEN];
+    inet_ntop(isIpV6()? AF_INET6 : AF_INET, destAddr, destIp, sizeof(destIp));
+    std::stringstream destName;
+    destName << destIp << ":" << destPort;
+    route.destName = destName.str();
+    for (unsigned e = 0; e < mEgress.size(); ++e)
+    {
+      if (isSameGroup && destPort == mMcastPort &&
+          mIfaces[mEgress[e].ifaceIdx].ifaceName == ingress.ifaceName)
+      {
+        LOG_ERROR(route.group << " would be relayed back to itself on " << ingress.getReadableName()
+            << ", map it to another group or port");
+        return false;
+      }
+    }
+
+    cout << "Route " << route.group << ":" << mMcastPort << " -> " << route.destName << endl;
+    mRoutes.push_back(route);
+  }
+
+  /*
+   * Batch buffers: datagrams are received in the arena & sent from it
+   */
+  int numaNode = Common::getIfaceNumaNode(ingress.ifaceName);
+  if (!Common::applyThreadSettings(Common::THREAD_RX, 0, numaNode))
+  {
+    LOG_ERROR("Relaying with default cpu & scheduling");
+  }
+
+  if (!mRxBuf.init(RELAY_BUFF_LEN, RELAY_BATCH_LEN, numaNode))
+  {
+    return false;
+  }
+  mRxControl.resize(RELAY_BATCH_LEN * RELAY_CONTROL_LEN);
+  mRxMsgs.resize(RELAY_BATCH_LEN);
+  mRxIovs.resize(RELAY_BATCH_LEN);
+  mTxMsgs.resize(RELAY_BATCH_LEN);
+  mTxIovs.resize(RELAY_BATCH_LEN);
+  for (unsigned i = 0; i < RELAY_BATCH_LEN; ++i)
+  {
+    mRxIovs[i].iov_base = mRxBuf.getSlot(i);
+    mRxIovs[i].iov_len = RELAY_BUFF_LEN;
+    memset(&mTxMsgs[i], 0, sizeof(mTxMsgs[i]));
+    mTxMsgs[i].msg_hdr.msg_iov = &mTxIovs[i];
+    mTxMsgs[i].msg_hdr.msg_iovlen = 1;
+  }
+  cout << "Relay buffers " << mRxBuf.toString() << endl;
+
+  return true;
+}
+
+bool RelayModule::run()
+{
+  if (!init())
+  {
+    return false;
+  }
+  cout << "==============================================================" << endl;
+
+  runRelay();
+  return true;
+}
+
+RelayRoute* RelayModule::findRoute(const struct in6_addr& group)
+{
+  for (unsigned i = 0; i < mRoutes.size(); ++i)
+  {
+    if (0 == memcmp(&mRoutes[i].groupAddr, &group, sizeof(group)))
+    {
+      return &mRoutes[i];
+    }
+  }
+  return NULL;
+}
+
+void RelayModule::runRelay()
+{
+  int fd = mIfaces[0].sockFd;
+  uint64_t kernelNs[RELAY_BATCH_LEN];
+  mStartNs = Common::getMonotonicNs();
+
+  while (!mIsStopped)
+  {
+    // lengths are updated by each call
+    for (unsigned i = 0; i < RELAY_BATCH_LEN; ++i)
+    {
+      struct msghdr& msg = mRxMsgs[i].msg_hdr;
+      memset(&msg, 0, sizeof(msg));
+      msg.msg_iov = &mRxIovs[i];
+      msg.msg_iovlen = 1;
+      msg.msg_control = &mRxControl[i * RELAY_CONTROL_LEN];
+      msg.msg_controllen = RELAY_CONTROL_LEN;
+    }
+
+    // block for the first datagram, then take what is queued
+    int numMsgs = recvmmsg(fd, &mRxMsgs[0], RELAY_BATCH_LEN, MSG_WAITFORONE, NULL);
+    if (0 >= numMsgs)
+    {
+      if (0 > numMsgs && EINTR != errno && EAGAIN != errno && EWOULDBLOCK != errno)
+      {
+        LOG_ERROR("recvmmsg " << fd << ": " << strerror(errno));
+      }
+      continue;
+    }
+    ++mBatches;
+
+    unsigned nTx = 0;
+    for (int i = 0; i < numMsgs; ++i)
+    {
+      struct msghdr& msg = mRxMsgs[i].msg_hdr;
+      struct in6_addr group;
+      memset(&group, 0, sizeof(group));
+      kernelNs[nTx] = 0;
+      for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg))
+      {
+        if (SOL_SOCKET == cmsg->cmsg_level && SCM_TIMESTAMPNS == cmsg->cmsg_type)
+        {
+          struct timespec ts;
+          memcpy(&ts, CMSG_DATA(cmsg), sizeof(ts));
+          kernelNs[nTx] = ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+        }
+        else if (SOL_SOCKET == cmsg->cmsg_level && SO_RXQ_OVFL == cmsg->cmsg_type)
+        {
+          memcpy(&mKernelDrops, CMSG_DATA(cmsg), sizeof(mKernelDrops));
+        }
+        else if (IPPROTO_IP == cmsg->cmsg_level && IP_PKTINFO == cmsg->cmsg_type)
+        {
+          struct in_pktinfo pktInfo;
+          memcpy(&pktInfo, CMSG_DATA(cmsg), sizeof(pktInfo));
+          memcpy(&group, &pktInfo.ipi_addr, sizeof(pktInfo.ipi_addr));
+        }
+        else if (IPPROTO_IPV6 == cmsg->cmsg_level && IPV6_PKTINFO == cmsg->cmsg_type)
+        {
+          struct in6_pktinfo pktInfo;
+          memcpy(&pktInfo, CMSG_DATA(cmsg), sizeof(pktInfo));
+          group = pktInfo.ipi6_addr;
+        }
+      }
+
+      ++mReceived;
+      mBytes += mRxMsgs[i].msg_len;
+      RelayRoute* route = findRoute(group);
+      if (!route)
+      {
+        ++mUnrouted;
+        continue;
+      }
+      ++route->forwarded;
+
+      // the send points at the receive slot
+      mTxIovs[nTx].iov_base = mRxIovs[i].iov_base;
+      mTxIovs[nTx].iov_len = mRxMsgs[i].msg_len;
+      mTxMsgs[nTx].msg_hdr.msg_name = &route->dest;
+      mTxMsgs[nTx].msg_hdr.msg_namelen = isIpV6()? sizeof(struct sockaddr_in6) : sizeof(struct sockaddr_in);
+      ++nTx;
+    }
+
+    for (unsigned e = 0; nTx && e < mEgress.size(); ++e)
+    {
+      forward(mEgress[e], nTx, kernelNs);
+    }
+  }
+}
+
+void RelayModule::forward(RelayEgress& egress, unsigned nMsgs, const uint64_t* kernelNs)
+{
+  int fd = mIfaces[egress.ifaceIdx].sockFd;
+  unsigned nSent = 0;
+  while (nSent < nMsgs)
+  {
+    ++egress.calls;
+    int sent = sendmmsg(fd, &mTxMsgs[nSent], nMsgs - nSent, 0);
+    if (0 > sent)
+    {
+      if (EINTR == errno)
+      {
+        continue;
+      }
+
+      // the datagram that failed is dropped, the rest of the batch is tried again
+      if (EAGAIN == errno || EWOULDBLOCK == errno || ENOBUFS == errno)
+      {
+        ++egress.blocked;
+      }
+      else
+      {
+        ++egress.errors;
+        LOG_DEBUG("sendmmsg " << egress.label << ": " << strerror(errno));
+      }
+      ++nSent;
+      continue;
+    }
+
+    uint64_t nowNs = Common::getRealtimeNs();
+    for (unsigned i = nSent; i < nSent + sent; ++i)
+    {
+      egress.bytes += mTxMsgs[i].msg_len;
+      if (0 < kernelNs[i] && kernelNs[i] <= nowNs)
+      {
+        egress.latency.add(nowNs - kernelNs[i]);
+      }
+    }
+    egress.sent += sent;
+    nSent += sent;
+  }
+}
+
+void RelayModule::printStats() const
+{
+  if (0 == mStartNs)
+  {
+    return;
+  }
+
+  double elapsed = (Common::getMonotonicNs() - mStartNs) / 1e9;
+  cout << "==============================================================" << endl;
+  printf("[RELAY] %-30s received: %llu bytes: %llu batches: %llu (%.1f per batch) "
+      "kernel drops: %u unrouted: %llu (%.1f pps)\n", mIfaces[0].toString().c_str(),
+      (unsigned long long) mReceived, (unsigned long long) mBytes, (unsigned long long) mBatches,
+      mBatches? (double) mReceived / mBatches : 0, mKernelDrops, (unsigned long long) mUnrouted,
+      elapsed > 0? mReceived / elapsed : 0);
+
+  for (unsigned i = 0; i < mRoutes.size(); ++i)
+  {
+    printf("[RELAY] %-30s -> %s forwarded: %llu\n", mRoutes[i].group.c_str(),
+        mRoutes[i].destName.c_str(), (unsigned long long) mRoutes[i].forwarded);
+  }
+
+  for (unsigned i = 0; i < mEgress.size(); ++i)
+  {
+    const RelayEgress& egress = mEgress[i];
+    printf("[RELAY] -> %-27s sent: %llu bytes: %llu blocked: %llu errors: %llu sendmmsg: %llu\n",
+        egress.label.c_str(), (unsigned long long) egress.sent, (unsigned long long) egress.bytes,
+        (unsigned long long) egress.blocked, (unsigned long long) egress.errors,
+        (unsigned long long) egress.calls);
+    printf("[RELAY] %-30s hop latency: %s\n", "", egress.latency.toString(1000, "us").c_str());
+  }
+}
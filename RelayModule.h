@@ -0,0 +1,119 @@
+#ifndef MCASTIT_RELAYMODULE_H_
+#define MCASTIT_RELAYMODULE_H_
+
+#include "McastModuleInterface.h"
+#include "Histogram.h"
+#include "PacketArena.h"
+
+#define RELAY_BATCH_LEN   (64)          // datagrams per recvmmsg & sendmmsg
+#define RELAY_RCVBUF      (1024 * 1024) // ingress receive buffer without --rcvbuf
+
+/**
+ * Where datagrams received for a group are multicast again
+ */
+struct RelayRoute
+{
+  string          group;     // as received
+  struct in6_addr groupAddr; // ipv4 group in the first 4 bytes
+  string          destName;  // "group:port" it is sent to
+  struct sockaddr_storage dest;
+  uint64_t        forwarded; // datagrams received for the group
+
+  RelayRoute(): forwarded(0) {}
+};
+
+/**
+ * Send side of one egress interface
+ */
+struct RelayEgress
+{
+  unsigned  ifaceIdx;
+  string    label;
+  uint64_t  sent;       // datagrams
+  uint64_t  bytes;
+  uint64_t  blocked;    // dropped because of EAGAIN/ENOBUFS
+  uint64_t  errors;     // other send errors
+  uint64_t  calls;      // sendmmsg calls
+  Histogram latency;    // kernel receive on the ingress to sent on this interface
+
+  RelayEgress(): ifaceIdx(0), sent(0), bytes(0), blocked(0), errors(0), calls(0) {}
+};
+
+/**
+ * Forward multicast from one interface to others
+ *
+ * The groups are received on the first interface in batches of up to
+ * RELAY_BATCH_LEN datagrams, then each batch is multicast again on every other
+ * interface with one sendmmsg per interface. All sends point at the receive
+ * buffers, datagrams are never copied. Groups are sent unchanged unless a
+ * mapping gives them another group or port
+ */
+class RelayModule: public McastModuleInterface
+{
+public:
+  /**
+   * @param ifaces    - ingress interface first, then the egress interfaces
+   * @param nLoopbackIfaces - loop back on the first n egress interfaces, < 0 for all
+   */
+  RelayModule(const vector<IfaceData>& ifaces, const vector<string>& mcastAddresses,
+      int mcastPort, int nLoopbackIfaces, bool useIpV6);
+  virtual ~RelayModule();
+  bool run();
+  void printStats() const;
+
+  /**
+   * Send a group under another group and/or port, the group is relayed even without -m
+   * @param spec - "{group}={group}", "{group}={group}:{port}" or "{group}=[{ipv6 group}]:{port}"
+   * @return false if spec is invalid
+   */
+  bool addMapping(const string& spec);
+
+  /**
+   * @param size - ingress socket receive buffer size, 0 for RELAY_RCVBUF
+   */
+  void setRecvBufferSize(int size);
+
+private:
+  /**
+   * Join the groups on the ingress, set up the egress sockets & the routes
+   * @return true on success
+   */
+  bool init();
+
+  /**
+   * Receive, route & forward batches until stopped
+   */
+  void runRelay();
+
+  /**
+   * Send the first nMsgs of mTxMsgs on one interface
+   * @param kernelNs  - ingress receive time of each message, 0 if unknown
+   */
+  void forward(RelayEgress& egress, unsigned nMsgs, const uint64_t* kernelNs);
+
+  /**
+   * @return route of the group a datagram was sent to, NULL if not relayed
+   */
+  RelayRoute* findRoute(const struct in6_addr& group);
+
+private:
+  int  mLoopbackCount;
+  int  mRecvBufferSize;
+  map<string, string>  mMappings;  // group -> destination spec
+  vector<RelayRoute>   mRoutes;    // a few groups, searched linearly
+  vector<RelayEgress>  mEgress;
+
+  PacketArena          mRxBuf;     // one slot per datagram of a batch
+  vector<char>         mRxControl;
+  vector<struct mmsghdr> mRxMsgs;
+  vector<struct iovec>   mRxIovs;
+  vector<struct mmsghdr> mTxMsgs;  // routed datagrams of the batch, shared by all egress sockets
+  vector<struct iovec>   mTxIovs;
+
+  uint64_t mReceived, mBytes, mBatches;
+  uint64_t mUnrouted;              // datagrams of a group without route
+  uint32_t mKernelDrops;           // ingress socket overflows, SO_RXQ_OVFL
+  uint64_t mStartNs;
+};
+
+#endif /* MCASTIT_RELAYMODULE_H_ */
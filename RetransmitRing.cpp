@@ -0,0 +1,55 @@
+#include "RetransmitRing.h"
+
+RetransmitRing::RetransmitRing()
+{
+  pthread_mutex_init(&mLock, NULL);
+}
+
+RetransmitRing::~RetransmitRing()
+{
+  pthread_mutex_destroy(&mLock);
+}
+
+bool RetransmitRing::init(unsigned nSlots, unsigned slotLen, int numaNode)
+{
+  if (!mSlots.init(slotLen, nSlots, numaNode))
+  {
+    return false;
+  }
+
+  mSeqs.assign(mSlots.getSlotCount(), 0);
+  mLens.assign(mSlots.getSlotCount(), 0);
+  return true;
+}
+
+void RetransmitRing::store(uint32_t firstSeq, const char* buf, unsigned nSegments, unsigned segSize)
+{
+  unsigned len = std::min(segSize, mSlots.getSlotLen());
+
+  pthread_mutex_lock(&mLock);
+  for (unsigned seg = 0; seg < nSegments; ++seg)
+  {
+    unsigned idx = (firstSeq + seg) % mSlots.getSlotCount();
+    memcpy(mSlots.getSlot(idx), buf + seg * segSize, len);
+    mSeqs[idx] = firstSeq + seg;
+    mLens[idx] = len;
+  }
+  pthread_mutex_unlock(&mLock);
+}
+
+bool RetransmitRing::load(uint32_t seq, char* buf, unsigned& len) const
+{
+  bool retVal = false;
+  unsigned idx = seq % mSlots.getSlotCount();
+
+  pthread_mutex_lock(&mLock);
+  if (mLens[idx] && seq == mSeqs[idx] && mLens[idx] <= len)
+  {
+    len = mLens[idx];
+    memcpy(buf, mSlots.getSlot(idx), len);
+    retVal = true;
+  }
+  pthread_mutex_unlock(&mLock);
+
+  return retVal;
+}
@@ -0,0 +1,51 @@
+#ifndef MCASTIT_RETRANSMITRING_H_
+#define MCASTIT_RETRANSMITRING_H_
+
+#include "Common.h"
+#include "PacketArena.h"
+
+#define RETX_RING_LEN     (4096)  // default datagrams kept for retransmission
+#define RETX_RING_MAX_LEN (1 << 20) // slots may be 64 KB each
+
+/**
+ * Last sent datagrams of one sender, indexed by sequence
+ *
+ * Written by the tx thread once per round, read by the ACK listener thread
+ * when a NACK asks for a datagram again
+ */
+class RetransmitRing
+{
+public:
+  RetransmitRing();
+  ~RetransmitRing();
+
+  /**
+   * @param nSlots    - datagrams kept, older ones are overwritten
+   * @param slotLen   - max datagram size
+   * @param numaNode  - node to place the datagrams on, -1 for the default policy
+   * @return true on success
+   */
+  bool init(unsigned nSlots, unsigned slotLen, int numaNode = -1);
+
+  /**
+   * Keep a copy of the datagrams of one round
+   * @param firstSeq  - sequence of the first datagram
+   * @param buf       - nSegments datagrams of segSize bytes
+   */
+  void store(uint32_t firstSeq, const char* buf, unsigned nSegments, unsigned segSize);
+
+  /**
+   * Copy datagram seq to buf
+   * @param len - [IN] size of buf, [OUT] datagram size
+   * @return false if seq was never sent or was overwritten already
+   */
+  bool load(uint32_t seq, char* buf, unsigned& len) const;
+
+private:
+  PacketArena      mSlots;
+  vector<uint32_t> mSeqs;     // sequence in each slot
+  vector<unsigned> mLens;     // 0 if the slot is empty
+  mutable pthread_mutex_t mLock;
+};
+
+#endif /* MCASTIT_RETRANSMITRING_H_ */
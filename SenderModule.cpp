@@ -1,4 +1,15 @@
 #include "SenderModule.h"
+#include "GaloisField.h"
+#include "Probes.h"
+#include <sys/eventfd.h>
+
+#define ZC_WAIT_MS        (10)    // wait for a zero copy buffer before copying
+#define ZC_DRAIN_MS       (1000)  // wait for zero copy completions when done sending
+#define NACK_HOLD_NS      (1000000ULL) // wait for NACKs of other receivers before retransmitting
+#define RECEIVER_SILENT_NS    (1000000000ULL) // no ACK in the last second of sending
+#define RECEIVER_LOSSY_PERCENT (1.0)
+#define RECEIVER_REPORT_MAX   (20)     // silent or lossy receivers listed in the statistics
+#define TX_PRECISE_SLEEP_NS   (10000000ULL) // end of longer gaps slept precisely, the rest waits on stop()
 
 SenderModule::SenderModule(const vector<IfaceData>& ifaces,
     const vector<string>& mcastAddresses, int mcastPort,
@@ -23,8 +34,98 @@ SenderModule::SenderModule(const vector<IfaceData>& ifaces,
   }
   cout << endl;
 
-  mIsStopped = false;
   mSenderPort = mMcastPort+1;
+  mSendCount = -1;
+  mPayloadSize = 0;
+  mGsoSegments = 1;
+  mUseZeroCopy = false;
+  mThreadPerIface = false;
+  mNackRingLen = 0;
+  mDestReady = false;
+  mFecBlockLen = 0;
+  mFecParity = 0;
+  mIsQuiet = false;
+  mExpectedAcks = 0;
+  mAckTimeoutMs = ACK_WINDOW_MS;
+  mSendDoneFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  mIsSendDone = false;
+  mLastSeq = 0;
+  mAckWaitNs = 0;
+}
+
+SenderModule::~SenderModule()
+{
+  if (-1 != mSendDoneFd)
+  {
+    close(mSendDoneFd);
+  }
+
+  for (unsigned i = 0; i < mTxWorkers.size(); ++i)
+  {
+    delete mTxWorkers[i];
+  }
+}
+
+void SenderModule::setQuiet(bool enable)
+{
+  mIsQuiet = enable;
+}
+
+void SenderModule::setThreadPerIface(bool enable)
+{
+  mThreadPerIface = enable;
+}
+
+void SenderModule::setIfaceRates(const vector<float>& rates)
+{
+  mIfaceRates = rates;
+}
+
+void SenderModule::setNackRing(unsigned nDatagrams)
+{
+  mNackRingLen = nDatagrams;
+}
+
+void SenderModule::setFec(unsigned blockLen, unsigned nParity)
+{
+  mFecBlockLen = blockLen;
+  mFecParity = nParity;
+}
+
+void SenderModule::setTrafficShape(const TrafficShape& shape)
+{
+  mShape = shape;
+}
+
+void SenderModule::setSendCount(long count)
+{
+  mSendCount = count;
+}
+
+void SenderModule::setPayloadSize(unsigned size)
+{
+  mPayloadSize = std::min(size, (unsigned)MCAST_MAX_DGRAM_LEN);
+}
+
+void SenderModule::setGsoSegments(unsigned nSegments)
+{
+  mGsoSegments = std::max(1u, std::min(nSegments, (unsigned)UDP_MAX_SEGMENTS));
+}
+
+void SenderModule::setStatsPage(const string& name)
+{
+  mStatsName = name;
+}
+
+void SenderModule::setZeroCopy(bool enable)
+{
+  mUseZeroCopy = enable;
+}
+
+void SenderModule::setAckWindow(unsigned nReceivers, unsigned timeoutMs)
+{
+  mExpectedAcks = nReceivers;
+  mAckTimeoutMs = timeoutMs;
 }
 
 bool SenderModule::run()
@@ -55,24 +156,71 @@ bool SenderModule::run()
     retVal = false;
   }
 
-  // Allow ack listener for 3 seconds
-  sleep(3);
-  mIsStopped = true;
+  // late ACKs, then the ACK listener is done
+  if (!mIsStopped)
+  {
+    waitForAcks();
+  }
+  stop();
+  pthread_join(rxThread, NULL);
   return retVal;
 }
 
+void SenderModule::waitForAcks()
+{
+  uint64_t startNs = Common::getMonotonicNs();
+  for (unsigned i = 0; i < mTxWorkers.size(); ++i)
+  {
+    mLastSeq = std::max(mLastSeq, mTxWorkers[i]->lastSeq);
+  }
+  __sync_synchronize();
+  mIsSendDone = true;
+  uint64_t one = 1;
+  ssize_t len = (-1 != mSendDoneFd)? write(mSendDoneFd, &one, sizeof(one)) : 0;
+  (void) len;
+
+  // the ACK listener calls stop() once the expected listeners answered
+  const uint64_t endNs = startNs + mAckTimeoutMs * 1000000ULL;
+  uint64_t nowNs = startNs;
+  while (nowNs < endNs && sleepUnlessStopped(endNs - nowNs))
+  {
+    nowNs = Common::getMonotonicNs();
+  }
+  mAckWaitNs = Common::getMonotonicNs() - startNs;
+}
+
+void SenderModule::checkAnswered(const ReceiverEntry& entry)
+{
+  if (!mExpectedAcks || !mIsSendDone || entry.highest < mLastSeq)
+  {
+    return;
+  }
+
+  // summary ACKs are per group, a listener answers once
+  ReceiverKey key = entry.key;
+  memset(&key.group, 0, sizeof(key.group));
+  (void) mAnswered.get(key);
+  if (mAnswered.size() >= mExpectedAcks)
+  {
+    stop();
+  }
+}
+
 void* SenderModule::runUcastReceiver()
 {
+  (void) Common::applyThreadSettings(Common::THREAD_RX);
+
   // Now listen to ack msgs
   char rxBuf[MCAST_BUFF_LEN];
   struct sockaddr_storage rmt;
   fd_set listenSet;
   struct timeval timeout;
-  int maxFd = -1;
+  int maxFd = std::max(getStopFd(), mSendDoneFd);
   for (unsigned i = 0; i < mIfaces.size(); ++i)
   {
     maxFd = (maxFd < mIfaces[i].sockFd)? mIfaces[i].sockFd : maxFd;
   }
+  bool isWindowOpen = false;
 
   while (!mIsStopped)
   {
@@ -82,25 +230,60 @@ void* SenderModule::runUcastReceiver()
     {
       FD_SET(mIfaces[i].sockFd, &listenSet);
     }
+    if (-1 != getStopFd())
+    {
+      FD_SET(getStopFd(), &listenSet);
+    }
+    if (-1 != mSendDoneFd && !isWindowOpen)
+    {
+      FD_SET(mSendDoneFd, &listenSet);
+    }
+
+    // the ACK of the last datagram may have come before the sending thread was done
+    if (mIsSendDone && !isWindowOpen)
+    {
+      isWindowOpen = true;
+      for (unsigned i = 0; i < mReceivers.size(); ++i)
+      {
+        checkAnswered(mReceivers[i]);
+      }
+    }
 
-    timeout.tv_sec = 1;
-    timeout.tv_usec = 1;
+    // wake up for the next queued retransmission & statistics page update
+    uint64_t retxWaitNs = checkStatsPage(flushRetransmits());
+    timeout.tv_sec = retxWaitNs? 0 : 1;
+    timeout.tv_usec = retxWaitNs? retxWaitNs / 1000 + 1 : 1;
 
     int numReady = select(maxFd + 1, &listenSet, NULL, NULL, &timeout);
     if (numReady <= 0)
     {
-      if (numReady<0)
+      if (numReady<0 && EINTR != errno)
       {
         LOG_ERROR("select: " << strerror(errno));
       }
       continue;
     }
 
+    // the wake up fds are not sockets
+    if (-1 != getStopFd() && FD_ISSET(getStopFd(), &listenSet))
+    {
+      continue;
+    }
+    if (-1 != mSendDoneFd && FD_ISSET(mSendDoneFd, &listenSet))
+    {
+      FD_CLR(mSendDoneFd, &listenSet);
+      if (0 == --numReady)
+      {
+        continue;
+      }
+    }
+
     while(numReady-- > 0)
     {
       int resultFd = -1;
       std::string recvIfaceName = "default";
 
+      unsigned ifaceIdx = 0;
       for (unsigned ii = 0 ; ii < mIfaces.size(); ++ii)
       {
         resultFd = mIfaces[ii].sockFd;
@@ -108,6 +291,7 @@ void* SenderModule::runUcastReceiver()
         {
           FD_CLR(resultFd, &listenSet);
           recvIfaceName = mIfaces[ii].ifaceName;
+          ifaceIdx = ii;
           break;
         }
       }
@@ -115,9 +299,17 @@ void* SenderModule::runUcastReceiver()
       // Get respond data
       memset(rxBuf, 0, sizeof(rxBuf));
       socklen_t rmtLen = sizeof(rmt);
-      int rxBytes = recvfrom(resultFd, rxBuf, sizeof(rxBuf), 0,
+      // don't block, zero copy completions on the error queue also wake up select
+      int rxBytes = recvfrom(resultFd, rxBuf, sizeof(rxBuf), MSG_DONTWAIT,
                                 (struct sockaddr*) &rmt, &rmtLen);
 
+      if (-1 == rxBytes && (EAGAIN == errno || EWOULDBLOCK == errno))
+      {
+        // only completions, reap them here or select returns at once until the next send
+        reapZeroCopy(ifaceIdx);
+        continue;
+      }
+
       if (-1 == rxBytes)
       {
         LOG_ERROR("recvfrom: "<< strerror(errno));
@@ -139,8 +331,18 @@ void* SenderModule::runUcastReceiver()
       }
 
       string decodedMsg;
-      if (Common::decodeAckMessage(rxBuf, decodedMsg))
+      if (handleNack(ifaceIdx, rmt, rxBuf))
+      {
+        LOG_DEBUG("[NACK] " << senderIp << " -> " << recvIfaceName << " (" << rxBuf << ")");
+      }
+      else if (Common::decodeAckMessage(rxBuf, decodedMsg))
       {
+        handleAck(resultFd, ifaceIdx, rmt, decodedMsg);
+        if (mIsQuiet)
+        {
+          continue;
+        }
+
         if (isIpV6())
         {
           printf("[ACK] %-45s -> %-10s (%s)\n", senderIp, recvIfaceName.c_str(), decodedMsg.c_str());
@@ -157,6 +359,11 @@ void* SenderModule::runUcastReceiver()
     }
   }
 
+  // final counters for the monitors
+  if (mStatsPage.isOpen())
+  {
+    updateStatsPage();
+  }
   return 0;
 }
 
@@ -165,134 +372,1065 @@ bool SenderModule::shouldLoop() const
   return mLoopInterval > 0.0;
 }
 
-bool SenderModule::sendMcastMessages(int port)
+bool SenderModule::buildDestinations(int port)
 {
-  // build addr struct vector
-  // if port is -1, use mcast port
-  port = (-1 == port)? mMcastPort: port;
-  vector<struct sockaddr_in> addrVec;
-  vector<struct sockaddr_in6> addr6Vec;
-
+  mDestAddrs.clear();
   for (unsigned i = 0; i < mMcastAddresses.size(); ++i)
   {
-    struct sockaddr_in addr;
-    struct sockaddr_in6 addr6;
-
-    addr.sin_family = AF_INET;
-    addr.sin_port = htons(port);
-
-    addr6.sin6_family = AF_INET6;
-    addr6.sin6_port = htons(port);
+    struct sockaddr_storage dest;
+    memset(&dest, 0, sizeof(dest));
 
     // setup mcast IP address
     if (isIpV6())
     {
-      if (inet_pton(AF_INET6, mMcastAddresses[i].c_str(), &addr6.sin6_addr) != 1)
+      struct sockaddr_in6* addr6 = (struct sockaddr_in6*) &dest;
+      addr6->sin6_family = AF_INET6;
+      addr6->sin6_port = htons(port);
+      if (inet_pton(AF_INET6, mMcastAddresses[i].c_str(), &addr6->sin6_addr) != 1)
       {
         LOG_ERROR("Error parsing address for " << mMcastAddresses[i]);
         return false;
       }
-      addr6Vec.push_back(addr6);
     }
     else
     {
-      addr.sin_addr.s_addr = inet_addr(mMcastAddresses[i].c_str());
-      addrVec.push_back(addr);
+      struct sockaddr_in* addr = (struct sockaddr_in*) &dest;
+      addr->sin_family = AF_INET;
+      addr->sin_port = htons(port);
+      addr->sin_addr.s_addr = inet_addr(mMcastAddresses[i].c_str());
     }
+
+    mDestAddrs.push_back(dest);
   }
 
-  // build message
-  const string dmsg = "<Sender info:";
-  int msgSeqNumber = 1;
+  return true;
+}
 
-  do
+bool SenderModule::buildTemplate(TxWorker& worker) const
+{
+  // sequence & timestamp when sending in loop or when datagrams have to be told apart
+  worker.hasHeader = worker.interval > 0 || mGsoSegments > 1;
+  unsigned headerLen = worker.hasHeader? MCAST_HEADER_LEN : 0;
+
+  // text with its terminating null, or fixed size with room for at least the header
+  worker.segSize = headerLen + worker.info.size() + 1;
+  if (mPayloadSize)
   {
-    char msgBuf[MCAST_BUFF_LEN];
-    for (unsigned i = 0; i < mIfaces.size(); ++i)
+    worker.segSize = std::max(mPayloadSize, headerLen + 1);
+  }
+
+  // zero filled, on the interface's node
+  if (!worker.txBuf.init(mGsoSegments * worker.segSize, 1, worker.numaNode))
+  {
+    return false;
+  }
+
+  for (unsigned seg = 0; seg < mGsoSegments; ++seg)
+  {
+    char* msg = worker.txBuf.getSlot(0) + seg * worker.segSize;
+    if (worker.hasHeader)
+    {
+      Common::encodeMessageHeader(msg, 0, 0);
+    }
+
+    unsigned infoLen = std::min((unsigned)worker.info.size(), worker.segSize - headerLen - 1);
+    memcpy(msg + headerLen, worker.info.data(), infoLen);
+  }
+
+  return true;
+}
+
+void SenderModule::stampRound(const TxWorker& worker, char* buf, int msgSeqNumber) const
+{
+  if (!worker.hasHeader)
+  {
+    return;
+  }
+
+  uint64_t sendTimeNs = Common::getRealtimeNs();
+  for (unsigned seg = 0; seg < mGsoSegments; ++seg)
+  {
+    Common::encodeMessageHeader(buf + seg * worker.segSize, msgSeqNumber + seg, sendTimeNs);
+  }
+}
+
+int SenderModule::sendSegmented(int fd, const char* buf, unsigned nSegments,
+    unsigned segSize, const struct sockaddr_storage& dest, int flags) const
+{
+  struct iovec iov;
+  iov.iov_base = (void*) buf;
+  iov.iov_len = nSegments * segSize;
+
+  char control[CMSG_SPACE(sizeof(uint16_t))];
+  memset(control, 0, sizeof(control));
+
+  struct msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_name = (void*) &dest;
+  msg.msg_namelen = isIpV6()? sizeof(struct sockaddr_in6) : sizeof(struct sockaddr_in);
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof(control);
+
+  // kernel splits the buffer in datagrams of gso size
+  struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level = SOL_UDP;
+  cmsg->cmsg_type = UDP_SEGMENT;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+  uint16_t gsoSize = segSize;
+  memcpy(CMSG_DATA(cmsg), &gsoSize, sizeof(gsoSize));
+
+  return sendmsg(fd, &msg, MSG_NOSIGNAL|MSG_DONTWAIT|flags);
+}
+
+int SenderModule::sendBuffer(TxWorker& worker, char* buf, unsigned len, unsigned nSegments,
+    const struct sockaddr_storage& dest, bool isZeroCopy)
+{
+  int fd = mIfaces[worker.ifaceIdx].sockFd;
+  socklen_t addrLen = isIpV6()? sizeof(struct sockaddr_in6) : sizeof(struct sockaddr_in);
+  int flags = isZeroCopy? MSG_ZEROCOPY : 0;
+
+  while (1)
+  {
+    if (flags)
+    {
+      worker.zcPool->lockSend();
+    }
+
+    int byteSent;
+    if (nSegments > 1)
+    {
+      byteSent = sendSegmented(fd, buf, nSegments, len / nSegments, dest, flags);
+    }
+    else
+    {
+      byteSent = sendto(fd, buf, len, MSG_NOSIGNAL|MSG_DONTWAIT|flags,
+                        (const struct sockaddr *) &dest, addrLen);
+    }
+
+    if (flags)
+    {
+      int sendErrno = errno;
+      if (0 <= byteSent)
+      {
+        worker.zcPool->onSent(buf);
+      }
+      worker.zcPool->unlockSend();
+      errno = sendErrno;
+    }
+
+    // ENOBUFS on a zero copy send means the notification memory is used up, copy instead
+    if (0 > byteSent && flags && ENOBUFS == errno)
+    {
+      worker.stats.zcFallback += nSegments;
+      flags = 0;
+      continue;
+    }
+
+    return byteSent;
+  }
+}
+
+bool SenderModule::sendRound(TxWorker& worker, int msgSeqNumber)
+{
+  // zero copy buffers can't be rewritten until the kernel is done with them
+  char* msgBuf = worker.txBuf.getSlot(0);
+  char* zcBuf = NULL;
+  if (worker.zcPool)
+  {
+    if (NULL != (zcBuf = worker.zcPool->acquire(ZC_WAIT_MS)))
     {
-      const IfaceData ifaceData = mIfaces[i];
-      int fd = ifaceData.sockFd;
+      msgBuf = zcBuf;
+    }
+    else
+    {
+      worker.stats.zcFallback += mGsoSegments * mDestAddrs.size();
+    }
+  }
+
+  // only sequence and send time change from one round to the next
+  stampRound(worker, msgBuf, msgSeqNumber);
+  worker.lastSeq = worker.hasHeader? msgSeqNumber + mGsoSegments - 1 : 0;
+  const unsigned msgLen = worker.segSize;
+  if (worker.retx)
+  {
+    worker.retx->store(msgSeqNumber, msgBuf, mGsoSegments, msgLen);
+  }
 
-      // build message
-      memset(msgBuf, 0 ,sizeof(msgBuf));
-      if (shouldLoop())
+  // send message
+  bool retVal = true;
+  for (unsigned i = 0; i < mDestAddrs.size() && retVal; ++i)
+  {
+    if (worker.useGso)
+    {
+      int byteSent = sendBuffer(worker, msgBuf, mGsoSegments * msgLen, mGsoSegments,
+          mDestAddrs[i], NULL != zcBuf);
+      if (0 <= byteSent)
       {
-        sprintf(msgBuf, "%4d ", msgSeqNumber);
+        ++worker.stats.gsoSends;
+        worker.stats.sent += mGsoSegments;
+        worker.stats.bytes += byteSent;
+        MCASTIT_PROBE5(tx_sent, mIfaces[worker.ifaceIdx].sockFd, worker.ifindex, msgSeqNumber,
+            byteSent, mGsoSegments);
+        LOG_DEBUG("[SENT] " << worker.label << " segmented bytes: " << byteSent);
+        continue;
       }
-      sprintf(msgBuf, "%s%s %s>", msgBuf, dmsg.c_str(), ifaceData.toString().c_str());
 
-      // send message
-      for (unsigned i = 0; i < addrVec.size() + addr6Vec.size(); ++i)
+      if (EAGAIN == errno || EWOULDBLOCK == errno || ENOBUFS == errno)
       {
-        const struct sockaddr_in& addr = addrVec[i];
-        const struct sockaddr_in6& addr6 = addr6Vec[i];
-        int byteSent;
-        if (!isIpV6())
-        {
-          byteSent = sendto(fd, msgBuf, strlen(msgBuf) + 1,
-                      MSG_NOSIGNAL|MSG_DONTWAIT, (struct sockaddr *) &addr, sizeof(addr));
-        }
-        else
-        {
-          byteSent = sendto(fd, msgBuf, strlen(msgBuf) + 1,
-                      MSG_NOSIGNAL|MSG_DONTWAIT, (struct sockaddr *) &addr6, sizeof(addr6));
-        }
+        worker.stats.blocked += mGsoSegments;
+        LOG_DEBUG("[BLOCKED] " << worker.label << " :" << strerror(errno));
+        continue;
+      }
 
-        // Error check for sending message
-        if (0 > byteSent)
-        {
-          LOG_ERROR("sendto " << ifaceData << " :" << strerror(errno));
-          return false;
-        }
-        else
-        {
-          LOG_DEBUG("[SENT] " << ifaceData << " bytes: " << byteSent);
-        }
+      // no segmentation offload on this kernel or path, send them one by one from now on
+      LOG_ERROR("UDP_SEGMENT on " << worker.label << " :" << strerror(errno)
+          << ", falling back to one send per datagram");
+      worker.useGso = false;
+      if (zcBuf)
+      {
+        worker.zcPool->onRefused();
       }
     }
 
-    // loop interval
-    if (shouldLoop())
+    for (unsigned seg = 0; seg < mGsoSegments; ++seg)
     {
-      ++msgSeqNumber;
-      (void) usleep( (int)(mLoopInterval*1e6) );
+      int byteSent = sendBuffer(worker, msgBuf + seg * worker.segSize, msgLen, 1,
+          mDestAddrs[i], NULL != zcBuf);
+
+      // Error check for sending message
+      if (0 > byteSent)
+      {
+        if (EAGAIN == errno || EWOULDBLOCK == errno || ENOBUFS == errno)
+        {
+          // congested interface, drop this one and keep going
+          ++worker.stats.blocked;
+          LOG_DEBUG("[BLOCKED] " << worker.label << " :" << strerror(errno));
+          continue;
+        }
+
+        ++worker.stats.errors;
+        LOG_ERROR("sendto " << worker.label << " :" << strerror(errno));
+        retVal = false;
+        break;
+      }
+      else
+      {
+        ++worker.stats.sent;
+        worker.stats.bytes += byteSent;
+        MCASTIT_PROBE5(tx_sent, mIfaces[worker.ifaceIdx].sockFd, worker.ifindex,
+            msgSeqNumber + seg, byteSent, 1);
+        LOG_DEBUG("[SENT] " << worker.label << " bytes: " << byteSent);
+      }
     }
+  }
 
-  } while (shouldLoop());
+  // parity is sent behind the data it covers
+  if (worker.fec && retVal)
+  {
+    encodeParity(worker, msgBuf, msgSeqNumber);
+  }
 
-  return true;
+  if (zcBuf)
+  {
+    worker.zcPool->release(zcBuf);
+  }
+
+  return retVal;
 }
 
-void* SenderModule::rxThreadHelper(void* context)
+void SenderModule::encodeParity(TxWorker& worker, const char* buf, int msgSeqNumber)
 {
-  return ((SenderModule*)context)->runUcastReceiver();
+  for (unsigned seg = 0; seg < mGsoSegments; ++seg)
+  {
+    uint64_t startNs = Common::getMonotonicNs();
+    bool isBlockDone = worker.fec->add(msgSeqNumber + seg, buf + seg * worker.segSize);
+    worker.stats.fecNs += Common::getMonotonicNs() - startNs;
+
+    if (isBlockDone)
+    {
+      sendParity(worker);
+    }
+  }
 }
 
-bool SenderModule::init()
+void SenderModule::sendParity(TxWorker& worker)
 {
-  /*
-   * First, setup mcast for all interfaces
-   */
-  for (unsigned i = 0; i < mIfaces.size(); ++i)
+  int fd = mIfaces[worker.ifaceIdx].sockFd;
+  socklen_t addrLen = isIpV6()? sizeof(struct sockaddr_in6) : sizeof(struct sockaddr_in);
+  for (unsigned i = 0; i < mDestAddrs.size(); ++i)
   {
-    bool setMcastOk;
-    if (isIpV6())
+    for (unsigned idx = 0; idx < worker.fec->getParityCount(); ++idx)
     {
-      setMcastOk = associateMcastV6WithIfaceName(mIfaces[i].sockFd,
-          mIfaces[i].ifaceName.c_str(), mLoopbackCount<0 || (int)i < mLoopbackCount);
+      unsigned len;
+      const char* parity = worker.fec->getParity(idx, len);
+      if (0 > sendto(fd, parity, len, MSG_NOSIGNAL|MSG_DONTWAIT,
+          (const struct sockaddr *) &mDestAddrs[i], addrLen))
+      {
+        ++worker.stats.blocked;
+        LOG_DEBUG("[BLOCKED] " << worker.label << " parity :" << strerror(errno));
+        continue;
+      }
+      ++worker.stats.fecParity;
     }
-    else
+  }
+}
+
+bool SenderModule::runTxWorker(TxWorker& worker)
+{
+  if (!Common::applyThreadSettings(Common::THREAD_TX, worker.ifaceIdx, worker.numaNode))
+  {
+    LOG_ERROR("Sending from " << worker.label << " with default cpu & scheduling");
+  }
+
+  const uint64_t intervalNs = (worker.interval > 0)? (uint64_t)(worker.interval * 1e9) : 0;
+  const bool isShaped = !mShape.isConstant();
+  uint64_t deadline = Common::getMonotonicNs();
+  worker.stats.startNs = deadline;
+
+  bool retVal = true;
+  int msgSeqNumber = 1;
+  long round = 0;
+  unsigned burstLen = 0;
+  uint64_t burstStartNs = 0;
+  while (!mIsStopped)
+  {
+    if (isShaped && 0 == burstLen++)
     {
-      setMcastOk = associateMcastWithIfaceName(mIfaces[i].sockFd,
-          mIfaces[i].ifaceName.c_str(), mLoopbackCount<0 || (int)i < mLoopbackCount);
+      burstStartNs = Common::getMonotonicNs();
+      worker.startError.add((burstStartNs > deadline)? burstStartNs - deadline : 0);
     }
 
-    if (!setMcastOk)
+    if (!sendRound(worker, msgSeqNumber))
     {
-      LOG_ERROR("Setting mcast for " << mIfaces[i]);
-      return false;
+      retVal = false;
+      break;
     }
-  }
 
-  return true;
+    if (0 == intervalNs || (mSendCount > 0 && ++round >= mSendCount))
+    {
+      break;
+    }
+    msgSeqNumber += mGsoSegments;
+
+    uint64_t gapNs = isShaped? mShape.nextGapNs(worker.shape, intervalNs) : intervalNs;
+    if (0 == gapNs)
+    {
+      // next round of the same burst, back to back
+      continue;
+    }
+
+    if (burstLen > 1)
+    {
+      worker.burstSpan.add(Common::getMonotonicNs() - burstStartNs);
+      worker.burstRounds += burstLen;
+    }
+    burstLen = 0;
+
+    // absolute deadlines so that send time doesn't add up to the gap,
+    // catch up at most one gap if this round was late
+    deadline += gapNs;
+    uint64_t now = Common::getMonotonicNs();
+    if (now >= deadline)
+    {
+      ++worker.stats.late;
+      MCASTIT_PROBE4(tx_slip, mIfaces[worker.ifaceIdx].sockFd, worker.ifindex, msgSeqNumber,
+          now - deadline);
+      if (now - deadline > gapNs)
+      {
+        deadline = now;
+      }
+    }
+    else
+    {
+      if (deadline - now > TX_PRECISE_SLEEP_NS &&
+          !sleepUnlessStopped(deadline - now - TX_PRECISE_SLEEP_NS))
+      {
+        break;
+      }
+      Common::sleepUntilNs(deadline);
+    }
+  }
+
+  // last block may be shorter
+  if (worker.fec && worker.fec->flush())
+  {
+    sendParity(worker);
+  }
+
+  if (worker.zcPool)
+  {
+    worker.zcPool->drain(ZC_DRAIN_MS);
+  }
+
+  worker.stats.stopNs = Common::getMonotonicNs();
+  return retVal;
+}
+
+bool SenderModule::sendMcastMessages(int port)
+{
+  // build addr struct vector
+  // if port is -1, use mcast port
+  port = (-1 == port)? mMcastPort: port;
+  if (!buildDestinations(port))
+  {
+    return false;
+  }
+  __sync_synchronize();
+  mDestReady = true;
+
+  // One pacing thread per interface
+  if (mThreadPerIface)
+  {
+    unsigned nStarted = 0;
+    for (; nStarted < mTxWorkers.size(); ++nStarted)
+    {
+      TxWorker* worker = mTxWorkers[nStarted];
+      if (0 != pthread_create(&worker->thread, NULL, &SenderModule::txWorkerHelper, worker))
+      {
+        LOG_ERROR("Cannot spawn sender thread for " << worker->label);
+        mIsStopped = true;
+        break;
+      }
+    }
+
+    bool retVal = (nStarted == mTxWorkers.size());
+    for (unsigned i = 0; i < nStarted; ++i)
+    {
+      void* result = NULL;
+      pthread_join(mTxWorkers[i]->thread, &result);
+      retVal = retVal && (NULL == result);
+    }
+
+    return retVal;
+  }
+
+  // Walk all interfaces from this thread
+  (void) Common::applyThreadSettings(Common::THREAD_TX);
+  int msgSeqNumber = 1;
+  long round = 0;
+  uint64_t startNs = Common::getMonotonicNs();
+  for (unsigned i = 0; i < mTxWorkers.size(); ++i)
+  {
+    mTxWorkers[i]->stats.startNs = startNs;
+  }
+
+  bool retVal = true;
+  do
+  {
+    for (unsigned i = 0; i < mTxWorkers.size() && retVal; ++i)
+    {
+      retVal = sendRound(*mTxWorkers[i], msgSeqNumber);
+    }
+
+    if (!retVal || (mSendCount > 0 && ++round >= mSendCount))
+    {
+      break;
+    }
+
+    // loop interval
+    if (shouldLoop())
+    {
+      msgSeqNumber += mGsoSegments;
+      (void) sleepUnlessStopped((uint64_t) (mLoopInterval * 1e9));
+    }
+
+  } while (shouldLoop() && !mIsStopped);
+
+  for (unsigned i = 0; i < mTxWorkers.size(); ++i)
+  {
+    if (mTxWorkers[i]->fec && mTxWorkers[i]->fec->flush())
+    {
+      sendParity(*mTxWorkers[i]);
+    }
+
+    if (mTxWorkers[i]->zcPool)
+    {
+      mTxWorkers[i]->zcPool->drain(ZC_DRAIN_MS);
+    }
+  }
+
+  uint64_t stopNs = Common::getMonotonicNs();
+  for (unsigned i = 0; i < mTxWorkers.size(); ++i)
+  {
+    mTxWorkers[i]->stats.stopNs = stopNs;
+  }
+
+  return retVal;
+}
+
+bool SenderModule::handleNack(unsigned ifaceIdx, const struct sockaddr_storage& requester,
+    const string& message)
+{
+  string group;
+  vector<SeqRange> ranges;
+  if (!Common::decodeNackMessage(message, group, ranges))
+  {
+    return false;
+  }
+
+  ++mRetxStats.nacks;
+  if (ifaceIdx >= mTxWorkers.size() || !mTxWorkers[ifaceIdx]->retx || !mDestReady)
+  {
+    LOG_DEBUG("Ignoring NACK for " << group);
+    return true;
+  }
+
+  // destination the NACK is about, addresses compared in binary form
+  struct in6_addr groupAddr, destAddr;
+  int family = isIpV6()? AF_INET6 : AF_INET;
+  int destIdx = -1;
+  if (1 != inet_pton(family, group.c_str(), &groupAddr))
+  {
+    LOG_DEBUG("Bad NACK group " << group);
+    return true;
+  }
+
+  for (unsigned i = 0; i < mMcastAddresses.size() && 0 > destIdx; ++i)
+  {
+    if (1 == inet_pton(family, mMcastAddresses[i].c_str(), &destAddr) &&
+        0 == memcmp(&groupAddr, &destAddr, isIpV6()? sizeof(struct in6_addr) : sizeof(struct in_addr)))
+    {
+      destIdx = i;
+    }
+  }
+
+  if (0 > destIdx)
+  {
+    LOG_DEBUG("NACK for unknown group " << group);
+    return true;
+  }
+
+  // a second receiver asking for the same datagram turns it into a multicast retransmission
+  uint64_t dueNs = Common::getMonotonicNs() + NACK_HOLD_NS;
+  unsigned budget = mNackRingLen;
+  for (unsigned r = 0; r < ranges.size(); ++r)
+  {
+    for (uint32_t seq = ranges[r].first; budget > 0; ++seq, --budget)
+    {
+      ++mRetxStats.requested;
+      uint64_t key = ((uint64_t) ifaceIdx << 48) | ((uint64_t) destIdx << 32) | seq;
+      map<uint64_t, PendingRetx>::iterator it = mPendingRetx.find(key);
+      if (mPendingRetx.end() == it)
+      {
+        PendingRetx& pending = mPendingRetx[key];
+        memcpy(&pending.requester, &requester, sizeof(requester));
+        pending.nRequesters = 1;
+        pending.dueNs = dueNs;
+      }
+      else if (0 != memcmp(&it->second.requester, &requester, sizeof(requester)))
+      {
+        it->second.nRequesters = 2;
+      }
+
+      if (seq == ranges[r].last)
+      {
+        break;
+      }
+    }
+  }
+
+  return true;
+}
+
+uint64_t SenderModule::flushRetransmits()
+{
+  uint64_t now = Common::getMonotonicNs();
+  uint64_t nextDueNs = 0;
+  map<uint64_t, PendingRetx>::iterator it = mPendingRetx.begin();
+  while (it != mPendingRetx.end())
+  {
+    const PendingRetx& pending = it->second;
+    if (pending.dueNs > now)
+    {
+      nextDueNs = nextDueNs? std::min(nextDueNs, pending.dueNs) : pending.dueNs;
+      ++it;
+      continue;
+    }
+
+    TxWorker& worker = *mTxWorkers[it->first >> 48];
+    const struct sockaddr_storage& dest = (pending.nRequesters > 1)?
+        mDestAddrs[(it->first >> 32) & 0xffff] : pending.requester;
+    unsigned len = mRetxBuf.size();
+    if (!worker.retx->load((uint32_t) it->first, &mRetxBuf[0], len))
+    {
+      ++mRetxStats.missing;
+    }
+    else if (0 > sendto(mIfaces[worker.ifaceIdx].sockFd, &mRetxBuf[0], len, 0,
+        (const struct sockaddr*) &dest, sizeof(dest)))
+    {
+      LOG_DEBUG("Retransmitting " << (uint32_t) it->first << ": " << strerror(errno));
+    }
+    else if (pending.nRequesters > 1)
+    {
+      ++mRetxStats.multicast;
+    }
+    else
+    {
+      ++mRetxStats.unicast;
+    }
+
+    mPendingRetx.erase(it++);
+  }
+
+  return nextDueNs? nextDueNs - now : 0;
+}
+
+/**
+ * One more ACK from entry
+ */
+static void touchReceiver(ReceiverEntry& entry)
+{
+  ++entry.acks;
+  entry.lastSeenNs = Common::getMonotonicNs();
+  entry.firstSeenNs = entry.firstSeenNs? entry.firstSeenNs : entry.lastSeenNs;
+}
+
+void SenderModule::handleAck(int fd, int ifaceIdx, const struct sockaddr_storage& receiver,
+    const string& message)
+{
+  ++mAckStats.messages;
+  uint64_t nowNs = Common::getRealtimeNs();
+
+  string acked;
+  uint32_t pid = 0;
+  if (!Common::decodeAckSender(message, acked, pid))
+  {
+    acked = message;
+  }
+
+  // summaries carry the totals of their stream, per packet ACKs echo the datagram
+  AckSummary summary;
+  uint32_t seq = 0;
+  uint64_t rttNs = 0;
+  if (Common::decodeAckSummary(acked, summary))
+  {
+    ++mAckStats.summaries;
+    ReceiverEntry& entry = mReceivers.get(ReceiverKey(receiver, pid, summary.group));
+    entry.acked = summary.received;
+    entry.lost = summary.lost;
+    entry.highest = summary.highest;
+    seq = summary.highest;
+    if (summary.echoNs && nowNs > summary.echoNs + summary.holdNs)
+    {
+      rttNs = nowNs - summary.echoNs - summary.holdNs;
+      entry.rtt.add(rttNs);
+    }
+    touchReceiver(entry);
+    checkAnswered(entry);
+  }
+  else
+  {
+    ++mAckStats.perPacket;
+    ReceiverEntry& entry = mReceivers.get(ReceiverKey(receiver, pid, ""));
+    ++entry.acked;
+
+    uint32_t ackedSeq;
+    uint64_t sendTimeNs;
+    if (Common::decodeMessageHeader(acked.c_str(), acked.size(), ackedSeq, sendTimeNs))
+    {
+      seq = ackedSeq;
+      entry.highest = std::max(entry.highest, seq);
+      entry.lost = (entry.highest > entry.acked)? entry.highest - entry.acked : 0;
+      if (0 < sendTimeNs && sendTimeNs < nowNs)
+      {
+        rttNs = nowNs - sendTimeNs;
+        entry.rtt.add(rttNs);
+      }
+    }
+    touchReceiver(entry);
+    checkAnswered(entry);
+  }
+
+  if (rttNs)
+  {
+    mAckRtt.add(rttNs);
+  }
+
+  int ifindex = (0 <= ifaceIdx && ifaceIdx < (int) mTxWorkers.size())?
+      mTxWorkers[ifaceIdx]->ifindex : 0;
+  MCASTIT_PROBE5(ack_received, fd, ifindex, seq, message.size(), rttNs);
+}
+
+void SenderModule::printStats() const
+{
+  if (mTxWorkers.empty())
+  {
+    return;
+  }
+
+  TxStats total;
+  double totalRate = 0;
+  cout << "==============================================================" << endl;
+  for (unsigned i = 0; i < mTxWorkers.size(); ++i)
+  {
+    const TxStats& stats = mTxWorkers[i]->stats;
+    uint64_t stopNs = stats.stopNs? stats.stopNs : Common::getMonotonicNs();
+    double elapsed = (stopNs - stats.startNs) / 1e9;
+    double rate = (stats.startNs && elapsed > 0)? stats.sent / elapsed : 0;
+
+    printf("[TX] %-30s sent: %llu bytes: %llu blocked: %llu errors: %llu late: %llu (%.1f pps)\n",
+        mTxWorkers[i]->label.c_str(), (unsigned long long) stats.sent,
+        (unsigned long long) stats.bytes, (unsigned long long) stats.blocked,
+        (unsigned long long) stats.errors, (unsigned long long) stats.late, rate);
+    if (mGsoSegments > 1)
+    {
+      printf("[TX] %-30s segmented sends: %llu%s\n", "", (unsigned long long) stats.gsoSends,
+          mTxWorkers[i]->useGso? "" : " (fell back to one send per datagram)");
+    }
+
+    const ZeroCopyPool* zcPool = mTxWorkers[i]->zcPool;
+    if (zcPool)
+    {
+      // kernel copied sends and sends without a free buffer both count as copied
+      uint64_t copied = zcPool->getCopied() + stats.zcFallback;
+      char ratio[32] = "n/a";
+      if (copied)
+      {
+        snprintf(ratio, sizeof(ratio), "%.2f", (double) zcPool->getZeroCopied() / copied);
+      }
+      printf("[TX] %-30s zero copy sends: %llu completed: %llu copied by kernel: %llu "
+          "no buffer: %llu (zero copy/copied %s)\n", "",
+          (unsigned long long) zcPool->getSends(), (unsigned long long) zcPool->getZeroCopied(),
+          (unsigned long long) zcPool->getCopied(), (unsigned long long) stats.zcFallback, ratio);
+    }
+
+    const FecEncoder* fec = mTxWorkers[i]->fec;
+    if (fec)
+    {
+      uint64_t nData = stats.sent / std::max((size_t) 1, mDestAddrs.size());
+      printf("[TX] %-30s fec %s %u+%u (%s) parity sent: %llu encode: %.1f ns/datagram\n", "",
+          fec->getCodeName(), mFecBlockLen, mFecParity,
+          GaloisField::getKernelName(GaloisField::getKernel()), (unsigned long long) stats.fecParity,
+          nData? (double) stats.fecNs / nData : 0);
+    }
+
+    const TxWorker& worker = *mTxWorkers[i];
+    if (!mShape.isConstant())
+    {
+      printf("[TX] %-30s %s, start error: %s\n", "", mShape.toString().c_str(),
+          worker.startError.toString(1000, "us").c_str());
+    }
+    if (worker.burstSpan.getCount())
+    {
+      // datagrams of a burst over the time from its first send to its last
+      double spanNs = worker.burstSpan.getMean() * worker.burstSpan.getCount();
+      printf("[TX] %-30s burst span: %s, %.0f pps within bursts\n", "",
+          worker.burstSpan.toString(1000, "us").c_str(),
+          worker.burstRounds * mGsoSegments * mDestAddrs.size() / spanNs * 1e9);
+    }
+
+    total.sent += stats.sent;
+    total.bytes += stats.bytes;
+    total.blocked += stats.blocked;
+    total.errors += stats.errors;
+    total.late += stats.late;
+    totalRate += rate;
+  }
+
+  printf("[TX] %-30s sent: %llu bytes: %llu blocked: %llu errors: %llu late: %llu (%.1f pps)\n",
+      "total", (unsigned long long) total.sent, (unsigned long long) total.bytes,
+      (unsigned long long) total.blocked, (unsigned long long) total.errors,
+      (unsigned long long) total.late, totalRate);
+
+  if (mNackRingLen)
+  {
+    printf("[TX] %-30s nacks: %llu requested: %llu multicast: %llu unicast: %llu not in ring: %llu\n",
+        "retransmissions", (unsigned long long) mRetxStats.nacks,
+        (unsigned long long) mRetxStats.requested, (unsigned long long) mRetxStats.multicast,
+        (unsigned long long) mRetxStats.unicast, (unsigned long long) mRetxStats.missing);
+  }
+
+  if (mAckStats.messages)
+  {
+    printReceivers();
+  }
+
+  if (mExpectedAcks && mIsSendDone)
+  {
+    printf("[TX] %-30s listeners that acked the last datagram: %u of %u in %.1f ms\n",
+        "ack window", mAnswered.size(), mExpectedAcks, mAckWaitNs / 1e6);
+  }
+}
+
+void SenderModule::printReceivers() const
+{
+  // listeners are silent if they stopped acking before the end of sending
+  uint64_t endNs = 0;
+  for (unsigned i = 0; i < mTxWorkers.size(); ++i)
+  {
+    uint64_t stopNs = mTxWorkers[i]->stats.stopNs;
+    endNs = std::max(endNs, stopNs? stopNs : Common::getMonotonicNs());
+  }
+
+  uint64_t acked = 0, lost = 0;
+  vector<unsigned> flagged;
+  for (unsigned i = 0; i < mReceivers.size(); ++i)
+  {
+    const ReceiverEntry& entry = mReceivers[i];
+    acked += entry.acked;
+    lost += entry.lost;
+
+    bool isSilent = entry.lastSeenNs + RECEIVER_SILENT_NS < endNs;
+    bool isLossy = entry.lost * 100 > RECEIVER_LOSSY_PERCENT * (entry.acked + entry.lost);
+    if (isSilent || isLossy)
+    {
+      flagged.push_back(i);
+    }
+  }
+
+  printf("[TX] %-30s messages: %llu summaries: %llu receivers: %u datagrams acked: %llu "
+      "lost: %llu\n", "acks", (unsigned long long) mAckStats.messages,
+      (unsigned long long) mAckStats.summaries, mReceivers.size(),
+      (unsigned long long) acked, (unsigned long long) lost);
+  if (mAckRtt.getCount())
+  {
+    printf("[TX] %-30s %s\n", "ack rtt", mAckRtt.toString(1000, "us").c_str());
+  }
+
+  for (unsigned i = 0; i < flagged.size() && i < RECEIVER_REPORT_MAX; ++i)
+  {
+    const ReceiverEntry& entry = mReceivers[flagged[i]];
+    uint64_t total = entry.acked + entry.lost;
+    double silentSec = (endNs > entry.lastSeenNs)? (endNs - entry.lastSeenNs) / 1e9 : 0;
+    printf("[TX] %-45s acked: %llu lost: %llu (%.2f%%) silent for: %.1f s rtt p50: %.1f us\n",
+        entry.key.toString().c_str(), (unsigned long long) entry.acked,
+        (unsigned long long) entry.lost, total? 100.0 * entry.lost / total : 0, silentSec,
+        entry.rtt.getPercentile(50) / 1e3);
+  }
+  if (flagged.size() > RECEIVER_REPORT_MAX)
+  {
+    printf("[TX] ... %u more silent or lossy receivers\n",
+        (unsigned) (flagged.size() - RECEIVER_REPORT_MAX));
+  }
+}
+
+void* SenderModule::rxThreadHelper(void* context)
+{
+  return ((SenderModule*)context)->runUcastReceiver();
+}
+
+void* SenderModule::txWorkerHelper(void* context)
+{
+  static int randNum = 1;
+  TxWorker* worker = (TxWorker*)context;
+  if (worker->module->runTxWorker(*worker))
+  {
+    return 0;
+  }
+  return &randNum;
+}
+
+void SenderModule::reapZeroCopy(int ifaceIdx)
+{
+  if (0 <= ifaceIdx && ifaceIdx < (int) mTxWorkers.size() && mTxWorkers[ifaceIdx]->zcPool)
+  {
+    mTxWorkers[ifaceIdx]->zcPool->reapCompletions();
+  }
+}
+
+bool SenderModule::init()
+{
+  /*
+   * First, setup mcast for all interfaces
+   */
+  for (unsigned i = 0; i < mIfaces.size(); ++i)
+  {
+    bool setMcastOk;
+    if (isIpV6())
+    {
+      setMcastOk = associateMcastV6WithIfaceName(mIfaces[i].sockFd,
+          mIfaces[i].ifaceName.c_str(), mLoopbackCount<0 || (int)i < mLoopbackCount);
+    }
+    else
+    {
+      setMcastOk = associateMcastWithIfaceName(mIfaces[i].sockFd,
+          mIfaces[i].ifaceName.c_str(), mLoopbackCount<0 || (int)i < mLoopbackCount);
+    }
+
+    if (!setMcastOk)
+    {
+      LOG_ERROR("Setting mcast for " << mIfaces[i]);
+      return false;
+    }
+  }
+
+  // shaped rounds are timed by the pacing threads
+  if (!mShape.isConstant() && !mThreadPerIface)
+  {
+    cout << "Traffic shape " << mShape.toString() << " sent from one thread per interface" << endl;
+    mThreadPerIface = true;
+  }
+
+  /*
+   * Then the send state of each interface, strings are built here since
+   * IfaceData helpers are not safe to call from the tx threads
+   */
+  for (unsigned i = 0; i < mIfaces.size(); ++i)
+  {
+    TxWorker* worker = new TxWorker();
+    worker->module = this;
+    worker->ifaceIdx = i;
+    worker->ifindex = if_nametoindex(mIfaces[i].ifaceName.c_str());
+    worker->label = mIfaces[i].toString();
+    worker->info = "<Sender info: " + worker->label + ">";
+    worker->interval = mLoopInterval;
+    worker->numaNode = Common::getIfaceNumaNode(mIfaces[i].ifaceName);
+
+    if (mThreadPerIface)
+    {
+      if (mIfaceRates.size() && mIfaceRates[i % mIfaceRates.size()] > 0)
+      {
+        worker->interval = 1.0 / mIfaceRates[i % mIfaceRates.size()];
+      }
+
+      if (mShape.hasOwnTiming())
+      {
+        worker->interval = mShape.getMeanGapNs(0) / 1e9;
+      }
+      else if (!mShape.isConstant() && worker->interval <= 0)
+      {
+        LOG_ERROR("Traffic shape " << mShape.toString() << " needs -i or --rate");
+        delete worker;
+        return false;
+      }
+      mShape.initState(worker->shape, i);
+
+      cout << "Sender thread " << worker->label
+           << " cpu " << Common::getThreadCpu(Common::THREAD_TX, i)
+           << " NUMA node " << worker->numaNode
+           << " interval " << worker->interval << " second(s)";
+      if (!mShape.isConstant())
+      {
+        cout << " average, " << mShape.toString();
+      }
+      cout << endl;
+    }
+
+    // datagrams are prepared once the interval is known, sending only patches the headers
+    if (!buildTemplate(*worker))
+    {
+      delete worker;
+      return false;
+    }
+    worker->useGso = mGsoSegments > 1 && mGsoSegments * worker->segSize <= UDP_MAX_GSO_LEN;
+    if (worker->useGso)
+    {
+      // probe kernel support, sends still fall back if the path refuses it
+      int gsoSize = 0;
+      socklen_t optLen = sizeof(gsoSize);
+      if (0 != getsockopt(mIfaces[i].sockFd, SOL_UDP, UDP_SEGMENT, &gsoSize, &optLen))
+      {
+        LOG_ERROR("No UDP_SEGMENT support for " << worker->label << ": " << strerror(errno)
+            << ", sending one datagram at a time");
+        worker->useGso = false;
+      }
+    }
+
+    if (mNackRingLen && !worker->hasHeader)
+    {
+      LOG_ERROR("NACKs need sequenced datagrams, use -i, --rate or --gso");
+    }
+    else if (mNackRingLen)
+    {
+      worker->retx = new RetransmitRing();
+      if (!worker->retx->init(mNackRingLen, worker->segSize, worker->numaNode))
+      {
+        delete worker;
+        return false;
+      }
+      mRetxBuf.resize(std::max((unsigned) mRetxBuf.size(), worker->segSize));
+    }
+
+    if (mFecBlockLen && !worker->hasHeader)
+    {
+      LOG_ERROR("FEC needs sequenced datagrams, use -i, --rate or --gso");
+      delete worker;
+      return false;
+    }
+    else if (mFecBlockLen)
+    {
+      // parity is FEC_HEADER_LEN longer than the data, it mustn't be the only one fragmented
+      unsigned mtu = Common::getIfaceMtu(mIfaces[i].ifaceName);
+      unsigned overhead = isIpV6()? UDP_IPV6_OVERHEAD : UDP_IPV4_OVERHEAD;
+      if (worker->segSize + overhead <= mtu && worker->segSize + FEC_HEADER_LEN + overhead > mtu)
+      {
+        LOG_ERROR("FEC parity of " << worker->label << " exceeds its MTU " << mtu
+            << ", use --size " << mtu - overhead - FEC_HEADER_LEN << " or less");
+        delete worker;
+        return false;
+      }
+
+      worker->fec = new FecEncoder();
+      if (!worker->fec->init(mFecBlockLen, mFecParity, worker->segSize, worker->numaNode))
+      {
+        delete worker;
+        return false;
+      }
+    }
+
+    if (mUseZeroCopy)
+    {
+      worker->zcPool = new ZeroCopyPool();
+      if (!worker->zcPool->init(mIfaces[i].sockFd, mGsoSegments * worker->segSize,
+          mMcastAddresses.size() * mGsoSegments, worker->numaNode))
+      {
+        LOG_ERROR("No zero copy for " << worker->label << ", copying instead");
+        delete worker->zcPool;
+        worker->zcPool = NULL;
+      }
+      else
+      {
+        worker->zcPool->setTemplate(worker->txBuf.getSlot(0), mGsoSegments * worker->segSize);
+      }
+    }
+
+    mTxWorkers.push_back(worker);
+  }
+
+  if (!mStatsName.empty())
+  {
+    if (!mStatsPage.create(mStatsName, STATS_ROLE_SENDER))
+    {
+      return false;
+    }
+    cout << "Statistics page " << mStatsPage.toString() << endl;
+  }
+
+  return true;
+}
+
+uint64_t SenderModule::checkStatsPage(uint64_t waitNs)
+{
+  if (!mStatsPage.isOpen())
+  {
+    return waitNs;
+  }
+
+  if (mStatsPage.isUpdateDue(Common::getMonotonicNs()))
+  {
+    updateStatsPage();
+  }
+  return waitNs? std::min(waitNs, (uint64_t) STATS_UPDATE_NS) : STATS_UPDATE_NS;
+}
+
+void SenderModule::updateStatsPage()
+{
+  // counters of the pacing threads are read as they go, each of them is a whole word
+  mStatsPage.beginUpdate();
+  unsigned nIfaces = std::min((unsigned) mTxWorkers.size(), (unsigned) STATS_MAX_IFACES);
+  for (unsigned i = 0; i < nIfaces; ++i)
+  {
+    const TxStats& stats = mTxWorkers[i]->stats;
+    StatsIface& iface = mStatsPage.getIface(i);
+    memset(&iface, 0, sizeof(iface));
+    const string& ifaceName = mIfaces[mTxWorkers[i]->ifaceIdx].ifaceName;
+    strncpy(iface.name, ifaceName.empty()? "default" : ifaceName.c_str(), sizeof(iface.name) - 1);
+    iface.packets = stats.sent;
+    iface.bytes = stats.bytes;
+    iface.blocked = stats.blocked;
+    iface.errors = stats.errors;
+  }
+  mStatsPage.endUpdate(nIfaces, 0, 0);
 }
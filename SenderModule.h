@@ -2,6 +2,107 @@
 #define MCAST_TOOL_MCASTSENDERMODULE_H_
 
 #include "McastModuleInterface.h"
+#include "ZeroCopyPool.h"
+#include "RetransmitRing.h"
+#include "FecCodec.h"
+#include "ReceiverTable.h"
+#include "TrafficShape.h"
+#include "StatsPage.h"
+
+#define ACK_WINDOW_MS (3000)  // ACKs are awaited this long after the last datagram by default
+#define ACK_WINDOW_MAX_MS (3600000) // longest ACK window, an hour
+#define ACK_EXPECT_MAX (1 << 20)    // most listeners awaited in the ACK window
+
+class SenderModule;
+
+/**
+ * Sender counters, each one is only written by its own tx thread
+ */
+struct TxStats
+{
+  uint64_t sent;        // datagrams sent
+  uint64_t bytes;       // payload bytes sent
+  uint64_t blocked;     // datagrams dropped because of EAGAIN/ENOBUFS
+  uint64_t errors;      // other send errors
+  uint64_t late;        // rounds that started behind schedule
+  uint64_t gsoSends;    // segmented sends, each carries several datagrams
+  uint64_t zcFallback;  // sends copied because no zero copy buffer was available
+  uint64_t fecParity;   // parity datagrams sent
+  uint64_t fecNs;       // time spent computing parity
+  uint64_t startNs, stopNs;
+
+  TxStats(): sent(0), bytes(0), blocked(0), errors(0), late(0), gsoSends(0), zcFallback(0),
+      fecParity(0), fecNs(0), startNs(0), stopNs(0) {}
+};
+
+/**
+ * Retransmission counters, only written by the ACK listener thread
+ */
+struct RetxStats
+{
+  uint64_t nacks;       // NACK messages received
+  uint64_t requested;   // sequences asked for
+  uint64_t multicast;   // datagrams sent again to the group
+  uint64_t unicast;     // datagrams sent again to the only receiver that asked
+  uint64_t missing;     // asked for but no longer in the ring
+
+  RetxStats(): nacks(0), requested(0), multicast(0), unicast(0), missing(0) {}
+};
+
+/**
+ * ACK counters, only written by the ACK listener thread
+ */
+struct AckStats
+{
+  uint64_t messages;    // ACK messages received, per packet & summaries
+  uint64_t perPacket;   // datagrams acknowledged one by one
+  uint64_t summaries;
+
+  AckStats(): messages(0), perPacket(0), summaries(0) {}
+};
+
+/**
+ * Retransmission waiting for NACKs of other receivers
+ */
+struct PendingRetx
+{
+  struct sockaddr_storage requester;  // first receiver that asked
+  unsigned nRequesters;               // 1, or 2 for more than one
+  uint64_t dueNs;                     // monotonic
+};
+
+/**
+ * Send state of one interface in mIfaces
+ */
+struct TxWorker
+{
+  SenderModule* module;
+  unsigned      ifaceIdx;
+  int           ifindex;   // of the interface, 0 if sent on the kernel's choice
+  float         interval;  // seconds between rounds, <= 0 if send once
+  int           numaNode;  // node of the interface, -1 if unknown
+  string        label;     // readable iface name, safe to use from tx thread
+  string        info;      // "<Sender info: iface (address)>"
+  unsigned      segSize;   // datagram size, all datagrams of a worker have the same size
+  bool          hasHeader; // datagrams start with sequence & send time
+  bool          useGso;    // false once the kernel or path refused UDP_SEGMENT
+  PacketArena   txBuf;     // template of all datagrams of one round in one slot, built once at init
+  uint32_t      lastSeq;   // of the last datagram sent, 0 if not sequenced
+  ZeroCopyPool* zcPool;    // MSG_ZEROCOPY buffers, NULL if copying
+  RetransmitRing* retx;    // datagrams kept for NACKs, NULL if not served
+  FecEncoder*   fec;       // parity of the datagrams sent, NULL without FEC
+  pthread_t     thread;
+  TxStats       stats;
+  ShapeState    shape;     // position in the traffic shape
+  Histogram     startError;  // burst start behind its deadline, traffic shapes only
+  Histogram     burstSpan;   // first to last send of bursts of several rounds
+  uint64_t      burstRounds; // rounds sent in those bursts
+
+  TxWorker(): module(NULL), ifaceIdx(0), ifindex(0), interval(-1), numaNode(-1), segSize(0),
+      hasHeader(false), useGso(false), lastSeq(0),
+      zcPool(NULL), retx(NULL), fec(NULL), thread(0), burstRounds(0) {}
+  ~TxWorker() { delete zcPool; delete retx; delete fec; }
+};
 
 /**
  * Send multicast
@@ -11,14 +112,97 @@ class SenderModule: public McastModuleInterface
 public:
   SenderModule(const vector<IfaceData>& ifaces, const vector<string>& mcastAddresses,
       int mcastPort, int nLoopbackIfaces, bool useIpV6, float loopInterval);
-  virtual ~SenderModule() {}
+  virtual ~SenderModule();
   bool run();
+  void printStats() const;
 
   /**
    * Listen for ACK messages from receiver modules
    */
   void* runUcastReceiver();
 
+  /**
+   * Don't print a line per received ACK, only the statistics
+   * @param enable
+   */
+  void setQuiet(bool enable = true);
+
+  /**
+   * Send from one pacing thread per interface instead of walking mIfaces serially
+   * @param enable
+   */
+  void setThreadPerIface(bool enable = true);
+
+  /**
+   * Rate targets in rounds per second for the per interface threads, in mIfaces order
+   * Interfaces without rate use the loop interval
+   * @param rates
+   */
+  void setIfaceRates(const vector<float>& rates);
+
+  /**
+   * Stop after sending count rounds
+   * @param count - number of rounds, <= 0 to loop forever
+   */
+  void setSendCount(long count);
+
+  /**
+   * Pad or truncate every datagram to size bytes
+   * @param size - datagram size, 0 to send the text as is
+   */
+  void setPayloadSize(unsigned size);
+
+  /**
+   * Coalesce nSegments equal size datagrams into one send with UDP_SEGMENT,
+   * falls back to one send per datagram if the kernel or path doesn't support it
+   * @param nSegments - datagrams per round, each with its own sequence number
+   */
+  void setGsoSegments(unsigned nSegments);
+
+  /**
+   * Send from a pool of buffers with MSG_ZEROCOPY, buffers are recycled
+   * when their completion notification is read from the socket error queue
+   * @param enable
+   */
+  void setZeroCopy(bool enable = true);
+
+  /**
+   * Serve NACKs from receivers: keep the last nDatagrams sent of each interface
+   * and send the missing ones again, to the group if several receivers asked,
+   * to the receiver otherwise
+   * @param nDatagrams - retransmit ring size, 0 to ignore NACKs
+   */
+  void setNackRing(unsigned nDatagrams);
+
+  /**
+   * Send nParity parity datagrams after every blockLen data datagrams so that
+   * receivers can rebuild up to nParity lost datagrams of a block without asking:
+   * XOR parity with one parity datagram, Reed-Solomon with more
+   * @param blockLen  - data datagrams per block, 0 to disable FEC
+   */
+  void setFec(unsigned blockLen, unsigned nParity);
+
+  /**
+   * Send rounds in bursts, on/off periods, poisson arrivals or replayed gaps
+   * instead of one per interval, from the per interface threads
+   * @param shape - see TrafficShape
+   */
+  void setTrafficShape(const TrafficShape& shape);
+
+  /**
+   * Keep the interface counters in a shared memory page for monitors,
+   * updated every STATS_UPDATE_NS by the ACK listener, see StatsPage.h
+   * @param name - /dev/shm/{name}, replaced if it exists
+   */
+  void setStatsPage(const string& name);
+
+  /**
+   * Keep listening for ACKs after the last datagram until nReceivers listeners
+   * acknowledged it, or for timeoutMs at most
+   * @param nReceivers - 0 to always wait timeoutMs
+   */
+  void setAckWindow(unsigned nReceivers, unsigned timeoutMs);
+
 protected:
   /**
    * Init all interfaces
@@ -33,21 +217,172 @@ protected:
    */
   bool sendMcastMessages(int port = -1);
 
+  /**
+   * Queue the retransmissions asked by a NACK received on interface ifaceIdx
+   * @param requester - receiver that sent the NACK
+   * @return false if message isn't a NACK
+   */
+  bool handleNack(unsigned ifaceIdx, const struct sockaddr_storage& requester, const string& message);
+
+  /**
+   * Send the queued retransmissions that are due
+   * @return ns until the next one is due, 0 if none is queued
+   */
+  uint64_t flushRetransmits();
+
+  /**
+   * Read the zero copy completions of interface ifaceIdx, they keep its socket
+   * readable to select without any data to receive
+   */
+  void reapZeroCopy(int ifaceIdx);
+
+  /**
+   * Account for an ACK received from a listener in its receiver table entry,
+   * per packet ACKs count one datagram, summaries replace the stream totals
+   * @param fd        - socket the ACK was received on
+   * @param ifaceIdx  - interface of that socket, -1 if not one of the interfaces
+   * @param receiver  - address the ACK came from
+   * @param message   - decoded ack, see Common::decodeAckMessage
+   */
+  void handleAck(int fd, int ifaceIdx, const struct sockaddr_storage& receiver,
+      const string& message);
+
+  /**
+   * Print totals of the receiver table & the silent or lossy receivers
+   */
+  void printReceivers() const;
+
+  /**
+   * Copy the interface counters to the statistics page when an update is due,
+   * from the ACK listener only
+   * @param waitNs - until the caller's next timer, 0 if none
+   * @return waitNs, shortened to the next update if the page is used
+   */
+  uint64_t checkStatsPage(uint64_t waitNs);
+
+  /**
+   * Copy the interface counters to the statistics page now
+   */
+  void updateStatsPage();
+
+  /**
+   * Count the listener of entry as answered if it acknowledged the last datagram,
+   * stop() once the expected listeners did, ACK listener thread only
+   */
+  void checkAnswered(const ReceiverEntry& entry);
+
+  /**
+   * Wait out the ACK window after the last datagram, returns early on stop()
+   */
+  void waitForAcks();
+
 private:
   // true if should send message in loop
   bool shouldLoop() const;
 
+  /**
+   * Fill mDestAddrs with mcast addresses on port
+   * @return true on success
+   */
+  bool buildDestinations(int port);
+
+  /**
+   * Build the datagrams of one round in worker.txBuf, only their headers change afterwards
+   * @return true on success
+   */
+  bool buildTemplate(TxWorker& worker) const;
+
+  /**
+   * Patch sequence and send time of the datagrams of one round in place
+   * @param buf           - copy of worker.txBuf
+   * @param msgSeqNumber  - sequence of the first datagram
+   */
+  void stampRound(const TxWorker& worker, char* buf, int msgSeqNumber) const;
+
+  /**
+   * Send one round of datagrams starting at sequence msgSeqNumber to all mcast addresses
+   * @return false on unrecoverable send error
+   */
+  bool sendRound(TxWorker& worker, int msgSeqNumber);
+
+  /**
+   * Send nSegments datagrams of segSize bytes in one UDP_SEGMENT send
+   * @return bytes sent, -1 on error, check errno
+   */
+  int sendSegmented(int fd, const char* buf, unsigned nSegments, unsigned segSize,
+      const struct sockaddr_storage& dest, int flags) const;
+
+  /**
+   * Send len bytes of buf to dest, segmented if nSegments > 1,
+   * with MSG_ZEROCOPY if buf belongs to the worker zero copy pool
+   * @return bytes sent, -1 on error, check errno
+   */
+  int sendBuffer(TxWorker& worker, char* buf, unsigned len, unsigned nSegments,
+      const struct sockaddr_storage& dest, bool isZeroCopy);
+
+  /**
+   * Add the datagrams of one round to the FEC blocks, send the parity of the completed ones
+   * @param buf           - datagrams of the round, stamped
+   * @param msgSeqNumber  - sequence of the first datagram
+   */
+  void encodeParity(TxWorker& worker, const char* buf, int msgSeqNumber);
+
+  /**
+   * Send the parity datagrams of the last completed block to all mcast addresses
+   */
+  void sendParity(TxWorker& worker);
+
+  /**
+   * Pacing loop of one interface
+   * @return true if all rounds were sent
+   */
+  bool runTxWorker(TxWorker& worker);
+
 private:
   int mLoopbackCount;
   float mLoopInterval; // loop micro seconds, -1 if send once
   string mMcastSingleAddress;
   int mSenderPort;
+  long mSendCount;
+  unsigned mPayloadSize;
+  unsigned mGsoSegments;
+  bool mUseZeroCopy;
+
+  bool mThreadPerIface;
+  vector<float> mIfaceRates;
+  vector<struct sockaddr_storage> mDestAddrs;
+  vector<TxWorker*> mTxWorkers;
+
+  unsigned mFecBlockLen;
+  unsigned mFecParity;
+  TrafficShape mShape;
+
+  unsigned mNackRingLen;
+  map<uint64_t, PendingRetx> mPendingRetx; // by interface, destination & sequence
+  vector<char> mRetxBuf;
+  RetxStats mRetxStats;
+  volatile bool mDestReady;                // mDestAddrs can be read by the ACK listener
+
+  bool mIsQuiet;
+  AckStats mAckStats;
+  ReceiverTable mReceivers;                // listeners that ACK, written by the ACK listener
+  Histogram mAckRtt;                       // of all listeners
+
+  string mStatsName;
+  StatsPage mStatsPage;                    // written by the ACK listener
+
+  unsigned mExpectedAcks;                  // listeners that end the ACK window, 0 to wait it all
+  unsigned mAckTimeoutMs;
+  int mSendDoneFd;                         // eventfd, wakes up the ACK listener when mIsSendDone
+  volatile bool mIsSendDone;               // mLastSeq is final
+  uint32_t mLastSeq;                       // highest sequence sent, 0 if not sequenced
+  ReceiverTable mAnswered;                 // listeners that acked mLastSeq, written by the ACK listener
+  uint64_t mAckWaitNs;                     // ACK window length
 
 // multi thread area -----------------------------
-private:
-  bool mIsStopped;
 public:
   static void* rxThreadHelper(void* context);
+  static void* txWorkerHelper(void* context);
 // -----------------------------------------------
 };
 
@@ -0,0 +1,92 @@
+#include "SequenceTracker.h"
+
+SequenceTracker::SequenceTracker() :
+    mReceived(0), mLost(0), mDuplicates(0), mReordered(0), mTooOld(0),
+    mHighest(0), mFirst(0), mHasSeq(false)
+{
+  memset(mWindow, 0, sizeof(mWindow));
+}
+
+bool SequenceTracker::isSeen(uint32_t seq) const
+{
+  unsigned bit = seq % SEQ_WINDOW_LEN;
+  return mWindow[bit / 64] & (1ULL << (bit % 64));
+}
+
+void SequenceTracker::setSeen(uint32_t seq, bool seen)
+{
+  unsigned bit = seq % SEQ_WINDOW_LEN;
+  if (seen)
+  {
+    mWindow[bit / 64] |= (1ULL << (bit % 64));
+  }
+  else
+  {
+    mWindow[bit / 64] &= ~(1ULL << (bit % 64));
+  }
+}
+
+SequenceTracker::SeqResult SequenceTracker::track(uint32_t seq)
+{
+  ++mReceived;
+
+  if (!mHasSeq)
+  {
+    mHasSeq = true;
+    mHighest = seq;
+    mFirst = seq;
+    setSeen(seq, true);
+    return SEQ_FIRST;
+  }
+
+  // signed distance so that wrap around of the sequence still moves forward
+  int32_t ahead = (int32_t)(seq - mHighest);
+  if (ahead > 0)
+  {
+    // forget the sequences that are now in front of the window
+    if (ahead >= SEQ_WINDOW_LEN)
+    {
+      memset(mWindow, 0, sizeof(mWindow));
+    }
+    else
+    {
+      for (uint32_t s = mHighest + 1; s != seq; ++s)
+      {
+        setSeen(s, false);
+      }
+    }
+
+    mLost += ahead - 1;
+    mHighest = seq;
+    setSeen(seq, true);
+    return (1 == ahead)? SEQ_NEXT : SEQ_GAP;
+  }
+
+  if (-ahead >= SEQ_WINDOW_LEN)
+  {
+    ++mTooOld;
+    return SEQ_TOO_OLD;
+  }
+
+  if (isSeen(seq))
+  {
+    ++mDuplicates;
+    return SEQ_DUPLICATE;
+  }
+
+  setSeen(seq, true);
+  ++mReordered;
+
+  // before the first sequence it was never counted lost, it's the new start of the stream
+  int32_t beforeFirst = (int32_t)(mFirst - seq);
+  if (beforeFirst > 0)
+  {
+    mLost += beforeFirst - 1;
+    mFirst = seq;
+  }
+  else
+  {
+    --mLost;
+  }
+  return SEQ_FILL;
+}
@@ -0,0 +1,53 @@
+#ifndef MCASTIT_SEQUENCETRACKER_H_
+#define MCASTIT_SEQUENCETRACKER_H_
+
+#include "Common.h"
+
+#define SEQ_WINDOW_LEN    (1024)  // sequences remembered behind the highest one
+
+/**
+ * Loss, duplicate and reorder tracking of one sequenced stream,
+ * uses a fixed size bitmap of the last SEQ_WINDOW_LEN sequences
+ */
+class SequenceTracker
+{
+public:
+  typedef enum _SeqResult
+  {
+    SEQ_FIRST=0,  // first sequence of the stream
+    SEQ_NEXT,     // highest + 1
+    SEQ_GAP,      // jumped ahead, sequences in between are counted lost
+    SEQ_FILL,     // fills an earlier gap, or comes before the first sequence
+    SEQ_DUPLICATE,
+    SEQ_TOO_OLD   // behind the window, can't tell fill from duplicate
+  } SeqResult;
+
+  SequenceTracker();
+
+  /**
+   * Account for one received sequence
+   * @param seq
+   * @return where seq falls in the stream
+   */
+  SeqResult track(uint32_t seq);
+
+  uint64_t getReceived() const   { return mReceived; }
+  uint64_t getLost() const       { return mLost; }
+  uint64_t getDuplicates() const { return mDuplicates; }
+  uint64_t getReordered() const  { return mReordered; }
+  uint64_t getTooOld() const     { return mTooOld; }
+  uint32_t getHighest() const    { return mHighest; }
+
+private:
+  bool isSeen(uint32_t seq) const;
+  void setSeen(uint32_t seq, bool seen);
+
+private:
+  uint64_t mReceived, mLost, mDuplicates, mReordered, mTooOld;
+  uint32_t mHighest;
+  uint32_t mFirst;    // lowest sequence received, losses are counted from there
+  bool     mHasSeq;
+  uint64_t mWindow[SEQ_WINDOW_LEN / 64];
+};
+
+#endif /* MCASTIT_SEQUENCETRACKER_H_ */
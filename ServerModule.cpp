@@ -67,12 +67,16 @@ bool ServerModule::run()
   if (-1 == (mUnicastSenderSock = Common::createSocket(isIpV6())))
   {
     LOG_ERROR("Cannot create socket");
+    stop();
+    pthread_join(txThread, NULL);
     return false;
   }
 
   if (-1 == Common::setReuseSocket(mUnicastSenderSock))
   {
     LOG_ERROR("Cannot set reuse socket");
+    stop();
+    pthread_join(txThread, NULL);
     return false;
   }
 
@@ -83,7 +87,7 @@ bool ServerModule::run()
   //
   // now prepare for select function
   //
-  int maxSockFd = mMcastListenSock;
+  int maxSockFd = std::max(mMcastListenSock, getStopFd());
   for (unsigned i = 0; i < mIfaces.size(); ++i)
   {
     maxSockFd = (maxSockFd < mIfaces[i].sockFd)? mIfaces[i].sockFd : maxSockFd;
@@ -94,8 +98,10 @@ bool ServerModule::run()
   char buffer[MCAST_BUFF_LEN];
   //-----------------------------------------------------------------------
 
+  (void) Common::applyThreadSettings(Common::THREAD_RX);
+
   // Main select loop -----------------------------------------------------
-  while (1)
+  while (!mIsStopped)
   {
     FD_ZERO(&rfds);
     FD_SET(mMcastListenSock, &rfds);
@@ -104,25 +110,44 @@ bool ServerModule::run()
     {
       FD_SET(mIfaces[i].sockFd, &rfds);
     }
+    if (-1 != getStopFd())
+    {
+      FD_SET(getStopFd(), &rfds);
+    }
 
-    timeout.tv_sec = 1;
-    timeout.tv_usec = 1;
+    // wake up for the next queued retransmission, the summary ACK timers & statistics page
+    uint64_t waitNs = flushRetransmits();
+    if (!mAckPolicy.isPerPacket())
+    {
+      checkAcks(Common::getRealtimeNs());
+      waitNs = waitNs? std::min(waitNs, (uint64_t) ACK_CHECK_NS) : ACK_CHECK_NS;
+    }
+    waitNs = checkStatsPage(waitNs);
+    timeout.tv_sec = waitNs? 0 : 1;
+    timeout.tv_usec = waitNs? waitNs / 1000 + 1 : 1;
     int numReady = select(maxSockFd + 1, &rfds, NULL, NULL, &timeout);
     if (numReady <= 0)
     {
-      if (-1 == numReady)
+      if (-1 == numReady && EINTR != errno)
       {
         LOG_ERROR("select: " << strerror(errno));
       }
       continue;
     }
 
+    // woken up by stop()
+    if (mIsStopped)
+    {
+      break;
+    }
+
     // for each found sock fd that detected from select()
     for (int i = 0; i < numReady; ++i)
     {
       // Retrieve the fd that has data
       IfaceData ifaceData;
       int fd = -1;
+      int ifaceIdx = -1;
       if (FD_ISSET(mUnicastSenderSock, &rfds))
       {
         fd = mUnicastSenderSock;
@@ -138,6 +163,7 @@ bool ServerModule::run()
           fd = mIfaces[ii].sockFd;
           if (FD_ISSET(fd, &rfds))
           {
+            ifaceIdx = ii;
             break;
           }
         }
@@ -148,8 +174,16 @@ bool ServerModule::run()
       socklen_t sendsize = sizeof(sender);
       bzero(&sender, sizeof(sender));
 
+      // don't block, zero copy completions on the error queue also wake up select
       memset(buffer, 0, sizeof(buffer));
-      int recvLen = recvfrom(fd, buffer, sizeof(buffer), 0, (struct sockaddr*) &sender, &sendsize);
+      int recvLen = recvfrom(fd, buffer, sizeof(buffer), MSG_DONTWAIT, (struct sockaddr*) &sender,
+          &sendsize);
+      if (0 > recvLen && (EAGAIN == errno || EWOULDBLOCK == errno))
+      {
+        // only completions, reap them here or select returns at once until the next send
+        reapZeroCopy(ifaceIdx);
+        continue;
+      }
       if (0 > recvLen)
       {
         LOG_ERROR("recvfrom " << fd << ": " << strerror(errno));
@@ -169,10 +203,18 @@ bool ServerModule::run()
         inet_ntop(sender.ss_family, &sender_addr->sin6_addr, senderIp, sizeof(senderIp));
       }
 
-      // print result message
+      // NACKs for the periodic sender
+      if (0 <= ifaceIdx && handleNack(ifaceIdx, sender, buffer))
+      {
+        LOG_DEBUG("[NACK] " << senderIp << " (" << buffer << ")");
+        continue;
+      }
+
+      // print result message, acks of the periodic sends count in the sender stats & aren't acked
       string decodedMsg;
       if (Common::decodeAckMessage(buffer, decodedMsg))
       {
+        handleAck(fd, ifaceIdx, sender, decodedMsg);
         if (isIpV6())
         {
           printf("[ACK] %-40s (%s)\n", senderIp, decodedMsg.c_str());
@@ -192,14 +234,7 @@ bool ServerModule::run()
         {
           printf("%-15s - %s\n", senderIp, buffer);
         }
-      }
-
-      // Build response message
-      string responseMsg;
-      Common::encodeAckMessage(buffer, responseMsg);
-      if (!Common::unicastMessage(mUnicastSenderSock, sender, responseMsg))
-      {
-        LOG_ERROR("sending ack message to " << senderIp);
+        ackMessage(sender, buffer, recvLen);
       }
 
       // rm fd so that it's not processed again
@@ -209,9 +244,89 @@ bool ServerModule::run()
   }
   // ----------------------------------------------------------------------
 
+  // the periodic sender checks mIsStopped between rounds
+  pthread_join(txThread, NULL);
   return true;
 }
 
+void ServerModule::setAckPolicy(const AckPolicy& policy)
+{
+  mAckPolicy = policy;
+}
+
+void ServerModule::ackMessage(struct sockaddr_storage& sender, const char* message, unsigned len)
+{
+  uint32_t seq;
+  uint64_t sendTimeNs;
+  if (!mAckPolicy.isPerPacket() && Common::decodeMessageHeader(message, len, seq, sendTimeNs))
+  {
+    unsigned i = 0;
+    while (i < mPeers.size() && 0 != memcmp(&mPeers[i].source, &sender, sizeof(sender)))
+    {
+      ++i;
+    }
+    if (i == mPeers.size())
+    {
+      mPeers.push_back(ServerPeer());
+      memcpy(&mPeers[i].source, &sender, sizeof(sender));
+    }
+
+    ServerPeer& peer = mPeers[i];
+    uint64_t nowNs = Common::getRealtimeNs();
+    (void) peer.seq.track(seq);
+    if (seq == peer.seq.getHighest())
+    {
+      peer.echoSendNs = sendTimeNs;
+      peer.echoRxNs = nowNs;
+    }
+    if (mAckPolicy.onDatagram(peer.ack, nowNs))
+    {
+      sendAckSummary(peer);
+    }
+    return;
+  }
+
+  // Build response message
+  string responseMsg;
+  Common::encodeAckMessage(message, responseMsg);
+  if (!Common::unicastMessage(mUnicastSenderSock, sender, responseMsg))
+  {
+    LOG_ERROR("sending ack message: " << strerror(errno));
+  }
+}
+
+void ServerModule::sendAckSummary(ServerPeer& peer)
+{
+  mAckPolicy.onSent(peer.ack);
+
+  // messages are read from one socket joined to every group, report the first one
+  AckSummary summary;
+  summary.group = mMcastAddresses.empty()? "-" : mMcastAddresses[0];
+  summary.received = peer.seq.getReceived();
+  summary.lost = peer.seq.getLost();
+  summary.highest = peer.seq.getHighest();
+  summary.echoNs = peer.echoSendNs;
+  summary.holdNs = peer.echoSendNs? Common::getRealtimeNs() - peer.echoRxNs : 0;
+
+  string ackMsg;
+  Common::encodeAckSummary(summary, ackMsg);
+  if (!Common::unicastMessage(mUnicastSenderSock, peer.source, ackMsg))
+  {
+    LOG_ERROR("sending summary ack: " << strerror(errno));
+  }
+}
+
+void ServerModule::checkAcks(uint64_t nowNs)
+{
+  for (unsigned i = 0; i < mPeers.size(); ++i)
+  {
+    if (mAckPolicy.isDue(mPeers[i].ack, nowNs))
+    {
+      sendAckSummary(mPeers[i]);
+    }
+  }
+}
+
 ServerModule::~ServerModule()
 {
   ::close(mMcastListenSock);
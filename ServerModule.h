@@ -2,6 +2,21 @@
 #define MCASTIT_SERVERMODULE_H_
 
 #include "SenderModule.h"
+#include "SequenceTracker.h"
+#include "AckPolicy.h"
+
+/**
+ * Sequenced messages from one sender, acknowledged by summaries
+ */
+struct ServerPeer
+{
+  struct sockaddr_storage source;
+  SequenceTracker seq;
+  AckTimer        ack;
+  uint64_t        echoSendNs, echoRxNs; // send & arrival time of the highest sequence
+
+  ServerPeer(): echoSendNs(0), echoRxNs(0) {}
+};
 
 class ServerModule: public SenderModule
 {
@@ -11,10 +26,36 @@ public:
   virtual ~ServerModule();
   bool run();
 
+  /**
+   * When sequenced messages are acknowledged, one ACK per message by default
+   * @param policy
+   */
+  void setAckPolicy(const AckPolicy& policy);
+
+private:
+  /**
+   * Acknowledge a message from sender, on its own or in the summary of its stream
+   * @param message - null terminated
+   */
+  void ackMessage(struct sockaddr_storage& sender, const char* message, unsigned len);
+
+  /**
+   * Send the summary ACK of one sender
+   */
+  void sendAckSummary(ServerPeer& peer);
+
+  /**
+   * Send the summary ACKs whose timer expired
+   */
+  void checkAcks(uint64_t nowNs);
+
 private:
   int mMcastListenSock, mUnicastSenderSock;
   int mMcastSendPort;
 
+  AckPolicy mAckPolicy;
+  vector<ServerPeer> mPeers;  // few senders, searched linearly
+
 // Multithread area --------------------------
 public:
   static void* txThreadHelper(void* context);
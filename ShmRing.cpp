@@ -0,0 +1,143 @@
+#include "ShmRing.h"
+#include <sys/mman.h>
+
+ShmRing::ShmRing() :
+    mHeader(NULL), mMapLen(0)
+{
+}
+
+ShmRing::~ShmRing()
+{
+  close();
+}
+
+void ShmRing::close()
+{
+  if (mHeader)
+  {
+    munmap(mHeader, mMapLen);
+    mHeader = NULL;
+  }
+}
+
+bool ShmRing::create(const string& name, unsigned nSlots)
+{
+  if (0 == nSlots || 0 != (nSlots & (nSlots - 1)))
+  {
+    LOG_ERROR("Shared memory ring of " << nSlots << " slots, must be a power of 2");
+    return false;
+  }
+
+  close();
+  mName = name;
+  mMapLen = sizeof(ShmRingHeader) + (size_t) nSlots * SHM_SLOT_LEN;
+  void* addr = Common::createSharedMemory(name, mMapLen);
+  if (!addr)
+  {
+    return false;
+  }
+
+  // magic last so readers see a whole header
+  mHeader = (ShmRingHeader*) addr;
+  mHeader->version = SHM_RING_VERSION;
+  mHeader->slotLen = SHM_SLOT_LEN;
+  mHeader->nSlots = nSlots;
+  mHeader->startNs = Common::getRealtimeNs();
+  __sync_synchronize();
+  mHeader->magic = SHM_RING_MAGIC;
+  return true;
+}
+
+bool ShmRing::open(const string& name)
+{
+  close();
+  mName = name;
+  const void* addr = Common::openSharedMemory(name, mMapLen);
+  if (!addr)
+  {
+    return false;
+  }
+
+  mHeader = (ShmRingHeader*) addr;
+  if (sizeof(ShmRingHeader) > mMapLen || SHM_RING_MAGIC != mHeader->magic ||
+      SHM_RING_VERSION != mHeader->version || mMapLen < sizeof(ShmRingHeader) + (size_t) mHeader->nSlots * mHeader->slotLen)
+  {
+    LOG_ERROR(name << " is not a version " << SHM_RING_VERSION << " ring");
+    close();
+    return false;
+  }
+
+  return true;
+}
+
+ShmSlotHeader* ShmRing::getSlot(uint64_t pos) const
+{
+  char* slots = (char*) mHeader + sizeof(ShmRingHeader);
+  return (ShmSlotHeader*) (slots + (pos & (mHeader->nSlots - 1)) * mHeader->slotLen);
+}
+
+void ShmRing::publish(const ShmSlotHeader& meta, const char* payload, unsigned len)
+{
+  uint64_t pos = mHeader->writeSeq;
+  ShmSlotHeader* slot = getSlot(pos);
+
+  // readers of the previous lap see a changed stamp
+  slot->stamp = 0;
+  __sync_synchronize();
+  memcpy((char*) slot + sizeof(uint64_t), (const char*) &meta + sizeof(uint64_t),
+      sizeof(ShmSlotHeader) - sizeof(uint64_t));
+  memcpy(slot + 1, payload, std::min(len, getMaxPayload()));
+  __sync_synchronize();
+  slot->stamp = pos + 1;
+  mHeader->writeSeq = pos + 1;
+}
+
+ShmRing::ReadResult ShmRing::read(uint64_t pos, ShmSlotHeader& meta, char* buf) const
+{
+  if (mHeader->writeSeq <= pos)
+  {
+    return SHM_READ_EMPTY;
+  }
+
+  const ShmSlotHeader* slot = getSlot(pos);
+  uint64_t stamp = slot->stamp;
+  __sync_synchronize();
+  if (pos + 1 != stamp)
+  {
+    return SHM_READ_OVERRUN;
+  }
+
+  memcpy(&meta, slot, sizeof(meta));
+  memcpy(buf, slot + 1, std::min(meta.len, getMaxPayload()));
+  __sync_synchronize();
+  return (pos + 1 == slot->stamp)? SHM_READ_OK : SHM_READ_OVERRUN;
+}
+
+uint64_t ShmRing::getWriteSeq() const
+{
+  return mHeader->writeSeq;
+}
+
+uint64_t ShmRing::getOldest() const
+{
+  // the slot after the newest one may be being written
+  uint64_t writeSeq = mHeader->writeSeq;
+  return (writeSeq + 1 > mHeader->nSlots)? writeSeq + 1 - mHeader->nSlots : 0;
+}
+
+unsigned ShmRing::getMaxPayload() const
+{
+  return mHeader->slotLen - sizeof(ShmSlotHeader);
+}
+
+unsigned ShmRing::getSlotCount() const
+{
+  return mHeader->nSlots;
+}
+
+string ShmRing::toString() const
+{
+  std::stringstream stm;
+  stm << "/dev/shm/" << mName << " " << mHeader->nSlots << " x " << mHeader->slotLen << " bytes";
+  return stm.str();
+}
@@ -0,0 +1,121 @@
+#ifndef MCASTIT_SHMRING_H_
+#define MCASTIT_SHMRING_H_
+
+#include "Common.h"
+
+#define SHM_RING_MAGIC    (0x4d435249)  // "MCRI"
+#define SHM_RING_VERSION  (1)
+#define SHM_SLOT_LEN      (2048)        // slot header & payload, payloads above are truncated
+#define SHM_RING_SLOTS    (16384)       // default, power of 2
+
+/*
+ * Shared memory layout, all integers in host order:
+ *
+ *   offset 0      ShmRingHeader, 128 bytes
+ *   offset 128    nSlots slots of slotLen bytes, position p is in slot p % nSlots
+ *
+ * Each slot is a ShmSlotHeader (64 bytes) followed by the payload. The writer
+ * never waits for readers: it clears the slot stamp, writes the slot, sets the
+ * stamp to p + 1 & then writeSeq to p + 1. A reader at position p waits for
+ * writeSeq > p, copies the slot if its stamp is p + 1 and checks the stamp is
+ * still p + 1 after the copy, else the writer lapped it & the slot is lost
+ */
+
+/**
+ * First 128 bytes of the ring
+ */
+struct ShmRingHeader
+{
+  uint32_t magic;             // SHM_RING_MAGIC
+  uint32_t version;           // SHM_RING_VERSION
+  uint32_t slotLen;           // bytes per slot, header included
+  uint32_t nSlots;
+  uint64_t startNs;           // realtime the ring was created
+  char     pad[40];
+  volatile uint64_t writeSeq; // positions written so far, in its own cache line
+  char     pad2[56];
+};
+
+/**
+ * First 64 bytes of a slot, the payload follows
+ */
+struct ShmSlotHeader
+{
+  volatile uint64_t stamp;    // position + 1 once written, 0 while being written
+  uint64_t kernelNs;          // kernel receive time, 0 if unknown
+  uint32_t len;               // payload length as received, min(len, slotLen - 64) bytes stored
+  uint32_t msgSeq;            // sequence of the test message header, 0 if none
+  uint32_t ifindex;           // receiving interface, 0 if unknown
+  uint16_t family;            // AF_INET or AF_INET6, of source & group
+  uint16_t sourcePort;
+  uint8_t  source[16];        // ipv4 in the first 4 bytes
+  uint8_t  group[16];         // destination, ipv4 in the first 4 bytes
+};
+
+/**
+ * Single writer, many readers ring of received datagrams in POSIX shared memory
+ *
+ * Readers don't register: each one keeps its own position & may be lapped by the
+ * writer, which is reported to it as lost slots
+ */
+class ShmRing
+{
+public:
+  typedef enum _ReadResult
+  {
+    SHM_READ_OK=0,
+    SHM_READ_EMPTY,     // nothing written at the position yet
+    SHM_READ_OVERRUN    // overwritten before or while it was read, skip to getOldest()
+  } ReadResult;
+
+  ShmRing();
+  ~ShmRing();
+
+  /**
+   * Create or replace the ring /dev/shm/{name} for writing
+   * @param nSlots - power of 2
+   * @return false on error
+   */
+  bool create(const string& name, unsigned nSlots);
+
+  /**
+   * Map an existing ring for reading
+   * @return false on error or if it isn't a ring of this version
+   */
+  bool open(const string& name);
+
+  /**
+   * Append one datagram, truncated to the slot
+   * @param meta - all but the stamp
+   */
+  void publish(const ShmSlotHeader& meta, const char* payload, unsigned len);
+
+  /**
+   * Copy the slot at position pos
+   * @param buf     - receives min(meta.len, getMaxPayload()) bytes
+   */
+  ReadResult read(uint64_t pos, ShmSlotHeader& meta, char* buf) const;
+
+  uint64_t getWriteSeq() const;
+
+  /**
+   * @return oldest position that can still be read
+   */
+  uint64_t getOldest() const;
+
+  bool isOpen() const { return NULL != mHeader; }
+  unsigned getMaxPayload() const;
+  unsigned getSlotCount() const;
+  string toString() const;
+
+private:
+  ShmSlotHeader* getSlot(uint64_t pos) const;
+  void close();
+
+private:
+  string          mName;
+  ShmRingHeader*  mHeader;
+  size_t          mMapLen;
+};
+
+#endif /* MCASTIT_SHMRING_H_ */
@@ -0,0 +1,156 @@
+#include "StatsPage.h"
+#include <sys/mman.h>
+
+#define STATS_READ_TRIES  (1000)  // copies tried before giving up on a busy writer
+#define STATS_RETRY_US    (10)    // between two tries
+
+StatsPage::StatsPage() :
+    mHeader(NULL), mMapLen(0), mLastUpdateNs(0)
+{
+}
+
+StatsPage::~StatsPage()
+{
+  close();
+}
+
+void StatsPage::close()
+{
+  if (mHeader)
+  {
+    munmap(mHeader, mMapLen);
+    mHeader = NULL;
+  }
+}
+
+bool StatsPage::create(const string& name, StatsRole role)
+{
+  close();
+  mName = name;
+  mMapLen = sizeof(StatsPageHeader) + STATS_MAX_IFACES * sizeof(StatsIface) +
+      STATS_MAX_STREAMS * sizeof(StatsStream);
+  void* addr = Common::createSharedMemory(name, mMapLen);
+  if (!addr)
+  {
+    return false;
+  }
+
+  // magic last so readers see a whole header
+  mHeader = (StatsPageHeader*) addr;
+  mHeader->version = STATS_PAGE_VERSION;
+  mHeader->startNs = Common::getRealtimeNs();
+  mHeader->updateNs = mHeader->startNs;
+  mHeader->pid = getpid();
+  mHeader->role = role;
+  mHeader->maxIfaces = STATS_MAX_IFACES;
+  mHeader->maxStreams = STATS_MAX_STREAMS;
+  __sync_synchronize();
+  mHeader->magic = STATS_PAGE_MAGIC;
+  return true;
+}
+
+bool StatsPage::open(const string& name)
+{
+  close();
+  mName = name;
+  const void* addr = Common::openSharedMemory(name, mMapLen);
+  if (!addr)
+  {
+    return false;
+  }
+
+  mHeader = (StatsPageHeader*) addr;
+  if (sizeof(StatsPageHeader) > mMapLen || STATS_PAGE_MAGIC != mHeader->magic ||
+      STATS_PAGE_VERSION != mHeader->version || mMapLen < sizeof(StatsPageHeader) +
+      mHeader->maxIfaces * sizeof(StatsIface) + mHeader->maxStreams * sizeof(StatsStream))
+  {
+    LOG_ERROR(name << " is not a version " << STATS_PAGE_VERSION << " statistics page");
+    close();
+    return false;
+  }
+
+  return true;
+}
+
+bool StatsPage::isUpdateDue(uint64_t nowNs) const
+{
+  return nowNs - mLastUpdateNs >= STATS_UPDATE_NS;
+}
+
+void StatsPage::beginUpdate()
+{
+  mLastUpdateNs = Common::getMonotonicNs();
+  mHeader->seq = mHeader->seq + 1;
+  __sync_synchronize();
+}
+
+StatsIface& StatsPage::getIface(unsigned idx)
+{
+  StatsIface* ifaces = (StatsIface*) (mHeader + 1);
+  return ifaces[idx];
+}
+
+StatsStream& StatsPage::getStream(unsigned idx)
+{
+  StatsStream* streams = (StatsStream*) ((char*) (mHeader + 1) +
+      mHeader->maxIfaces * sizeof(StatsIface));
+  return streams[idx];
+}
+
+void StatsPage::endUpdate(unsigned nIfaces, unsigned nStreams, unsigned hiddenStreams)
+{
+  mHeader->nIfaces = nIfaces;
+  mHeader->nStreams = nStreams;
+  mHeader->hiddenStreams = hiddenStreams;
+  mHeader->updateNs = Common::getRealtimeNs();
+  __sync_synchronize();
+  mHeader->seq = mHeader->seq + 1;
+}
+
+bool StatsPage::read(StatsPageHeader& header, vector<StatsIface>& ifaces,
+    vector<StatsStream>& streams) const
+{
+  const char* ifaceBase = (const char*) (mHeader + 1);
+  const char* streamBase = ifaceBase + mHeader->maxIfaces * sizeof(StatsIface);
+  for (unsigned tries = 0; tries < STATS_READ_TRIES; ++tries)
+  {
+    if (tries)
+    {
+      usleep(STATS_RETRY_US);
+    }
+
+    uint64_t seq = mHeader->seq;
+    if (seq & 1)
+    {
+      continue;
+    }
+    __sync_synchronize();
+
+    memcpy(&header, mHeader, sizeof(header));
+    ifaces.resize(std::min(header.nIfaces, header.maxIfaces));
+    streams.resize(std::min(header.nStreams, header.maxStreams));
+    if (!ifaces.empty())
+    {
+      memcpy(&ifaces[0], ifaceBase, ifaces.size() * sizeof(StatsIface));
+    }
+    if (!streams.empty())
+    {
+      memcpy(&streams[0], streamBase, streams.size() * sizeof(StatsStream));
+    }
+
+    __sync_synchronize();
+    if (seq == mHeader->seq)
+    {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+string StatsPage::toString() const
+{
+  std::stringstream stm;
+  stm << "/dev/shm/" << mName << " " << mMapLen << " bytes";
+  return stm.str();
+}
@@ -0,0 +1,140 @@
+#ifndef MCASTIT_STATSPAGE_H_
+#define MCASTIT_STATSPAGE_H_
+
+#include "Common.h"
+
+#define STATS_PAGE_MAGIC    (0x4d435354)  // "MCST"
+#define STATS_PAGE_VERSION  (1)
+#define STATS_MAX_IFACES    (64)
+#define STATS_MAX_STREAMS   (4096)        // the others are only counted
+#define STATS_NAME_LEN      (64)
+#define STATS_UPDATE_NS     (100000000ULL) // the page is rewritten this often at most
+
+/*
+ * Shared memory layout, all integers in host order:
+ *
+ *   offset 0      StatsPageHeader, 64 bytes
+ *   offset 64     maxIfaces StatsIface of 64 bytes, the first nIfaces are used
+ *   then          maxStreams StatsStream of 128 bytes, the first nStreams are used
+ *
+ * Counters are totals since startNs. The writer copies its counters to the page
+ * every STATS_UPDATE_NS at most, away from the packet path, and readers never
+ * write to it. seq is a seqlock: odd while the page is being written, a reader
+ * copies the page when it is even and keeps the copy if seq is unchanged after
+ * the copy, else it tries again
+ */
+
+typedef enum _StatsRole
+{
+  STATS_ROLE_LISTENER=1,
+  STATS_ROLE_SENDER
+} StatsRole;
+
+/**
+ * First 64 bytes of the page
+ */
+struct StatsPageHeader
+{
+  uint32_t magic;             // STATS_PAGE_MAGIC
+  uint32_t version;           // STATS_PAGE_VERSION
+  volatile uint64_t seq;      // odd while the page is written
+  uint64_t startNs;           // realtime the page was created
+  uint64_t updateNs;          // realtime of the last update
+  uint32_t pid;               // of the writer
+  uint32_t role;              // StatsRole
+  uint32_t nIfaces;
+  uint32_t nStreams;
+  uint32_t maxIfaces;
+  uint32_t maxStreams;
+  uint32_t hiddenStreams;     // streams that didn't fit
+  uint32_t pad;
+};
+
+/**
+ * Counters of one interface, 64 bytes
+ */
+struct StatsIface
+{
+  char     name[16];
+  uint64_t packets;           // received or sent datagrams
+  uint64_t bytes;
+  uint64_t coalesced;         // listener: receives that carried more than one datagram
+  uint64_t blocked;           // sender: datagrams dropped on a full socket
+  uint64_t errors;            // sender: other send errors
+  uint64_t pad;
+};
+
+/**
+ * Counters of one received stream, 128 bytes
+ */
+struct StatsStream
+{
+  char     name[STATS_NAME_LEN]; // "source -> group"
+  uint64_t received;
+  uint64_t lost;
+  uint64_t duplicates;
+  uint64_t reordered;
+  uint64_t bytes;
+  uint64_t jitterNs;          // RFC 3550 interarrival jitter
+  uint64_t maxGapNs;          // longest time without datagram
+  uint32_t highest;           // highest sequence
+  uint32_t pad;
+};
+
+/**
+ * Page of live counters in POSIX shared memory, one writer & any number of
+ * readers that poll it without syscalls or locks
+ */
+class StatsPage
+{
+public:
+  StatsPage();
+  ~StatsPage();
+
+  /**
+   * Create or replace the page /dev/shm/{name} for writing
+   * @return false on error
+   */
+  bool create(const string& name, StatsRole role);
+
+  /**
+   * Map an existing page for reading
+   * @return false on error or if it isn't a page of this version
+   */
+  bool open(const string& name);
+
+  bool isOpen() const { return NULL != mHeader; }
+
+  /**
+   * @return whether STATS_UPDATE_NS passed since the last update
+   */
+  bool isUpdateDue(uint64_t nowNs) const;
+
+  /**
+   * Start rewriting the page, the entries are filled between beginUpdate() & endUpdate()
+   */
+  void beginUpdate();
+  StatsIface& getIface(unsigned idx);    // idx < STATS_MAX_IFACES
+  StatsStream& getStream(unsigned idx);  // idx < STATS_MAX_STREAMS
+  void endUpdate(unsigned nIfaces, unsigned nStreams, unsigned hiddenStreams);
+
+  /**
+   * Consistent copy of the page
+   * @return false if the writer kept it busy for too long
+   */
+  bool read(StatsPageHeader& header, vector<StatsIface>& ifaces,
+      vector<StatsStream>& streams) const;
+
+  string toString() const;
+
+private:
+  void close();
+
+private:
+  string           mName;
+  StatsPageHeader* mHeader;
+  size_t           mMapLen;
+  uint64_t         mLastUpdateNs; // monotonic
+};
+
+#endif /* MCASTIT_STATSPAGE_H_ */
@@ -0,0 +1,526 @@
+#include "StreamModule.h"
+#include <fstream>
+
+#define STREAM_PRINT_MAX  (50)    // streams printed one by one in the statistics
+
+/**
+ * Replace group by the next address, e.g. 239.192.1.255 -> 239.192.2.0
+ * @return false if group isn't an address
+ */
+static bool nextGroup(string& group, bool useIpV6)
+{
+  char groupIp[INET6_ADDRSTRLEN];
+  if (useIpV6)
+  {
+    struct in6_addr addr;
+    if (1 != inet_pton(AF_INET6, group.c_str(), &addr))
+    {
+      return false;
+    }
+    // add one with carry from the last byte
+    int i = sizeof(addr.s6_addr) - 1;
+    while (i >= 0 && 0 == ++addr.s6_addr[i])
+    {
+      --i;
+    }
+    inet_ntop(AF_INET6, &addr, groupIp, sizeof(groupIp));
+  }
+  else
+  {
+    struct in_addr addr;
+    if (1 != inet_pton(AF_INET, group.c_str(), &addr))
+    {
+      return false;
+    }
+    addr.s_addr = htonl(ntohl(addr.s_addr) + 1);
+    inet_ntop(AF_INET, &addr, groupIp, sizeof(groupIp));
+  }
+
+  group = groupIp;
+  return true;
+}
+
+StreamModule::StreamModule(const vector<IfaceData>& ifaces,
+    const vector<StreamProfile>& profiles, int nLoopbackIfaces, bool useIpV6) :
+    // printed as the first stream, the others follow
+    McastModuleInterface(ifaces, vector<string>(1, profiles.empty()? "" : profiles[0].group),
+        profiles.empty()? 0 : profiles[0].port, useIpV6),
+    mProfiles(profiles), mLoopbackCount(nLoopbackIfaces), mThreadPerIface(false)
+{
+  for (unsigned i = 1; i < profiles.size(); ++i)
+  {
+    mMcastAddresses.push_back(profiles[i].group);
+  }
+  cout << "Sending " << profiles.size() << " streams" << endl;
+}
+
+StreamModule::~StreamModule()
+{
+  mIsStopped = true;
+  for (unsigned i = 0; i < mThreads.size(); ++i)
+  {
+    // may be destroyed from a signal handler running on a wheel thread
+    if (mThreads[i]->thread && !pthread_equal(mThreads[i]->thread, pthread_self()))
+    {
+      pthread_join(mThreads[i]->thread, NULL);
+    }
+    delete mThreads[i];
+  }
+
+  for (unsigned i = 0; i < mStreams.size(); ++i)
+  {
+    delete mStreams[i];
+  }
+}
+
+void StreamModule::setThreadPerIface(bool enable)
+{
+  mThreadPerIface = enable;
+}
+
+bool StreamModule::loadProfiles(const string& path, const StreamProfile& defaults,
+    vector<StreamProfile>& profiles)
+{
+  std::ifstream file(path.c_str());
+  if (!file)
+  {
+    LOG_ERROR("Cannot open " << path << ": " << strerror(errno));
+    return false;
+  }
+
+  string line;
+  for (unsigned lineNum = 1; std::getline(file, line); ++lineNum)
+  {
+    line = line.substr(0, line.find('#'));
+    std::stringstream stm(line);
+    StreamProfile profile = defaults;
+    unsigned repeat = 1;
+    bool hasField = false;
+
+    string field;
+    while (stm >> field)
+    {
+      hasField = true;
+      size_t eq = field.find('=');
+      const string key = field.substr(0, eq);
+      const string value = (string::npos == eq)? "" : field.substr(eq + 1);
+      if (value.empty())
+      {
+        LOG_ERROR(path << ":" << lineNum << " " << field << " has no value");
+        return false;
+      }
+
+      if ("group" == key)
+      {
+        profile.group = value;
+      }
+      else if ("iface" == key)
+      {
+        profile.iface = value;
+      }
+      else if ("port" == key)
+      {
+        profile.port = atoi(value.c_str());
+      }
+      else if ("rate" == key)
+      {
+        profile.rate = atof(value.c_str());
+      }
+      else if ("size" == key)
+      {
+        profile.size = atoi(value.c_str());
+      }
+      else if ("burst" == key)
+      {
+        profile.burst = atoi(value.c_str());
+      }
+      else if ("count" == key)
+      {
+        profile.count = atol(value.c_str());
+      }
+      else if ("start" == key)
+      {
+        profile.startMs = atof(value.c_str());
+      }
+      else if ("streams" == key)
+      {
+        repeat = atoi(value.c_str());
+      }
+      else
+      {
+        LOG_ERROR(path << ":" << lineNum << " unknown field " << key);
+        return false;
+      }
+    }
+
+    if (!hasField)
+    {
+      continue;
+    }
+
+    if (profile.group.empty() || 0 >= profile.rate || 0 >= profile.port || 0 == repeat ||
+        0 == profile.burst || STREAM_MAX_BURST < profile.burst || MCAST_MAX_DGRAM_LEN < profile.size)
+    {
+      LOG_ERROR(path << ":" << lineNum << " needs a group, a rate, a port & 1 to "
+          << STREAM_MAX_BURST << " datagrams per burst");
+      return false;
+    }
+
+    bool useIpV6 = string::npos != profile.group.find(':');
+    for (unsigned i = 0; i < repeat; ++i)
+    {
+      profiles.push_back(profile);
+      if (i + 1 < repeat && !nextGroup(profile.group, useIpV6))
+      {
+        LOG_ERROR(path << ":" << lineNum << " invalid group " << profile.group);
+        return false;
+      }
+    }
+  }
+
+  if (profiles.empty())
+  {
+    LOG_ERROR("No stream in " << path);
+    return false;
+  }
+  return true;
+}
+
+bool StreamModule::init()
+{
+  for (unsigned i = 0; i < mIfaces.size(); ++i)
+  {
+    bool isLoopBack = mLoopbackCount < 0 || (int)i < mLoopbackCount;
+    bool setMcastOk = isIpV6()?
+        associateMcastV6WithIfaceName(mIfaces[i].sockFd, mIfaces[i].ifaceName.c_str(), isLoopBack) :
+        associateMcastWithIfaceName(mIfaces[i].sockFd, mIfaces[i].ifaceName.c_str(), isLoopBack);
+    if (!setMcastOk)
+    {
+      LOG_ERROR("Setting mcast for " << mIfaces[i]);
+      return false;
+    }
+  }
+
+  // one wheel for all streams, or one per interface
+  mThreads.resize(mThreadPerIface? mIfaces.size() : 1, NULL);
+  for (unsigned i = 0; i < mThreads.size(); ++i)
+  {
+    mThreads[i] = new WheelThread();
+    mThreads[i]->module = this;
+    mThreads[i]->index = i;
+    mThreads[i]->label = mThreadPerIface? mIfaces[i].toString() : "all interfaces";
+    mThreads[i]->numaNode = (1 == mIfaces.size() || mThreadPerIface)?
+        Common::getIfaceNumaNode(mIfaces[i].ifaceName) : -1;
+  }
+
+  for (unsigned p = 0; p < mProfiles.size(); ++p)
+  {
+    TxStream* stream = new TxStream();
+    mStreams.push_back(stream);
+    stream->profile = mProfiles[p];
+    const StreamProfile& profile = stream->profile;
+
+    bool isIfaceFound = profile.iface.empty();
+    for (unsigned i = 0; i < mIfaces.size() && !isIfaceFound; ++i)
+    {
+      if (mIfaces[i].ifaceName == profile.iface)
+      {
+        stream->ifaceIdx = i;
+        isIfaceFound = true;
+      }
+    }
+    if (!isIfaceFound)
+    {
+      LOG_ERROR("Unknown interface " << profile.iface << " for " << profile.group);
+      return false;
+    }
+    stream->sockFd = mIfaces[stream->ifaceIdx].sockFd;
+
+    memset(&stream->dest, 0, sizeof(stream->dest));
+    int parsed;
+    if (isIpV6())
+    {
+      struct sockaddr_in6* addr6 = (struct sockaddr_in6*) &stream->dest;
+      addr6->sin6_family = AF_INET6;
+      addr6->sin6_port = htons(profile.port);
+      parsed = inet_pton(AF_INET6, profile.group.c_str(), &addr6->sin6_addr);
+    }
+    else
+    {
+      struct sockaddr_in* addr = (struct sockaddr_in*) &stream->dest;
+      addr->sin_family = AF_INET;
+      addr->sin_port = htons(profile.port);
+      parsed = inet_pton(AF_INET, profile.group.c_str(), &addr->sin_addr);
+    }
+    if (1 != parsed)
+    {
+      LOG_ERROR("Error parsing address for " << profile.group);
+      return false;
+    }
+
+    std::stringstream label;
+    label << profile.group << ":" << profile.port << " " << mIfaces[stream->ifaceIdx].getReadableName();
+    stream->label = label.str();
+    stream->periodNs = (uint64_t) (1e9 / profile.rate);
+    stream->periodNs = stream->periodNs? stream->periodNs : 1;
+
+    // always sequenced, the header is followed by the stream info or padding up to size
+    stream->segSize = profile.size? std::max(profile.size, (unsigned) MCAST_HEADER_LEN + 1) :
+        MCAST_HEADER_LEN + stream->label.size() + 16;
+    mThreads[mThreadPerIface? stream->ifaceIdx : 0]->streams.push_back(stream);
+  }
+
+  // templates of each thread in one arena on its node
+  for (unsigned i = 0; i < mThreads.size(); ++i)
+  {
+    WheelThread& thread = *mThreads[i];
+    unsigned slotLen = 0;
+    for (unsigned s = 0; s < thread.streams.size(); ++s)
+    {
+      slotLen = std::max(slotLen, thread.streams[s]->segSize);
+    }
+    if (thread.streams.empty())
+    {
+      continue;
+    }
+    if (!thread.txBuf.init(slotLen, thread.streams.size(), thread.numaNode))
+    {
+      LOG_ERROR("No datagram templates for wheel thread " << thread.label);
+      return false;
+    }
+
+    for (unsigned s = 0; s < thread.streams.size(); ++s)
+    {
+      TxStream& stream = *thread.streams[s];
+      stream.msg = thread.txBuf.getSlot(s);
+      Common::encodeMessageHeader(stream.msg, 0, 0);
+      const string info = "<Stream: " + stream.label + ">";
+      unsigned infoLen = std::min((unsigned) info.size(), stream.segSize - MCAST_HEADER_LEN - 1);
+      memcpy(stream.msg + MCAST_HEADER_LEN, info.data(), infoLen);
+    }
+
+    cout << "Wheel thread " << thread.label << " streams " << thread.streams.size()
+         << " cpu " << Common::getThreadCpu(Common::THREAD_TX, i)
+         << " NUMA node " << thread.numaNode << " " << thread.txBuf.toString() << endl;
+  }
+
+  return true;
+}
+
+bool StreamModule::run()
+{
+  if (!init())
+  {
+    return false;
+  }
+  cout << "==============================================================" << endl;
+
+  for (unsigned i = 0; i < mThreads.size(); ++i)
+  {
+    if (mThreads[i]->streams.empty())
+    {
+      continue;
+    }
+
+    if (0 != pthread_create(&mThreads[i]->thread, NULL, &StreamModule::wheelThreadHelper, mThreads[i]))
+    {
+      LOG_ERROR("Cannot spawn wheel thread " << i);
+      mThreads[i]->thread = 0;
+      return false;
+    }
+  }
+
+  // threads end when all their streams sent their count
+  for (unsigned i = 0; i < mThreads.size(); ++i)
+  {
+    if (mThreads[i]->thread)
+    {
+      pthread_join(mThreads[i]->thread, NULL);
+      mThreads[i]->thread = 0;
+    }
+  }
+
+  return true;
+}
+
+void StreamModule::runWheel(WheelThread& thread)
+{
+  if (!Common::applyThreadSettings(Common::THREAD_TX, thread.index, thread.numaNode))
+  {
+    LOG_ERROR("Scheduling " << thread.label << " with default cpu & scheduling");
+  }
+
+  TimingWheel& wheel = thread.wheel;
+  uint64_t startNs = Common::getMonotonicNs();
+  for (unsigned s = 0; s < thread.streams.size(); ++s)
+  {
+    TxStream& stream = *thread.streams[s];
+    stream.nextNs = startNs + (uint64_t) (stream.profile.startMs * 1e6);
+    stream.stats.startNs = stream.nextNs;
+    stream.timer.context = &stream;
+    wheel.schedule(stream.timer, (stream.nextNs - startNs) / STREAM_TICK_NS);
+  }
+
+  unsigned nActive = thread.streams.size();
+  while (nActive && !mIsStopped)
+  {
+    // tick n starts at startNs + n ticks, sleep until the next one is due
+    uint64_t nowNs = Common::getMonotonicNs();
+    uint64_t nowTick = (nowNs - startNs) / STREAM_TICK_NS;
+    if (wheel.getTick() >= nowTick)
+    {
+      Common::sleepUntilNs(startNs + (wheel.getTick() + 1) * STREAM_TICK_NS);
+      continue;
+    }
+
+    uint64_t lagNs = nowNs - startNs - (wheel.getTick() + 1) * STREAM_TICK_NS;
+    thread.maxLagNs = std::max(thread.maxLagNs, lagNs);
+    thread.lateTicks += (lagNs >= STREAM_TICK_NS)? 1 : 0;
+
+    while (wheel.getTick() < nowTick)
+    {
+      uint64_t wheelStartNs = Common::getMonotonicNs();
+      TimerNode* expired = wheel.advance();
+      thread.wheelNs += Common::getMonotonicNs() - wheelStartNs;
+      ++thread.ticks;
+
+      while (expired)
+      {
+        TimerNode* next = expired->next;
+        ++thread.fired;
+        if (!fireStream(thread, *(TxStream*) expired->context, startNs))
+        {
+          --nActive;
+        }
+        expired = next;
+      }
+    }
+  }
+}
+
+bool StreamModule::fireStream(WheelThread& thread, TxStream& stream, uint64_t startNs)
+{
+  uint64_t nowNs = Common::getMonotonicNs();
+  long count = stream.profile.count;
+
+  // every burst that is due, faster streams than the tick send several per tick
+  while (stream.nextNs <= nowNs && (0 >= count || stream.bursts < count))
+  {
+    if (nowNs - stream.nextNs >= STREAM_TICK_NS)
+    {
+      ++stream.stats.late;
+    }
+    sendBurst(stream);
+    ++stream.bursts;
+    stream.nextNs += stream.periodNs;
+
+    // catch up at most one period, like the interface senders
+    if (nowNs > stream.nextNs && nowNs - stream.nextNs > stream.periodNs)
+    {
+      stream.stats.skipped += (nowNs - stream.nextNs) / stream.periodNs;
+      stream.nextNs = nowNs;
+    }
+  }
+
+  if (0 < count && stream.bursts >= count)
+  {
+    stream.stats.stopNs = nowNs;
+    return false;
+  }
+
+  // first tick that starts at or after the next burst
+  thread.wheel.schedule(stream.timer, (stream.nextNs - startNs + STREAM_TICK_NS - 1) / STREAM_TICK_NS);
+  return true;
+}
+
+void StreamModule::sendBurst(TxStream& stream)
+{
+  uint64_t sendTimeNs = Common::getRealtimeNs();
+  for (unsigned i = 0; i < stream.profile.burst; ++i)
+  {
+    Common::encodeMessageHeader(stream.msg, stream.seq++, sendTimeNs);
+    // a full socket drops the datagram rather than stall every stream of the wheel
+    int sent = sendto(stream.sockFd, stream.msg, stream.segSize, MSG_NOSIGNAL|MSG_DONTWAIT,
+        (const struct sockaddr*) &stream.dest, sizeof(stream.dest));
+    if (0 > sent && (EAGAIN == errno || EWOULDBLOCK == errno || ENOBUFS == errno))
+    {
+      ++stream.stats.blocked;
+      continue;
+    }
+    if (0 > sent)
+    {
+      ++stream.stats.errors;
+      continue;
+    }
+    ++stream.stats.sent;
+    stream.stats.bytes += sent;
+  }
+}
+
+void StreamModule::printStats() const
+{
+  if (mThreads.empty())
+  {
+    return;
+  }
+
+  cout << "==============================================================" << endl;
+  StreamStats total;
+  double totalRate = 0;
+  for (unsigned i = 0; i < mStreams.size(); ++i)
+  {
+    const StreamStats& stats = mStreams[i]->stats;
+    uint64_t stopNs = stats.stopNs? stats.stopNs : Common::getMonotonicNs();
+    double elapsed = (stats.startNs && stopNs > stats.startNs)? (stopNs - stats.startNs) / 1e9 : 0;
+    double rate = (elapsed > 0)? stats.sent / elapsed : 0;
+    if (i < STREAM_PRINT_MAX)
+    {
+      printf("[TX] %-40s sent: %llu bytes: %llu blocked: %llu errors: %llu late: %llu "
+          "skipped: %llu (%.1f pps)\n", mStreams[i]->label.c_str(), (unsigned long long) stats.sent,
+          (unsigned long long) stats.bytes, (unsigned long long) stats.blocked,
+          (unsigned long long) stats.errors, (unsigned long long) stats.late,
+          (unsigned long long) stats.skipped, rate);
+    }
+
+    total.sent += stats.sent;
+    total.bytes += stats.bytes;
+    total.blocked += stats.blocked;
+    total.errors += stats.errors;
+    total.late += stats.late;
+    total.skipped += stats.skipped;
+    totalRate += rate;
+  }
+
+  if (mStreams.size() > STREAM_PRINT_MAX)
+  {
+    printf("[TX] ... %u more streams\n", (unsigned) (mStreams.size() - STREAM_PRINT_MAX));
+  }
+  printf("[TX] %-40s sent: %llu bytes: %llu blocked: %llu errors: %llu late: %llu "
+      "skipped: %llu (%.1f pps)\n", "total", (unsigned long long) total.sent,
+      (unsigned long long) total.bytes, (unsigned long long) total.blocked,
+      (unsigned long long) total.errors, (unsigned long long) total.late,
+      (unsigned long long) total.skipped, totalRate);
+
+  for (unsigned i = 0; i < mThreads.size(); ++i)
+  {
+    const WheelThread& thread = *mThreads[i];
+    if (thread.streams.empty())
+    {
+      continue;
+    }
+
+    printf("[TX] wheel %-34s streams: %u ticks: %llu late ticks: %llu max lag: %.1f us "
+        "advance: %.1f ns/tick timers fired: %llu cascaded: %llu\n", thread.label.c_str(),
+        (unsigned) thread.streams.size(), (unsigned long long) thread.ticks,
+        (unsigned long long) thread.lateTicks, thread.maxLagNs / 1e3,
+        thread.ticks? (double) thread.wheelNs / thread.ticks : 0,
+        (unsigned long long) thread.fired, (unsigned long long) thread.wheel.getCascaded());
+  }
+}
+
+void* StreamModule::wheelThreadHelper(void* context)
+{
+  WheelThread* thread = (WheelThread*) context;
+  thread->module->runWheel(*thread);
+  return 0;
+}
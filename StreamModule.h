@@ -0,0 +1,170 @@
+#ifndef MCASTIT_STREAMMODULE_H_
+#define MCASTIT_STREAMMODULE_H_
+
+#include "McastModuleInterface.h"
+#include "TimingWheel.h"
+#include "PacketArena.h"
+
+#define STREAM_TICK_NS    (100000ULL) // timing wheel resolution
+#define STREAM_MAX_BURST  (1024)      // datagrams per burst
+
+class StreamModule;
+
+/**
+ * One stream of a profile file, see StreamModule::loadProfiles
+ */
+struct StreamProfile
+{
+  string   group;
+  int      port;
+  string   iface;     // empty for the first interface
+  double   rate;      // bursts per second
+  unsigned size;      // datagram size, 0 for the header & stream info only
+  unsigned burst;     // datagrams sent back to back, each with its own sequence
+  long     count;     // bursts to send, <= 0 forever
+  double   startMs;   // delay of the first burst
+
+  StreamProfile(): port(0), rate(0), size(0), burst(1), count(-1), startMs(0) {}
+};
+
+/**
+ * Send counters of one stream, only written by its wheel thread
+ */
+struct StreamStats
+{
+  uint64_t sent;        // datagrams
+  uint64_t bytes;
+  uint64_t blocked;     // datagrams dropped because of EAGAIN/ENOBUFS
+  uint64_t errors;      // other send errors
+  uint64_t late;        // bursts sent more than a tick after their time
+  uint64_t skipped;     // bursts dropped to catch up after falling a whole period behind
+  uint64_t startNs, stopNs;
+
+  StreamStats(): sent(0), bytes(0), blocked(0), errors(0), late(0), skipped(0), startNs(0),
+      stopNs(0) {}
+};
+
+/**
+ * Send state of one stream
+ */
+struct TxStream
+{
+  StreamProfile profile;
+  unsigned      ifaceIdx;
+  int           sockFd;
+  struct sockaddr_storage dest;
+  string        label;     // "group:port iface"
+  unsigned      segSize;
+  char*         msg;       // template in the wheel thread's arena, only the header changes
+  uint32_t      seq;
+  uint64_t      periodNs;
+  uint64_t      nextNs;    // monotonic time of the next burst
+  long          bursts;    // sent so far
+  TimerNode     timer;
+  StreamStats   stats;
+
+  TxStream(): ifaceIdx(0), sockFd(-1), segSize(0), msg(NULL), seq(1), periodNs(0), nextNs(0),
+      bursts(0) {}
+};
+
+/**
+ * Streams scheduled by one thread on one timing wheel
+ */
+struct WheelThread
+{
+  StreamModule*     module;
+  unsigned          index;       // THREAD_TX index
+  int               numaNode;    // of its interface if it has only one, -1 otherwise
+  string            label;
+  vector<TxStream*> streams;
+  PacketArena       txBuf;       // one template per stream
+  TimingWheel       wheel;
+  pthread_t         thread;
+
+  uint64_t          ticks;
+  uint64_t          lateTicks;   // processed after the next one had started
+  uint64_t          maxLagNs;
+  uint64_t          wheelNs;     // in TimingWheel::advance, sends excluded
+  uint64_t          fired;       // timers expired
+
+  WheelThread(): module(NULL), index(0), numaNode(-1), thread(0), ticks(0), lateTicks(0),
+      maxLagNs(0), wheelNs(0), fired(0) {}
+};
+
+/**
+ * Send many independent streams described in a profile file
+ *
+ * Each stream has its own group, port, interface, rate, datagram size and burst
+ * length. All streams, or the streams of each interface with one thread per
+ * interface, are driven by a hierarchical timing wheel ticking every
+ * STREAM_TICK_NS, so a tick only costs the streams that are due
+ */
+class StreamModule: public McastModuleInterface
+{
+public:
+  /**
+   * @param ifaces    - every interface named by the profiles, the first one for the others
+   * @param profiles  - see loadProfiles
+   * @param nLoopbackIfaces - loop back on the first n interfaces, < 0 for all
+   */
+  StreamModule(const vector<IfaceData>& ifaces, const vector<StreamProfile>& profiles,
+      int nLoopbackIfaces, bool useIpV6);
+  virtual ~StreamModule();
+  bool run();
+  void printStats() const;
+
+  /**
+   * Read a profile file, one stream per line of key=value fields, # starts a comment:
+   *   group=239.192.1.1 port=12321 iface=eth0 rate=1000 size=1200 burst=4 count=5000 start=10 streams=100
+   * group and rate (bursts per second) are required, streams=n repeats the line
+   * on n consecutive groups
+   * @param defaults  - values of the fields a line doesn't set
+   * @return false on error, logged with the line number
+   */
+  static bool loadProfiles(const string& path, const StreamProfile& defaults,
+      vector<StreamProfile>& profiles);
+
+  /**
+   * Schedule the streams of each interface from their own thread instead of one for all
+   * @param enable
+   */
+  void setThreadPerIface(bool enable = true);
+
+private:
+  /**
+   * Destinations, templates & threads of all streams
+   * @return true on success
+   */
+  bool init();
+
+  /**
+   * Wheel loop of one thread, until all its streams sent their count
+   */
+  void runWheel(WheelThread& thread);
+
+  /**
+   * Send the bursts of stream that are due at nowNs, then schedule the next one
+   * @param startNs - when the thread's wheel was at tick 0
+   * @return false once the stream sent its count
+   */
+  bool fireStream(WheelThread& thread, TxStream& stream, uint64_t startNs);
+
+  /**
+   * Send burst datagrams of stream, each with the next sequence
+   */
+  void sendBurst(TxStream& stream);
+
+private:
+  vector<StreamProfile> mProfiles;
+  int  mLoopbackCount;
+  bool mThreadPerIface;
+  vector<TxStream*>    mStreams;
+  vector<WheelThread*> mThreads;
+
+// multi thread area -----------------------------
+public:
+  static void* wheelThreadHelper(void* context);
+// -----------------------------------------------
+};
+
+#endif /* MCASTIT_STREAMMODULE_H_ */
@@ -0,0 +1,119 @@
+#include "TimingWheel.h"
+
+TimingWheel::TimingWheel() :
+    mTick(0), mCount(0), mCascaded(0)
+{
+  for (unsigned level = 0; level < TW_LEVELS; ++level)
+  {
+    for (unsigned i = 0; i < TW_SLOTS; ++i)
+    {
+      mSlots[level][i].next = mSlots[level][i].prev = &mSlots[level][i];
+    }
+  }
+}
+
+void TimingWheel::schedule(TimerNode& node, uint64_t expiry)
+{
+  if (node.prev)
+  {
+    cancel(node);
+  }
+
+  node.expiry = (expiry > mTick)? expiry : mTick + 1;
+  place(node);
+  ++mCount;
+}
+
+void TimingWheel::cancel(TimerNode& node)
+{
+  if (!node.prev)
+  {
+    return;
+  }
+
+  node.prev->next = node.next;
+  node.next->prev = node.prev;
+  node.next = node.prev = NULL;
+  --mCount;
+}
+
+void TimingWheel::place(TimerNode& node)
+{
+  // lowest level that reaches the expiry, beyond the top one the timer waits in its last slot
+  uint64_t distance = node.expiry - mTick;
+  unsigned level = 0;
+  while (level + 1 < TW_LEVELS && distance >= (1ULL << (TW_LEVEL_BITS * (level + 1))))
+  {
+    ++level;
+  }
+
+  uint64_t expiry = node.expiry;
+  if (distance >= (1ULL << (TW_LEVEL_BITS * TW_LEVELS)))
+  {
+    expiry = mTick + (1ULL << (TW_LEVEL_BITS * TW_LEVELS)) - 1;
+  }
+
+  TimerNode& head = mSlots[level][(expiry >> (TW_LEVEL_BITS * level)) & (TW_SLOTS - 1)];
+  node.prev = head.prev;
+  node.next = &head;
+  head.prev->next = &node;
+  head.prev = &node;
+}
+
+void TimingWheel::cascade(unsigned level, unsigned idx)
+{
+  TimerNode& head = mSlots[level][idx];
+  TimerNode* node = head.next;
+  head.next = head.prev = &head;
+
+  while (node != &head)
+  {
+    TimerNode* next = node->next;
+    place(*node);
+    ++mCascaded;
+    node = next;
+  }
+}
+
+TimerNode* TimingWheel::advance()
+{
+  ++mTick;
+
+  // entering a new slot of each level whose lower bits wrapped, coarsest first
+  unsigned top = 0;
+  while (top + 1 < TW_LEVELS && 0 == (mTick & ((1ULL << (TW_LEVEL_BITS * (top + 1))) - 1)))
+  {
+    ++top;
+  }
+  for (unsigned level = top; level > 0; --level)
+  {
+    cascade(level, (mTick >> (TW_LEVEL_BITS * level)) & (TW_SLOTS - 1));
+  }
+
+  TimerNode& head = mSlots[0][mTick & (TW_SLOTS - 1)];
+  TimerNode* expired = NULL;
+  TimerNode** tail = &expired;
+  TimerNode* node = head.next;
+  head.next = head.prev = &head;
+
+  while (node != &head)
+  {
+    TimerNode* next = node->next;
+    if (node->expiry > mTick)
+    {
+      // parked at the top level for more than 2^32 ticks
+      place(*node);
+    }
+    else
+    {
+      node->prev = NULL;
+      node->next = NULL;
+      *tail = node;
+      tail = &node->next;
+      --mCount;
+    }
+    node = next;
+  }
+
+  return expired;
+}
@@ -0,0 +1,72 @@
+#ifndef MCASTIT_TIMINGWHEEL_H_
+#define MCASTIT_TIMINGWHEEL_H_
+
+#include "Common.h"
+
+#define TW_LEVEL_BITS     (8)
+#define TW_SLOTS          (1 << TW_LEVEL_BITS)  // per level
+#define TW_LEVELS         (4)                   // 2^32 ticks ahead, further timers wait at the top
+
+/**
+ * Timer of a TimingWheel, embedded in what it schedules
+ */
+struct TimerNode
+{
+  TimerNode* next;
+  TimerNode* prev;      // NULL if not scheduled
+  uint64_t   expiry;    // tick
+  void*      context;   // for the owner
+
+  TimerNode(): next(NULL), prev(NULL), expiry(0), context(NULL) {}
+};
+
+/**
+ * Hierarchical timing wheel
+ *
+ * Level l has TW_SLOTS slots of TW_SLOTS^l ticks each. A timer goes to the
+ * lowest level whose span covers its distance to the current tick, in the slot
+ * of its expiry tick at that level. When the current tick enters a slot of a
+ * higher level, the timers of that slot are moved down to finer slots.
+ * Scheduling, cancelling & advancing one tick cost O(1) plus the timers that
+ * expire or move down, whatever the number of timers
+ */
+class TimingWheel
+{
+public:
+  TimingWheel();
+
+  /**
+   * @param expiry - tick to fire at, the next tick if it's not in the future
+   */
+  void schedule(TimerNode& node, uint64_t expiry);
+  void cancel(TimerNode& node);
+
+  /**
+   * Move to the next tick
+   * @return timers that expire at it, unscheduled & chained with next, NULL if none
+   */
+  TimerNode* advance();
+
+  uint64_t getTick() const { return mTick; }
+  unsigned getCount() const { return mCount; }
+  uint64_t getCascaded() const { return mCascaded; }
+
+private:
+  /**
+   * Link node in the slot matching its expiry
+   */
+  void place(TimerNode& node);
+
+  /**
+   * Empty slot idx of level into the lower levels
+   */
+  void cascade(unsigned level, unsigned idx);
+
+private:
+  TimerNode mSlots[TW_LEVELS][TW_SLOTS];  // list heads, circular
+  uint64_t  mTick;
+  unsigned  mCount;                       // timers scheduled
+  uint64_t  mCascaded;                    // timers moved down a level
+};
+
+#endif /* MCASTIT_TIMINGWHEEL_H_ */
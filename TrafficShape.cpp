@@ -0,0 +1,205 @@
+#include "TrafficShape.h"
+#include <fstream>
+#include <math.h>
+
+TrafficShape::TrafficShape() :
+    mMode(SHAPE_CONSTANT), mBurstLen(1), mPeriodNs(0), mOnNs(0), mOffNs(0)
+{
+}
+
+bool TrafficShape::parse(const string& spec)
+{
+  if ("constant" == spec || "poisson" == spec)
+  {
+    mMode = ("constant" == spec)? SHAPE_CONSTANT : SHAPE_POISSON;
+    return true;
+  }
+
+  size_t colon = spec.find(':');
+  if (string::npos == colon)
+  {
+    return false;
+  }
+
+  const string name = spec.substr(0, colon);
+  const string args = spec.substr(colon + 1);
+  if ("replay" == name)
+  {
+    vector<uint64_t> gapsNs;
+    if (!loadGaps(args, gapsNs))
+    {
+      return false;
+    }
+    mMode = SHAPE_REPLAY;
+    mReplayPath = args;
+    mGapsNs.swap(gapsNs);
+    return true;
+  }
+
+  double first, second;
+  char extra;
+  if (2 != sscanf(args.c_str(), "%lf:%lf%c", &first, &second, &extra) || first <= 0 || second <= 0)
+  {
+    return false;
+  }
+
+  if ("burst" == name && first == (unsigned) first)
+  {
+    mMode = SHAPE_BURST;
+    mBurstLen = (unsigned) first;
+    mPeriodNs = (uint64_t) (second * 1e6);
+  }
+  else if ("onoff" == name)
+  {
+    mMode = SHAPE_ONOFF;
+    mOnNs = (uint64_t) (first * 1e6);
+    mOffNs = (uint64_t) (second * 1e6);
+  }
+  else
+  {
+    return false;
+  }
+
+  return true;
+}
+
+bool TrafficShape::loadGaps(const string& path, vector<uint64_t>& gapsNs)
+{
+  std::ifstream file(path.c_str());
+  if (!file)
+  {
+    LOG_ERROR("Cannot open " << path << ": " << strerror(errno));
+    return false;
+  }
+
+  string line;
+  uint64_t totalNs = 0;
+  for (unsigned lineNum = 1; std::getline(file, line); ++lineNum)
+  {
+    line = line.substr(0, line.find('#'));
+    std::stringstream stm(line);
+    double gapUs;
+    while (stm >> gapUs)
+    {
+      if (gapUs < 0)
+      {
+        LOG_ERROR(path << ":" << lineNum << " negative gap " << gapUs);
+        return false;
+      }
+      gapsNs.push_back((uint64_t) (gapUs * 1e3));
+      totalNs += gapsNs.back();
+    }
+
+    if (!stm.eof())
+    {
+      LOG_ERROR(path << ":" << lineNum << " gaps must be numbers of microseconds");
+      return false;
+    }
+  }
+
+  // back to back rounds only would never sleep
+  if (0 == totalNs)
+  {
+    LOG_ERROR("No gap in " << path);
+    return false;
+  }
+  return true;
+}
+
+string TrafficShape::toString() const
+{
+  std::stringstream stm;
+  switch (mMode)
+  {
+  case SHAPE_BURST:
+    stm << "burst of " << mBurstLen << " rounds every " << mPeriodNs / 1e6 << " ms";
+    break;
+  case SHAPE_ONOFF:
+    stm << "on " << mOnNs / 1e6 << " ms off " << mOffNs / 1e6 << " ms";
+    break;
+  case SHAPE_POISSON:
+    stm << "poisson";
+    break;
+  case SHAPE_REPLAY:
+    stm << "replay of " << mGapsNs.size() << " gaps from " << mReplayPath;
+    break;
+  default:
+    stm << "constant";
+    break;
+  }
+  return stm.str();
+}
+
+uint64_t TrafficShape::getMeanGapNs(uint64_t intervalNs) const
+{
+  switch (mMode)
+  {
+  case SHAPE_BURST:
+    return mPeriodNs / mBurstLen;
+  case SHAPE_ONOFF:
+  {
+    uint64_t onRounds = std::max((uint64_t) 1, intervalNs? mOnNs / intervalNs : 1);
+    return (mOnNs + mOffNs) / onRounds;
+  }
+  case SHAPE_REPLAY:
+  {
+    uint64_t totalNs = 0;
+    for (unsigned i = 0; i < mGapsNs.size(); ++i)
+    {
+      totalNs += mGapsNs[i];
+    }
+    return totalNs / mGapsNs.size();
+  }
+  default:
+    return intervalNs;
+  }
+}
+
+void TrafficShape::initState(ShapeState& state, unsigned index) const
+{
+  state.round = 0;
+  state.replayIdx = 0;
+  state.seed = getpid() ^ time(NULL) ^ (index * 2654435761U);
+}
+
+uint64_t TrafficShape::nextGapNs(ShapeState& state, uint64_t intervalNs) const
+{
+  switch (mMode)
+  {
+  case SHAPE_BURST:
+    if (++state.round < mBurstLen)
+    {
+      return 0;
+    }
+    state.round = 0;
+    return mPeriodNs;
+
+  case SHAPE_ONOFF:
+  {
+    // rounds of one on period are an interval apart, the next period starts ON + OFF after it
+    uint64_t onRounds = std::max((uint64_t) 1, intervalNs? mOnNs / intervalNs : 1);
+    if (++state.round < onRounds)
+    {
+      return intervalNs;
+    }
+    state.round = 0;
+    return mOnNs + mOffNs - (onRounds - 1) * intervalNs;
+  }
+
+  case SHAPE_POISSON:
+  {
+    double u = rand_r(&state.seed) / (RAND_MAX + 1.0);
+    return (uint64_t) (-log(1.0 - u) * intervalNs);
+  }
+
+  case SHAPE_REPLAY:
+  {
+    uint64_t gapNs = mGapsNs[state.replayIdx];
+    state.replayIdx = (state.replayIdx + 1) % mGapsNs.size();
+    return gapNs;
+  }
+
+  default:
+    return intervalNs;
+  }
+}
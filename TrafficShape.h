@@ -0,0 +1,87 @@
+#ifndef MCASTIT_TRAFFICSHAPE_H_
+#define MCASTIT_TRAFFICSHAPE_H_
+
+#include "Common.h"
+
+/**
+ * Position of one sender thread in a TrafficShape
+ */
+struct ShapeState
+{
+  unsigned round;     // rounds sent in the current burst or on period
+  size_t   replayIdx; // next gap of the replayed distribution
+  unsigned seed;      // poisson arrivals
+
+  ShapeState(): round(0), replayIdx(0), seed(0) {}
+};
+
+/**
+ * Timing of the rounds of a sender thread
+ *
+ * Constant sends one round every interval. Burst sends N rounds back to back
+ * every T ms, on/off sends rounds at the interval for ON ms then pauses for OFF ms,
+ * poisson draws exponential gaps averaging the interval, replay loops over the
+ * gaps of a file. Each round is one datagram per group, or --gso datagrams
+ */
+class TrafficShape
+{
+public:
+  typedef enum _Mode
+  {
+    SHAPE_CONSTANT=0,
+    SHAPE_BURST,      // N rounds at line rate every T
+    SHAPE_ONOFF,      // the interval during ON, nothing during OFF
+    SHAPE_POISSON,    // exponential gaps, mean of the interval
+    SHAPE_REPLAY      // gaps read from a file, in a loop
+  } Mode;
+
+  TrafficShape();
+
+  /**
+   * @param spec - "constant", "burst:{n}:{ms}", "onoff:{ms}:{ms}", "poisson" or "replay:{file}",
+   *               replay files hold one gap in microseconds per line, # starts a comment
+   * @return false if spec or the replay file is invalid, the shape is unchanged
+   */
+  bool parse(const string& spec);
+  string toString() const;
+  bool isConstant() const { return SHAPE_CONSTANT == mMode; }
+
+  /**
+   * @return true if the shape sets its own timing, false if it needs the interval
+   */
+  bool hasOwnTiming() const { return SHAPE_BURST == mMode || SHAPE_REPLAY == mMode; }
+
+  /**
+   * @param intervalNs - interval of the sender thread
+   * @return average time between two rounds
+   */
+  uint64_t getMeanGapNs(uint64_t intervalNs) const;
+
+  /**
+   * Start thread index of a shape at its first round
+   */
+  void initState(ShapeState& state, unsigned index) const;
+
+  /**
+   * @param intervalNs - interval of the sender thread
+   * @return time from the round just sent to the next one, 0 if it follows in the same burst
+   */
+  uint64_t nextGapNs(ShapeState& state, uint64_t intervalNs) const;
+
+private:
+  /**
+   * Read the gaps of a replay file in gapsNs
+   * @return false on error, logged
+   */
+  static bool loadGaps(const string& path, vector<uint64_t>& gapsNs);
+
+private:
+  Mode     mMode;
+  unsigned mBurstLen;     // rounds per burst
+  uint64_t mPeriodNs;     // from burst to burst
+  uint64_t mOnNs, mOffNs;
+  string   mReplayPath;
+  vector<uint64_t> mGapsNs;
+};
+
+#endif /* MCASTIT_TRAFFICSHAPE_H_ */
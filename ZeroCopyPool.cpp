@@ -0,0 +1,270 @@
+#include "ZeroCopyPool.h"
+
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <linux/errqueue.h>
+
+#ifndef SO_ZEROCOPY
+#define SO_ZEROCOPY                 (60)
+#endif
+#ifndef SO_EE_ORIGIN_ZEROCOPY
+#define SO_EE_ORIGIN_ZEROCOPY       (5)
+#endif
+#ifndef SO_EE_CODE_ZEROCOPY_COPIED
+#define SO_EE_CODE_ZEROCOPY_COPIED  (1)
+#endif
+
+ZeroCopyPool::ZeroCopyPool() :
+    mFd(-1), mWakeFd(-1), mIsWaiting(false),
+    mNextId(0), mInFlight(0),
+    mSends(0), mZeroCopied(0), mCopied(0)
+{
+  pthread_mutex_init(&mLock, NULL);
+}
+
+ZeroCopyPool::~ZeroCopyPool()
+{
+  if (-1 != mWakeFd)
+  {
+    close(mWakeFd);
+  }
+  pthread_mutex_destroy(&mLock);
+}
+
+bool ZeroCopyPool::init(int fd, unsigned bufferLen, unsigned maxSendsPerBuf, int numaNode)
+{
+  int opt = 1;
+  if (0 > setsockopt(fd, SOL_SOCKET, SO_ZEROCOPY, &opt, sizeof(opt)))
+  {
+    LOG_ERROR("sockopt SO_ZEROCOPY: " << strerror(errno));
+    return false;
+  }
+
+  mWakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (-1 == mWakeFd)
+  {
+    LOG_ERROR("eventfd: " << strerror(errno));
+    return false;
+  }
+
+  // page aligned buffers so that each one pins its own pages
+  mFd = fd;
+  unsigned bufferPages = (bufferLen + ARENA_PAGE_LEN - 1) / ARENA_PAGE_LEN;
+  if (!mArena.init(bufferPages * ARENA_PAGE_LEN, ZC_POOL_LEN, numaNode))
+  {
+    return false;
+  }
+  LOG_DEBUG("Zero copy buffers " << mArena.toString());
+
+  mPending.assign(ZC_POOL_LEN, 0);
+  mAcquired.assign(ZC_POOL_LEN, false);
+  mIdBuffer.assign(ZC_POOL_LEN * std::max(1u, maxSendsPerBuf), -1);
+  mFreeList.clear();
+  for (unsigned i = ZC_POOL_LEN; i > 0; --i)
+  {
+    mFreeList.push_back(i - 1);
+  }
+
+  return true;
+}
+
+void ZeroCopyPool::setTemplate(const char* data, unsigned len)
+{
+  len = std::min(len, mArena.getSlotLen());
+  for (unsigned i = 0; i < ZC_POOL_LEN; ++i)
+  {
+    memcpy(mArena.getSlot(i), data, len);
+  }
+}
+
+char* ZeroCopyPool::acquire(int waitMs)
+{
+  reapCompletions();
+
+  uint64_t deadline = Common::getMonotonicNs() + waitMs * 1000000ULL;
+  pthread_mutex_lock(&mLock);
+  while (mFreeList.empty())
+  {
+    uint64_t now = Common::getMonotonicNs();
+    if (now >= deadline)
+    {
+      pthread_mutex_unlock(&mLock);
+      return NULL;
+    }
+    mIsWaiting = true;
+    pthread_mutex_unlock(&mLock);
+
+    // completions are signaled as POLLERR, or on the wake fd once another thread reaped them
+    struct pollfd pfds[2];
+    pfds[0].fd = mFd;
+    pfds[0].events = 0;
+    pfds[1].fd = mWakeFd;
+    pfds[1].events = POLLIN;
+    pfds[0].revents = pfds[1].revents = 0;
+    (void) poll(pfds, 2, (deadline - now) / 1000000ULL + 1);
+    if (pfds[1].revents & POLLIN)
+    {
+      uint64_t value;
+      ssize_t len = read(mWakeFd, &value, sizeof(value));
+      (void) len;
+    }
+    reapCompletions();
+
+    pthread_mutex_lock(&mLock);
+    mIsWaiting = false;
+  }
+
+  unsigned idx = mFreeList.back();
+  mFreeList.pop_back();
+  mAcquired[idx] = true;
+  pthread_mutex_unlock(&mLock);
+  return mArena.getSlot(idx);
+}
+
+void ZeroCopyPool::lockSend()
+{
+  pthread_mutex_lock(&mLock);
+}
+
+void ZeroCopyPool::unlockSend()
+{
+  pthread_mutex_unlock(&mLock);
+}
+
+void ZeroCopyPool::onSent(char* buf)
+{
+  unsigned idx = mArena.getSlotIdx(buf);
+  ++mPending[idx];
+  mIdBuffer[mNextId % mIdBuffer.size()] = idx;
+  ++mNextId;
+  ++mInFlight;
+  ++mSends;
+}
+
+void ZeroCopyPool::onRefused()
+{
+  pthread_mutex_lock(&mLock);
+  mIdBuffer[mNextId % mIdBuffer.size()] = -1;
+  ++mNextId;
+  pthread_mutex_unlock(&mLock);
+}
+
+void ZeroCopyPool::release(char* buf)
+{
+  unsigned idx = mArena.getSlotIdx(buf);
+  pthread_mutex_lock(&mLock);
+  mAcquired[idx] = false;
+  if (0 == mPending[idx])
+  {
+    mFreeList.push_back(idx);
+  }
+  pthread_mutex_unlock(&mLock);
+}
+
+void ZeroCopyPool::complete(uint32_t id, bool copied)
+{
+  int idx = mIdBuffer[id % mIdBuffer.size()];
+  if (0 > idx || 0 == mPending[idx])
+  {
+    LOG_DEBUG("Unexpected zero copy completion " << id);
+    return;
+  }
+
+  if (copied)
+  {
+    ++mCopied;
+  }
+  else
+  {
+    ++mZeroCopied;
+  }
+
+  --mInFlight;
+  if (0 == --mPending[idx] && !mAcquired[idx])
+  {
+    mFreeList.push_back(idx);
+    if (mIsWaiting)
+    {
+      uint64_t one = 1;
+      ssize_t len = write(mWakeFd, &one, sizeof(one));
+      (void) len;
+      mIsWaiting = false;
+    }
+  }
+}
+
+void ZeroCopyPool::reapCompletions()
+{
+  pthread_mutex_lock(&mLock);
+  while (mInFlight > 0)
+  {
+    char control[CMSG_SPACE(sizeof(struct sock_extended_err) + sizeof(struct sockaddr_in6))];
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    if (0 > recvmsg(mFd, &msg, MSG_ERRQUEUE|MSG_DONTWAIT))
+    {
+      if (EAGAIN != errno && EWOULDBLOCK != errno)
+      {
+        LOG_ERROR("recvmsg error queue: " << strerror(errno));
+      }
+      break;
+    }
+
+    for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg))
+    {
+      if (!(IPPROTO_IP == cmsg->cmsg_level && IP_RECVERR == cmsg->cmsg_type) &&
+          !(IPPROTO_IPV6 == cmsg->cmsg_level && IPV6_RECVERR == cmsg->cmsg_type))
+      {
+        continue;
+      }
+
+      struct sock_extended_err serr;
+      memcpy(&serr, CMSG_DATA(cmsg), sizeof(serr));
+      if (0 != serr.ee_errno || SO_EE_ORIGIN_ZEROCOPY != serr.ee_origin)
+      {
+        continue;
+      }
+
+      // one notification covers the send ids [ee_info, ee_data]
+      bool copied = serr.ee_code & SO_EE_CODE_ZEROCOPY_COPIED;
+      for (uint32_t id = serr.ee_info; id != serr.ee_data + 1; ++id)
+      {
+        complete(id, copied);
+      }
+    }
+  }
+  pthread_mutex_unlock(&mLock);
+}
+
+void ZeroCopyPool::drain(int timeoutMs)
+{
+  uint64_t deadline = Common::getMonotonicNs() + timeoutMs * 1000000ULL;
+  reapCompletions();
+  while (getInFlight() > 0)
+  {
+    uint64_t now = Common::getMonotonicNs();
+    if (now >= deadline)
+    {
+      LOG_ERROR(getInFlight() << " zero copy sends did not complete");
+      return;
+    }
+
+    struct pollfd pfd;
+    pfd.fd = mFd;
+    pfd.events = 0;
+    pfd.revents = 0;
+    (void) poll(&pfd, 1, (deadline - now) / 1000000ULL + 1);
+    reapCompletions();
+  }
+}
+
+unsigned ZeroCopyPool::getInFlight() const
+{
+  pthread_mutex_lock(&mLock);
+  unsigned inFlight = mInFlight;
+  pthread_mutex_unlock(&mLock);
+  return inFlight;
+}
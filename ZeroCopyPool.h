@@ -0,0 +1,104 @@
+#ifndef MCASTIT_ZEROCOPYPOOL_H_
+#define MCASTIT_ZEROCOPYPOOL_H_
+
+#include "Common.h"
+#include "PacketArena.h"
+
+#define ZC_POOL_LEN       (256)   // send buffers per socket
+
+/**
+ * Send buffers for MSG_ZEROCOPY on one socket
+ *
+ * The kernel keeps referencing a buffer after sendmsg returns, so a buffer is
+ * only handed out again once the completion notification of every send made
+ * from it has been read from the socket error queue. Buffers are used by the
+ * sending thread, completions may also be reaped by the thread receiving on the
+ * socket: notifications left on the error queue keep it signaled to select
+ */
+class ZeroCopyPool
+{
+public:
+  ZeroCopyPool();
+  ~ZeroCopyPool();
+
+  /**
+   * Enable SO_ZEROCOPY on fd and allocate the buffers
+   * @param fd              - socket the buffers are sent on
+   * @param bufferLen       - bytes per buffer
+   * @param maxSendsPerBuf  - max sends referencing the same buffer
+   * @param numaNode        - node to place the buffers on, -1 for the default policy
+   * @return true on success, false if zero copy isn't available
+   */
+  bool init(int fd, unsigned bufferLen, unsigned maxSendsPerBuf, int numaNode = -1);
+
+  /**
+   * Copy data to the start of every buffer so that senders only patch what changes
+   */
+  void setTemplate(const char* data, unsigned len);
+
+  /**
+   * Get a free buffer, reaping completions and waiting up to waitMs if none is free
+   * @return buffer, NULL if all buffers are still in flight
+   */
+  char* acquire(int waitMs);
+
+  /**
+   * Hold off reaping around a MSG_ZEROCOPY send, so that its completion can't be
+   * read by another thread before onSent() recorded it
+   */
+  void lockSend();
+  void unlockSend();
+
+  /**
+   * Record one successful MSG_ZEROCOPY send made from buf, between lockSend & unlockSend
+   */
+  void onSent(char* buf);
+
+  /**
+   * Account for a MSG_ZEROCOPY send refused after the kernel numbered it, e.g. a
+   * segmented send the path can't take: its completion comes but frees nothing
+   */
+  void onRefused();
+
+  /**
+   * Done sending from buf, it's free again once its sends complete
+   */
+  void release(char* buf);
+
+  /**
+   * Read all pending completion notifications without blocking, from any thread
+   */
+  void reapCompletions();
+
+  /**
+   * Wait until all sends have completed
+   * @param timeoutMs
+   */
+  void drain(int timeoutMs);
+
+  uint64_t getSends() const     { return mSends; }
+  uint64_t getZeroCopied() const { return mZeroCopied; }
+  uint64_t getCopied() const    { return mCopied; }
+
+private:
+  void complete(uint32_t id, bool copied);
+  unsigned getInFlight() const;
+
+private:
+  int         mFd;
+  int         mWakeFd;    // wakes up acquire() when another thread freed a buffer
+  bool        mIsWaiting; // acquire() is waiting for a free buffer
+  PacketArena mArena;     // one page aligned slot per buffer
+
+  vector<unsigned> mPending;   // sends in flight per buffer
+  vector<bool>     mAcquired;  // buffer being filled by the sender
+  vector<int>      mIdBuffer;  // buffer of each in flight send id, indexed by id % size
+  vector<unsigned> mFreeList;
+  uint32_t         mNextId;    // kernel numbers zero copy sends from 0 per socket
+  unsigned         mInFlight;
+
+  uint64_t mSends, mZeroCopied, mCopied;
+  mutable pthread_mutex_t mLock;
+};
+
+#endif /* MCASTIT_ZEROCOPYPOOL_H_ */
@@ -0,0 +1,168 @@
+/**
+ * Micro-benchmark of the FEC codes
+ *
+ *  1. GF(256) multiply-add & XOR throughput of every kernel the cpu supports
+ *  2. encode cost per data datagram and buffering & decode cost per recovered datagram
+ *     for XOR and Reed-Solomon blocks, with the selected kernel
+ *
+ * Usage: fec_bench [datagram size]
+ */
+#include "Common.h"
+#include "GaloisField.h"
+#include "FecCodec.h"
+
+#define KERNEL_BYTES      (256ULL * 1024 * 1024) // processed per kernel & operation
+#define KERNEL_BUF_LEN    (64 * 1024)
+#define CODEC_BLOCKS      (2000)
+
+static void benchKernels()
+{
+  vector<uint8_t> src(KERNEL_BUF_LEN), dst(KERNEL_BUF_LEN, 0);
+  for (unsigned i = 0; i < src.size(); ++i)
+  {
+    src[i] = i * 31 + 7;
+  }
+
+  for (int k = GaloisField::GF_KERNEL_SCALAR; k < GaloisField::GF_KERNELS; ++k)
+  {
+    GaloisField::Kernel kernel = (GaloisField::Kernel) k;
+    if (!GaloisField::setKernel(kernel))
+    {
+      printf("%-8s not supported by this cpu\n", GaloisField::getKernelName(kernel));
+      continue;
+    }
+
+    // coefficient 1 is the XOR path, any other one the table multiply
+    const uint8_t coefs[] = {1, 0x8e};
+    for (unsigned c = 0; c < sizeof(coefs); ++c)
+    {
+      uint64_t start = Common::getMonotonicNs();
+      for (uint64_t done = 0; done < KERNEL_BYTES; done += KERNEL_BUF_LEN)
+      {
+        GaloisField::mulAdd(&dst[0], &src[0], coefs[c], KERNEL_BUF_LEN);
+      }
+      double elapsed = (Common::getMonotonicNs() - start) / 1e9;
+      printf("%-8s %-10s %8.2f GB/s\n", GaloisField::getKernelName(kernel),
+          (1 == coefs[c])? "xor" : "mul-add", KERNEL_BYTES / elapsed / 1e9);
+    }
+  }
+
+  // back to the best one
+  GaloisField::init();
+  if (!GaloisField::setKernel(GaloisField::GF_KERNEL_AVX2))
+  {
+    (void) GaloisField::setKernel(GaloisField::GF_KERNEL_SSSE3);
+  }
+}
+
+/**
+ * Encode CODEC_BLOCKS blocks, drop nParity data datagrams of each and rebuild them
+ * @return false if a rebuilt datagram differs from the original
+ */
+static bool benchCodec(unsigned blockLen, unsigned nParity, unsigned segLen)
+{
+  FecEncoder encoder;
+  if (!encoder.init(blockLen, nParity, segLen))
+  {
+    return false;
+  }
+
+  vector<char> data(blockLen * segLen);
+  vector<char> parity(nParity * (FEC_HEADER_LEN + segLen));
+  FecDecoder decoder;
+  uint64_t encodeNs = 0, decodeNs = 0, recovered = 0;
+  bool isOk = true;
+
+  for (unsigned b = 0; b < CODEC_BLOCKS + 1 && isOk; ++b)
+  {
+    uint32_t firstSeq = b * blockLen + 1;
+    for (unsigned i = 0; i < blockLen; ++i)
+    {
+      char* msg = &data[i * segLen];
+      memset(msg, 'a' + (b + i) % 26, segLen);
+      Common::encodeMessageHeader(msg, firstSeq + i, 0);
+      msg[MCAST_HEADER_LEN] = '<';
+    }
+
+    uint64_t start = Common::getMonotonicNs();
+    for (unsigned i = 0; i < blockLen; ++i)
+    {
+      (void) encoder.add(firstSeq + i, &data[i * segLen]);
+    }
+    encodeNs += b? Common::getMonotonicNs() - start : 0;
+
+    for (unsigned j = 0; j < nParity; ++j)
+    {
+      unsigned len;
+      const char* msg = encoder.getParity(j, len);
+      memcpy(&parity[j * (FEC_HEADER_LEN + segLen)], msg, len);
+    }
+
+    // the first block only sets up the decoder, like a receiver joining late
+    FecHeader header;
+    if (!Common::decodeFecHeader(&parity[0], FEC_HEADER_LEN + segLen, header))
+    {
+      return false;
+    }
+    if (0 == b)
+    {
+      isOk = decoder.init(header, segLen);
+      continue;
+    }
+
+    // lose the first nParity data datagrams, the worst case for decoding
+    start = Common::getMonotonicNs();
+    for (unsigned i = nParity; i < blockLen; ++i)
+    {
+      (void) decoder.addData(firstSeq + i, &data[i * segLen], segLen);
+    }
+
+    unsigned nRecovered = 0;
+    for (unsigned j = 0; j < nParity; ++j)
+    {
+      const char* msg = &parity[j * (FEC_HEADER_LEN + segLen)];
+      (void) Common::decodeFecHeader(msg, FEC_HEADER_LEN + segLen, header);
+      unsigned n = decoder.addParity(header, msg + FEC_HEADER_LEN, segLen);
+      for (unsigned r = 0; r < n; ++r)
+      {
+        uint32_t seq;
+        uint64_t sendTimeNs;
+        const char* rebuilt = decoder.getRecovered(r);
+        isOk = isOk && Common::decodeMessageHeader(rebuilt, segLen, seq, sendTimeNs) &&
+            0 == memcmp(rebuilt, &data[(seq - firstSeq) * segLen], segLen);
+      }
+      nRecovered += n;
+    }
+    decodeNs += Common::getMonotonicNs() - start;
+    recovered += nRecovered;
+    isOk = isOk && (nRecovered == std::min(nParity, blockLen));
+  }
+
+  printf("%-12s %3u+%-2u %6u bytes  encode: %8.1f ns/datagram  buffering & decode: %8.2f us/recovered%s\n",
+      encoder.getCodeName(), blockLen, nParity, segLen,
+      (double) encodeNs / (CODEC_BLOCKS * blockLen),
+      recovered? decodeNs / 1e3 / recovered : 0, isOk? "" : "  MISMATCH");
+  return isOk;
+}
+
+int main(int argc, char** argv)
+{
+  unsigned segLen = (argc > 1)? atoi(argv[1]) : 1200;
+  if (segLen <= MCAST_HEADER_LEN + 1 || segLen + FEC_HEADER_LEN > MCAST_MAX_DGRAM_LEN)
+  {
+    LOG_ERROR("Invalid datagram size " << segLen);
+    return 1;
+  }
+
+  GaloisField::init();
+  cout << "== GF(256) kernels ==" << endl;
+  benchKernels();
+
+  cout << "== codecs (" << GaloisField::getKernelName(GaloisField::getKernel()) << ") ==" << endl;
+  bool isOk = benchCodec(10, 1, segLen);
+  isOk = benchCodec(10, 3, segLen) && isOk;
+  isOk = benchCodec(32, 4, segLen) && isOk;
+  isOk = benchCodec(100, 16, segLen) && isOk;
+
+  return isOk? 0 : 2;
+}
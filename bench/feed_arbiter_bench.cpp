@@ -0,0 +1,101 @@
+/**
+ * Micro-benchmark of the listener A/B arbitration
+ *
+ * Cost of arbitrating one datagram of two copies of a feed, B running 1 to
+ * 4096 sequences behind A with 0.1% loss on each side, in the FeedArbiter
+ * window and with a std::map of the sequences in flight as a baseline.
+ * Exits non zero if the window delivers a sequence twice or not at all
+ *
+ * Usage: feed_arbiter_bench
+ */
+#include "Common.h"
+#include "FeedArbiter.h"
+
+#define SEQUENCES         (2000000)
+#define LOSS_PER_MILLION  (1000)
+
+static uint32_t nextRandom(uint32_t& state)
+{
+  state ^= state << 13;
+  state ^= state >> 17;
+  state ^= state << 5;
+  return state;
+}
+
+/**
+ * Arrivals of both sides, B delayed by skew sequences, some copies lost
+ */
+static void makeArrivals(unsigned skew, vector<uint32_t>& seqs, vector<unsigned char>& sides)
+{
+  uint32_t state = 2463534242U;
+  for (uint32_t seq = 1; seq <= SEQUENCES + skew; ++seq)
+  {
+    if (seq <= SEQUENCES && LOSS_PER_MILLION <= nextRandom(state) % 1000000)
+    {
+      seqs.push_back(seq);
+      sides.push_back(0);
+    }
+    if (seq > skew && LOSS_PER_MILLION <= nextRandom(state) % 1000000)
+    {
+      seqs.push_back(seq - skew);
+      sides.push_back(1);
+    }
+  }
+}
+
+static bool benchArbiter(unsigned skew)
+{
+  vector<uint32_t> seqs;
+  vector<unsigned char> sides;
+  makeArrivals(skew, seqs, sides);
+
+  FeedArbiter arbiter;
+  uint64_t start = Common::getMonotonicNs();
+  for (unsigned i = 0; i < seqs.size(); ++i)
+  {
+    (void) arbiter.arbitrate(sides[i], seqs[i], i);
+  }
+  double windowNs = (double) (Common::getMonotonicNs() - start) / seqs.size();
+
+  // sequences in flight, forgotten once the slower side is past them
+  map<uint32_t, unsigned char> inFlight;
+  uint64_t delivered = 0;
+  start = Common::getMonotonicNs();
+  for (unsigned i = 0; i < seqs.size(); ++i)
+  {
+    if (inFlight.insert(std::make_pair(seqs[i], sides[i])).second)
+    {
+      ++delivered;
+    }
+    while (!inFlight.empty() && inFlight.begin()->first + ARB_WINDOW_LEN < seqs[i])
+    {
+      inFlight.erase(inFlight.begin());
+    }
+  }
+  double mapNs = (double) (Common::getMonotonicNs() - start) / seqs.size();
+
+  unsigned pendingGaps, pendingOnlyOn[ARB_SIDES];
+  arbiter.getPending(pendingGaps, pendingOnlyOn);
+  printf("skew %4u  window: %6.1f ns/datagram  std::map: %6.1f ns/datagram  "
+      "delivered: %llu duplicates: %llu gaps: %llu\n", skew, windowNs, mapNs,
+      (unsigned long long) arbiter.getDelivered(), (unsigned long long) arbiter.getDuplicates(),
+      (unsigned long long) (arbiter.getGaps() + pendingGaps));
+
+  return arbiter.getDelivered() == delivered &&
+      arbiter.getDelivered() + arbiter.getGaps() + pendingGaps == SEQUENCES;
+}
+
+int main()
+{
+  const unsigned skews[] = {1, 64, 1024, 4096};
+  int ret = 0;
+  for (unsigned i = 0; i < sizeof(skews) / sizeof(skews[0]); ++i)
+  {
+    if (!benchArbiter(skews[i]))
+    {
+      printf("MISMATCH with skew %u\n", skews[i]);
+      ret = 1;
+    }
+  }
+  return ret;
+}
@@ -0,0 +1,77 @@
+/**
+ * Micro-benchmark of the sender receiver table
+ *
+ * Cost of one ACK update for tables of 10 to 10000 listeners, with the
+ * ReceiverTable open addressing hash and with a std::map keyed by the
+ * printable listener name as a baseline
+ *
+ * Usage: receiver_table_bench
+ */
+#include "Common.h"
+#include "ReceiverTable.h"
+
+#define UPDATES           (4000000)
+
+static uint32_t nextRandom(uint32_t& state)
+{
+  state ^= state << 13;
+  state ^= state >> 17;
+  state ^= state << 5;
+  return state;
+}
+
+/**
+ * Listener i, all on the ACK port with their own address & pid
+ */
+static ReceiverKey makeKey(unsigned i)
+{
+  struct sockaddr_storage source;
+  memset(&source, 0, sizeof(source));
+  struct sockaddr_in* addr = (struct sockaddr_in*) &source;
+  addr->sin_family = AF_INET;
+  addr->sin_port = htons(12321);
+  addr->sin_addr.s_addr = htonl(0x0a000000 + i / 4);
+  return ReceiverKey(source, 1000 + i % 4, "239.192.0.123");
+}
+
+static void benchTable(unsigned nReceivers)
+{
+  vector<ReceiverKey> keys;
+  vector<string> names;
+  for (unsigned i = 0; i < nReceivers; ++i)
+  {
+    keys.push_back(makeKey(i));
+    names.push_back(keys.back().toString());
+  }
+
+  ReceiverTable table;
+  uint32_t state = 2463534242U;
+  uint64_t start = Common::getMonotonicNs();
+  for (unsigned i = 0; i < UPDATES; ++i)
+  {
+    ++table.get(keys[nextRandom(state) % nReceivers]).acked;
+  }
+  double tableNs = (double) (Common::getMonotonicNs() - start) / UPDATES;
+
+  map<string, uint64_t> baseline;
+  state = 2463534242U;
+  start = Common::getMonotonicNs();
+  for (unsigned i = 0; i < UPDATES; ++i)
+  {
+    ++baseline[names[nextRandom(state) % nReceivers]];
+  }
+  double mapNs = (double) (Common::getMonotonicNs() - start) / UPDATES;
+
+  printf("%6u receivers  table: %6.1f ns/ack (%u slots)  std::map: %6.1f ns/ack\n",
+      nReceivers, tableNs, table.getSlotCount(), mapNs);
+}
+
+int main()
+{
+  const unsigned sizes[] = {10, 100, 1000, 10000};
+  for (unsigned i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i)
+  {
+    benchTable(sizes[i]);
+  }
+  return 0;
+}
@@ -0,0 +1,158 @@
+/**
+ * Micro-benchmark of the sender hot path
+ *
+ *  1. building a test message: legacy per round formatting vs patching the template header
+ *  2. heap allocations per datagram of SenderModule send loop, taken as the difference
+ *     between two runs of different length so that setup allocations cancel out
+ *
+ * Usage: send_path_bench [iface]
+ */
+#include "Common.h"
+#include "SenderModule.h"
+
+#define FORMAT_ITERATIONS (2000000)
+#define SHORT_RUN_ROUNDS  (1000)
+#define LONG_RUN_ROUNDS   (21000)
+
+// Heap allocation counter, interposes the libc allocator ------------------
+static volatile unsigned long g_allocCount = 0;
+
+extern "C" void* __libc_malloc(size_t size);
+extern "C" void* __libc_calloc(size_t n, size_t size);
+extern "C" void* __libc_realloc(void* ptr, size_t size);
+
+extern "C" void* malloc(size_t size)
+{
+  __sync_fetch_and_add(&g_allocCount, 1);
+  return __libc_malloc(size);
+}
+
+extern "C" void* calloc(size_t n, size_t size)
+{
+  __sync_fetch_and_add(&g_allocCount, 1);
+  return __libc_calloc(n, size);
+}
+
+extern "C" void* realloc(void* ptr, size_t size)
+{
+  __sync_fetch_and_add(&g_allocCount, 1);
+  return __libc_realloc(ptr, size);
+}
+// -------------------------------------------------------------------------
+
+/**
+ * Expose the send loop of SenderModule
+ */
+class BenchSender: public SenderModule
+{
+public:
+  BenchSender(const vector<IfaceData>& ifaces, const vector<string>& mcastAddresses) :
+    SenderModule(ifaces, mcastAddresses, 12321, 0, false, -1) {}
+
+  bool init() { return SenderModule::init(); }
+  bool send() { return sendMcastMessages(); }
+};
+
+static void report(const char* name, uint64_t elapsedNs, unsigned long allocs, unsigned long n)
+{
+  printf("%-40s %8.1f ns/op %8.3f allocs/op\n", name, (double) elapsedNs / n, (double) allocs / n);
+}
+
+static void benchFormatting(const IfaceData& iface)
+{
+  char msgBuf[MCAST_BUFF_LEN];
+  const string dmsg = "<Sender info:";
+
+  // what every round used to do
+  unsigned long allocs = g_allocCount;
+  uint64_t start = Common::getMonotonicNs();
+  for (int seq = 0; seq < FORMAT_ITERATIONS; ++seq)
+  {
+    const IfaceData ifaceData = iface;
+    int len = snprintf(msgBuf, sizeof(msgBuf), "%4d ", seq);
+    snprintf(msgBuf + len, sizeof(msgBuf) - len, "%s %s>", dmsg.c_str(), ifaceData.toString().c_str());
+  }
+  report("legacy copy + toString + sprintf", Common::getMonotonicNs() - start,
+      g_allocCount - allocs, FORMAT_ITERATIONS);
+
+  // template built once, header patched in place
+  const string info = "<Sender info: " + iface.toString() + ">";
+  memset(msgBuf, 0, sizeof(msgBuf));
+  memcpy(msgBuf + MCAST_HEADER_LEN, info.data(), info.size());
+
+  allocs = g_allocCount;
+  start = Common::getMonotonicNs();
+  for (int seq = 0; seq < FORMAT_ITERATIONS; ++seq)
+  {
+    Common::encodeMessageHeader(msgBuf, seq, Common::getRealtimeNs());
+  }
+  report("template header patch", Common::getMonotonicNs() - start,
+      g_allocCount - allocs, FORMAT_ITERATIONS);
+}
+
+/**
+ * Run the thread per interface send loop flat out for nRounds
+ * @return allocations made while sending
+ */
+static unsigned long runSender(const IfaceData& iface, long nRounds, uint64_t& elapsedNs)
+{
+  // each run binds its own socket
+  int fd = Common::createSocket();
+  if (0 > fd)
+  {
+    LOG_ERROR("Creating socket: " << strerror(errno));
+    exit(1);
+  }
+
+  vector<IfaceData> ifaces(1, IfaceData(iface.ifaceName, iface.ifaceAddresses, fd));
+  vector<string> groups(1, "239.192.0.123");
+  BenchSender sender(ifaces, groups);
+  sender.setThreadPerIface(true);
+  sender.setIfaceRates(vector<float>(1, 1e8));
+  sender.setSendCount(nRounds);
+  if (!sender.init())
+  {
+    LOG_ERROR("Cannot init sender");
+    exit(1);
+  }
+
+  unsigned long allocs = g_allocCount;
+  uint64_t start = Common::getMonotonicNs();
+  if (!sender.send())
+  {
+    LOG_ERROR("Sending failed");
+  }
+  elapsedNs = Common::getMonotonicNs() - start;
+  allocs = g_allocCount - allocs;
+
+  close(fd);
+  return allocs;
+}
+
+int main(int argc, char** argv)
+{
+  string ifaceName = (argc > 1)? argv[1] : "";
+  vector<string> addresses;
+  if (ifaceName.size() && 0 != Common::getIfaceIPFromIfaceName(ifaceName, addresses))
+  {
+    LOG_ERROR("Can't find interface IP address for " << ifaceName);
+    return 1;
+  }
+
+  const IfaceData iface(ifaceName, addresses);
+
+  cout << "== message build ==" << endl;
+  benchFormatting(iface);
+
+  cout << "== SenderModule send loop ==" << endl;
+  uint64_t shortNs, longNs;
+  (void) runSender(iface, SHORT_RUN_ROUNDS, shortNs); // warm up one time allocations
+  unsigned long shortAllocs = runSender(iface, SHORT_RUN_ROUNDS, shortNs);
+  unsigned long longAllocs = runSender(iface, LONG_RUN_ROUNDS, longNs);
+  printf("setup allocations: %lu, allocations while sending %d more rounds: %ld\n", shortAllocs,
+      LONG_RUN_ROUNDS - SHORT_RUN_ROUNDS, (long) longAllocs - (long) shortAllocs);
+  report("send round (sendto included)", longNs - shortNs, longAllocs - shortAllocs,
+      LONG_RUN_ROUNDS - SHORT_RUN_ROUNDS);
+
+  return (longAllocs == shortAllocs)? 0 : 2;
+}
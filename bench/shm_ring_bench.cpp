@@ -0,0 +1,120 @@
+/**
+ * Micro-benchmark of the listener shared memory ring
+ *
+ * Publish cost of 64 to 1472 byte datagrams with no reader, then the
+ * throughput of one writer & one reader thread: datagrams read, datagrams
+ * lost because the writer lapped the reader. Exits non zero if a datagram is
+ * read with a payload that doesn't match its position
+ *
+ * Usage: shm_ring_bench
+ */
+#include "Common.h"
+#include "ShmRing.h"
+#include <sys/mman.h>
+
+#define BENCH_RING_NAME   "mcastit-bench"
+#define DATAGRAMS         (2000000)
+
+struct ReaderState
+{
+  unsigned len;
+  uint64_t nRead, nLost, nCorrupt;
+};
+
+static void* runReader(void* arg)
+{
+  ReaderState& state = *(ReaderState*) arg;
+  ShmRing ring;
+  if (!ring.open(BENCH_RING_NAME))
+  {
+    return NULL;
+  }
+
+  vector<char> payload(ring.getMaxPayload());
+  uint64_t pos = 0;
+  while (pos < DATAGRAMS)
+  {
+    ShmSlotHeader meta;
+    ShmRing::ReadResult result = ring.read(pos, meta, &payload[0]);
+    if (ShmRing::SHM_READ_OK == result)
+    {
+      uint64_t stamped;
+      memcpy(&stamped, &payload[0], sizeof(stamped));
+      state.nCorrupt += (stamped != pos || meta.len != state.len)? 1 : 0;
+      ++state.nRead;
+      ++pos;
+    }
+    else if (ShmRing::SHM_READ_OVERRUN == result)
+    {
+      uint64_t oldest = std::max(ring.getOldest(), pos + 1);
+      state.nLost += oldest - pos;
+      pos = oldest;
+    }
+    else
+    {
+      sched_yield();
+    }
+  }
+  return NULL;
+}
+
+static bool benchRing(unsigned len)
+{
+  ShmRing ring;
+  if (!ring.create(BENCH_RING_NAME, SHM_RING_SLOTS))
+  {
+    return false;
+  }
+
+  vector<char> payload(len, 'x');
+  ShmSlotHeader meta;
+  memset(&meta, 0, sizeof(meta));
+  meta.len = len;
+  uint64_t start = Common::getMonotonicNs();
+  for (uint64_t pos = 0; pos < DATAGRAMS; ++pos)
+  {
+    memcpy(&payload[0], &pos, sizeof(pos));
+    ring.publish(meta, &payload[0], len);
+  }
+  double publishNs = (double) (Common::getMonotonicNs() - start) / DATAGRAMS;
+
+  // again with a reader following from the first position
+  if (!ring.create(BENCH_RING_NAME, SHM_RING_SLOTS))
+  {
+    return false;
+  }
+  ReaderState state;
+  memset(&state, 0, sizeof(state));
+  state.len = len;
+  pthread_t reader;
+  pthread_create(&reader, NULL, runReader, &state);
+  start = Common::getMonotonicNs();
+  for (uint64_t pos = 0; pos < DATAGRAMS; ++pos)
+  {
+    memcpy(&payload[0], &pos, sizeof(pos));
+    ring.publish(meta, &payload[0], len);
+  }
+  pthread_join(reader, NULL);
+  double elapsedNs = Common::getMonotonicNs() - start;
+
+  printf("%5u bytes  publish: %6.1f ns/datagram (%.2f GB/s)  with a reader: %6.2f Mdatagrams/s "
+      "read: %llu lost: %llu\n", len, publishNs, len / publishNs, DATAGRAMS * 1e3 / elapsedNs,
+      (unsigned long long) state.nRead, (unsigned long long) state.nLost);
+  return 0 == state.nCorrupt && DATAGRAMS == state.nRead + state.nLost;
+}
+
+int main()
+{
+  const unsigned lens[] = {64, 256, 1024, 1472};
+  int ret = 0;
+  for (unsigned i = 0; i < sizeof(lens) / sizeof(lens[0]); ++i)
+  {
+    if (!benchRing(lens[i]))
+    {
+      printf("MISMATCH with %u byte datagrams\n", lens[i]);
+      ret = 1;
+    }
+  }
+  shm_unlink("/" BENCH_RING_NAME);
+  return ret;
+}
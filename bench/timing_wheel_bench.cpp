@@ -0,0 +1,86 @@
+/**
+ * Micro-benchmark of the stream scheduler timing wheel
+ *
+ * Cost of one tick for 100 to 100000 periodic timers, each rescheduled when
+ * it fires with a period of 1 to 10000 ticks, against scanning every stream
+ * for the ones that are due as a baseline
+ *
+ * Usage: timing_wheel_bench
+ */
+#include "Common.h"
+#include "TimingWheel.h"
+
+#define TICKS             (50000)
+#define MAX_PERIOD        (10000)
+
+static uint32_t nextRandom(uint32_t& state)
+{
+  state ^= state << 13;
+  state ^= state >> 17;
+  state ^= state << 5;
+  return state;
+}
+
+static void benchWheel(unsigned nTimers)
+{
+  vector<TimerNode> timers(nTimers);
+  vector<uint64_t> periods(nTimers);
+  uint32_t state = 2463534242U;
+  for (unsigned i = 0; i < nTimers; ++i)
+  {
+    periods[i] = 1 + nextRandom(state) % MAX_PERIOD;
+  }
+
+  TimingWheel wheel;
+  for (unsigned i = 0; i < nTimers; ++i)
+  {
+    timers[i].context = &periods[i];
+    wheel.schedule(timers[i], periods[i]);
+  }
+
+  uint64_t fired = 0;
+  uint64_t start = Common::getMonotonicNs();
+  for (unsigned t = 0; t < TICKS; ++t)
+  {
+    TimerNode* expired = wheel.advance();
+    while (expired)
+    {
+      TimerNode* next = expired->next;
+      wheel.schedule(*expired, wheel.getTick() + *(uint64_t*) expired->context);
+      ++fired;
+      expired = next;
+    }
+  }
+  double wheelNs = (double) (Common::getMonotonicNs() - start) / TICKS;
+
+  // every stream checked every tick
+  vector<uint64_t> due(periods);
+  uint64_t scanFired = 0;
+  start = Common::getMonotonicNs();
+  for (unsigned t = 1; t <= TICKS; ++t)
+  {
+    for (unsigned i = 0; i < nTimers; ++i)
+    {
+      if (due[i] <= t)
+      {
+        due[i] += periods[i];
+        ++scanFired;
+      }
+    }
+  }
+  double scanNs = (double) (Common::getMonotonicNs() - start) / TICKS;
+
+  printf("%6u timers  wheel: %8.1f ns/tick (%.2f fired, %.2f cascaded)  scan: %8.1f ns/tick (%.2f fired)\n",
+      nTimers, wheelNs, (double) fired / TICKS, (double) wheel.getCascaded() / TICKS, scanNs,
+      (double) scanFired / TICKS);
+}
+
+int main()
+{
+  const unsigned sizes[] = {100, 1000, 10000, 100000};
+  for (unsigned i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i)
+  {
+    benchWheel(sizes[i]);
+  }
+  return 0;
+}
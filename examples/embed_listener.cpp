@@ -0,0 +1,87 @@
+/**
+ * Example of a listener embedded in an application with libmcastit
+ *
+ * Receives the groups on the interfaces from the application's own loop, the
+ * datagrams are handed to a PacketHandler without copy. Prints one line of
+ * totals per second & stops on SIGINT or SIGTERM
+ *
+ * Usage: embed_listener {group} {port} [iface1 iface2 ...]
+ *   e.g. embed_listener 239.192.0.123 12321 eth0
+ */
+#include "McastSession.h"
+
+static McastSession* g_session = NULL;
+
+static void onSignal(int)
+{
+  g_session->stop();
+}
+
+/**
+ * Counts the datagrams & bytes, keeps the highest sequence
+ */
+class CountingHandler: public PacketHandler
+{
+public:
+  CountingHandler(): nPackets(0), nBytes(0), highestSeq(0) {}
+
+  void onPacket(const RxPacket& packet)
+  {
+    ++nPackets;
+    nBytes += packet.len;
+    highestSeq = std::max(highestSeq, packet.seq);
+  }
+
+  uint64_t nPackets, nBytes;
+  uint32_t highestSeq;
+};
+
+int main(int argc, char* argv[])
+{
+  if (3 > argc)
+  {
+    printf("Usage: %s {group} {port} [iface1 iface2 ...]\n", argv[0]);
+    return 1;
+  }
+
+  McastSession session;
+  for (int i = 3; i < argc; ++i)
+  {
+    if (!session.addIface(argv[i]))
+    {
+      return 2;
+    }
+  }
+
+  ReceiverModule* listener = session.createListener(vector<string>(1, argv[1]), atoi(argv[2]));
+  if (!listener)
+  {
+    return 1;
+  }
+  CountingHandler handler;
+  listener->setQuiet();
+  listener->setPacketHandler(&handler);
+
+  g_session = &session;
+  signal(SIGINT, onSignal);
+  signal(SIGTERM, onSignal);
+  if (!session.start())
+  {
+    return 1;
+  }
+
+  // the application would do its own work between the polls
+  uint64_t nextPrintNs = Common::getMonotonicNs() + 1000000000ULL;
+  while (session.poll(100))
+  {
+    if (Common::getMonotonicNs() >= nextPrintNs)
+    {
+      printf("packets: %llu bytes: %llu highest: %u\n", (unsigned long long) handler.nPackets,
+          (unsigned long long) handler.nBytes, handler.highestSeq);
+      nextPrintNs += 1000000000ULL;
+    }
+  }
+
+  session.printStats();
+  return 0;
+}
@@ -0,0 +1,107 @@
+/**
+ * Example reader of the listener shared memory ring
+ *
+ * Follows the ring from its newest datagram, prints one line per datagram with
+ * -v, else one line of totals per second: datagrams, datagrams lost because
+ * the listener lapped this reader & kernel receive to read latency.
+ * Several readers can follow the same ring
+ *
+ * Usage: shm_reader {name} [-v]
+ *   e.g. mcastit -l -q --shm mcast eth0 & shm_reader mcast
+ */
+#include "Common.h"
+#include "ShmRing.h"
+#include "Histogram.h"
+
+static volatile bool g_isStopped = false;
+
+static void onSignal(int)
+{
+  g_isStopped = true;
+}
+
+static void printDatagram(uint64_t pos, const ShmSlotHeader& meta, const char* payload,
+    unsigned maxPayload)
+{
+  int family = (AF_INET6 == meta.family)? AF_INET6 : AF_INET;
+  char source[INET6_ADDRSTRLEN], group[INET6_ADDRSTRLEN], ifname[IF_NAMESIZE];
+  inet_ntop(family, meta.source, source, sizeof(source));
+  inet_ntop(family, meta.group, group, sizeof(group));
+  if (!if_indextoname(meta.ifindex, ifname))
+  {
+    strcpy(ifname, "?");
+  }
+
+  string text(payload, strnlen(payload, std::min(meta.len, maxPayload)));
+  printf("%llu %s:%u -> %s on %s seq: %u len: %u %s\n", (unsigned long long) pos, source,
+      meta.sourcePort, group, ifname, meta.msgSeq, meta.len, text.c_str());
+}
+
+int main(int argc, char* argv[])
+{
+  if (2 > argc)
+  {
+    printf("Usage: %s {name} [-v]\n", argv[0]);
+    return 1;
+  }
+  bool isVerbose = (3 <= argc && 0 == strcmp("-v", argv[2]));
+
+  ShmRing ring;
+  if (!ring.open(argv[1]))
+  {
+    return 1;
+  }
+  printf("Reading %s\n", ring.toString().c_str());
+  signal(SIGINT, onSignal);
+  signal(SIGTERM, onSignal);
+
+  vector<char> payload(ring.getMaxPayload());
+  uint64_t pos = ring.getWriteSeq();
+  uint64_t nRead = 0, nLost = 0, lastRead = 0, lastLost = 0;
+  uint64_t nextPrintNs = Common::getMonotonicNs() + 1000000000ULL;
+  Histogram latency;
+  while (!g_isStopped)
+  {
+    ShmSlotHeader meta;
+    ShmRing::ReadResult result = ring.read(pos, meta, &payload[0]);
+    if (ShmRing::SHM_READ_OK == result)
+    {
+      uint64_t nowNs = Common::getRealtimeNs();
+      if (0 < meta.kernelNs && meta.kernelNs <= nowNs)
+      {
+        latency.add(nowNs - meta.kernelNs);
+      }
+      if (isVerbose)
+      {
+        printDatagram(pos, meta, &payload[0], ring.getMaxPayload());
+      }
+      ++nRead;
+      ++pos;
+    }
+    else if (ShmRing::SHM_READ_OVERRUN == result)
+    {
+      uint64_t oldest = std::max(ring.getOldest(), pos + 1);
+      nLost += oldest - pos;
+      pos = oldest;
+    }
+    else
+    {
+      // a spinning reader would get the datagrams sooner, at the cost of a cpu
+      usleep(50);
+    }
+
+    if (!isVerbose && Common::getMonotonicNs() >= nextPrintNs)
+    {
+      printf("read: %llu (+%llu) lost: %llu (+%llu)\n", (unsigned long long) nRead,
+          (unsigned long long) (nRead - lastRead), (unsigned long long) nLost,
+          (unsigned long long) (nLost - lastLost));
+      lastRead = nRead;
+      lastLost = nLost;
+      nextPrintNs += 1000000000ULL;
+    }
+  }
+
+  printf("read: %llu lost: %llu\n", (unsigned long long) nRead, (unsigned long long) nLost);
+  printf("kernel -> reader latency: %s\n", latency.toString(1000, "us").c_str());
+  return 0;
+}
@@ -1,24 +1,108 @@
-#include "Common.h"
-#include "SenderModule.h"
-#include "ReceiverModule.h"
-#include "ServerModule.h"
+#include "McastSession.h"
+
+#include <getopt.h>
+#include <sys/mman.h>
 
 // Global vars
 #define DEFAULT_MCAST_ADDRESS_V4  "239.192.0.123"
 #define DEFAULT_MCAST_ADDRESS_V6  "FFFE::1:FF47:0"
 #define DEFAULT_MCAST_PORT        (12321)
 #define DEFAULT_SERVER_INTERVAL   (1)
+#define DEFAULT_BUSY_POLL_US      (50)
+#define DEFAULT_RT_PRIO           (10)
 
-static vector<IfaceData> g_ifaces;
-static McastModuleInterface* g_McastModule = NULL;
+static McastSession* g_session = NULL;
+static volatile bool g_isStopping = false;
 
 typedef enum _ModuleMode
 {
   READER=0,
   SENDER,
-  SERVER
+  SERVER,
+  STREAMS,
+  RELAY,
+  GATEWAY
 } ModuleMode;
 
+// Long only options
+enum
+{
+  OPT_TX_THREADS = 256,
+  OPT_TX_CPUS,
+  OPT_RATE,
+  OPT_SIZE,
+  OPT_GSO,
+  OPT_ZEROCOPY,
+  OPT_GRO,
+  OPT_RCVBUF,
+  OPT_BUSY_POLL,
+  OPT_CPU_RX,
+  OPT_RX_PRIO,
+  OPT_CPU_MAIN,
+  OPT_SCHED,
+  OPT_PRIO,
+  OPT_MLOCK,
+  OPT_NACK,
+  OPT_NACK_RING,
+  OPT_LOSS,
+  OPT_FEC,
+  OPT_ACK,
+  OPT_SHAPE,
+  OPT_RELAY,
+  OPT_MAP,
+  OPT_GATEWAY,
+  OPT_GW_IN,
+  OPT_SUBSCRIBE,
+  OPT_ARBITRATE,
+  OPT_SHM,
+  OPT_SHM_SLOTS,
+  OPT_STATS,
+  OPT_EXPECT_ACKS,
+  OPT_ACK_TIMEOUT
+};
+
+static const struct option g_longOptions[] =
+{
+  {"count",      required_argument, NULL, 'n'},
+  {"streams",    required_argument, NULL, 'f'},
+  {"tx-threads", no_argument,       NULL, OPT_TX_THREADS},
+  {"tx-cpus",    required_argument, NULL, OPT_TX_CPUS},
+  {"cpu-tx",     required_argument, NULL, OPT_TX_CPUS},
+  {"rate",       required_argument, NULL, OPT_RATE},
+  {"size",       required_argument, NULL, OPT_SIZE},
+  {"gso",        required_argument, NULL, OPT_GSO},
+  {"zerocopy",   no_argument,       NULL, OPT_ZEROCOPY},
+  {"quiet",      no_argument,       NULL, 'q'},
+  {"gro",        no_argument,       NULL, OPT_GRO},
+  {"rcvbuf",     required_argument, NULL, OPT_RCVBUF},
+  {"busy-poll",  optional_argument, NULL, OPT_BUSY_POLL},
+  {"cpu-rx",     required_argument, NULL, OPT_CPU_RX},
+  {"rx-prio",    required_argument, NULL, OPT_RX_PRIO},
+  {"cpu-main",   required_argument, NULL, OPT_CPU_MAIN},
+  {"sched",      required_argument, NULL, OPT_SCHED},
+  {"prio",       required_argument, NULL, OPT_PRIO},
+  {"mlock",      no_argument,       NULL, OPT_MLOCK},
+  {"nack",       no_argument,       NULL, OPT_NACK},
+  {"nack-ring",  required_argument, NULL, OPT_NACK_RING},
+  {"loss",       required_argument, NULL, OPT_LOSS},
+  {"fec",        required_argument, NULL, OPT_FEC},
+  {"ack",        required_argument, NULL, OPT_ACK},
+  {"shape",      required_argument, NULL, OPT_SHAPE},
+  {"relay",      no_argument,       NULL, OPT_RELAY},
+  {"map",        required_argument, NULL, OPT_MAP},
+  {"gateway",    no_argument,       NULL, OPT_GATEWAY},
+  {"gw-in",      required_argument, NULL, OPT_GW_IN},
+  {"subscribe",  required_argument, NULL, OPT_SUBSCRIBE},
+  {"arbitrate",  no_argument,       NULL, OPT_ARBITRATE},
+  {"shm",        required_argument, NULL, OPT_SHM},
+  {"shm-slots",  required_argument, NULL, OPT_SHM_SLOTS},
+  {"stats",      required_argument, NULL, OPT_STATS},
+  {"expect-acks", required_argument, NULL, OPT_EXPECT_ACKS},
+  {"ack-timeout", required_argument, NULL, OPT_ACK_TIMEOUT},
+  {"help",       no_argument,       NULL, 'h'},
+  {NULL, 0, NULL, 0}
+};
+
 static void usage(int /*argc*/, char * argv[])
 {
   cout << "Usage: " << argv[0] << " [options] [iface1 iface2 ...]" << endl << endl
@@ -39,29 +123,129 @@ static void usage(int /*argc*/, char * argv[])
                                  << " second" << endl
       << "    -o {n}             turn on loop back on the first n interfaces, default: all" << endl\
       << "    -a                 use all eligible interfaces except localhost" << endl
+      << "    --relay            receive the groups on the first interface & multicast them on the others" << endl
+      << "    --map {g}={g}[:{port}] relay group g under another group and/or port, repeatable" << endl
+      << "    --gateway          send the groups of the first interface by unicast to their subscribers," << endl
+      << "                        who subscribe on the ACK port (-p + 1), e.g. with -l --subscribe" << endl
+      << "    --gw-in {port}={g}[:{port}] gateway multicasts the datagrams of a unicast port to group g, repeatable" << endl
+      << "    -n, --count {n}    stop sending after n rounds" << endl
+      << "    --expect-acks {n}  sender exits as soon as n listeners acked the last datagram" << endl
+      << "    --ack-timeout {ms} sender listens for ACKs this long after the last datagram, default: "
+                                 << ACK_WINDOW_MS << endl
+      << "    -f, --streams {file} send the streams of a profile file, one per line, e.g." << endl
+      << "                        group=239.192.1.1 port=12321 iface=eth0 rate=1000 size=1200 burst=4 count=5000 streams=100" << endl
+      << "                        rate in bursts per second, -p, -n & --size are the defaults," << endl
+      << "                        --tx-threads schedules each interface from its own thread" << endl << endl
+
+      << "    --tx-threads       send from one pacing thread per interface" << endl
+      << "    --tx-cpus {list}   pin the sender threads to cpus, e.g. 2,3 or 2-5, in interface order" << endl
+      << "                        alias: --cpu-tx" << endl
+      << "    --rate {list}      per interface rate in rounds per second, e.g. 1000,500" << endl
+      << "    --size {bytes}     pad or truncate every datagram to bytes, max " << MCAST_MAX_DGRAM_LEN << endl
+      << "    --gso {n}          send n datagrams per round in one UDP_SEGMENT send, max "
+                                 << UDP_MAX_SEGMENTS << endl
+      << "    --zerocopy         send from a pool of buffers with MSG_ZEROCOPY" << endl
+      << "    --shape {shape}    timing of the sender rounds: constant (default), burst:{n}:{ms} n rounds back to back" << endl
+      << "                        every ms, onoff:{ms}:{ms} the interval during on then off, poisson gaps" << endl
+      << "                        averaging the interval, replay:{file} gaps in usec one per line, looped" << endl << endl
+
+      << "    -q, --quiet        listener & sender only print statistics, not every message or ACK" << endl
+      << "    --gro              listener receives coalesced datagrams with UDP_GRO" << endl
+      << "    --rcvbuf {bytes}   listener, relay & gateway socket receive buffer size" << endl
+      << "    --subscribe {ip}   listener gets the groups by unicast from the gateway at ip" << endl
+      << "    --arbitrate        listener keeps the first copy of each sequence from the first two" << endl
+      << "                        interfaces (A/B feeds) & drops the other one" << endl
+      << "    --shm {name}       listener publishes every datagram in the shared memory ring /dev/shm/name" << endl
+      << "    --shm-slots {n}    datagrams in the ring, power of 2, default: " << SHM_RING_SLOTS << endl
+      << "    --stats {name}     listener, sender & server keep live counters in the shared memory page" << endl
+      << "                        /dev/shm/name, read it with mcastit-stat name" << endl
+      << "    --busy-poll[=usec] listener spins on non blocking sockets with SO_BUSY_POLL, default: "
+                                 << DEFAULT_BUSY_POLL_US << " usec" << endl
+      << "    --cpu-rx {cpu}     pin the receiving thread to cpu" << endl
+      << "    --rx-prio {prio}   run the receiving thread with SCHED_FIFO priority 1-99" << endl << endl
+
+      << "    --cpu-main {cpu}   pin the main thread to cpu" << endl
+      << "    --sched {policy}   scheduling policy of all threads: fifo, rr or other, default: other" << endl
+      << "    --prio {prio}      real time priority of all threads with --sched fifo or rr, default: "
+                                 << DEFAULT_RT_PRIO << endl
+      << "    --mlock            lock all current & future memory with mlockall" << endl << endl
+
+      << "    --nack             reliable mode: listener NACKs missing sequences, sender retransmits them" << endl
+      << "    --nack-ring {n}    datagrams kept per interface for retransmission, default: "
+                                 << RETX_RING_LEN << endl
+      << "    --loss {percent}   listener drops this share of data datagrams to test recovery" << endl
+      << "    --fec {k}[,{m}]    send m parity datagrams every k datagrams, XOR if m is 1 (default),"
+                                 << " Reed-Solomon otherwise" << endl
+      << "    --ack {policy}     how listener & server acknowledge sequenced datagrams: packet (default)," << endl
+      << "                        or a summary per stream: count:{n} datagrams, time:{ms}, jitter:{ms} +-50%" << endl << endl
       << "    -h                 This message, (version " __DATE__ << " " << __TIME__ << ")" << endl << endl;
 
   exit(1);
 }
 
-static void cleanup()
+/**
+ * Parse comma separated list of positive numbers
+ * @return true on success
+ */
+static bool parseRateList(const string& rateList, vector<float>& rates)
 {
-  delete g_McastModule;
-  set<int> uniqueFdSet;
-  for (unsigned i = 0; i < g_ifaces.size(); ++i)
+  rates.clear();
+  std::stringstream stm(rateList);
+  string token;
+  while (std::getline(stm, token, ','))
   {
-    uniqueFdSet.insert(g_ifaces[i].sockFd);
+    float rate = atof(token.c_str());
+    if (rate <= 0)
+    {
+      return false;
+    }
+    rates.push_back(rate);
   }
+  return rates.size() > 0;
+}
 
-  for (set<int>::const_iterator setIt = uniqueFdSet.begin(); 
-            setIt != uniqueFdSet.end(); ++setIt)
+/**
+ * Parse a decimal number within [minValue, maxValue], nothing may follow it
+ * @return true on success
+ */
+static bool parseUnsigned(const char* str, unsigned minValue, unsigned maxValue, unsigned& value)
+{
+  char* end = NULL;
+  errno = 0;
+  long number = strtol(str, &end, 10);
+  if (end == str || '\0' != *end || 0 != errno || number < (long) minValue ||
+      number > (long) maxValue)
   {
-    if (-1 == close(*setIt))
-    {
-      LOG_ERROR("Close socket " << *setIt << ": " << strerror(errno));
-    }
+    return false;
+  }
+  value = number;
+  return true;
+}
+
+/**
+ * Same for a number with decimals
+ */
+static bool parseFloat(const char* str, float minValue, float maxValue, float& value)
+{
+  char* end = NULL;
+  double number = strtod(str, &end);
+  if (end == str || '\0' != *end || !(number >= minValue && number <= maxValue))
+  {
+    return false;
+  }
+  value = number;
+  return true;
+}
+
+static void cleanup()
+{
+  if (g_session)
+  {
+    g_session->printStats();
   }
-  
+  delete g_session;
+  g_session = NULL;
+
   Common::cleanupCommon();
 }
 
@@ -74,6 +258,14 @@ static void safeExit(int errCode = 0)
 static void sigHandler(int signo)
 {
   cout << " Caught signal " << signo << endl;
+
+  // the module returns & main prints the statistics, unless it is stuck
+  if (g_session && !g_isStopping)
+  {
+    g_isStopping = true;
+    g_session->stop();
+    return;
+  }
   safeExit(0);
 }
 
@@ -100,11 +292,45 @@ int main(int argc, char** argv)
   int exitVal = 0;
   float sendInterval = -1;
   bool useAllIfaces = false;
-
-  g_ifaces.clear();
+  long sendCount = -1;
+  bool useTxThreads = false;
+  vector<int> txCpus;
+  vector<float> txRates;
+  unsigned payloadSize = 0;
+  unsigned gsoSegments = 1;
+  bool useZeroCopy = false;
+  bool isQuiet = false;
+  bool useGro = false;
+  int rcvBufSize = 0;
+  int busyPollUs = 0;
+  vector<int> rxCpus;
+  vector<int> mainCpus;
+  int schedPolicy = SCHED_OTHER;
+  int schedPrio = DEFAULT_RT_PRIO;
+  int rxPrio = 0;
+  bool useMlock = false;
+  bool useNack = false;
+  unsigned nackRingLen = RETX_RING_LEN;
+  float lossPercent = 0;
+  unsigned fecBlockLen = 0;
+  unsigned fecParity = 1;
+  AckPolicy ackPolicy;
+  TrafficShape trafficShape;
+  vector<string> relayMaps;
+  vector<string> gatewayInbound;
+  string gateway;
+  bool useArbitration = false;
+  string shmName;
+  unsigned shmSlots = SHM_RING_SLOTS;
+  string statsName;
+  unsigned expectedAcks = 0;
+  unsigned ackTimeoutMs = ACK_WINDOW_MS;
+  bool hasAckWindow = false;      // --expect-acks or --ack-timeout given
+  string streamsFile;
+  vector<StreamProfile> streamProfiles;
 
   int command = -1;
-  while ((command = getopt(argc, argv, "asD6lo:m:p:i:h")) != -1)
+  while ((command = getopt_long(argc, argv, "asD6lqo:m:p:i:n:f:h", g_longOptions, NULL)) != -1)
   {
     switch (command)
     {
@@ -137,6 +363,170 @@ int main(int argc, char** argv)
       cout << "Debug mode ON" << endl;
       Common::setDebugMode(true);
       break;
+    case 'n':
+      sendCount = atol(optarg);
+      break;
+    case 'f':
+      streamsFile = optarg;
+      mode = STREAMS;
+      break;
+    case OPT_TX_THREADS:
+      useTxThreads = true;
+      break;
+    case OPT_TX_CPUS:
+      if (!Common::parseCpuList(optarg, txCpus))
+      {
+        LOG_ERROR("Invalid cpu list " << optarg);
+        usage(argc, argv);
+      }
+      break;
+    case 'q':
+      isQuiet = true;
+      break;
+    case OPT_GRO:
+      useGro = true;
+      break;
+    case OPT_RCVBUF:
+      rcvBufSize = atoi(optarg);
+      break;
+    case OPT_BUSY_POLL:
+      busyPollUs = optarg? atoi(optarg) : DEFAULT_BUSY_POLL_US;
+      if (0 >= busyPollUs)
+      {
+        LOG_ERROR("Invalid busy poll time " << optarg);
+        usage(argc, argv);
+      }
+      break;
+    case OPT_CPU_RX:
+      if (!Common::parseCpuList(optarg, rxCpus) || 1 != rxCpus.size())
+      {
+        LOG_ERROR("Invalid cpu " << optarg);
+        usage(argc, argv);
+      }
+      break;
+    case OPT_RX_PRIO:
+      rxPrio = atoi(optarg);
+      break;
+    case OPT_CPU_MAIN:
+      if (!Common::parseCpuList(optarg, mainCpus) || 1 != mainCpus.size())
+      {
+        LOG_ERROR("Invalid cpu " << optarg);
+        usage(argc, argv);
+      }
+      break;
+    case OPT_SCHED:
+      if (!Common::parseSchedPolicy(optarg, schedPolicy))
+      {
+        LOG_ERROR("Invalid scheduling policy " << optarg);
+        usage(argc, argv);
+      }
+      break;
+    case OPT_PRIO:
+      schedPrio = atoi(optarg);
+      break;
+    case OPT_MLOCK:
+      useMlock = true;
+      break;
+    case OPT_NACK:
+      useNack = true;
+      break;
+    case OPT_NACK_RING:
+      if (!parseUnsigned(optarg, 1, RETX_RING_MAX_LEN, nackRingLen))
+      {
+        LOG_ERROR("Invalid NACK ring length " << optarg << ", 1 to " << RETX_RING_MAX_LEN
+            << " datagrams");
+        usage(argc, argv);
+      }
+      break;
+    case OPT_LOSS:
+      if (!parseFloat(optarg, 0, 100, lossPercent))
+      {
+        LOG_ERROR("Invalid loss " << optarg << ", 0 to 100 percent");
+        usage(argc, argv);
+      }
+      break;
+    case OPT_FEC:
+      if (1 > sscanf(optarg, "%u,%u", &fecBlockLen, &fecParity) || 0 == fecBlockLen ||
+          FEC_MAX_DATA < fecBlockLen || 0 == fecParity || FEC_MAX_PARITY < fecParity)
+      {
+        LOG_ERROR("Invalid FEC block " << optarg << ", 1 to " << FEC_MAX_DATA
+            << " datagrams with 1 to " << FEC_MAX_PARITY << " parity datagrams");
+        usage(argc, argv);
+      }
+      break;
+    case OPT_ACK:
+      if (!ackPolicy.parse(optarg))
+      {
+        LOG_ERROR("Invalid ACK policy " << optarg);
+        usage(argc, argv);
+      }
+      break;
+    case OPT_RELAY:
+      mode = RELAY;
+      break;
+    case OPT_MAP:
+      relayMaps.push_back(optarg);
+      break;
+    case OPT_GATEWAY:
+      mode = GATEWAY;
+      break;
+    case OPT_GW_IN:
+      gatewayInbound.push_back(optarg);
+      break;
+    case OPT_SUBSCRIBE:
+      gateway = optarg;
+      break;
+    case OPT_ARBITRATE:
+      useArbitration = true;
+      break;
+    case OPT_SHM:
+      shmName = optarg;
+      break;
+    case OPT_SHM_SLOTS:
+      shmSlots = atoi(optarg);
+      break;
+    case OPT_STATS:
+      statsName = optarg;
+      break;
+    case OPT_EXPECT_ACKS:
+      if (!parseUnsigned(optarg, 1, ACK_EXPECT_MAX, expectedAcks))
+      {
+        LOG_ERROR("Invalid expected ACKs " << optarg << ", 1 to " << ACK_EXPECT_MAX << " listeners");
+        usage(argc, argv);
+      }
+      hasAckWindow = true;
+      break;
+    case OPT_ACK_TIMEOUT:
+      if (!parseUnsigned(optarg, 0, ACK_WINDOW_MAX_MS, ackTimeoutMs))
+      {
+        LOG_ERROR("Invalid ACK timeout " << optarg << ", 0 to " << ACK_WINDOW_MAX_MS << " ms");
+        usage(argc, argv);
+      }
+      hasAckWindow = true;
+      break;
+    case OPT_SHAPE:
+      if (!trafficShape.parse(optarg))
+      {
+        LOG_ERROR("Invalid traffic shape " << optarg);
+        usage(argc, argv);
+      }
+      break;
+    case OPT_ZEROCOPY:
+      useZeroCopy = true;
+      break;
+    case OPT_SIZE:
+      payloadSize = atoi(optarg);
+      break;
+    case OPT_GSO:
+      gsoSegments = atoi(optarg);
+      break;
+    case OPT_RATE:
+      if (!parseRateList(optarg, txRates))
+      {
+        LOG_ERROR("Invalid rate list " << optarg);
+        usage(argc, argv);
+      }
+      break;
     case 'h':
     default:
       usage(argc, argv);
@@ -147,7 +537,8 @@ int main(int argc, char** argv)
   /*
    * Update arguments based on getopt
    */
-  if (useDefaultIp)
+  // relayed groups may all come from --map
+  if (useDefaultIp && (RELAY != mode || relayMaps.empty()))
   {
     if (useIPv6)
     {
@@ -159,6 +550,48 @@ int main(int argc, char** argv)
     }
   }
 
+  // the stream, relay & gateway modes have no statistics page
+  if (!statsName.empty() && READER != mode && SENDER != mode && SERVER != mode)
+  {
+    LOG_ERROR("Invalid --stats, only the listen, send & server modes keep a statistics page");
+    usage(argc, argv);
+  }
+
+  // the server never ends its sending, so only the send mode has an ACK window
+  if (hasAckWindow && SENDER != mode)
+  {
+    LOG_ERROR("Invalid --expect-acks or --ack-timeout, only the send mode waits for ACKs");
+    usage(argc, argv);
+  }
+
+  if (mode == STREAMS)
+  {
+    StreamProfile defaults;
+    defaults.port = mcastPort;
+    defaults.size = payloadSize;
+    defaults.count = sendCount;
+    if (!StreamModule::loadProfiles(streamsFile, defaults, streamProfiles))
+    {
+      safeExit(1);
+    }
+  }
+
+  /*
+   * Cpus & scheduling of each thread, applied by the threads themselves
+   */
+  Common::setThreadCpus(Common::THREAD_MAIN, mainCpus);
+  Common::setThreadCpus(Common::THREAD_RX, rxCpus);
+  Common::setThreadCpus(Common::THREAD_TX, txCpus);
+  for (int role = 0; role < Common::THREAD_ROLES; ++role)
+  {
+    Common::setThreadScheduling((Common::ThreadRole) role, schedPolicy, schedPrio);
+  }
+
+  if (rxPrio > 0)
+  {
+    Common::setThreadScheduling(Common::THREAD_RX, SCHED_FIFO, rxPrio);
+  }
+
   /*
    * Setup server mode
    */
@@ -176,6 +609,7 @@ int main(int argc, char** argv)
   signal(SIGINT, sigHandler);
   signal(SIGHUP, sigHandler);
   signal(SIGQUIT, sigHandler);
+  signal(SIGTERM, sigHandler);
   signal(SIGSEGV, errorHandler);
   signal(SIGABRT, errorHandler);
   signal(SIGILL, errorHandler);
@@ -185,16 +619,13 @@ int main(int argc, char** argv)
   /*
    * Put all iface names in iface set
    */
-  vector<string> ifaceNames;
+  g_session = new McastSession(useIPv6);
   if (useAllIfaces)
   {
     // use all available interfaces
-    ifaceNames = Common::getAllIfaceNames(useIPv6);
-
-    // remove localhost if found in ifaceNames
-    if (ifaceNames.end() != std::find(ifaceNames.begin(), ifaceNames.end(), "lo"))
+    if (!g_session->addAllIfaces())
     {
-      ifaceNames.erase(std::remove(ifaceNames.begin(), ifaceNames.end(), "lo"), ifaceNames.end());
+      safeExit(2);
     }
   }
   else
@@ -202,49 +633,27 @@ int main(int argc, char** argv)
     // use specified interfaces
     for (int i = optind; i < argc; ++i)
     {
-      ifaceNames.push_back(argv[i]);
+      if (!g_session->addIface(argv[i]))
+      {
+        safeExit(2);
+      }
     }
   }
 
-  /*
-   * Now get iface info
-   */
-  int fd = -1;
-  for (unsigned i = 0; i < ifaceNames.size(); ++i)
+  // interfaces named by stream profiles, the first interface sends the others
+  for (unsigned i = 0; i < streamProfiles.size(); ++i)
   {
-    const string ifaceName = ifaceNames[i];
-    vector<string> ifaceAddresses;
-    if (READER != mode || i == 0)
+    const string& ifaceName = streamProfiles[i].iface;
+    const vector<IfaceData>& ifaces = g_session->getIfaces();
+    bool isKnown = false;
+    for (unsigned j = 0; j < ifaces.size() && !isKnown; ++j)
     {
-      fd = Common::createSocket(useIPv6);
+      isKnown = (ifaceName == ifaces[j].ifaceName);
     }
-
-    if (-1 == fd)
+    if (!ifaceName.empty() && !isKnown && !g_session->addIface(ifaceName))
     {
-      LOG_ERROR("Can't create socket for " << ifaceName << " :" << strerror(errno));
-      safeExit(1);
-    }
-
-    // use interface name
-    if (0 != Common::getIfaceIPFromIfaceName(ifaceName, ifaceAddresses, useIPv6))
-    {
-      LOG_ERROR("Can't find interface IP address for " << ifaceName);
       safeExit(2);
     }
-
-    g_ifaces.push_back((IfaceData(ifaceName, ifaceAddresses, fd)));
-  }
-
-  if (0 == g_ifaces.size())
-  {
-    int sock = Common::createSocket(useIPv6);
-    if (sock < 0)
-    {
-      LOG_ERROR("Creating socket: " << strerror(errno));
-      safeExit(1);
-    }
-
-    g_ifaces.push_back(IfaceData("", vector<string>(), sock));
   }
 
   /*
@@ -252,29 +661,141 @@ int main(int argc, char** argv)
    */
   vector<string> mcastAddressesVec;
   mcastAddressesVec.insert(mcastAddressesVec.end(), mcastAddresses.begin(), mcastAddresses.end());
+  SenderModule* sender = NULL;
   switch (mode) {
   case READER:
   {
-    g_McastModule = new ReceiverModule(g_ifaces, mcastAddressesVec, mcastPort, useIPv6);
+    ReceiverModule* receiver = g_session->createListener(mcastAddressesVec, mcastPort);
+    if (!receiver)
+    {
+      safeExit(1);
+    }
+    receiver->setQuiet(isQuiet);
+    receiver->setGro(useGro);
+    receiver->setRecvBufferSize(rcvBufSize);
+    receiver->setBusyPoll(busyPollUs);
+    receiver->setNack(useNack);
+    receiver->setLoss(lossPercent);
+    receiver->setAckPolicy(ackPolicy);
+    receiver->setArbitrate(useArbitration);
+    receiver->setShmRing(shmName, shmSlots);
+    receiver->setStatsPage(statsName);
+    if (!gateway.empty() && !receiver->setSubscribe(gateway))
+    {
+      LOG_ERROR("Invalid gateway address " << gateway);
+      safeExit(1);
+    }
   }
     break;
   case SENDER:
   {
-    g_McastModule = new SenderModule(g_ifaces, mcastAddressesVec, mcastPort,
-        nLoopbackInterfaces, useIPv6, sendInterval);
+    sender = g_session->createSender(mcastAddressesVec, mcastPort, nLoopbackInterfaces,
+        sendInterval);
+    if (!sender)
+    {
+      safeExit(1);
+    }
   }
     break;
   case SERVER:
   {
-    g_McastModule = new ServerModule(g_ifaces, mcastAddressesVec, mcastPort, nLoopbackInterfaces, useIPv6,
-        sendInterval);
+    ServerModule* server = g_session->createServer(mcastAddressesVec, mcastPort,
+        nLoopbackInterfaces, sendInterval);
+    if (!server)
+    {
+      safeExit(1);
+    }
+    server->setAckPolicy(ackPolicy);
+    sender = server;
+  }
+    break;
+  case RELAY:
+  {
+    RelayModule* relay = g_session->createRelay(mcastAddressesVec, mcastPort, nLoopbackInterfaces);
+    if (!relay)
+    {
+      safeExit(1);
+    }
+    relay->setRecvBufferSize(rcvBufSize);
+    for (unsigned i = 0; i < relayMaps.size(); ++i)
+    {
+      if (!relay->addMapping(relayMaps[i]))
+      {
+        LOG_ERROR("Invalid group mapping " << relayMaps[i]);
+        safeExit(1);
+      }
+    }
+  }
+    break;
+  case GATEWAY:
+  {
+    GatewayModule* gatewayModule = g_session->createGateway(mcastAddressesVec, mcastPort,
+        nLoopbackInterfaces);
+    if (!gatewayModule)
+    {
+      safeExit(1);
+    }
+    gatewayModule->setRecvBufferSize(rcvBufSize);
+    for (unsigned i = 0; i < gatewayInbound.size(); ++i)
+    {
+      if (!gatewayModule->addInbound(gatewayInbound[i]))
+      {
+        LOG_ERROR("Invalid gateway inbound port " << gatewayInbound[i]);
+        safeExit(1);
+      }
+    }
+  }
+    break;
+  case STREAMS:
+  {
+    StreamModule* streams = g_session->createStreams(streamProfiles, nLoopbackInterfaces);
+    if (!streams)
+    {
+      safeExit(1);
+    }
+    streams->setThreadPerIface(useTxThreads);
   }
     break;
   default:
     break;
   }
 
-  if (!g_McastModule || !g_McastModule->run())
+  if (sender)
+  {
+    sender->setSendCount(sendCount);
+    sender->setQuiet(isQuiet);
+    sender->setThreadPerIface(useTxThreads);
+    sender->setIfaceRates(txRates);
+    sender->setPayloadSize(payloadSize);
+    sender->setGsoSegments(gsoSegments);
+    sender->setZeroCopy(useZeroCopy);
+    sender->setStatsPage(statsName);
+    sender->setAckWindow(expectedAcks, ackTimeoutMs);
+    sender->setNackRing(useNack? nackRingLen : 0);
+    sender->setFec(fecBlockLen, fecParity);
+    sender->setTrafficShape(trafficShape);
+  }
+
+  /*
+   * Settings that change results, recorded so that a run can be reproduced
+   */
+  cout << "Threads " << Common::threadSettingsToString() << endl;
+  if (useMlock)
+  {
+    if (0 != mlockall(MCL_CURRENT | MCL_FUTURE))
+    {
+      LOG_ERROR("mlockall: " << strerror(errno));
+      safeExit(1);
+    }
+    cout << "Memory locked with mlockall" << endl;
+  }
+
+  if (!Common::applyThreadSettings(Common::THREAD_MAIN))
+  {
+    LOG_ERROR("Running main thread with default cpu & scheduling");
+  }
+
+  if (!g_session->run())
    {
      cout << "Error running module, exiting..." << endl;
      safeExit(1);
@@ -0,0 +1,158 @@
+/**
+ * Viewer of the statistics page of a listener or sender started with --stats
+ *
+ * Prints the interface & stream counters of the page with their rates every
+ * interval, reading the page never disturbs the writer
+ *
+ * Usage: mcastit-stat {name} [-i {seconds}] [-n {count}]
+ *   e.g. mcastit -l -q --stats rx eth0 & mcastit-stat rx -i 0.5
+ */
+#include "StatsPage.h"
+
+#include <getopt.h>
+
+static volatile bool g_isStopped = false;
+
+static void onSignal(int)
+{
+  g_isStopped = true;
+}
+
+static double getRate(uint64_t now, uint64_t prev, double seconds)
+{
+  return (seconds > 0 && now >= prev)? (now - prev) / seconds : 0;
+}
+
+static void printPage(const string& name, const StatsPageHeader& header,
+    const vector<StatsIface>& ifaces, const vector<StatsStream>& streams,
+    const StatsPageHeader& prevHeader, const vector<StatsIface>& prevIfaces,
+    const vector<StatsStream>& prevStreams)
+{
+  bool isAlive = (0 == kill(header.pid, 0) || EPERM == errno);
+  uint64_t nowNs = Common::getRealtimeNs();
+  double ageSec = (nowNs > header.updateNs)? (nowNs - header.updateNs) / 1e9 : 0;
+  double seconds = (header.updateNs - prevHeader.updateNs) / 1e9;
+  printf("%s %s pid %u%s, updated %.2f s ago, up %.1f s\n", name.c_str(),
+      (STATS_ROLE_LISTENER == header.role)? "listener" : "sender", header.pid,
+      isAlive? "" : " (exited)", ageSec, (header.updateNs - header.startNs) / 1e9);
+
+  bool isListener = (STATS_ROLE_LISTENER == header.role);
+  printf("  %-16s %12s %14s %10s %9s %10s", "interface", "packets", "bytes", "pps", "Mbps",
+      isListener? "coalesced" : "blocked");
+  printf(isListener? "\n" : " %10s\n", "errors");
+  for (unsigned i = 0; i < ifaces.size(); ++i)
+  {
+    const StatsIface& iface = ifaces[i];
+    const StatsIface* prev = (i < prevIfaces.size())? &prevIfaces[i] : NULL;
+    double pps = prev? getRate(iface.packets, prev->packets, seconds) : 0;
+    double bps = prev? getRate(iface.bytes, prev->bytes, seconds) * 8 : 0;
+    if (isListener)
+    {
+      printf("  %-16s %12llu %14llu %10.1f %9.2f %10llu\n", iface.name,
+          (unsigned long long) iface.packets, (unsigned long long) iface.bytes, pps, bps / 1e6,
+          (unsigned long long) iface.coalesced);
+    }
+    else
+    {
+      printf("  %-16s %12llu %14llu %10.1f %9.2f %10llu %10llu\n", iface.name,
+          (unsigned long long) iface.packets, (unsigned long long) iface.bytes, pps, bps / 1e6,
+          (unsigned long long) iface.blocked, (unsigned long long) iface.errors);
+    }
+  }
+
+  if (streams.empty())
+  {
+    return;
+  }
+
+  printf("  %-45s %10s %8s %8s %8s %10s %9s %10s %12s\n", "stream", "received", "lost",
+      "dups", "reorder", "highest", "pps", "jitter us", "max gap us");
+  for (unsigned i = 0; i < streams.size(); ++i)
+  {
+    // the writer fills the page in its map order, a new stream shifts the ones after it, so
+    // the previous counters are only used if the position still holds the same stream
+    const StatsStream& stream = streams[i];
+    const StatsStream* prev = (i < prevStreams.size() &&
+        0 == strcmp(stream.name, prevStreams[i].name))? &prevStreams[i] : NULL;
+    printf("  %-45s %10llu %8llu %8llu %8llu %10u %9.1f %10.2f %12.2f\n", stream.name,
+        (unsigned long long) stream.received, (unsigned long long) stream.lost,
+        (unsigned long long) stream.duplicates, (unsigned long long) stream.reordered,
+        stream.highest, prev? getRate(stream.received, prev->received, seconds) : 0,
+        stream.jitterNs / 1e3, stream.maxGapNs / 1e3);
+  }
+  if (header.hiddenStreams)
+  {
+    printf("  ... %u more streams\n", header.hiddenStreams);
+  }
+}
+
+int main(int argc, char* argv[])
+{
+  float interval = 1;
+  long count = -1;
+  int command = -1;
+  while ((command = getopt(argc, argv, "i:n:h")) != -1)
+  {
+    switch (command)
+    {
+    case 'i':
+      interval = atof(optarg);
+      break;
+    case 'n':
+      count = atol(optarg);
+      break;
+    default:
+      optind = argc;
+      break;
+    }
+  }
+
+  if (optind + 1 != argc || interval <= 0)
+  {
+    printf("Usage: %s {name} [-i {seconds}] [-n {count}]\n", argv[0]);
+    printf("   Print the statistics page /dev/shm/{name} of mcastit --stats every interval,\n");
+    printf("   default: every second until interrupted\n");
+    return 1;
+  }
+
+  const string name = argv[optind];
+  StatsPage page;
+  if (!page.open(name))
+  {
+    return 1;
+  }
+  signal(SIGINT, onSignal);
+  signal(SIGTERM, onSignal);
+
+  StatsPageHeader header, prevHeader;
+  vector<StatsIface> ifaces, prevIfaces;
+  vector<StatsStream> streams, prevStreams;
+  memset(&prevHeader, 0, sizeof(prevHeader));
+  for (long round = 0; !g_isStopped && (0 > count || round < count); ++round)
+  {
+    if (round)
+    {
+      usleep((useconds_t) (interval * 1e6));
+    }
+
+    if (!page.read(header, ifaces, streams))
+    {
+      LOG_ERROR("Page " << name << " is being written all the time");
+      continue;
+    }
+
+    // rates need a previous update of the same writer
+    if (prevHeader.startNs != header.startNs || prevHeader.updateNs == header.updateNs)
+    {
+      prevHeader = header;
+      prevIfaces.clear();
+      prevStreams.clear();
+    }
+    printPage(page.toString(), header, ifaces, streams, prevHeader, prevIfaces, prevStreams);
+    prevHeader = header;
+    prevIfaces.swap(ifaces);
+    prevStreams.swap(streams);
+  }
+
+  return 0;
+}